@@ -26,7 +26,10 @@
 #include "audio/softsynth/opl/dosbox.h"
 #include "audio/softsynth/opl/mame.h"
 
+#include "common/array.h"
 #include "common/config-manager.h"
+#include "common/file.h"
+#include "common/mutex.h"
 #include "common/system.h"
 #include "common/textconsole.h"
 #include "common/timer.h"
@@ -141,11 +144,180 @@ Config::DriverId Config::detect(OplType type) {
 	return drv;
 }
 
+/**
+ * The capture file, shared by all OPLs of the session. Only one OPL exists
+ * at a time, so it never needs a lock.
+ */
+static Common::DumpFile *s_captureFile = 0;
+static Config::OplType s_captureType;
+
+/**
+ * Forwards everything to another OPL, and logs the writes in the format
+ * described at kCaptureTag.
+ */
+class CaptureOPL : public OPL {
+public:
+	CaptureOPL(Config::DriverId driver, Config::OplType type) : _type(type), _file(0), _time(0), _lastTime(0), _tickRemainder(0), _timerFrequency(0) {
+		// Only one OPL can exist at a time, the capture takes that place and
+		// the actual driver is created behind it
+		_hasInstance = false;
+		_opl = Config::createDriver(driver, type);
+	}
+
+	~CaptureOPL() {
+		// The wrapped OPL clears the instance flag, our own destructor does it as well
+		delete _opl;
+
+		if (_file) {
+			flush();
+			_file->flush();
+		}
+	}
+
+	bool hasDriver() const { return _opl != 0; }
+
+	bool init() {
+		if (!_opl->init())
+			return false;
+
+		if (!_file)
+			_file = openFile();
+		return true;
+	}
+
+	void reset() { _opl->reset(); }
+
+	void write(int a, int v) {
+		log(kCapturePort | a, v);
+		_opl->write(a, v);
+	}
+
+	byte read(int a) { return _opl->read(a); }
+
+	void writeReg(int r, int v) {
+		log(r, v);
+		_opl->writeReg(r, v);
+	}
+
+	void setCallbackFrequency(int timerFrequency) {
+		_timerFrequency = timerFrequency;
+		_opl->setCallbackFrequency(timerFrequency);
+	}
+
+protected:
+	void startCallbacks(int timerFrequency) {
+		_timerFrequency = timerFrequency;
+		_opl->start(new Common::Functor0Mem<void, CaptureOPL>(this, &CaptureOPL::onTimer), timerFrequency);
+	}
+
+	void stopCallbacks() {
+		_opl->stop();
+	}
+
+private:
+	enum {
+		kFlushSize = 64 * 1024
+	};
+
+	void onTimer() {
+		{
+			Common::StackLock lock(_mutex);
+			const uint32 ticks = 1000000 + _tickRemainder;
+			_time += ticks / _timerFrequency;
+			_tickRemainder = ticks % _timerFrequency;
+		}
+
+		if (_callback && _callback->isValid())
+			(*_callback)();
+	}
+
+	/**
+	 * Opens the capture file once the first driver of the session works, so
+	 * a failed init leaves no file behind. Later OPLs append their writes,
+	 * as long as they are of the same type.
+	 */
+	Common::DumpFile *openFile() {
+		if (s_captureFile) {
+			if (_type == s_captureType)
+				return s_captureFile;
+
+			warning("Not capturing OPL type %d into a capture of type %d", _type, s_captureType);
+			return 0;
+		}
+
+		const Common::String &fileName = ConfMan.get("opl_capture");
+		Common::DumpFile *file = new Common::DumpFile();
+		if (!file->open(fileName)) {
+			warning("Could not open OPL capture file '%s'", fileName.c_str());
+			delete file;
+			return 0;
+		}
+
+		file->writeUint32BE(kCaptureTag);
+		file->writeByte(kCaptureVersion);
+		file->writeByte(_type);
+
+		s_captureFile = file;
+		s_captureType = _type;
+		return file;
+	}
+
+	void log(uint16 address, uint8 value) {
+		if (!_file)
+			return;
+
+		Common::StackLock lock(_mutex);
+
+		uint32 delta = _time - _lastTime;
+		_lastTime = _time;
+		while (delta >= 0x80) {
+			_buffer.push_back(0x80 | (delta & 0x7F));
+			delta >>= 7;
+		}
+		_buffer.push_back(delta);
+		_buffer.push_back(address & 0xFF);
+		_buffer.push_back(address >> 8);
+		_buffer.push_back(value);
+
+		if (_buffer.size() >= kFlushSize)
+			flush();
+	}
+
+	void flush() {
+		if (!_buffer.empty())
+			_file->write(&_buffer.front(), _buffer.size());
+		_buffer.clear();
+	}
+
+	OPL *_opl;
+	Config::OplType _type;
+	Common::DumpFile *_file;
+	Common::Mutex _mutex;
+	Common::Array<byte> _buffer;
+
+	uint32 _time;
+	uint32 _lastTime;
+	uint32 _tickRemainder;
+	int _timerFrequency;
+};
+
 OPL *Config::create(OplType type) {
 	return create(kAuto, type);
 }
 
 OPL *Config::create(DriverId driver, OplType type) {
+	if (!ConfMan.hasKey("opl_capture"))
+		return createDriver(driver, type);
+
+	CaptureOPL *opl = new CaptureOPL(driver, type);
+	if (!opl->hasDriver()) {
+		delete opl;
+		return 0;
+	}
+	return opl;
+}
+
+OPL *Config::createDriver(DriverId driver, OplType type) {
 	// On invalid driver selection, we try to do some fallback detection
 	if (driver == -1) {
 		warning("Invalid OPL driver selected, trying to detect a fallback emulator");
@@ -25,6 +25,7 @@
 
 #include "audio/audiostream.h"
 
+#include "common/endian.h"
 #include "common/func.h"
 #include "common/ptr.h"
 #include "common/scummsys.h"
@@ -40,6 +41,7 @@ class String;
 namespace OPL {
 
 class OPL;
+class CaptureOPL;
 
 class Config {
 public:
@@ -103,7 +105,43 @@ public:
 	static OPL *create(OplType type = kOpl2);
 
 private:
+	friend class CaptureOPL;
+
 	static const EmulatorDescription _drivers[];
+
+	/**
+	 * Creates the driver, without capturing it.
+	 */
+	static OPL *createDriver(DriverId driver, OplType type);
+};
+
+/**
+ * Register write captures.
+ *
+ * When the "opl_capture" setting names a file, Config::create() returns an
+ * OPL that logs every write to it, for replaying them offline with the
+ * devtools/render_opl tool. The file starts with the 4 byte kCaptureTag,
+ * a version byte and the Config::OplType byte, followed by one record for
+ * every write until the end of the file:
+ *
+ * - Time since the previous write in microseconds, as a variable length
+ *   integer of 7 bit groups, least significant first, with the top bit set
+ *   on all but the last byte.
+ * - 16 bit little endian address. With kCapturePort set it is the port of
+ *   an OPL::write() call, otherwise the register of an OPL::writeReg() call.
+ * - The value byte.
+ *
+ * Time advances with the timer callbacks, so writes done outside them get
+ * the time of the last callback.
+ *
+ * The file is created when the first OPL of the session initializes. The
+ * OPLs created after it append their writes, starting at the time of the
+ * last write, unless they emulate a different Config::OplType.
+ */
+enum {
+	kCaptureTag = MKTAG('O', 'P', 'L', 'C'),
+	kCaptureVersion = 1,
+	kCapturePort = 0x8000
 };
 
 /**
@@ -115,7 +153,7 @@ typedef Common::Functor0<void> TimerCallback;
  * A representation of a Yamaha OPL chip.
  */
 class OPL {
-private:
+protected:
 	static bool _hasInstance;
 public:
 	OPL();
@@ -22,6 +22,7 @@
 
 #include "gui/EventRecorder.h"
 
+#include "common/atomic.h"
 #include "common/util.h"
 #include "common/system.h"
 #include "common/textconsole.h"
@@ -41,27 +42,42 @@ namespace Audio {
 
 /**
  * Channel used by the default Mixer implementation.
+ *
+ * The engine side of the mixer owns the channel settings (volume, balance,
+ * pause level), mixCallback() owns the stream and the mixing parameters
+ * derived from those settings. The latter are only changed through the
+ * mixer's command queue. The state the engine side queries about the
+ * mixing (whether the stream finished and the elapsed time) is published
+ * atomically by the mixing side.
  */
 class Channel {
 public:
-	Channel(Mixer *mixer, Mixer::SoundType type, AudioStream *stream, DisposeAfterUse::Flag autofreeStream, bool reverseStereo, int id, bool permanent);
+	Channel(Mixer *mixer, Mixer::SoundType type, AudioStream *stream, DisposeAfterUse::Flag autofreeStream, bool reverseStereo, int id, bool permanent, RateConverterQuality quality);
 	~Channel();
 
 	/**
-	 * Mixes the channel's samples into the given buffer.
+	 * Mixes the channel's samples into the given accumulator.
 	 *
-	 * @param data buffer where to mix the data
-	 * @param len  number of sample *pairs*. So a value of
-	 *             10 means that the buffer contains twice 10 sample, each
-	 *             16 bits, for a total of 40 bytes.
+	 * @param acc     accumulator where to mix the data, twice @p len 32 bit
+	 *                samples
+	 * @param scratch buffer of twice @p len 16 bit samples, used to hold
+	 *                the converted but not yet scaled samples
+	 * @param len     number of sample *pairs*
 	 * @return number of sample pairs processed (which can still be silence!)
 	 */
-	int mix(int16 *data, uint len);
+	int mix(int32 *acc, int16 *scratch, uint len);
 
 	/**
-	 * Queries whether the channel is still playing or not.
+	 * Checks whether the stream has ended and publishes the result.
+	 * Must only be called by the mixing side.
 	 */
-	bool isFinished() const { return _stream->endOfStream(); }
+	bool checkFinished();
+
+	/**
+	 * Queries whether the channel is still playing or not, as last seen by
+	 * the mixing side.
+	 */
+	bool isFinished() const { return Common::atomicLoad(&_finished) != 0; }
 
 	/**
 	 * Queries whether the channel is a permanent channel.
@@ -88,6 +104,16 @@ public:
 	 */
 	bool isPaused() const { return (_pauseLevel != 0); }
 
+	/**
+	 * Pauses or unpauses the mixing, on the mixing side.
+	 */
+	void setMixPaused(bool paused) { Common::atomicStore(&_mixPaused, paused ? 1u : 0u); }
+
+	/**
+	 * Queries whether the mixing side should skip the channel.
+	 */
+	bool isMixPaused() const { return Common::atomicLoad(&_mixPaused) != 0; }
+
 	/**
 	 * Sets the channel's own volume.
 	 *
@@ -122,6 +148,19 @@ public:
 	 */
 	void notifyGlobalVolChange() { updateChannelVolumes(); }
 
+	/**
+	 * Returns the effective left and right volumes, packed for
+	 * setMixVolumes().
+	 */
+	uint32 getMixVolumes() const { return (_volL << 16) | _volR; }
+
+	/**
+	 * Sets the volumes used by the mixing side.
+	 *
+	 * @param volumes effective volumes, as returned by getMixVolumes()
+	 */
+	void setMixVolumes(uint32 volumes);
+
 	/**
 	 * Queries how long the channel has been playing.
 	 */
@@ -159,11 +198,26 @@ private:
 
 	Mixer *_mixer;
 
-	uint32 _samplesConsumed;
-	uint32 _samplesDecoded;
-	uint32 _mixerTimeStamp;
 	uint32 _pauseStartTime;
 	uint32 _pauseTime;
+	/** Number of mixes done when _pauseTime was set; the next mix resets it. */
+	uint32 _pauseMixCount;
+
+	// Mixing side. The parameters are set atomically, as the engine side
+	// applies the queued commands itself when the queue overflows.
+	volatile uint32 _mixVolumes;
+	volatile uint32 _mixPaused;
+	uint32 _samplesDecoded;
+
+	volatile uint32 _finished;
+
+	/**
+	 * Elapsed time snapshot, published by each mix. The sequence number is
+	 * odd while the snapshot is being updated; halved, it counts the mixes.
+	 */
+	volatile uint32 _snapshotSequence;
+	volatile uint32 _samplesConsumed;
+	volatile uint32 _mixerTimeStamp;
 
 	RateConverter *_converter;
 	Common::DisposablePtr<AudioStream> _stream;
@@ -175,17 +229,36 @@ private:
 
 // TODO: parameter "system" is unused
 MixerImpl::MixerImpl(OSystem *system, uint sampleRate)
-	: _mutex(), _sampleRate(sampleRate), _mixerReady(false), _handleSeed(0), _soundTypeSettings() {
+	: _mutex(), _sampleRate(sampleRate), _mixerReady(false), _handleSeed(0), _soundTypeSettings(),
+	  _channels(0), _numChannels(INITIAL_CHANNELS), _maxChannels(DEFAULT_MAX_CHANNELS), _rateConverterQuality(kRateQualityLow),
+	  _commandHead(0), _commandTail(0), _mixEpoch(0), _consumerLock(0),
+	  _accumulator(0), _scratch(0), _mixBufferSize(0) {
 
 	assert(sampleRate > 0);
 
-	for (int i = 0; i != NUM_CHANNELS; i++)
+	_channels = new Channel *[_numChannels];
+	for (uint i = 0; i != _numChannels; i++)
 		_channels[i] = 0;
+
+	// When channels run out, sound effects are the first to give way
+	_soundTypeSettings[kSFXSoundType].priority = 0;
+	_soundTypeSettings[kPlainSoundType].priority = 1;
+	_soundTypeSettings[kMusicSoundType].priority = 2;
+	_soundTypeSettings[kSpeechSoundType].priority = 3;
 }
 
 MixerImpl::~MixerImpl() {
-	for (int i = 0; i != NUM_CHANNELS; i++)
+	for (uint i = 0; i != _numChannels; i++)
 		delete _channels[i];
+	delete[] _channels;
+
+	for (uint i = 0; i < _retired.size(); i++) {
+		delete _retired[i].channel;
+		delete[] _retired[i].table;
+	}
+
+	free(_accumulator);
+	free(_scratch);
 }
 
 void MixerImpl::setReady(bool ready) {
@@ -196,29 +269,248 @@ uint MixerImpl::getOutputRate() const {
 	return _sampleRate;
 }
 
-void MixerImpl::insertChannel(SoundHandle *handle, Channel *chan) {
+void MixerImpl::setRateConverterQuality(RateConverterQuality quality) {
+	Common::StackLock lock(_mutex);
+	_rateConverterQuality = quality;
+}
+
+void MixerImpl::setPriorityForSoundType(SoundType type, int priority) {
+	assert(0 <= (int)type && (int)type < ARRAYSIZE(_soundTypeSettings));
+
+	Common::StackLock lock(_mutex);
+	_soundTypeSettings[type].priority = priority;
+}
+
+int MixerImpl::getPriorityForSoundType(SoundType type) const {
+	assert(0 <= (int)type && (int)type < ARRAYSIZE(_soundTypeSettings));
+
+	return _soundTypeSettings[type].priority;
+}
+
+void MixerImpl::setMaxChannels(uint count) {
+	Common::StackLock lock(_mutex);
+	_maxChannels = CLIP<uint>(count, 1, MAX_CHANNELS);
+}
+
+uint MixerImpl::getMaxChannels() const {
+	return _maxChannels;
+}
+
+Mixer::PlayStats MixerImpl::getPlayStats(SoundType type) const {
+	assert(0 <= (int)type && (int)type < ARRAYSIZE(_soundTypeSettings));
+
+	Common::StackLock lock(_mutex);
+	return _soundTypeSettings[type].stats;
+}
+
+int MixerImpl::findChannel(SoundHandle handle) const {
+	const uint index = handle._val % MAX_CHANNELS;
+	if (index >= _numChannels || !_channels[index] || _channels[index]->getHandle()._val != handle._val)
+		return -1;
+
+	return index;
+}
+
+int MixerImpl::growChannels() {
+	const uint oldCount = _numChannels;
+	if (oldCount >= _maxChannels)
+		return -1;
+
+	const uint newCount = MIN<uint>(oldCount * 2, _maxChannels);
+	Channel *volatile *oldChannels = _channels;
+	Channel *volatile *newChannels = new Channel *[newCount];
+	for (uint i = 0; i != oldCount; i++)
+		newChannels[i] = oldChannels[i];
+	for (uint i = oldCount; i != newCount; i++)
+		newChannels[i] = 0;
+
+	// Publish the table before its size, so the mixing side never sees a
+	// size larger than the table it reads. The old table stays valid
+	// until any mix which may be using it is over.
+	Common::atomicStore(&_channels, newChannels);
+	Common::atomicStore(&_numChannels, newCount);
+
+	Retired retired;
+	retired.channel = 0;
+	retired.table = oldChannels;
+	Common::memoryBarrier();
+	retired.epoch = Common::atomicLoad(&_mixEpoch);
+	_retired.push_back(retired);
+
+	return oldCount;
+}
+
+int MixerImpl::stealChannel(SoundType type) {
+	// Take over the oldest channel of the lowest priority, provided the new
+	// sound is at least as important. Permanent channels are never stolen.
+	int victim = -1;
+	int victimPriority = _soundTypeSettings[type].priority;
+	uint32 victimSerial = 0;
+
+	for (uint i = 0; i != _numChannels && i != _maxChannels; i++) {
+		Channel *chan = _channels[i];
+		if (!chan || chan->isPermanent())
+			continue;
+
+		const int priority = _soundTypeSettings[chan->getType()].priority;
+		const uint32 serial = chan->getHandle()._val / MAX_CHANNELS;
+		if (priority < victimPriority || (priority == victimPriority && (victim == -1 || serial < victimSerial))) {
+			victim = i;
+			victimPriority = priority;
+			victimSerial = serial;
+		}
+	}
+
+	if (victim == -1)
+		return -1;
+
+	_soundTypeSettings[_channels[victim]->getType()].stats.stolen++;
+
+	// The engine may release the stream as soon as it notices the sound is
+	// gone, so playStream() waits for a mix which may still be using it
+	retireChannel(victim);
+
+	return victim;
+}
+
+bool MixerImpl::insertChannel(SoundHandle *handle, Channel *chan) {
+	bool stolen = false;
+
 	int index = -1;
-	for (int i = 0; i != NUM_CHANNELS; i++) {
+	for (uint i = 0; i != _numChannels && i != _maxChannels; i++) {
 		if (_channels[i] == 0) {
 			index = i;
 			break;
 		}
 	}
+	if (index == -1)
+		index = growChannels();
+	if (index == -1) {
+		index = stealChannel(chan->getType());
+		stolen = index != -1;
+	}
 	if (index == -1) {
 		warning("MixerImpl::out of mixer slots");
+		_soundTypeSettings[chan->getType()].stats.rejected++;
 		delete chan;
-		return;
+		return false;
 	}
 
-	_channels[index] = chan;
+	_soundTypeSettings[chan->getType()].stats.played++;
 
 	SoundHandle chanHandle;
-	chanHandle._val = index + (_handleSeed * NUM_CHANNELS);
+	chanHandle._val = index + (_handleSeed * MAX_CHANNELS);
 
 	chan->setHandle(chanHandle);
+	chan->setMixVolumes(chan->getMixVolumes());
 	_handleSeed++;
 	if (handle)
 		*handle = chanHandle;
+
+	// The channel is fully set up, publish it to the mixing side
+	Common::atomicStore(&_channels[index], chan);
+	return stolen;
+}
+
+void MixerImpl::pushCommand(CommandType type, int index, SoundHandle handle, uint32 value) {
+	// Only the engine side, serialised by _mutex, advances the tail
+	const uint32 tail = _commandTail;
+
+	if (tail - Common::atomicLoad(&_commandHead) == COMMAND_QUEUE_SIZE) {
+		// The callback has not run for a long while, e.g. because the
+		// backend does not call it yet. Act as the consumer instead. The
+		// callback only holds the lock while it processes the queue, which
+		// never calls back into the mixer, so this can't wait for long.
+		while (Common::atomicExchange(&_consumerLock, 1u) != 0)
+			g_system->delayMillis(1);
+		processCommands();
+		Common::atomicStore(&_consumerLock, 0u);
+	}
+
+	Command &command = _commands[tail % COMMAND_QUEUE_SIZE];
+	command.type = type;
+	command.index = index;
+	command.handle = handle._val;
+	command.value = value;
+
+	Common::atomicStore(&_commandTail, tail + 1);
+}
+
+void MixerImpl::processCommands() {
+	const uint32 tail = Common::atomicLoad(&_commandTail);
+	uint32 head = _commandHead;
+
+	for (; head != tail; head++) {
+		const Command &command = _commands[head % COMMAND_QUEUE_SIZE];
+
+		// Ignore commands for channels which were stopped in the meantime.
+		// The table only grows, so the index is always in range.
+		Channel *volatile *channels = Common::atomicLoad(&_channels);
+		Channel *chan = Common::atomicLoad(&channels[command.index]);
+		if (!chan || chan->getHandle()._val != command.handle)
+			continue;
+
+		switch (command.type) {
+		case kCommandSetVolumes:
+			chan->setMixVolumes(command.value);
+			break;
+		case kCommandPause:
+			chan->setMixPaused(command.value != 0);
+			break;
+		}
+	}
+
+	Common::atomicStore(&_commandHead, head);
+}
+
+void MixerImpl::retireChannel(int index) {
+	Retired retired;
+	retired.channel = _channels[index];
+	retired.table = 0;
+	Common::atomicStore(&_channels[index], (Channel *)0);
+
+	// If a mix is in progress, it may have picked up the channel before
+	// it was removed. Only once that mix is over, it can be deleted.
+	Common::memoryBarrier();
+	retired.epoch = Common::atomicLoad(&_mixEpoch);
+
+	_retired.push_back(retired);
+}
+
+void MixerImpl::retireFinishedChannels() {
+	for (uint i = 0; i != _numChannels; i++) {
+		if (_channels[i] && _channels[i]->isFinished())
+			retireChannel(i);
+	}
+
+	freeRetired();
+}
+
+void MixerImpl::freeRetired() {
+	uint i = 0;
+	while (i < _retired.size()) {
+		const uint32 epoch = _retired[i].epoch;
+
+		if ((epoch & 1) && Common::atomicLoad(&_mixEpoch) == epoch) {
+			i++;
+			continue;
+		}
+
+		delete _retired[i].channel;
+		delete[] _retired[i].table;
+		_retired.remove_at(i);
+	}
+}
+
+void MixerImpl::waitForMix() {
+	// A mix which started before the channels were retired holds the mix
+	// mutex until it is over. The audio thread already holds it, if a
+	// stream stopped a sound, and must not wait for its own mix.
+	_mixMutex.lock();
+	_mixMutex.unlock();
+
+	Common::StackLock lock(_mutex);
+	freeRetired();
 }
 
 void MixerImpl::playStream(
@@ -229,47 +521,66 @@ void MixerImpl::playStream(
 			DisposeAfterUse::Flag autofreeStream,
 			bool permanent,
 			bool reverseStereo) {
-	Common::StackLock lock(_mutex);
+	bool stolen;
 
-	if (stream == 0) {
-		warning("stream is 0");
-		return;
-	}
+	{
+		Common::StackLock lock(_mutex);
 
+		if (stream == 0) {
+			warning("stream is 0");
+			return;
+		}
 
-	assert(_mixerReady);
-
-	// Prevent duplicate sounds
-	if (id != -1) {
-		for (int i = 0; i != NUM_CHANNELS; i++)
-			if (_channels[i] != 0 && _channels[i]->getId() == id) {
-				// Delete the stream if were asked to auto-dispose it.
-				// Note: This could cause trouble if the client code does not
-				// yet expect the stream to be gone. The primary example to
-				// keep in mind here is QueuingAudioStream.
-				// Thus, as a quick rule of thumb, you should never, ever,
-				// try to play QueuingAudioStreams with a sound id.
-				if (autofreeStream == DisposeAfterUse::YES)
-					delete stream;
-				return;
-			}
-	}
+
+		assert(_mixerReady);
+
+		retireFinishedChannels();
+
+		// Prevent duplicate sounds
+		if (id != -1) {
+			for (uint i = 0; i != _numChannels; i++)
+				if (_channels[i] != 0 && _channels[i]->getId() == id) {
+					// Delete the stream if were asked to auto-dispose it.
+					// Note: This could cause trouble if the client code does not
+					// yet expect the stream to be gone. The primary example to
+					// keep in mind here is QueuingAudioStream.
+					// Thus, as a quick rule of thumb, you should never, ever,
+					// try to play QueuingAudioStreams with a sound id.
+					if (autofreeStream == DisposeAfterUse::YES)
+						delete stream;
+					return;
+				}
+		}
 
 #ifdef AUDIO_REVERSE_STEREO
-	reverseStereo = !reverseStereo;
+		reverseStereo = !reverseStereo;
 #endif
 
-	// Create the channel
-	Channel *chan = new Channel(this, type, stream, autofreeStream, reverseStereo, id, permanent);
-	chan->setVolume(volume);
-	chan->setBalance(balance);
-	insertChannel(handle, chan);
+		// Create the channel
+		Channel *chan = new Channel(this, type, stream, autofreeStream, reverseStereo, id, permanent, _rateConverterQuality);
+		chan->setVolume(volume);
+		chan->setBalance(balance);
+		stolen = insertChannel(handle, chan);
+	}
+
+	if (stolen)
+		waitForMix();
 }
 
 int MixerImpl::mixCallback(byte *samples, uint len) {
 	assert(samples);
 
-	Common::StackLock lock(_mutex);
+	// Only ever contended for a moment, by a stop waiting for this mix
+	Common::StackLock mixLock(_mixMutex);
+	Common::atomicAdd(&_mixEpoch, 1u);
+
+	// If the engine side is draining an overflowing command queue, leave
+	// the commands to it rather than waiting. The lock is not kept while
+	// mixing, as a stream may queue commands from here.
+	if (Common::atomicExchange(&_consumerLock, 1u) == 0) {
+		processCommands();
+		Common::atomicStore(&_consumerLock, 0u);
+	}
 
 	int16 *buf = (int16 *)samples;
 	// we store stereo, 16-bit samples
@@ -279,66 +590,94 @@ int MixerImpl::mixCallback(byte *samples, uint len) {
 	// Since the mixer callback has been called, the mixer must be ready...
 	_mixerReady = true;
 
-	//  zero the buf
-	memset(buf, 0, 2 * len * sizeof(int16));
+	// Reallocate the mixing buffers, if necessary
+	if (len > _mixBufferSize) {
+		free(_accumulator);
+		free(_scratch);
+		_accumulator = (int32 *)malloc(2 * len * sizeof(int32));
+		_scratch = (int16 *)malloc(2 * len * sizeof(int16));
+		_mixBufferSize = len;
+
+		if (!_accumulator || !_scratch)
+			error("[MixerImpl::mixCallback] Cannot allocate memory for mixing buffers");
+	}
 
-	// mix all channels
+	//  zero the accumulator
+	memset(_accumulator, 0, 2 * len * sizeof(int32));
+
+	// mix all channels at full precision...
 	int res = 0, tmp;
-	for (int i = 0; i != NUM_CHANNELS; i++)
-		if (_channels[i]) {
-			if (_channels[i]->isFinished()) {
-				delete _channels[i];
-				_channels[i] = 0;
-			} else if (!_channels[i]->isPaused()) {
-				tmp = _channels[i]->mix(buf, len);
-
-				if (tmp > res)
-					res = tmp;
-			}
+	const uint numChannels = Common::atomicLoad(&_numChannels);
+	Channel *volatile *channels = Common::atomicLoad(&_channels);
+	for (uint i = 0; i != numChannels; i++) {
+		// Finished channels are removed by the engine side
+		Channel *chan = Common::atomicLoad(&channels[i]);
+		if (chan && !chan->checkFinished() && !chan->isMixPaused()) {
+			tmp = chan->mix(_accumulator, _scratch, len);
+
+			if (tmp > res)
+				res = tmp;
 		}
+	}
+
+	// ...and clip only once, when producing the output
+	saturateAccumulator(buf, _accumulator, len);
+
+	Common::atomicAdd(&_mixEpoch, 1u);
 
 	return res;
 }
 
 void MixerImpl::stopAll() {
-	Common::StackLock lock(_mutex);
-	for (int i = 0; i != NUM_CHANNELS; i++) {
-		if (_channels[i] != 0 && !_channels[i]->isPermanent()) {
-			delete _channels[i];
-			_channels[i] = 0;
+	{
+		Common::StackLock lock(_mutex);
+		for (uint i = 0; i != _numChannels; i++) {
+			if (_channels[i] != 0 && !_channels[i]->isPermanent())
+				retireChannel(i);
 		}
 	}
+
+	waitForMix();
 }
 
 void MixerImpl::stopID(int id) {
-	Common::StackLock lock(_mutex);
-	for (int i = 0; i != NUM_CHANNELS; i++) {
-		if (_channels[i] != 0 && _channels[i]->getId() == id) {
-			delete _channels[i];
-			_channels[i] = 0;
+	{
+		Common::StackLock lock(_mutex);
+		for (uint i = 0; i != _numChannels; i++) {
+			if (_channels[i] != 0 && _channels[i]->getId() == id)
+				retireChannel(i);
 		}
 	}
+
+	waitForMix();
 }
 
 void MixerImpl::stopHandle(SoundHandle handle) {
-	Common::StackLock lock(_mutex);
+	{
+		Common::StackLock lock(_mutex);
 
-	// Simply ignore stop requests for handles of sounds that already terminated
-	const int index = handle._val % NUM_CHANNELS;
-	if (!_channels[index] || _channels[index]->getHandle()._val != handle._val)
-		return;
+		// Simply ignore stop requests for handles of sounds that already terminated
+		const int index = findChannel(handle);
+		if (index == -1)
+			return;
+
+		retireChannel(index);
+	}
 
-	delete _channels[index];
-	_channels[index] = 0;
+	waitForMix();
 }
 
 void MixerImpl::muteSoundType(SoundType type, bool mute) {
 	assert(0 <= (int)type && (int)type < ARRAYSIZE(_soundTypeSettings));
+
+	Common::StackLock lock(_mutex);
 	_soundTypeSettings[type].mute = mute;
 
-	for (int i = 0; i != NUM_CHANNELS; ++i) {
-		if (_channels[i] && _channels[i]->getType() == type)
+	for (uint i = 0; i != _numChannels; ++i) {
+		if (_channels[i] && _channels[i]->getType() == type) {
 			_channels[i]->notifyGlobalVolChange();
+			pushCommand(kCommandSetVolumes, i, _channels[i]->getHandle(), _channels[i]->getMixVolumes());
+		}
 	}
 }
 
@@ -350,16 +689,19 @@ bool MixerImpl::isSoundTypeMuted(SoundType type) const {
 void MixerImpl::setChannelVolume(SoundHandle handle, byte volume) {
 	Common::StackLock lock(_mutex);
 
-	const int index = handle._val % NUM_CHANNELS;
-	if (!_channels[index] || _channels[index]->getHandle()._val != handle._val)
+	const int index = findChannel(handle);
+	if (index == -1)
 		return;
 
 	_channels[index]->setVolume(volume);
+	pushCommand(kCommandSetVolumes, index, handle, _channels[index]->getMixVolumes());
 }
 
 byte MixerImpl::getChannelVolume(SoundHandle handle) {
-	const int index = handle._val % NUM_CHANNELS;
-	if (!_channels[index] || _channels[index]->getHandle()._val != handle._val)
+	Common::StackLock lock(_mutex);
+
+	const int index = findChannel(handle);
+	if (index == -1)
 		return 0;
 
 	return _channels[index]->getVolume();
@@ -368,16 +710,19 @@ byte MixerImpl::getChannelVolume(SoundHandle handle) {
 void MixerImpl::setChannelBalance(SoundHandle handle, int8 balance) {
 	Common::StackLock lock(_mutex);
 
-	const int index = handle._val % NUM_CHANNELS;
-	if (!_channels[index] || _channels[index]->getHandle()._val != handle._val)
+	const int index = findChannel(handle);
+	if (index == -1)
 		return;
 
 	_channels[index]->setBalance(balance);
+	pushCommand(kCommandSetVolumes, index, handle, _channels[index]->getMixVolumes());
 }
 
 int8 MixerImpl::getChannelBalance(SoundHandle handle) {
-	const int index = handle._val % NUM_CHANNELS;
-	if (!_channels[index] || _channels[index]->getHandle()._val != handle._val)
+	Common::StackLock lock(_mutex);
+
+	const int index = findChannel(handle);
+	if (index == -1)
 		return 0;
 
 	return _channels[index]->getBalance();
@@ -390,8 +735,8 @@ uint32 MixerImpl::getSoundElapsedTime(SoundHandle handle) {
 Timestamp MixerImpl::getElapsedTime(SoundHandle handle) {
 	Common::StackLock lock(_mutex);
 
-	const int index = handle._val % NUM_CHANNELS;
-	if (!_channels[index] || _channels[index]->getHandle()._val != handle._val)
+	const int index = findChannel(handle);
+	if (index == -1)
 		return Timestamp(0, _sampleRate);
 
 	return _channels[index]->getElapsedTime();
@@ -399,18 +744,20 @@ Timestamp MixerImpl::getElapsedTime(SoundHandle handle) {
 
 void MixerImpl::pauseAll(bool paused) {
 	Common::StackLock lock(_mutex);
-	for (int i = 0; i != NUM_CHANNELS; i++) {
+	for (uint i = 0; i != _numChannels; i++) {
 		if (_channels[i] != 0) {
 			_channels[i]->pause(paused);
+			pushCommand(kCommandPause, i, _channels[i]->getHandle(), _channels[i]->isPaused());
 		}
 	}
 }
 
 void MixerImpl::pauseID(int id, bool paused) {
 	Common::StackLock lock(_mutex);
-	for (int i = 0; i != NUM_CHANNELS; i++) {
+	for (uint i = 0; i != _numChannels; i++) {
 		if (_channels[i] != 0 && _channels[i]->getId() == id) {
 			_channels[i]->pause(paused);
+			pushCommand(kCommandPause, i, _channels[i]->getHandle(), _channels[i]->isPaused());
 			return;
 		}
 	}
@@ -420,11 +767,12 @@ void MixerImpl::pauseHandle(SoundHandle handle, bool paused) {
 	Common::StackLock lock(_mutex);
 
 	// Simply ignore (un)pause requests for sounds that already terminated
-	const int index = handle._val % NUM_CHANNELS;
-	if (!_channels[index] || _channels[index]->getHandle()._val != handle._val)
+	const int index = findChannel(handle);
+	if (index == -1)
 		return;
 
 	_channels[index]->pause(paused);
+	pushCommand(kCommandPause, index, handle, _channels[index]->isPaused());
 }
 
 bool MixerImpl::isSoundIDActive(int id) {
@@ -434,7 +782,9 @@ bool MixerImpl::isSoundIDActive(int id) {
 	g_eventRec.updateSubsystems();
 #endif
 
-	for (int i = 0; i != NUM_CHANNELS; i++)
+	retireFinishedChannels();
+
+	for (uint i = 0; i != _numChannels; i++)
 		if (_channels[i] && _channels[i]->getId() == id)
 			return true;
 	return false;
@@ -442,8 +792,10 @@ bool MixerImpl::isSoundIDActive(int id) {
 
 int MixerImpl::getSoundID(SoundHandle handle) {
 	Common::StackLock lock(_mutex);
-	const int index = handle._val % NUM_CHANNELS;
-	if (_channels[index] && _channels[index]->getHandle()._val == handle._val)
+	retireFinishedChannels();
+
+	const int index = findChannel(handle);
+	if (index != -1)
 		return _channels[index]->getId();
 	return 0;
 }
@@ -455,13 +807,16 @@ bool MixerImpl::isSoundHandleActive(SoundHandle handle) {
 	g_eventRec.updateSubsystems();
 #endif
 
-	const int index = handle._val % NUM_CHANNELS;
-	return _channels[index] && _channels[index]->getHandle()._val == handle._val;
+	retireFinishedChannels();
+
+	return findChannel(handle) != -1;
 }
 
 bool MixerImpl::hasActiveChannelOfType(SoundType type) {
 	Common::StackLock lock(_mutex);
-	for (int i = 0; i != NUM_CHANNELS; i++)
+	retireFinishedChannels();
+
+	for (uint i = 0; i != _numChannels; i++)
 		if (_channels[i] && _channels[i]->getType() == type)
 			return true;
 	return false;
@@ -482,9 +837,11 @@ void MixerImpl::setVolumeForSoundType(SoundType type, int volume) {
 	Common::StackLock lock(_mutex);
 	_soundTypeSettings[type].volume = volume;
 
-	for (int i = 0; i != NUM_CHANNELS; ++i) {
-		if (_channels[i] && _channels[i]->getType() == type)
+	for (uint i = 0; i != _numChannels; ++i) {
+		if (_channels[i] && _channels[i]->getType() == type) {
 			_channels[i]->notifyGlobalVolChange();
+			pushCommand(kCommandSetVolumes, i, _channels[i]->getHandle(), _channels[i]->getMixVolumes());
+		}
 	}
 }
 
@@ -500,16 +857,17 @@ int MixerImpl::getVolumeForSoundType(SoundType type) const {
 #pragma mark -
 
 Channel::Channel(Mixer *mixer, Mixer::SoundType type, AudioStream *stream,
-                 DisposeAfterUse::Flag autofreeStream, bool reverseStereo, int id, bool permanent)
+                 DisposeAfterUse::Flag autofreeStream, bool reverseStereo, int id, bool permanent, RateConverterQuality quality)
     : _type(type), _mixer(mixer), _id(id), _permanent(permanent), _volume(Mixer::kMaxChannelVolume),
-      _balance(0), _pauseLevel(0), _samplesConsumed(0), _samplesDecoded(0), _mixerTimeStamp(0),
-      _pauseStartTime(0), _pauseTime(0), _converter(0), _volL(0), _volR(0),
-      _stream(stream, autofreeStream) {
+      _balance(0), _pauseLevel(0), _pauseStartTime(0), _pauseTime(0), _pauseMixCount(0),
+      _volL(0), _volR(0), _mixVolumes(0), _mixPaused(0), _samplesDecoded(0),
+      _finished(0), _snapshotSequence(0), _samplesConsumed(0), _mixerTimeStamp(0),
+      _converter(0), _stream(stream, autofreeStream) {
 	assert(mixer);
 	assert(stream);
 
 	// Get a rate converter instance
-	_converter = makeRateConverter(_stream->getRate(), mixer->getOutputRate(), _stream->isStereo(), reverseStereo);
+	_converter = makeRateConverter(_stream->getRate(), mixer->getOutputRate(), _stream->isStereo(), reverseStereo, quality);
 }
 
 Channel::~Channel() {
@@ -534,6 +892,10 @@ int8 Channel::getBalance() {
 	return _balance;
 }
 
+void Channel::setMixVolumes(uint32 volumes) {
+	Common::atomicStore(&_mixVolumes, volumes);
+}
+
 void Channel::updateChannelVolumes() {
 	// From the channel balance/volume and the global volume, we compute
 	// the effective volume for the left and right channel. Note the
@@ -574,6 +936,7 @@ void Channel::pause(bool paused) {
 
 		if (!_pauseLevel) {
 			_pauseTime = (g_system->getMillis(true) - _pauseStartTime);
+			_pauseMixCount = Common::atomicLoad(&_snapshotSequence) >> 1;
 			_pauseStartTime = 0;
 		}
 	}
@@ -585,17 +948,29 @@ Timestamp Channel::getElapsedTime() {
 
 	Audio::Timestamp ts(0, rate);
 
-	if (_mixerTimeStamp == 0)
+	// Take a consistent snapshot of the last mix
+	uint32 sequence, samplesConsumed, mixerTimeStamp;
+	do {
+		sequence = Common::atomicLoad(&_snapshotSequence);
+		samplesConsumed = Common::atomicLoad(&_samplesConsumed);
+		mixerTimeStamp = Common::atomicLoad(&_mixerTimeStamp);
+	} while ((sequence & 1) || sequence != Common::atomicLoad(&_snapshotSequence));
+
+	if (mixerTimeStamp == 0)
 		return ts;
 
+	// A mix since the channel was resumed accounts for the pause already
+	const uint32 pauseTime = (sequence >> 1) == _pauseMixCount ? _pauseTime : 0;
+
 	if (isPaused())
-		delta = _pauseStartTime - _mixerTimeStamp;
+		// The mixing side may have mixed once more before it saw the pause
+		delta = _pauseStartTime > mixerTimeStamp ? _pauseStartTime - mixerTimeStamp : 0;
 	else
-		delta = g_system->getMillis(true) - _mixerTimeStamp - _pauseTime;
+		delta = g_system->getMillis(true) - mixerTimeStamp - pauseTime;
 
 	// Convert the number of samples into a time duration.
 
-	ts = ts.addFrames(_samplesConsumed);
+	ts = ts.addFrames(samplesConsumed);
 	ts = ts.addMsecs(delta);
 
 	// In theory it would seem like a good idea to limit the approximation
@@ -607,7 +982,14 @@ Timestamp Channel::getElapsedTime() {
 	return ts;
 }
 
-int Channel::mix(int16 *data, uint len) {
+bool Channel::checkFinished() {
+	if (!_finished && _stream->endOfStream())
+		Common::atomicStore(&_finished, 1u);
+
+	return _finished != 0;
+}
+
+int Channel::mix(int32 *acc, int16 *scratch, uint len) {
 	assert(_stream);
 
 	int res = 0;
@@ -615,10 +997,19 @@ int Channel::mix(int16 *data, uint len) {
 		// TODO: call drain method
 	} else {
 		assert(_converter);
-		_samplesConsumed = _samplesDecoded;
-		_mixerTimeStamp = g_system->getMillis(true);
-		_pauseTime = 0;
-		res = _converter->flow(*_stream, data, len, _volL, _volR);
+
+		// Publish the elapsed time snapshot; the full barriers of the
+		// sequence updates keep the stores in between them
+		Common::atomicAdd(&_snapshotSequence, 1u);
+		Common::atomicStore(&_samplesConsumed, _samplesDecoded);
+		Common::atomicStore(&_mixerTimeStamp, g_system->getMillis(true));
+		Common::atomicAdd(&_snapshotSequence, 1u);
+
+		res = _converter->convert(*_stream, scratch, len);
+		const uint32 volumes = Common::atomicLoad(&_mixVolumes);
+		const st_volume_t volL = volumes >> 16, volR = volumes & 0xFFFF;
+		if (res > 0 && (volL || volR))
+			mixToAccumulator(acc, scratch, res, volL, volR);
 		_samplesDecoded += res;
 	}
 
@@ -65,6 +65,15 @@ public:
 		kMaxMixerVolume = 256
 	};
 
+	/**
+	 * Playback statistics of a sound type.
+	 */
+	struct PlayStats {
+		uint32 played;   ///< sounds which got a channel
+		uint32 stolen;   ///< sounds stopped early to make room for another one
+		uint32 rejected; ///< sounds not played because no channel was available
+	};
+
 public:
 	Mixer() {}
 	virtual ~Mixer() {}
@@ -271,6 +280,52 @@ public:
 	 */
 	virtual int getVolumeForSoundType(SoundType type) const = 0;
 
+	/**
+	 * Set the priority of the given sound type. When all channels are in
+	 * use, a new sound takes over the oldest channel with the lowest
+	 * priority, unless that priority is higher than its own. Permanent
+	 * sounds are never stopped this way.
+	 *
+	 * By default, speech has the highest priority, followed by music,
+	 * plain sounds and sound effects.
+	 *
+	 * @param type the sound type
+	 * @param priority the new priority, higher values win
+	 */
+	virtual void setPriorityForSoundType(SoundType type, int priority) = 0;
+
+	/**
+	 * Query the priority of the given sound type.
+	 *
+	 * @param type the sound type
+	 * @return the priority of the sound type
+	 */
+	virtual int getPriorityForSoundType(SoundType type) const = 0;
+
+	/**
+	 * Set how many sounds may play at the same time. Sounds already
+	 * playing are not affected if the limit is lowered.
+	 *
+	 * @param count the new limit
+	 */
+	virtual void setMaxChannels(uint count) = 0;
+
+	/**
+	 * Query how many sounds may play at the same time.
+	 *
+	 * @return the channel limit
+	 */
+	virtual uint getMaxChannels() const = 0;
+
+	/**
+	 * Query how many sounds of the given type were played, stolen and
+	 * rejected so far.
+	 *
+	 * @param type the sound type
+	 * @return the statistics of the sound type
+	 */
+	virtual PlayStats getPlayStats(SoundType type) const = 0;
+
 	/**
 	 * Query the system's audio output sample rate.
 	 *
@@ -24,8 +24,10 @@
 #define AUDIO_MIXER_INTERN_H
 
 #include "common/scummsys.h"
+#include "common/array.h"
 #include "common/mutex.h"
 #include "audio/mixer.h"
+#include "audio/rate.h"
 
 namespace Audio {
 
@@ -42,6 +44,21 @@ namespace Audio {
  * 4) Change the mixer into ready mode via setReady(true).
  * 5) Start audio processing (e.g. by resuming the audio thread, if applicable).
  *
+ * The mixCallback() only ever waits a moment for the engine side, for a stop
+ * to see that the mix is over. All the other methods are meant to be called
+ * from engine code (possibly from several threads, which are serialised
+ * among themselves), and hand their changes to the callback: channels are
+ * published to and removed from the channel table with atomic stores, and
+ * parameter changes go through a single producer, single consumer command
+ * queue, which the callback drains before it mixes. A channel being removed
+ * is only deleted once the callback can no longer use it, so stopping a
+ * sound still guarantees that its stream is not touched anymore once the
+ * call returns.
+ *
+ * Streams may call the mixer from the audio thread, while they are mixed.
+ * The engine side therefore never waits for the callback while it holds
+ * its mutex.
+ *
  * In the future, we might make it possible for backends to provide
  * (partial) alternative implementations of the mixer, e.g. to make
  * better use of native sound mixing support on low-end devices.
@@ -51,24 +68,97 @@ namespace Audio {
 class MixerImpl : public Mixer {
 private:
 	enum {
-		NUM_CHANNELS = 16
+		/** Size of the channel table to start with; it grows on demand. */
+		INITIAL_CHANNELS = 16,
+		DEFAULT_MAX_CHANNELS = 64,
+		/** Upper limit for setMaxChannels(), handles encode the index modulo this. */
+		MAX_CHANNELS = 256,
+		COMMAND_QUEUE_SIZE = 256
 	};
 
+	/** Serialises the engine side; mixCallback() never takes it. */
 	Common::Mutex _mutex;
 
+	/**
+	 * Held by mixCallback() while it mixes. Stopping a sound takes it, never
+	 * while holding _mutex, only to wait for a mix which may still use the
+	 * sound's stream. As it is recursive, a stream stopping a sound from the
+	 * audio thread passes right through, and the channel is deleted later.
+	 */
+	Common::Mutex _mixMutex;
+
 	const uint _sampleRate;
 	bool _mixerReady;
 	uint32 _handleSeed;
 
 	struct SoundTypeSettings {
-		SoundTypeSettings() : mute(false), volume(kMaxMixerVolume) {}
+		SoundTypeSettings() : mute(false), volume(kMaxMixerVolume), priority(0) {
+			stats.played = stats.stolen = stats.rejected = 0;
+		}
 
 		bool mute;
 		int volume;
+		int priority;
+		PlayStats stats;
 	};
 
 	SoundTypeSettings _soundTypeSettings[4];
-	Channel *_channels[NUM_CHANNELS];
+
+	/**
+	 * Only the engine side changes the channel table, mixCallback() only
+	 * reads it. Both sides access the entries atomically. When the table
+	 * grows, the new one is published before its size.
+	 */
+	Channel *volatile *volatile _channels;
+	volatile uint _numChannels;
+	uint _maxChannels;
+
+	/** Used for the rate converters of new channels. */
+	RateConverterQuality _rateConverterQuality;
+
+	enum CommandType {
+		kCommandSetVolumes,
+		kCommandPause
+	};
+
+	/** A change to a channel's mixing parameters, queued for mixCallback(). */
+	struct Command {
+		CommandType type;
+		int index;
+		uint32 handle;
+		uint32 value;
+	};
+
+	Command _commands[COMMAND_QUEUE_SIZE];
+	/** Next command to process, only advanced by the consumer. */
+	volatile uint32 _commandHead;
+	/** Next free command, only advanced by the engine side. */
+	volatile uint32 _commandTail;
+
+	/** Incremented when mixCallback() starts and when it returns, so it is odd while mixing. */
+	volatile uint32 _mixEpoch;
+	/**
+	 * Held by whoever processes the command queue. The engine side only
+	 * takes it to drain a full queue itself, the callback then leaves the
+	 * commands to it instead of waiting.
+	 */
+	volatile uint32 _consumerLock;
+
+	/** A channel or an old channel table, which the mix in progress may still use. */
+	struct Retired {
+		Channel *channel;
+		Channel *volatile *table;
+		uint32 epoch;
+	};
+
+	Common::Array<Retired> _retired;
+
+	/** Every channel is mixed into the accumulator, which is clipped once at the end. */
+	int32 *_accumulator;
+	/** Converted samples of the channel being mixed, before volume is applied. */
+	int16 *_scratch;
+	/** Size of both buffers, in sample pairs. */
+	uint _mixBufferSize;
 
 
 public:
@@ -116,10 +206,48 @@ public:
 	virtual void setVolumeForSoundType(SoundType type, int volume);
 	virtual int getVolumeForSoundType(SoundType type) const;
 
+	virtual void setPriorityForSoundType(SoundType type, int priority);
+	virtual int getPriorityForSoundType(SoundType type) const;
+
+	virtual void setMaxChannels(uint count);
+	virtual uint getMaxChannels() const;
+
+	virtual PlayStats getPlayStats(SoundType type) const;
+
 	virtual uint getOutputRate() const;
 
 protected:
-	void insertChannel(SoundHandle *handle, Channel *chan);
+	/**
+	 * Add a channel to the table. Returns true if another channel had to be
+	 * stopped for it, see waitForMix().
+	 */
+	bool insertChannel(SoundHandle *handle, Channel *chan);
+
+private:
+	/** Queue a channel parameter change for mixCallback(). */
+	void pushCommand(CommandType type, int index, SoundHandle handle, uint32 value);
+	/** Apply all queued commands. Must only be called by the consumer. */
+	void processCommands();
+
+	/** Return the channel index for @p handle, or -1 if its sound is not playing. */
+	int findChannel(SoundHandle handle) const;
+	/** Enlarge the channel table, up to the channel limit. Returns a free index or -1. */
+	int growChannels();
+	/** Stop a channel to make room for a sound of type @p type. Returns the freed index or -1. */
+	int stealChannel(SoundType type);
+
+	/** Remove a channel from the table and schedule it for deletion. */
+	void retireChannel(int index);
+	/** Retire all channels mixCallback() found to be finished. */
+	void retireFinishedChannels();
+	/** Delete the retired channels and tables which are not in use anymore. */
+	void freeRetired();
+	/**
+	 * Wait for a mix in progress (if any) to finish, then delete the retired
+	 * channels. Must be called without holding _mutex. On the audio thread,
+	 * it returns right away, and the channels are deleted by a later call.
+	 */
+	void waitForMix();
 
 public:
 	/**
@@ -133,6 +261,12 @@ public:
 	 */
 	int mixCallback(byte *samples, uint len);
 
+	/**
+	 * Set the quality of the rate conversion for sounds which are not at
+	 * the output rate. Only applies to sounds started afterwards.
+	 */
+	void setRateConverterQuality(RateConverterQuality quality);
+
 	/**
 	 * Set the internal 'is ready' flag of the mixer.
 	 * Backends should invoke Mixer::setReady(true) once initialisation of
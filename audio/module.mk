@@ -65,10 +65,10 @@ MODULE_OBJS += \
 	alsa_opl.o
 endif
 
-ifndef USE_ARM_SOUND_ASM
 MODULE_OBJS += \
 	rate.o
-else
+
+ifdef USE_ARM_SOUND_ASM
 MODULE_OBJS += \
 	rate_arm.o \
 	rate_arm_asm.o
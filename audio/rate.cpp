@@ -31,10 +31,19 @@
 #include "audio/audiostream.h"
 #include "audio/rate.h"
 #include "audio/mixer.h"
+#include "common/algorithm.h"
+#include "common/array.h"
+#include "common/atomic.h"
 #include "common/frac.h"
 #include "common/textconsole.h"
 #include "common/util.h"
 
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
 namespace Audio {
 
 
@@ -79,7 +88,7 @@ protected:
 
 public:
 	SimpleRateConverter(st_rate_t inrate, st_rate_t outrate);
-	int flow(AudioStream &input, st_sample_t *obuf, st_size_t osamp, st_volume_t vol_l, st_volume_t vol_r);
+	int convert(AudioStream &input, st_sample_t *obuf, st_size_t osamp);
 	int drain(st_sample_t *obuf, st_size_t osamp, st_volume_t vol) {
 		return ST_SUCCESS;
 	}
@@ -112,7 +121,7 @@ SimpleRateConverter<stereo, reverseStereo>::SimpleRateConverter(st_rate_t inrate
  * Return number of sample pairs processed.
  */
 template<bool stereo, bool reverseStereo>
-int SimpleRateConverter<stereo, reverseStereo>::flow(AudioStream &input, st_sample_t *obuf, st_size_t osamp, st_volume_t vol_l, st_volume_t vol_r) {
+int SimpleRateConverter<stereo, reverseStereo>::convert(AudioStream &input, st_sample_t *obuf, st_size_t osamp) {
 	st_sample_t *ostart, *oend;
 
 	ostart = obuf;
@@ -143,11 +152,9 @@ int SimpleRateConverter<stereo, reverseStereo>::flow(AudioStream &input, st_samp
 		// Increment output position
 		opos += opos_inc;
 
-		// output left channel
-		clampedAdd(obuf[reverseStereo    ], (out0 * (int)vol_l) / Audio::Mixer::kMaxMixerVolume);
-
-		// output right channel
-		clampedAdd(obuf[reverseStereo ^ 1], (out1 * (int)vol_r) / Audio::Mixer::kMaxMixerVolume);
+		// output left and right channel
+		obuf[reverseStereo    ] = out0;
+		obuf[reverseStereo ^ 1] = out1;
 
 		obuf += 2;
 	}
@@ -185,7 +192,7 @@ protected:
 
 public:
 	LinearRateConverter(st_rate_t inrate, st_rate_t outrate);
-	int flow(AudioStream &input, st_sample_t *obuf, st_size_t osamp, st_volume_t vol_l, st_volume_t vol_r);
+	int convert(AudioStream &input, st_sample_t *obuf, st_size_t osamp);
 	int drain(st_sample_t *obuf, st_size_t osamp, st_volume_t vol) {
 		return ST_SUCCESS;
 	}
@@ -221,7 +228,7 @@ LinearRateConverter<stereo, reverseStereo>::LinearRateConverter(st_rate_t inrate
  * Return number of sample pairs processed.
  */
 template<bool stereo, bool reverseStereo>
-int LinearRateConverter<stereo, reverseStereo>::flow(AudioStream &input, st_sample_t *obuf, st_size_t osamp, st_volume_t vol_l, st_volume_t vol_r) {
+int LinearRateConverter<stereo, reverseStereo>::convert(AudioStream &input, st_sample_t *obuf, st_size_t osamp) {
 	st_sample_t *ostart, *oend;
 
 	ostart = obuf;
@@ -258,11 +265,9 @@ int LinearRateConverter<stereo, reverseStereo>::flow(AudioStream &input, st_samp
 						  (st_sample_t)(ilast1 + (((icur1 - ilast1) * opos + FRAC_HALF_LOW) >> FRAC_BITS_LOW)) :
 						  out0);
 
-			// output left channel
-			clampedAdd(obuf[reverseStereo    ], (out0 * (int)vol_l) / Audio::Mixer::kMaxMixerVolume);
-
-			// output right channel
-			clampedAdd(obuf[reverseStereo ^ 1], (out1 * (int)vol_r) / Audio::Mixer::kMaxMixerVolume);
+			// output left and right channel
+			obuf[reverseStereo    ] = out0;
+			obuf[reverseStereo ^ 1] = out1;
 
 			obuf += 2;
 
@@ -279,71 +284,549 @@ int LinearRateConverter<stereo, reverseStereo>::flow(AudioStream &input, st_samp
 
 /**
  * Simple audio rate converter for the case that the inrate equals the outrate.
+ * The input is read straight into the output buffer.
  */
 template<bool stereo, bool reverseStereo>
 class CopyRateConverter : public RateConverter {
-	st_sample_t *_buffer;
-	st_size_t _bufferSize;
 public:
-	CopyRateConverter() : _buffer(0), _bufferSize(0) {}
-	~CopyRateConverter() {
-		free(_buffer);
+	virtual int convert(AudioStream &input, st_sample_t *obuf, st_size_t osamp) {
+		assert(input.isStereo() == stereo);
+
+		if (stereo) {
+			const int len = input.readBuffer(obuf, osamp * 2);
+			if (len <= 0)
+				return 0;
+
+			if (reverseStereo) {
+				for (int i = 0; i < len; i += 2)
+					SWAP(obuf[i], obuf[i + 1]);
+			}
+			return len / 2;
+		}
+
+		// Read into the upper half, then spread each sample over a pair;
+		// going forward, no sample is overwritten before it is read.
+		st_sample_t *ptr = obuf + osamp;
+		const int len = input.readBuffer(ptr, osamp);
+		for (int i = 0; i < len; i++)
+			obuf[2 * i] = obuf[2 * i + 1] = ptr[i];
+
+		return MAX(len, 0);
 	}
 
-	virtual int flow(AudioStream &input, st_sample_t *obuf, st_size_t osamp, st_volume_t vol_l, st_volume_t vol_r) {
-		assert(input.isStereo() == stereo);
+	virtual int drain(st_sample_t *obuf, st_size_t osamp, st_volume_t vol) {
+		return ST_SUCCESS;
+	}
+};
 
-		st_sample_t *ptr;
-		st_size_t len;
 
-		st_sample_t *ostart = obuf;
+#pragma mark -
 
-		if (stereo)
-			osamp *= 2;
 
-		// Reallocate temp buffer, if necessary
-		if (osamp > _bufferSize) {
-			free(_buffer);
-			_buffer = (st_sample_t *)malloc(osamp * 2);
-			_bufferSize = osamp;
+#if defined(__SSE2__)
+
+static inline int32 firDot(const int16 *x, const int16 *h, int taps) {
+	__m128i acc = _mm_setzero_si128();
+	for (int i = 0; i < taps; i += 8)
+		acc = _mm_add_epi32(acc, _mm_madd_epi16(_mm_loadu_si128((const __m128i *)(x + i)), _mm_loadu_si128((const __m128i *)(h + i))));
+
+	acc = _mm_add_epi32(acc, _mm_shuffle_epi32(acc, 0x4E));
+	acc = _mm_add_epi32(acc, _mm_shuffle_epi32(acc, 0xB1));
+	return _mm_cvtsi128_si32(acc);
+}
+
+#elif defined(__ARM_NEON)
+
+static inline int32 firDot(const int16 *x, const int16 *h, int taps) {
+	int32x4_t acc = vdupq_n_s32(0);
+	for (int i = 0; i < taps; i += 8) {
+		acc = vmlal_s16(acc, vld1_s16(x + i), vld1_s16(h + i));
+		acc = vmlal_s16(acc, vld1_s16(x + i + 4), vld1_s16(h + i + 4));
+	}
+
+	const int32x2_t sum = vadd_s32(vget_low_s32(acc), vget_high_s32(acc));
+	return vget_lane_s32(vpadd_s32(sum, sum), 0);
+}
+
+#else
+
+static inline int32 firDot(const int16 *x, const int16 *h, int taps) {
+	int32 acc = 0;
+	for (int i = 0; i < taps; i++)
+		acc += x[i] * h[i];
+	return acc;
+}
+
+#endif
+
+/** Zeroth order modified Bessel function of the first kind, for the Kaiser window. */
+static double besselI0(double x) {
+	double sum = 1.0, term = 1.0;
+	for (int k = 1; k < 32; k++) {
+		term *= (x / (2 * k)) * (x / (2 * k));
+		sum += term;
+		if (term < sum * 1e-12)
+			break;
+	}
+	return sum;
+}
+
+enum {
+	/** Beyond this, positions are rounded to the nearest of this many phases. */
+	POLYPHASE_MAX_PHASES = 1024,
+	POLYPHASE_MAX_TAPS = 256
+};
+
+/**
+ * Coefficients of a polyphase filter. They only depend on the conversion
+ * ratio and the quality, so converters share them through a cache, and
+ * they are never modified once computed.
+ */
+struct PolyphaseFilter {
+	/** Conversion ratio interp/decim, in lowest terms. */
+	uint32 interp, decim;
+	RateConverterQuality quality;
+
+	/** Taps per phase, a multiple of 8. */
+	int taps;
+	uint32 phases;
+	int16 *coeffs;
+
+	/** Number of converters using the filter. */
+	int refCount;
+
+	PolyphaseFilter(uint32 interp_, uint32 decim_, RateConverterQuality quality_);
+	~PolyphaseFilter() { delete[] coeffs; }
+};
+
+PolyphaseFilter::PolyphaseFilter(uint32 interp_, uint32 decim_, RateConverterQuality quality_)
+	: interp(interp_), decim(decim_), quality(quality_), refCount(0) {
+	phases = MIN<uint32>(interp, POLYPHASE_MAX_PHASES);
+
+	// Filter length and window shape per quality; the stopband attenuation
+	// is roughly 60dB for medium and 90dB for high quality
+	int baseTaps;
+	double beta, rolloff;
+	if (quality == kRateQualityHigh) {
+		baseTaps = 48;
+		beta = 9.0;
+		rolloff = 0.92;
+	} else {
+		baseTaps = 16;
+		beta = 6.0;
+		rolloff = 0.85;
+	}
+
+	// When downsampling, the cutoff moves down to the output Nyquist
+	// frequency, and the filter needs to be longer by the same factor to
+	// keep its transition band
+	double cutoff = 0.5 * rolloff;
+	if (decim > interp) {
+		cutoff = cutoff * interp / decim;
+		baseTaps = (int)((uint64)baseTaps * decim / interp);
+	}
+	taps = MIN<int>((baseTaps + 7) & ~7, POLYPHASE_MAX_TAPS);
+
+	coeffs = new int16[phases * taps];
+
+	const int center = taps / 2 - 1;
+	const double halfWidth = taps / 2.0;
+	const double windowScale = 1.0 / besselI0(beta);
+	double *row = new double[taps];
+
+	for (uint32 p = 0; p < phases; p++) {
+		const double offset = (double)p / phases;
+		double sum = 0.0;
+
+		for (int j = 0; j < taps; j++) {
+			const double d = j - center - offset;
+			const double x = 2.0 * cutoff * d;
+			const double sinc = (fabs(x) < 1e-9) ? 1.0 : sin(M_PI * x) / (M_PI * x);
+			const double w = d / halfWidth;
+			const double window = (fabs(w) < 1.0) ? besselI0(beta * sqrt(1.0 - w * w)) * windowScale : 0.0;
+
+			row[j] = sinc * window;
+			sum += row[j];
+		}
+
+		// Normalise every phase to unity gain, and put the rounding error
+		// on the largest coefficient so the sum is exact
+		int16 *out = coeffs + p * taps;
+		int32 total = 0, largest = 0;
+		for (int j = 0; j < taps; j++) {
+			out[j] = (int16)CLIP<double>(floor(row[j] * 32768.0 / sum + 0.5), -32767.0, 32767.0);
+			total += out[j];
+			if (ABS(out[j]) > ABS(out[largest]))
+				largest = j;
 		}
+		out[largest] = (int16)CLIP<int32>(out[largest] + 32768 - total, -32767, 32767);
+	}
 
-		if (!_buffer)
-			error("[CopyRateConverter::flow] Cannot allocate memory for temp buffer");
+	delete[] row;
+}
 
-		// Read up to 'osamp' samples into our temporary buffer
-		len = input.readBuffer(_buffer, osamp);
+/** Filters in use, so converters for the same ratio and quality share them. */
+static Common::Array<PolyphaseFilter *> s_polyphaseFilters;
+static Common::SpinLock s_polyphaseFiltersLock;
 
-		// Mix the data into the output buffer
-		ptr = _buffer;
-		for (; len > 0; len -= (stereo ? 2 : 1)) {
-			st_sample_t out0, out1;
-			out0 = *ptr++;
-			out1 = (stereo ? *ptr++ : out0);
+static PolyphaseFilter *findPolyphaseFilter(uint32 interp, uint32 decim, RateConverterQuality quality) {
+	for (uint i = 0; i < s_polyphaseFilters.size(); i++) {
+		PolyphaseFilter *filter = s_polyphaseFilters[i];
+		if (filter->interp == interp && filter->decim == decim && filter->quality == quality)
+			return filter;
+	}
+	return 0;
+}
 
-			// output left channel
-			clampedAdd(obuf[reverseStereo    ], (out0 * (int)vol_l) / Audio::Mixer::kMaxMixerVolume);
+/** Returns the shared filter for the given ratio and quality, computing it if needed. */
+static const PolyphaseFilter *acquirePolyphaseFilter(uint32 interp, uint32 decim, RateConverterQuality quality) {
+	{
+		Common::SpinLockHolder lock(s_polyphaseFiltersLock);
+		PolyphaseFilter *filter = findPolyphaseFilter(interp, decim, quality);
+		if (filter) {
+			filter->refCount++;
+			return filter;
+		}
+	}
 
-			// output right channel
-			clampedAdd(obuf[reverseStereo ^ 1], (out1 * (int)vol_r) / Audio::Mixer::kMaxMixerVolume);
+	// Computing the coefficients takes a while, so do it without holding
+	// the lock, and keep the first filter if another thread was faster
+	PolyphaseFilter *created = new PolyphaseFilter(interp, decim, quality);
 
-			obuf += 2;
+	Common::SpinLockHolder lock(s_polyphaseFiltersLock);
+	PolyphaseFilter *filter = findPolyphaseFilter(interp, decim, quality);
+	if (filter) {
+		delete created;
+	} else {
+		filter = created;
+		s_polyphaseFilters.push_back(filter);
+	}
+	filter->refCount++;
+	return filter;
+}
+
+static void releasePolyphaseFilter(const PolyphaseFilter *filter) {
+	Common::SpinLockHolder lock(s_polyphaseFiltersLock);
+	for (uint i = 0; i < s_polyphaseFilters.size(); i++) {
+		if (s_polyphaseFilters[i] != filter)
+			continue;
+
+		if (--s_polyphaseFilters[i]->refCount == 0) {
+			delete s_polyphaseFilters[i];
+			s_polyphaseFilters.remove_at(i);
 		}
-		return (obuf - ostart) / 2;
+		return;
 	}
+}
 
-	virtual int drain(st_sample_t *obuf, st_size_t osamp, st_volume_t vol) {
+/**
+ * Audio rate converter based on a Kaiser windowed-sinc low-pass filter.
+ *
+ * Converting by the ratio L/M (in lowest terms) places every output sample
+ * at one of L positions between two input samples. The filter is split in
+ * one set of coefficients, a phase, per position, so each output sample
+ * costs one dot product of a fixed number of taps. Unlike the interpolating
+ * converters above, it removes the images of the input spectrum when
+ * upsampling, and the content above the output Nyquist frequency when
+ * downsampling.
+ *
+ * The coefficients are computed (in floating point) when the first
+ * converter for a ratio and quality is created; the filtering itself is
+ * fixed point, with Q15 coefficients.
+ */
+template<bool stereo, bool reverseStereo>
+class PolyphaseRateConverter : public RateConverter {
+protected:
+	st_sample_t inBuf[INTERMEDIATE_BUFFER_SIZE];
+
+	/** Input samples per channel, with the filter history in front. */
+	int16 *buf[2];
+	int bufSize;
+	/** First sample of the current filter window. */
+	int pos;
+	/** Number of valid samples in buf. */
+	int fill;
+	/** Whether the end of the stream was padded to flush the filter. */
+	bool flushed;
+
+	/** Shared coefficients, taps per phase. */
+	const PolyphaseFilter *filter;
+	int taps;
+	uint32 phases;
+	const int16 *coeffs;
+
+	/** Conversion ratio interp/decim. */
+	uint32 interp, decim;
+	/** Position of the next output sample after pos, in units of 1/interp. */
+	uint32 phase;
+
+	bool refill(AudioStream &input);
+
+public:
+	PolyphaseRateConverter(st_rate_t inrate, st_rate_t outrate, RateConverterQuality quality);
+	~PolyphaseRateConverter();
+	int convert(AudioStream &input, st_sample_t *obuf, st_size_t osamp);
+	int drain(st_sample_t *obuf, st_size_t osamp, st_volume_t vol) {
 		return ST_SUCCESS;
 	}
 };
 
+template<bool stereo, bool reverseStereo>
+PolyphaseRateConverter<stereo, reverseStereo>::PolyphaseRateConverter(st_rate_t inrate, st_rate_t outrate, RateConverterQuality quality) {
+	const st_rate_t divisor = Common::gcd(inrate, outrate);
+	interp = outrate / divisor;
+	decim = inrate / divisor;
+	phase = 0;
+
+	filter = acquirePolyphaseFilter(interp, decim, quality);
+	taps = filter->taps;
+	phases = filter->phases;
+	coeffs = filter->coeffs;
+
+	// Start with the history empty, so the first output sample is centered
+	// on the first input sample
+	bufSize = taps + INTERMEDIATE_BUFFER_SIZE;
+	buf[0] = new int16[bufSize];
+	buf[1] = stereo ? new int16[bufSize] : 0;
+	memset(buf[0], 0, sizeof(int16) * bufSize);
+	if (stereo)
+		memset(buf[1], 0, sizeof(int16) * bufSize);
+	pos = 0;
+	fill = taps / 2 - 1;
+	flushed = false;
+}
+
+template<bool stereo, bool reverseStereo>
+PolyphaseRateConverter<stereo, reverseStereo>::~PolyphaseRateConverter() {
+	releasePolyphaseFilter(filter);
+	delete[] buf[0];
+	delete[] buf[1];
+}
+
+template<bool stereo, bool reverseStereo>
+bool PolyphaseRateConverter<stereo, reverseStereo>::refill(AudioStream &input) {
+	// Drop the samples the filter window has passed
+	const int shift = MIN(pos, fill);
+	if (shift) {
+		memmove(buf[0], buf[0] + shift, sizeof(int16) * (fill - shift));
+		if (stereo)
+			memmove(buf[1], buf[1] + shift, sizeof(int16) * (fill - shift));
+		pos -= shift;
+		fill -= shift;
+	}
+
+	const int frames = MIN<int>(bufSize - fill, ARRAYSIZE(inBuf) / (stereo ? 2 : 1));
+	const int len = input.readBuffer(inBuf, frames * (stereo ? 2 : 1));
+
+	if (len <= 0) {
+		if (flushed || !input.endOfStream())
+			return false;
+
+		// Let the last input samples through the filter
+		const int padding = taps / 2;
+		memset(buf[0] + fill, 0, sizeof(int16) * padding);
+		if (stereo)
+			memset(buf[1] + fill, 0, sizeof(int16) * padding);
+		fill += padding;
+		flushed = true;
+		return true;
+	}
+
+	if (stereo) {
+		for (int i = 0; i < len / 2; i++) {
+			buf[0][fill + i] = inBuf[2 * i];
+			buf[1][fill + i] = inBuf[2 * i + 1];
+		}
+		fill += len / 2;
+	} else {
+		memcpy(buf[0] + fill, inBuf, sizeof(int16) * len);
+		fill += len;
+	}
+
+	return true;
+}
+
+template<bool stereo, bool reverseStereo>
+int PolyphaseRateConverter<stereo, reverseStereo>::convert(AudioStream &input, st_sample_t *obuf, st_size_t osamp) {
+	st_sample_t *ostart, *oend;
+
+	ostart = obuf;
+	oend = obuf + osamp * 2;
+
+	while (obuf < oend) {
+		// Make sure the whole filter window is available
+		if (pos + taps > fill) {
+			if (!refill(input))
+				break;
+			continue;
+		}
+
+		const uint32 index = (phases == interp) ? phase : (uint32)((uint64)phase * phases / interp);
+		const int16 *h = coeffs + index * taps;
+
+		st_sample_t out0, out1;
+		out0 = (st_sample_t)CLIP<int32>((firDot(buf[0] + pos, h, taps) + (1 << 14)) >> 15, ST_SAMPLE_MIN, ST_SAMPLE_MAX);
+		out1 = (stereo ?
+		        (st_sample_t)CLIP<int32>((firDot(buf[1] + pos, h, taps) + (1 << 14)) >> 15, ST_SAMPLE_MIN, ST_SAMPLE_MAX) :
+		        out0);
+
+		// output left and right channel
+		obuf[reverseStereo    ] = out0;
+		obuf[reverseStereo ^ 1] = out1;
+
+		obuf += 2;
+
+		// Advance to the next output position
+		phase += decim;
+		if (phase >= interp) {
+			pos += phase / interp;
+			phase %= interp;
+		}
+	}
+	return (obuf - ostart) / 2;
+}
+
+
+#pragma mark -
+
+int RateConverter::flow(AudioStream &input, st_sample_t *obuf, st_size_t osamp, st_volume_t vol_l, st_volume_t vol_r) {
+	st_sample_t buf[INTERMEDIATE_BUFFER_SIZE * 2];
+	st_size_t done = 0;
+
+	while (done < osamp) {
+		const st_size_t chunk = MIN<st_size_t>(osamp - done, INTERMEDIATE_BUFFER_SIZE);
+		const int len = convert(input, buf, chunk);
+
+		for (int i = 0; i < len; i++) {
+			clampedAdd(obuf[0], (buf[2 * i    ] * (int)vol_l) / Audio::Mixer::kMaxMixerVolume);
+			clampedAdd(obuf[1], (buf[2 * i + 1] * (int)vol_r) / Audio::Mixer::kMaxMixerVolume);
+			obuf += 2;
+		}
+
+		done += MAX(len, 0);
+		if (len < (int)chunk)
+			break;
+	}
+
+	return done;
+}
+
+static inline st_sample_t saturateSample(int32 val) {
+	val = CLIP<int32>(val, ST_SAMPLE_MIN, ST_SAMPLE_MAX);
+#ifdef OUTPUT_UNSIGNED_AUDIO
+	val ^= 0x8000;
+#endif
+	return (st_sample_t)val;
+}
+
+#if defined(__SSE2__)
+
+void mixToAccumulator(int32 *acc, const st_sample_t *in, st_size_t osamp, st_volume_t vol_l, st_volume_t vol_r) {
+	const __m128i vol = _mm_set_epi16(vol_r, vol_l, vol_r, vol_l, vol_r, vol_l, vol_r, vol_l);
+	const __m128i bias = _mm_set1_epi32(Audio::Mixer::kMaxMixerVolume - 1);
+	st_size_t i = 0;
+
+	for (; i + 4 <= osamp; i += 4) {
+		const __m128i s = _mm_loadu_si128((const __m128i *)(in + 2 * i));
+		const __m128i lo = _mm_mullo_epi16(s, vol);
+		const __m128i hi = _mm_mulhi_epi16(s, vol);
+		__m128i p0 = _mm_unpacklo_epi16(lo, hi);
+		__m128i p1 = _mm_unpackhi_epi16(lo, hi);
+
+		// Divide by kMaxMixerVolume rounding towards zero, like the scalar code
+		p0 = _mm_srai_epi32(_mm_add_epi32(p0, _mm_and_si128(_mm_srai_epi32(p0, 31), bias)), 8);
+		p1 = _mm_srai_epi32(_mm_add_epi32(p1, _mm_and_si128(_mm_srai_epi32(p1, 31), bias)), 8);
+
+		__m128i *out = (__m128i *)(acc + 2 * i);
+		_mm_storeu_si128(out, _mm_add_epi32(_mm_loadu_si128(out), p0));
+		_mm_storeu_si128(out + 1, _mm_add_epi32(_mm_loadu_si128(out + 1), p1));
+	}
+
+	for (; i < osamp; i++) {
+		acc[2 * i    ] += (in[2 * i    ] * (int)vol_l) / Audio::Mixer::kMaxMixerVolume;
+		acc[2 * i + 1] += (in[2 * i + 1] * (int)vol_r) / Audio::Mixer::kMaxMixerVolume;
+	}
+}
+
+void saturateAccumulator(st_sample_t *out, const int32 *acc, st_size_t osamp) {
+	const st_size_t count = osamp * 2;
+	st_size_t i = 0;
+
+	for (; i + 8 <= count; i += 8) {
+		__m128i v = _mm_packs_epi32(_mm_loadu_si128((const __m128i *)(acc + i)), _mm_loadu_si128((const __m128i *)(acc + i + 4)));
+#ifdef OUTPUT_UNSIGNED_AUDIO
+		v = _mm_xor_si128(v, _mm_set1_epi16((int16)0x8000));
+#endif
+		_mm_storeu_si128((__m128i *)(out + i), v);
+	}
+
+	for (; i < count; i++)
+		out[i] = saturateSample(acc[i]);
+}
+
+#elif defined(__ARM_NEON)
+
+void mixToAccumulator(int32 *acc, const st_sample_t *in, st_size_t osamp, st_volume_t vol_l, st_volume_t vol_r) {
+	const int16 volPair[4] = { (int16)vol_l, (int16)vol_r, (int16)vol_l, (int16)vol_r };
+	const int16x4_t vol = vld1_s16(volPair);
+	st_size_t i = 0;
+
+	for (; i + 2 <= osamp; i += 2) {
+		int32x4_t p = vmull_s16(vld1_s16(in + 2 * i), vol);
+
+		// Divide by kMaxMixerVolume rounding towards zero, like the scalar code
+		const int32x4_t bias = vreinterpretq_s32_u32(vshrq_n_u32(vreinterpretq_u32_s32(vshrq_n_s32(p, 31)), 24));
+		p = vshrq_n_s32(vaddq_s32(p, bias), 8);
+
+		vst1q_s32(acc + 2 * i, vaddq_s32(vld1q_s32(acc + 2 * i), p));
+	}
+
+	for (; i < osamp; i++) {
+		acc[2 * i    ] += (in[2 * i    ] * (int)vol_l) / Audio::Mixer::kMaxMixerVolume;
+		acc[2 * i + 1] += (in[2 * i + 1] * (int)vol_r) / Audio::Mixer::kMaxMixerVolume;
+	}
+}
+
+void saturateAccumulator(st_sample_t *out, const int32 *acc, st_size_t osamp) {
+	const st_size_t count = osamp * 2;
+	st_size_t i = 0;
+
+	for (; i + 4 <= count; i += 4) {
+		int16x4_t v = vqmovn_s32(vld1q_s32(acc + i));
+#ifdef OUTPUT_UNSIGNED_AUDIO
+		v = veor_s16(v, vdup_n_s16((int16)0x8000));
+#endif
+		vst1_s16(out + i, v);
+	}
+
+	for (; i < count; i++)
+		out[i] = saturateSample(acc[i]);
+}
+
+#else
+
+void mixToAccumulator(int32 *acc, const st_sample_t *in, st_size_t osamp, st_volume_t vol_l, st_volume_t vol_r) {
+	for (st_size_t i = 0; i < osamp; i++) {
+		acc[2 * i    ] += (in[2 * i    ] * (int)vol_l) / Audio::Mixer::kMaxMixerVolume;
+		acc[2 * i + 1] += (in[2 * i + 1] * (int)vol_r) / Audio::Mixer::kMaxMixerVolume;
+	}
+}
+
+void saturateAccumulator(st_sample_t *out, const int32 *acc, st_size_t osamp) {
+	for (st_size_t i = 0; i < osamp * 2; i++)
+		out[i] = saturateSample(acc[i]);
+}
+
+#endif
 
 #pragma mark -
 
 template<bool stereo, bool reverseStereo>
-RateConverter *makeRateConverter(st_rate_t inrate, st_rate_t outrate) {
+RateConverter *makeRateConverter(st_rate_t inrate, st_rate_t outrate, RateConverterQuality quality) {
 	if (inrate != outrate) {
-		if ((inrate % outrate) == 0 && (inrate < 65536)) {
+		if (quality != kRateQualityLow) {
+			return new PolyphaseRateConverter<stereo, reverseStereo>(inrate, outrate, quality);
+		} else if ((inrate % outrate) == 0 && (inrate < 65536)) {
 			return new SimpleRateConverter<stereo, reverseStereo>(inrate, outrate);
 		} else {
 			return new LinearRateConverter<stereo, reverseStereo>(inrate, outrate);
@@ -353,17 +836,27 @@ RateConverter *makeRateConverter(st_rate_t inrate, st_rate_t outrate) {
 	}
 }
 
+#ifdef USE_ARM_SOUND_ASM
+// Defined in rate_arm.cpp
+RateConverter *makeARMRateConverter(st_rate_t inrate, st_rate_t outrate, bool stereo, bool reverseStereo);
+#endif
+
 /**
  * Create and return a RateConverter object for the specified input and output rates.
  */
-RateConverter *makeRateConverter(st_rate_t inrate, st_rate_t outrate, bool stereo, bool reverseStereo) {
+RateConverter *makeRateConverter(st_rate_t inrate, st_rate_t outrate, bool stereo, bool reverseStereo, RateConverterQuality quality) {
+#ifdef USE_ARM_SOUND_ASM
+	if (quality == kRateQualityLow)
+		return makeARMRateConverter(inrate, outrate, stereo, reverseStereo);
+#endif
+
 	if (stereo) {
 		if (reverseStereo)
-			return makeRateConverter<true, true>(inrate, outrate);
+			return makeRateConverter<true, true>(inrate, outrate, quality);
 		else
-			return makeRateConverter<true, false>(inrate, outrate);
+			return makeRateConverter<true, false>(inrate, outrate, quality);
 	} else
-		return makeRateConverter<false, false>(inrate, outrate);
+		return makeRateConverter<false, false>(inrate, outrate, quality);
 }
 
 } // End of namespace Audio
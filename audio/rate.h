@@ -65,20 +65,55 @@ static inline void clampedAdd(int16& a, int b) {
 #endif
 }
 
+/**
+ * Adds stereo sample pairs, scaled by the channel volumes, to a 32 bit
+ * accumulator. Scaling matches the one RateConverter::flow applies.
+ */
+void mixToAccumulator(int32 *acc, const st_sample_t *in, st_size_t osamp, st_volume_t vol_l, st_volume_t vol_r);
+
+/**
+ * Converts accumulated sample pairs to 16 bit output, saturating once
+ * instead of after every channel.
+ */
+void saturateAccumulator(st_sample_t *out, const int32 *acc, st_size_t osamp);
+
 class RateConverter {
 public:
 	RateConverter() {}
 	virtual ~RateConverter() {}
 
 	/**
+	 * Converts the input and adds it to the buffer at the given volume,
+	 * clamping after the addition.
+	 *
 	 * @return Number of sample pairs written into the buffer.
 	 */
-	virtual int flow(AudioStream &input, st_sample_t *obuf, st_size_t osamp, st_volume_t vol_l, st_volume_t vol_r) = 0;
+	virtual int flow(AudioStream &input, st_sample_t *obuf, st_size_t osamp, st_volume_t vol_l, st_volume_t vol_r);
+
+	/**
+	 * Converts the input into stereo sample pairs at the output rate,
+	 * overwriting the buffer and leaving volume to the caller.
+	 *
+	 * @return Number of sample pairs written into the buffer.
+	 */
+	virtual int convert(AudioStream &input, st_sample_t *obuf, st_size_t osamp) = 0;
 
 	virtual int drain(st_sample_t *obuf, st_size_t osamp, st_volume_t vol) = 0;
 };
 
-RateConverter *makeRateConverter(st_rate_t inrate, st_rate_t outrate, bool stereo, bool reverseStereo = false);
+/**
+ * Trade-off between CPU time and accuracy of the rate conversion.
+ */
+enum RateConverterQuality {
+	/** Nearest sample or linear interpolation; cheapest, but adds images and aliasing */
+	kRateQualityLow,
+	/** 16 tap windowed-sinc filter (longer when downsampling), around 60dB stopband */
+	kRateQualityMedium,
+	/** 48 tap windowed-sinc filter (longer when downsampling), around 90dB stopband */
+	kRateQualityHigh
+};
+
+RateConverter *makeRateConverter(st_rate_t inrate, st_rate_t outrate, bool stereo, bool reverseStereo = false, RateConverterQuality quality = kRateQualityLow);
 
 } // End of namespace Audio
 
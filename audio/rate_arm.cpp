@@ -22,9 +22,9 @@
 
 /*
  * The code in this file, together with the rate_arm_asm.s file offers
- * an ARM optimised version of the code in rate.cpp. The operation of this
- * code should be identical to that of rate.cpp, but faster. The heavy
- * lifting is done in the assembler file.
+ * an ARM optimised version of the low quality converters in rate.cpp. The
+ * operation of this code should be identical to that of rate.cpp, but
+ * faster. The heavy lifting is done in the assembler file.
  *
  * To be as portable as possible we implement the core routines with C
  * linkage in assembly, and implement the C++ routines that call into
@@ -68,6 +68,14 @@ namespace Audio {
  */
 #define INTERMEDIATE_BUFFER_SIZE 512
 
+/**
+ * The assembler routines add the scaled samples to the output buffer;
+ * RateConverter::convert overwrites it instead. Mixing into a cleared
+ * buffer at this volume, which the routines widen to 0xFFFF/0x10000,
+ * yields the converted samples to within one LSB.
+ */
+#define ARM_UNITY_VOLUME 0xff
+
 /**
  * The default fractional type in frac.h (with 16 fractional bits) limits
  * the rate conversion code to 65536Hz audio: we need to able to handle
@@ -105,7 +113,7 @@ protected:
 	SimpleRateDetails  sr;
 public:
 	SimpleRateConverter(st_rate_t inrate, st_rate_t outrate);
-	int flow(AudioStream &input, st_sample_t *obuf, st_size_t osamp, st_volume_t vol_l, st_volume_t vol_r);
+	int convert(AudioStream &input, st_sample_t *obuf, st_size_t osamp);
 	int drain(st_sample_t *obuf, st_size_t osamp, st_volume_t vol) {
 		return (ST_SUCCESS);
 	}
@@ -179,12 +187,15 @@ extern "C" int SimpleRate_readFudge(Audio::AudioStream &input, int16 *a, int b)
 }
 
 template<bool stereo, bool reverseStereo>
-int SimpleRateConverter<stereo, reverseStereo>::flow(AudioStream &input, st_sample_t *obuf, st_size_t osamp, st_volume_t vol_l, st_volume_t vol_r) {
+int SimpleRateConverter<stereo, reverseStereo>::convert(AudioStream &input, st_sample_t *obuf, st_size_t osamp) {
 
 #ifdef DEBUG_RATECONV
 	debug("Simple st=%d rev=%d", stereo, reverseStereo);
 #endif
 	st_sample_t *ostart = obuf;
+	const st_volume_t vol_l = ARM_UNITY_VOLUME, vol_r = ARM_UNITY_VOLUME;
+
+	memset(obuf, 0, osamp * 2 * sizeof(st_sample_t));
 
 	if (!stereo) {
 		obuf = ARM_SimpleRate_M(input,
@@ -279,7 +290,7 @@ protected:
 
 public:
 	LinearRateConverter(st_rate_t inrate, st_rate_t outrate);
-	int flow(AudioStream &input, st_sample_t *obuf, st_size_t osamp, st_volume_t vol_l, st_volume_t vol_r);
+	int convert(AudioStream &input, st_sample_t *obuf, st_size_t osamp);
 	int drain(st_sample_t *obuf, st_size_t osamp, st_volume_t vol) {
 		return (ST_SUCCESS);
 	}
@@ -320,18 +331,15 @@ LinearRateConverter<stereo, reverseStereo>::LinearRateConverter(st_rate_t inrate
  * Return number of sample pairs processed.
  */
 template<bool stereo, bool reverseStereo>
-int LinearRateConverter<stereo, reverseStereo>::flow(AudioStream &input, st_sample_t *obuf, st_size_t osamp, st_volume_t vol_l, st_volume_t vol_r) {
+int LinearRateConverter<stereo, reverseStereo>::convert(AudioStream &input, st_sample_t *obuf, st_size_t osamp) {
 
 #ifdef DEBUG_RATECONV
 	debug("Linear st=%d rev=%d", stereo, reverseStereo);
 #endif
 	st_sample_t *ostart = obuf;
+	const st_volume_t vol_l = ARM_UNITY_VOLUME, vol_r = ARM_UNITY_VOLUME;
 
-	if (vol_l > 0xff)
-		vol_l = 0xff;
-
-	if (vol_r > 0xff)
-		vol_r = 0xff;
+	memset(obuf, 0, osamp * 2 * sizeof(st_sample_t));
 
 	if (!stereo) {
 		obuf = ARM_LinearRate_M(input,
@@ -400,7 +408,7 @@ public:
 		free(_buffer);
 	}
 
-	virtual int flow(AudioStream &input, st_sample_t *obuf, st_size_t osamp, st_volume_t vol_l, st_volume_t vol_r) {
+	virtual int convert(AudioStream &input, st_sample_t *obuf, st_size_t osamp) {
 		assert(input.isStereo() == stereo);
 
 #ifdef DEBUG_RATECONV
@@ -408,6 +416,9 @@ public:
 #endif
 		st_size_t len;
 		st_sample_t *ostart = obuf;
+		const st_volume_t vol_l = ARM_UNITY_VOLUME, vol_r = ARM_UNITY_VOLUME;
+
+		memset(obuf, 0, osamp * 2 * sizeof(st_sample_t));
 
 		if (stereo)
 			osamp *= 2;
@@ -445,9 +456,10 @@ public:
 
 
 /**
- * Create and return a RateConverter object for the specified input and output rates.
+ * Create and return one of the assembler converters for the specified input
+ * and output rates. rate.cpp uses these for kRateQualityLow.
  */
-RateConverter *makeRateConverter(st_rate_t inrate, st_rate_t outrate, bool stereo, bool reverseStereo) {
+RateConverter *makeARMRateConverter(st_rate_t inrate, st_rate_t outrate, bool stereo, bool reverseStereo) {
 	if (inrate != outrate) {
 		if ((inrate % outrate) == 0 && (inrate < 65536)) {
 			if (stereo) {
@@ -37,7 +37,9 @@
 #include "common/system.h"
 #include "common/util.h"
 #include "common/archive.h"
+#include "common/atomic.h"
 #include "common/textconsole.h"
+#include "common/timer.h"
 #include "common/translation.h"
 #include "common/osd_message_queue.h"
 
@@ -113,6 +115,56 @@ private:
 
 	int _outputRate;
 
+	enum {
+		/** Upper limit of the "mt32_render_ahead" setting, in milliseconds. */
+		kMaxRenderAhead = 1000,
+		/** Frames rendered at once, so sends do not wait long for the synth. */
+		kRenderChunk = 256
+	};
+
+	/**
+	 * In render ahead mode ("mt32_render_ahead" is set), a timer proc keeps
+	 * the synth _aheadFrames ahead of the mixer, in the _ring single
+	 * producer, single consumer queue of stereo frames. generateSamples()
+	 * only copies from it, so the mixer callback never waits for the synth.
+	 *
+	 * MIDI events are queued with the playback position they were sent at,
+	 * plus _aheadFrames, as timestamp. Events sent by the music timer are
+	 * thereby just as sample accurate as when rendering in the callback,
+	 * with a constant delay. The synth renders at its internal rate in the
+	 * analog mode we use, so output frames are synth timestamps.
+	 */
+	uint32 _aheadFrames;
+	int16 *_ring;
+	/** Capacity of _ring in frames, a power of two. */
+	uint32 _ringFrames;
+	/** Frames played, only advanced by generateSamples(). */
+	volatile uint32 _ringRead;
+	/** Frames rendered, only advanced by renderAhead(). */
+	volatile uint32 _ringWrite;
+
+	/** A MIDI event waiting for renderAhead() to hand it to the synth. */
+	struct QueuedEvent {
+		uint32 timestamp;
+		uint32 msg;
+		/** Position and size of the message in _eventSysex, for a sysex. */
+		uint32 sysexOffset, sysexLength;
+	};
+
+	Common::Mutex _eventMutex;
+	Common::Array<QueuedEvent> _events;
+	Common::Array<byte> _eventSysex;
+
+	void startRenderAhead(int milliseconds);
+	void stopRenderAhead();
+	static void renderAheadProc(void *refCon);
+	void renderAhead();
+	void renderRing(uint32 target);
+	bool playQueuedEvent(const QueuedEvent &event);
+
+	void queueEvent(uint32 msg, const byte *sysex, uint32 length);
+	void queueWriteSysex(byte channel, const byte *data, uint32 length);
+
 protected:
 	void generateSamples(int16 *buf, int len);
 
@@ -150,6 +202,10 @@ MidiDriver_MT32::MidiDriver_MT32(Audio::Mixer *mixer) : MidiDriver_Emulated(mixe
 	_outputRate = 0;
 	_controlData = nullptr;
 	_pcmData = nullptr;
+	_aheadFrames = 0;
+	_ring = nullptr;
+	_ringFrames = 0;
+	_ringRead = _ringWrite = 0;
 }
 
 MidiDriver_MT32::~MidiDriver_MT32() {
@@ -219,6 +275,9 @@ int MidiDriver_MT32::open() {
 	// AudioStream.
 	_outputRate = _service.getActualStereoOutputSamplerate();
 
+	if (ConfMan.hasKey("mt32_render_ahead") && ConfMan.getInt("mt32_render_ahead") > 0)
+		startRenderAhead(MIN<int>(ConfMan.getInt("mt32_render_ahead"), kMaxRenderAhead));
+
 	MidiDriver_Emulated::open();
 
 	_mixer->playStream(Audio::Mixer::kPlainSoundType, &_mixerSoundHandle, this, -1, Audio::Mixer::kMaxChannelVolume, 0, DisposeAfterUse::NO, true);
@@ -227,6 +286,11 @@ int MidiDriver_MT32::open() {
 }
 
 void MidiDriver_MT32::send(uint32 b) {
+	if (_aheadFrames) {
+		queueEvent(b, nullptr, 0);
+		return;
+	}
+
 	Common::StackLock lock(_mutex);
 	_service.playMsg(b);
 }
@@ -238,12 +302,22 @@ void MidiDriver_MT32::setPitchBendRange(byte channel, uint range) {
 		warning("setPitchBendRange() called with range > 24: %d", range);
 	}
 	byte benderRangeSysex[4] = { 0, 0, 4, (uint8)range };
+	if (_aheadFrames) {
+		queueWriteSysex(channel, benderRangeSysex, 4);
+		return;
+	}
+
 	Common::StackLock lock(_mutex);
 	_service.writeSysex(channel, benderRangeSysex, 4);
 }
 
 void MidiDriver_MT32::sysEx(const byte *msg, uint16 length) {
 	if (msg[0] == 0xf0) {
+		if (_aheadFrames) {
+			queueEvent(0, msg, length);
+			return;
+		}
+
 		Common::StackLock lock(_mutex);
 		_service.playSysex(msg, length);
 	} else {
@@ -253,6 +327,11 @@ void MidiDriver_MT32::sysEx(const byte *msg, uint16 length) {
 		};
 
 		if (msg[3] == SYSEX_CMD_DT1 || msg[3] == SYSEX_CMD_DAT) {
+			if (_aheadFrames) {
+				queueWriteSysex(msg[1], msg + 4, length - 5);
+				return;
+			}
+
 			Common::StackLock lock(_mutex);
 			_service.writeSysex(msg[1], msg + 4, length - 5);
 		} else {
@@ -270,6 +349,7 @@ void MidiDriver_MT32::close() {
 	setTimerCallback(NULL, NULL);
 	// Detach the mixer callback handler
 	_mixer->stopHandle(_mixerSoundHandle);
+	stopRenderAhead();
 
 	Common::StackLock lock(_mutex);
 	_service.closeSynth();
@@ -281,8 +361,151 @@ void MidiDriver_MT32::close() {
 }
 
 void MidiDriver_MT32::generateSamples(int16 *data, int len) {
+	if (!_aheadFrames) {
+		Common::StackLock lock(_mutex);
+		_service.renderBit16s(data, len);
+		return;
+	}
+
+	const uint32 read = _ringRead;
+	const uint32 count = MIN<uint32>(len, Common::atomicLoad(&_ringWrite) - read);
+
+	for (uint32 done = 0; done < count; ) {
+		const uint32 index = (read + done) & (_ringFrames - 1);
+		const uint32 step = MIN(count - done, _ringFrames - index);
+		memcpy(data + 2 * done, _ring + 2 * index, step * 2 * sizeof(int16));
+		done += step;
+	}
+
+	// On an underrun the playback position stays behind, so the timestamps
+	// of new events are never in the part the synth has already rendered
+	if (count < (uint32)len) {
+		memset(data + 2 * count, 0, (len - count) * 2 * sizeof(int16));
+		debug(5, "MT-32 render ahead underrun, %d frames missing", len - count);
+	}
+
+	Common::atomicStore(&_ringRead, read + count);
+}
+
+void MidiDriver_MT32::startRenderAhead(int milliseconds) {
+	_aheadFrames = _outputRate * milliseconds / 1000;
+	_ringFrames = 1;
+	while (_ringFrames < _aheadFrames)
+		_ringFrames <<= 1;
+	_ring = new int16[_ringFrames * 2];
+	_ringRead = _ringWrite = 0;
+
+	// Fill the queue before the mixer starts reading it
+	renderAhead();
+
+	const int32 interval = MAX<int32>(milliseconds * 1000 / 4, 1000);
+	if (!g_system->getTimerManager()->installTimerProc(&renderAheadProc, interval, this, "MT32RenderAhead")) {
+		warning("MT-32 emulator could not install its render timer, rendering in the mixer instead");
+		delete[] _ring;
+		_ring = nullptr;
+		_aheadFrames = 0;
+		_ringFrames = 0;
+	}
+}
+
+void MidiDriver_MT32::stopRenderAhead() {
+	if (!_aheadFrames)
+		return;
+
+	// Once removed, the timer proc is not running anymore either
+	g_system->getTimerManager()->removeTimerProc(&renderAheadProc);
+
+	delete[] _ring;
+	_ring = nullptr;
+	_aheadFrames = 0;
+	_ringFrames = 0;
+	_events.clear();
+	_eventSysex.clear();
+}
+
+void MidiDriver_MT32::renderAheadProc(void *refCon) {
+	static_cast<MidiDriver_MT32 *>(refCon)->renderAhead();
+}
+
+void MidiDriver_MT32::renderAhead() {
 	Common::StackLock lock(_mutex);
-	_service.renderBit16s(data, len);
+
+	{
+		Common::StackLock eventLock(_eventMutex);
+		for (uint i = 0; i < _events.size(); ++i) {
+			const QueuedEvent &event = _events[i];
+			if (playQueuedEvent(event))
+				continue;
+
+			// The synth's MIDI queue is full. Rendering up to the event
+			// plays the ones before it, which makes room; timestamps never
+			// lie beyond the render ahead target, so the ring has space.
+			if ((int32)(event.timestamp - _ringWrite) > 0)
+				renderRing(event.timestamp);
+
+			if (!playQueuedEvent(event))
+				warning("MT-32 emulator MIDI queue overflow, dropping %s", event.sysexLength ? "sysex" : "message");
+		}
+		_events.resize(0);
+		_eventSysex.resize(0);
+	}
+
+	renderRing(Common::atomicLoad(&_ringRead) + _aheadFrames);
+}
+
+bool MidiDriver_MT32::playQueuedEvent(const QueuedEvent &event) {
+	if (event.sysexLength)
+		return _service.playSysexAt(&_eventSysex[event.sysexOffset], event.sysexLength, event.timestamp);
+	else
+		return _service.playMsgAt(event.msg, event.timestamp);
+}
+
+void MidiDriver_MT32::renderRing(uint32 target) {
+	uint32 write = _ringWrite;
+
+	while ((int32)(target - write) > 0) {
+		const uint32 index = write & (_ringFrames - 1);
+		const uint32 count = MIN<uint32>(MIN(target - write, _ringFrames - index), kRenderChunk);
+		_service.renderBit16s(_ring + 2 * index, count);
+
+		write += count;
+		Common::atomicStore(&_ringWrite, write);
+	}
+}
+
+void MidiDriver_MT32::queueEvent(uint32 msg, const byte *sysex, uint32 length) {
+	QueuedEvent event;
+	event.timestamp = Common::atomicLoad(&_ringRead) + _aheadFrames;
+	event.msg = msg;
+	event.sysexLength = length;
+
+	Common::StackLock lock(_eventMutex);
+	event.sysexOffset = _eventSysex.size();
+	for (uint32 i = 0; i < length; ++i)
+		_eventSysex.push_back(sysex[i]);
+	_events.push_back(event);
+}
+
+void MidiDriver_MT32::queueWriteSysex(byte channel, const byte *data, uint32 length) {
+	// writeSysex() has no timestamped variant, so this becomes a DT1 sysex
+	// for the channel. Unlike writeSysex() the synth checks the checksum,
+	// hence it is calculated here.
+	Common::Array<byte> sysex;
+	sysex.push_back(0xF0);
+	sysex.push_back(0x41);
+	sysex.push_back(channel);
+	sysex.push_back(0x16);
+	sysex.push_back(0x12);
+
+	byte checksum = 0;
+	for (uint32 i = 0; i < length; ++i) {
+		sysex.push_back(data[i]);
+		checksum += data[i];
+	}
+	sysex.push_back((128 - (checksum & 0x7F)) & 0x7F);
+	sysex.push_back(0xF7);
+
+	queueEvent(0, &sysex[0], sysex.size());
 }
 
 uint32 MidiDriver_MT32::property(int prop, uint32 param) {
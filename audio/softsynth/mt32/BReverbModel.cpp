@@ -22,6 +22,17 @@
 #include "BReverbModel.h"
 #include "Synth.h"
 
+// The block processing is only implemented for the default integer samples
+#define MT32EMU_BLOCK_REVERB (!MT32EMU_USE_FLOAT_SAMPLES && !MT32EMU_BOSS_REVERB_PRECISE_MODE)
+
+#if MT32EMU_BLOCK_REVERB
+#if MT32EMU_SSE2
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+#endif
+
 // Analysing of state of reverb RAM address lines gives exact sizes of the buffers of filters used. This also indicates that
 // the reverb model implemented in the real devices consists of three series allpass filters preceded by a non-feedback comb (or a delay with a LPF)
 // and followed by three parallel comb filters
@@ -37,6 +48,9 @@ static const Bit32u PROCESS_DELAY = 1;
 static const Bit32u MODE_3_ADDITIONAL_DELAY = 1;
 static const Bit32u MODE_3_FEEDBACK_DELAY = 1;
 
+// Number of samples process() passes through each stage at once, the scratch buffers live on the stack.
+static const Bit32u BLOCK_SIZE = 256;
+
 // Default reverb settings for "new" reverb model implemented in CM-32L / LAPC-I.
 // Found by tracing reverb RAM data lines (thanks go to Lord_Nightmare & balrog).
 const BReverbSettings &BReverbModel::getCM32L_LAPCSettings(const ReverbMode mode) {
@@ -196,6 +210,150 @@ static Sample weirdMul(Sample a, Bit8u addMask, Bit8u carryMask) {
 #endif
 }
 
+#if MT32EMU_BLOCK_REVERB
+
+#if MT32EMU_SSE2
+// weirdMul() for eight samples. The product never exceeds 24 bits, so bits 8 to 23 are assembled from both halves.
+MT32EMU_SSE2_TARGET static inline __m128i weirdMulSSE2(const __m128i a, const __m128i factor) {
+	const __m128i hi = _mm_mulhi_epi16(a, factor);
+	const __m128i lo = _mm_mullo_epi16(a, factor);
+	return _mm_or_si128(_mm_slli_epi16(hi, 8), _mm_srli_epi16(lo, 8));
+}
+
+MT32EMU_SSE2_TARGET static inline __m128i widenLowSSE2(const __m128i a) {
+	return _mm_srai_epi32(_mm_unpacklo_epi16(a, a), 16);
+}
+
+MT32EMU_SSE2_TARGET static inline __m128i widenHighSSE2(const __m128i a) {
+	return _mm_srai_epi32(_mm_unpackhi_epi16(a, a), 16);
+}
+
+// The SSE2 kernels process whole groups of eight samples and return how many samples they did.
+
+MT32EMU_SSE2_TARGET static Bit32u mixDryBlockSSE2(const Sample *inLeft, const Sample *inRight, Sample *out, Bit32u numSamples, const int shift, const Bit8u dryAmp) {
+	Bit32u i = 0;
+	const __m128i factor = _mm_set1_epi16(dryAmp);
+	const __m128i count = _mm_cvtsi32_si128(shift);
+	for (; i + 8 <= numSamples; i += 8) {
+		const __m128i l = _mm_sra_epi16(_mm_loadu_si128((const __m128i *)(inLeft + i)), count);
+		const __m128i r = _mm_sra_epi16(_mm_loadu_si128((const __m128i *)(inRight + i)), count);
+		_mm_storeu_si128((__m128i *)(out + i), weirdMulSSE2(_mm_add_epi16(l, r), factor));
+	}
+	return i;
+}
+
+MT32EMU_SSE2_TARGET static Bit32u mixCombOutputsBlockSSE2(const Sample *out1, const Sample *out2, const Sample *out3, Sample *out, Bit32u numSamples, const Bit8u wetLevel) {
+	Bit32u i = 0;
+	const __m128i factor = _mm_set1_epi16(wetLevel);
+	for (; i + 8 <= numSamples; i += 8) {
+		const __m128i a = _mm_loadu_si128((const __m128i *)(out1 + i));
+		const __m128i b = _mm_loadu_si128((const __m128i *)(out2 + i));
+		const __m128i c = _mm_loadu_si128((const __m128i *)(out3 + i));
+		__m128i lo = _mm_add_epi32(widenLowSSE2(a), _mm_srai_epi32(widenLowSSE2(a), 1));
+		lo = _mm_add_epi32(lo, _mm_add_epi32(widenLowSSE2(b), _mm_srai_epi32(widenLowSSE2(b), 1)));
+		lo = _mm_add_epi32(lo, widenLowSSE2(c));
+		__m128i hi = _mm_add_epi32(widenHighSSE2(a), _mm_srai_epi32(widenHighSSE2(a), 1));
+		hi = _mm_add_epi32(hi, _mm_add_epi32(widenHighSSE2(b), _mm_srai_epi32(widenHighSSE2(b), 1)));
+		hi = _mm_add_epi32(hi, widenHighSSE2(c));
+		// The saturating pack does the same as Synth::clipSampleEx()
+		_mm_storeu_si128((__m128i *)(out + i), weirdMulSSE2(_mm_packs_epi32(lo, hi), factor));
+	}
+	return i;
+}
+
+MT32EMU_SSE2_TARGET static Bit32u scaleBlockSSE2(const Sample *in, Sample *out, Bit32u numSamples, const Bit8u amp) {
+	Bit32u i = 0;
+	const __m128i factor = _mm_set1_epi16(amp);
+	for (; i + 8 <= numSamples; i += 8) {
+		_mm_storeu_si128((__m128i *)(out + i), weirdMulSSE2(_mm_loadu_si128((const __m128i *)(in + i)), factor));
+	}
+	return i;
+}
+
+MT32EMU_SSE2_TARGET static Bit32u allpassBlockSSE2(Sample *buf, Sample *inOut, Bit32u count) {
+	Bit32u i = 0;
+	for (; i + 8 <= count; i += 8) {
+		const __m128i bufferOut = _mm_loadu_si128((const __m128i *)(buf + i));
+		const __m128i stored = _mm_sub_epi16(_mm_loadu_si128((const __m128i *)(inOut + i)), _mm_srai_epi16(bufferOut, 1));
+		_mm_storeu_si128((__m128i *)(buf + i), stored);
+		_mm_storeu_si128((__m128i *)(inOut + i), _mm_add_epi16(bufferOut, _mm_srai_epi16(stored, 1)));
+	}
+	return i;
+}
+#elif defined(__ARM_NEON)
+static inline int16x8_t weirdMulNEON(const int16x8_t a, const int16x4_t factor) {
+	const int16x4_t lo = vshrn_n_s32(vmull_s16(vget_low_s16(a), factor), 8);
+	const int16x4_t hi = vshrn_n_s32(vmull_s16(vget_high_s16(a), factor), 8);
+	return vcombine_s16(lo, hi);
+}
+#endif
+
+// Mixes the input channels down to mono and applies dryAmp, shift is 1 in the tap delay mode and 2 otherwise.
+static void mixDryBlock(const Sample *inLeft, const Sample *inRight, Sample *out, Bit32u numSamples, const int shift, const Bit8u dryAmp) {
+	Bit32u i = 0;
+#if MT32EMU_SSE2
+	if (hasSSE2())
+		i = mixDryBlockSSE2(inLeft, inRight, out, numSamples, shift, dryAmp);
+#elif defined(__ARM_NEON)
+	const int16x4_t factor = vdup_n_s16(dryAmp);
+	const int16x8_t count = vdupq_n_s16(-shift);
+	for (; i + 8 <= numSamples; i += 8) {
+		const int16x8_t l = vshlq_s16(vld1q_s16(inLeft + i), count);
+		const int16x8_t r = vshlq_s16(vld1q_s16(inRight + i), count);
+		vst1q_s16(out + i, weirdMulNEON(vaddq_s16(l, r), factor));
+	}
+#endif
+	for (; i < numSamples; i++) {
+		const Sample dry = (inLeft[i] >> shift) + (inRight[i] >> shift);
+		out[i] = weirdMul(dry, dryAmp, 0xFF);
+	}
+}
+
+// Sums the outputs of the three combs the same way as processReference() and applies wetLevel.
+static void mixCombOutputsBlock(const Sample *out1, const Sample *out2, const Sample *out3, Sample *out, Bit32u numSamples, const Bit8u wetLevel) {
+	Bit32u i = 0;
+#if MT32EMU_SSE2
+	if (hasSSE2())
+		i = mixCombOutputsBlockSSE2(out1, out2, out3, out, numSamples, wetLevel);
+#elif defined(__ARM_NEON)
+	const int16x4_t factor = vdup_n_s16(wetLevel);
+	for (; i + 8 <= numSamples; i += 8) {
+		const int16x8_t a = vld1q_s16(out1 + i);
+		const int16x8_t b = vld1q_s16(out2 + i);
+		const int16x8_t c = vld1q_s16(out3 + i);
+		int32x4_t lo = vaddq_s32(vmovl_s16(vget_low_s16(a)), vmovl_s16(vshr_n_s16(vget_low_s16(a), 1)));
+		lo = vaddq_s32(lo, vaddq_s32(vmovl_s16(vget_low_s16(b)), vmovl_s16(vshr_n_s16(vget_low_s16(b), 1))));
+		lo = vaddq_s32(lo, vmovl_s16(vget_low_s16(c)));
+		int32x4_t hi = vaddq_s32(vmovl_s16(vget_high_s16(a)), vmovl_s16(vshr_n_s16(vget_high_s16(a), 1)));
+		hi = vaddq_s32(hi, vaddq_s32(vmovl_s16(vget_high_s16(b)), vmovl_s16(vshr_n_s16(vget_high_s16(b), 1))));
+		hi = vaddq_s32(hi, vmovl_s16(vget_high_s16(c)));
+		vst1q_s16(out + i, weirdMulNEON(vcombine_s16(vqmovn_s32(lo), vqmovn_s32(hi)), factor));
+	}
+#endif
+	for (; i < numSamples; i++) {
+		const Sample outSample = Synth::clipSampleEx(SampleEx(out1[i]) + (SampleEx(out1[i]) >> 1) + SampleEx(out2[i]) + (SampleEx(out2[i]) >> 1) + SampleEx(out3[i]));
+		out[i] = weirdMul(outSample, wetLevel, 0xFF);
+	}
+}
+
+static void scaleBlock(const Sample *in, Sample *out, Bit32u numSamples, const Bit8u amp) {
+	Bit32u i = 0;
+#if MT32EMU_SSE2
+	if (hasSSE2())
+		i = scaleBlockSSE2(in, out, numSamples, amp);
+#elif defined(__ARM_NEON)
+	const int16x4_t factor = vdup_n_s16(amp);
+	for (; i + 8 <= numSamples; i += 8) {
+		vst1q_s16(out + i, weirdMulNEON(vld1q_s16(in + i), factor));
+	}
+#endif
+	for (; i < numSamples; i++) {
+		out[i] = weirdMul(in[i], amp, 0xFF);
+	}
+}
+
+#endif // #if MT32EMU_BLOCK_REVERB
+
 RingBuffer::RingBuffer(Bit32u newsize) : size(newsize), index(0) {
 	buffer = new Sample[size];
 }
@@ -255,6 +413,42 @@ Sample AllpassFilter::process(const Sample in) {
 #endif
 }
 
+#if MT32EMU_BLOCK_REVERB
+void AllpassFilter::processBlock(Sample *inOut, Bit32u numSamples) {
+	while (numSamples > 0) {
+		next();
+
+		// Within a single pass over the ring, no sample reads a value stored by the same block
+		Bit32u count = size - index;
+		if (count > numSamples) {
+			count = numSamples;
+		}
+		Sample *buf = buffer + index;
+		Bit32u i = 0;
+#if MT32EMU_SSE2
+		if (hasSSE2())
+			i = allpassBlockSSE2(buf, inOut, count);
+#elif defined(__ARM_NEON)
+		for (; i + 8 <= count; i += 8) {
+			const int16x8_t bufferOut = vld1q_s16(buf + i);
+			const int16x8_t stored = vsubq_s16(vld1q_s16(inOut + i), vshrq_n_s16(bufferOut, 1));
+			vst1q_s16(buf + i, stored);
+			vst1q_s16(inOut + i, vaddq_s16(bufferOut, vshrq_n_s16(stored, 1)));
+		}
+#endif
+		for (; i < count; i++) {
+			const Sample bufferOut = buf[i];
+			buf[i] = inOut[i] - (bufferOut >> 1);
+			inOut[i] = bufferOut + (buf[i] >> 1);
+		}
+
+		index += count - 1;
+		inOut += count;
+		numSamples -= count;
+	}
+}
+#endif
+
 CombFilter::CombFilter(const Bit32u useSize, const Bit8u useFilterFactor) : RingBuffer(useSize), filterFactor(useFilterFactor) {}
 
 void CombFilter::process(const Sample in) {
@@ -278,6 +472,29 @@ void CombFilter::setFeedbackFactor(const Bit8u useFeedbackFactor) {
 	feedbackFactor = useFeedbackFactor;
 }
 
+#if MT32EMU_BLOCK_REVERB
+void CombFilter::processBlock(const Sample *in, Sample *outL, const Bit32u outLPosition, Sample *outR, const Bit32u outRPosition, Bit32u numSamples) {
+	// The recursion through the low-pass filter leaves nothing to vectorise, but keeping the state in locals still pays off
+	Sample last = buffer[index];
+	Bit32u pos = index;
+	Bit32u posL = (size + index - outLPosition) % size;
+	Bit32u posR = (size + index - outRPosition) % size;
+
+	for (Bit32u i = 0; i < numSamples; i++) {
+		if (++pos >= size) pos = 0;
+		if (++posL >= size) posL = 0;
+		if (++posR >= size) posR = 0;
+		outL[i] = buffer[posL];
+		outR[i] = buffer[posR];
+
+		const Sample filterIn = in[i] + weirdMul(buffer[pos], feedbackFactor, 0xF0);
+		last = weirdMul(last, filterFactor, 0xC0) - filterIn;
+		buffer[pos] = last;
+	}
+	index = pos;
+}
+#endif
+
 DelayWithLowPassFilter::DelayWithLowPassFilter(const Bit32u useSize, const Bit8u useFilterFactor, const Bit8u useAmp)
 	: CombFilter(useSize, useFilterFactor), amp(useAmp) {}
 
@@ -295,6 +512,25 @@ void DelayWithLowPassFilter::process(const Sample in) {
 	buffer[index] = weirdMul(lpfOut, amp, 0xFF);
 }
 
+#if MT32EMU_BLOCK_REVERB
+void DelayWithLowPassFilter::processBlock(const Sample *in, Sample *out, Bit32u numSamples) {
+	Sample last = buffer[index];
+	Bit32u pos = index;
+
+	for (Bit32u i = 0; i < numSamples; i++) {
+		if (++pos >= size) pos = 0;
+
+		// See processReference() regarding the reverb noise
+		out[i] = buffer[pos] - 1;
+
+		const Sample lpfOut = weirdMul(last, filterFactor, 0xFF) + in[i];
+		last = weirdMul(lpfOut, amp, 0xFF);
+		buffer[pos] = last;
+	}
+	index = pos;
+}
+#endif
+
 TapDelayCombFilter::TapDelayCombFilter(const Bit32u useSize, const Bit8u useFilterFactor) : CombFilter(useSize, useFilterFactor) {}
 
 void TapDelayCombFilter::process(const Sample in) {
@@ -325,6 +561,32 @@ void TapDelayCombFilter::setOutputPositions(const Bit32u useOutL, const Bit32u u
 	outR = useOutR;
 }
 
+#if MT32EMU_BLOCK_REVERB
+void TapDelayCombFilter::processBlock(const Sample *in, Sample *outLeft, Sample *outRight, Bit32u numSamples) {
+	// None of the taps coincides with the position being stored, so all of them can be read upfront
+	Sample last = buffer[index];
+	Bit32u pos = index;
+	Bit32u posFeedback = (size + index - outR - MODE_3_FEEDBACK_DELAY) % size;
+	Bit32u posL = (size + index - outL - PROCESS_DELAY - MODE_3_ADDITIONAL_DELAY) % size;
+	Bit32u posR = (size + index - outR - PROCESS_DELAY - MODE_3_ADDITIONAL_DELAY) % size;
+
+	for (Bit32u i = 0; i < numSamples; i++) {
+		if (++pos >= size) pos = 0;
+		if (++posFeedback >= size) posFeedback = 0;
+		if (++posL >= size) posL = 0;
+		if (++posR >= size) posR = 0;
+
+		const Sample filterIn = in[i] + weirdMul(buffer[posFeedback], feedbackFactor, 0xF0);
+		last = weirdMul(last, filterFactor, 0xF0) - filterIn;
+		buffer[pos] = last;
+
+		outLeft[i] = buffer[posL];
+		outRight[i] = buffer[posR];
+	}
+	index = pos;
+}
+#endif
+
 BReverbModel::BReverbModel(const ReverbMode mode, const bool mt32CompatibleModel) :
 	allpasses(NULL), combs(NULL),
 	currentSettings(mt32CompatibleModel ? getMT32Settings(mode) : getCM32L_LAPCSettings(mode)),
@@ -434,6 +696,64 @@ bool BReverbModel::isMT32Compatible(const ReverbMode mode) const {
 }
 
 void BReverbModel::process(const Sample *inLeft, const Sample *inRight, Sample *outLeft, Sample *outRight, Bit32u numSamples) {
+#if MT32EMU_BLOCK_REVERB
+	if (combs == NULL) {
+		Synth::muteSampleBuffer(outLeft, numSamples);
+		Synth::muteSampleBuffer(outRight, numSamples);
+		return;
+	}
+
+	Sample dry[BLOCK_SIZE];
+	Sample link[BLOCK_SIZE];
+	Sample outL1[BLOCK_SIZE], outR1[BLOCK_SIZE];
+	Sample outL2[BLOCK_SIZE], outR2[BLOCK_SIZE];
+	Sample outL3[BLOCK_SIZE], outR3[BLOCK_SIZE];
+
+	while (numSamples > 0) {
+		const Bit32u blockSize = numSamples < BLOCK_SIZE ? numSamples : BLOCK_SIZE;
+
+		mixDryBlock(inLeft, inRight, dry, blockSize, tapDelayMode ? 1 : 2, dryAmp);
+
+		if (tapDelayMode) {
+			static_cast<TapDelayCombFilter *>(*combs)->processBlock(dry, outL1, outR1, blockSize);
+			if (outLeft != NULL) {
+				scaleBlock(outL1, outLeft, blockSize, wetLevel);
+			}
+			if (outRight != NULL) {
+				scaleBlock(outR1, outRight, blockSize, wetLevel);
+			}
+		} else {
+			static_cast<DelayWithLowPassFilter *>(combs[0])->processBlock(dry, link, blockSize);
+			allpasses[0]->processBlock(link, blockSize);
+			allpasses[1]->processBlock(link, blockSize);
+			allpasses[2]->processBlock(link, blockSize);
+			combs[1]->processBlock(link, outL1, currentSettings.outLPositions[0], outR1, currentSettings.outRPositions[0], blockSize);
+			combs[2]->processBlock(link, outL2, currentSettings.outLPositions[1], outR2, currentSettings.outRPositions[1], blockSize);
+			combs[3]->processBlock(link, outL3, currentSettings.outLPositions[2], outR3, currentSettings.outRPositions[2], blockSize);
+			if (outLeft != NULL) {
+				mixCombOutputsBlock(outL1, outL2, outL3, outLeft, blockSize, wetLevel);
+			}
+			if (outRight != NULL) {
+				mixCombOutputsBlock(outR1, outR2, outR3, outRight, blockSize, wetLevel);
+			}
+		}
+
+		inLeft += blockSize;
+		inRight += blockSize;
+		if (outLeft != NULL) {
+			outLeft += blockSize;
+		}
+		if (outRight != NULL) {
+			outRight += blockSize;
+		}
+		numSamples -= blockSize;
+	}
+#else
+	processReference(inLeft, inRight, outLeft, outRight, numSamples);
+#endif
+}
+
+void BReverbModel::processReference(const Sample *inLeft, const Sample *inRight, Sample *outLeft, Sample *outRight, Bit32u numSamples) {
 	if (combs == NULL) {
 		Synth::muteSampleBuffer(outLeft, numSamples);
 		Synth::muteSampleBuffer(outRight, numSamples);
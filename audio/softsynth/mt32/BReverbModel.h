@@ -56,6 +56,8 @@ class AllpassFilter : public RingBuffer {
 public:
 	AllpassFilter(const Bit32u size);
 	Sample process(const Sample in);
+	// Processes the samples in place, same as calling process() for each of them.
+	void processBlock(Sample *inOut, Bit32u numSamples);
 };
 
 class CombFilter : public RingBuffer {
@@ -68,6 +70,9 @@ public:
 	virtual void process(const Sample in);
 	Sample getOutputAt(const Bit32u outIndex) const;
 	void setFeedbackFactor(const Bit8u useFeedbackFactor);
+	// Same as calling process() for each input sample. The outputs at the given positions are read before the new sample
+	// is stored, so a position equal to the size yields the sample being overwritten.
+	void processBlock(const Sample *in, Sample *outL, const Bit32u outLPosition, Sample *outR, const Bit32u outRPosition, Bit32u numSamples);
 };
 
 class DelayWithLowPassFilter : public CombFilter {
@@ -77,6 +82,8 @@ public:
 	DelayWithLowPassFilter(const Bit32u useSize, const Bit8u useFilterFactor, const Bit8u useAmp);
 	void process(const Sample in);
 	void setFeedbackFactor(const Bit8u) {}
+	// Same as calling process() for each input sample, out receives the link to the allpasses (including the reverb noise).
+	void processBlock(const Sample *in, Sample *out, Bit32u numSamples);
 };
 
 class TapDelayCombFilter : public CombFilter {
@@ -89,6 +96,8 @@ public:
 	Sample getLeftOutput() const;
 	Sample getRightOutput() const;
 	void setOutputPositions(const Bit32u useOutL, const Bit32u useOutR);
+	// Same as calling process(), getLeftOutput() and getRightOutput() for each input sample.
+	void processBlock(const Sample *in, Sample *outL, Sample *outR, Bit32u numSamples);
 };
 
 class BReverbModel {
@@ -112,7 +121,10 @@ public:
 	void close();
 	void mute();
 	void setParameters(Bit8u time, Bit8u level);
+	// Renders in blocks, using SSE2 or NEON where the compiler provides it. The output is bit-exact to processReference().
 	void process(const Sample *inLeft, const Sample *inRight, Sample *outLeft, Sample *outRight, Bit32u numSamples);
+	// Straightforward sample by sample implementation, kept as the reference for process().
+	void processReference(const Sample *inLeft, const Sample *inRight, Sample *outLeft, Sample *outRight, Bit32u numSamples);
 	bool isActive() const;
 	bool isMT32Compatible(const ReverbMode mode) const;
 };
@@ -28,6 +28,14 @@
 #include "TVF.h"
 #include "TVP.h"
 
+#if !MT32EMU_USE_FLOAT_SAMPLES
+#if MT32EMU_SSE2
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+#endif
+
 namespace MT32Emu {
 
 static const Bit8u PAN_NUMERATOR_MASTER[] = {0, 0, 0, 0, 0, 0, 0, 0, 1, 2, 3, 4, 5, 6, 7};
@@ -35,6 +43,67 @@ static const Bit8u PAN_NUMERATOR_SLAVE[]  = {0, 1, 2, 3, 4, 5, 6, 7, 7, 7, 7, 7,
 
 static const Bit32s PAN_FACTORS[] = {0, 18, 37, 55, 73, 91, 110, 128, 146, 165, 183, 201, 219, 238, 256};
 
+// Number of samples produceOutput() generates before panning and mixing them into the output buffers at once.
+static const Bit32u MIX_BLOCK_SIZE = 128;
+
+#if !MT32EMU_USE_FLOAT_SAMPLES && MT32EMU_SSE2
+// mixPanned() for whole groups of eight samples, returns how many samples it did.
+MT32EMU_SSE2_TARGET static Bit32u mixPannedSSE2(const Sample *in, Sample *leftBuf, Sample *rightBuf, Bit32u length, Bit32s leftPanValue, Bit32s rightPanValue) {
+	Bit32u i = 0;
+	const __m128i leftFactor = _mm_set1_epi16(Bit16s(leftPanValue));
+	const __m128i rightFactor = _mm_set1_epi16(Bit16s(rightPanValue));
+	for (; i + 8 <= length; i += 8) {
+		const __m128i sample = _mm_loadu_si128((const __m128i *)(in + i));
+		const __m128i leftOut = _mm_or_si128(_mm_slli_epi16(_mm_mulhi_epi16(sample, leftFactor), 8), _mm_srli_epi16(_mm_mullo_epi16(sample, leftFactor), 8));
+		const __m128i rightOut = _mm_or_si128(_mm_slli_epi16(_mm_mulhi_epi16(sample, rightFactor), 8), _mm_srli_epi16(_mm_mullo_epi16(sample, rightFactor), 8));
+		_mm_storeu_si128((__m128i *)(leftBuf + i), _mm_adds_epi16(_mm_loadu_si128((const __m128i *)(leftBuf + i)), leftOut));
+		_mm_storeu_si128((__m128i *)(rightBuf + i), _mm_adds_epi16(_mm_loadu_si128((const __m128i *)(rightBuf + i)), rightOut));
+	}
+	return i;
+}
+#endif
+
+// Pans the partial output and adds it to the output buffers.
+static void mixPanned(const Sample *in, Sample *leftBuf, Sample *rightBuf, Bit32u length, Bit32s leftPanValue, Bit32s rightPanValue) {
+#if MT32EMU_USE_FLOAT_SAMPLES
+	for (Bit32u i = 0; i < length; i++) {
+		leftBuf[i] += (in[i] * (float)leftPanValue) / 14.0f;
+		rightBuf[i] += (in[i] * (float)rightPanValue) / 14.0f;
+	}
+#else
+	Bit32u i = 0;
+	// The pan factors are within +/-256, so the products never exceed 24 bits and bits 8 to 23 are assembled from both halves.
+	// Saturating addition does the same as Synth::clipSampleEx().
+#if MT32EMU_SSE2
+	if (hasSSE2())
+		i = mixPannedSSE2(in, leftBuf, rightBuf, length, leftPanValue, rightPanValue);
+#elif defined(__ARM_NEON)
+	const int16x4_t leftFactor = vdup_n_s16(Bit16s(leftPanValue));
+	const int16x4_t rightFactor = vdup_n_s16(Bit16s(rightPanValue));
+	for (; i + 8 <= length; i += 8) {
+		const int16x8_t sample = vld1q_s16(in + i);
+		const int16x8_t leftOut = vcombine_s16(vshrn_n_s32(vmull_s16(vget_low_s16(sample), leftFactor), 8), vshrn_n_s32(vmull_s16(vget_high_s16(sample), leftFactor), 8));
+		const int16x8_t rightOut = vcombine_s16(vshrn_n_s32(vmull_s16(vget_low_s16(sample), rightFactor), 8), vshrn_n_s32(vmull_s16(vget_high_s16(sample), rightFactor), 8));
+		vst1q_s16(leftBuf + i, vqaddq_s16(vld1q_s16(leftBuf + i), leftOut));
+		vst1q_s16(rightBuf + i, vqaddq_s16(vld1q_s16(rightBuf + i), rightOut));
+	}
+#endif
+	for (; i < length; i++) {
+		// FIXME: Dividing by 7 (or by 14 in a Mok-friendly way) looks of course pointless. Need clarification.
+		// FIXME2: LA32 may produce distorted sound in case if the absolute value of maximal amplitude of the input exceeds 8191
+		// when the panning value is non-zero. Most probably the distortion occurs in the same way it does with ring modulation,
+		// and it seems to be caused by limited precision of the common multiplication circuit.
+		// From analysis of this overflow, it is obvious that the right channel output is actually found
+		// by subtraction of the left channel output from the input.
+		// Though, it is unknown whether this overflow is exploited somewhere.
+		Sample leftOut = Sample((in[i] * leftPanValue) >> 8);
+		Sample rightOut = Sample((in[i] * rightPanValue) >> 8);
+		leftBuf[i] = Synth::clipSampleEx(SampleEx(leftBuf[i]) + SampleEx(leftOut));
+		rightBuf[i] = Synth::clipSampleEx(SampleEx(rightBuf[i]) + SampleEx(rightOut));
+	}
+#endif
+}
+
 Partial::Partial(Synth *useSynth, int useDebugPartialNum) :
 	synth(useSynth), debugPartialNum(useDebugPartialNum), sampleNum(0) {
 	// Initialisation of tva, tvp and tvf uses 'this' pointer
@@ -281,6 +350,8 @@ bool Partial::produceOutput(Sample *leftBuf, Sample *rightBuf, Bit32u length) {
 	}
 	alreadyOutputed = true;
 
+	Sample mixBuffer[MIX_BLOCK_SIZE];
+	Bit32u mixLength = 0;
 	for (sampleNum = 0; sampleNum < length; sampleNum++) {
 		if (!tva->isPlaying() || !la32Pair.isActive(LA32PartialPair::MASTER)) {
 			deactivate();
@@ -300,30 +371,17 @@ bool Partial::produceOutput(Sample *leftBuf, Sample *rightBuf, Bit32u length) {
 
 		// Although, LA32 applies panning itself, we assume here it is applied in the mixer, not within a pair.
 		// Applying the pan value in the log-space looks like a waste of unlog resources. Though, it needs clarification.
-		Sample sample = la32Pair.nextOutSample();
-
 		// FIXME: Sample analysis suggests that the use of panVal is linear, but there are some quirks that still need to be resolved.
-#if MT32EMU_USE_FLOAT_SAMPLES
-		Sample leftOut = (sample * (float)leftPanValue) / 14.0f;
-		Sample rightOut = (sample * (float)rightPanValue) / 14.0f;
-		*(leftBuf++) += leftOut;
-		*(rightBuf++) += rightOut;
-#else
-		// FIXME: Dividing by 7 (or by 14 in a Mok-friendly way) looks of course pointless. Need clarification.
-		// FIXME2: LA32 may produce distorted sound in case if the absolute value of maximal amplitude of the input exceeds 8191
-		// when the panning value is non-zero. Most probably the distortion occurs in the same way it does with ring modulation,
-		// and it seems to be caused by limited precision of the common multiplication circuit.
-		// From analysis of this overflow, it is obvious that the right channel output is actually found
-		// by subtraction of the left channel output from the input.
-		// Though, it is unknown whether this overflow is exploited somewhere.
-		Sample leftOut = Sample((sample * leftPanValue) >> 8);
-		Sample rightOut = Sample((sample * rightPanValue) >> 8);
-		*leftBuf = Synth::clipSampleEx(SampleEx(*leftBuf) + SampleEx(leftOut));
-		*rightBuf = Synth::clipSampleEx(SampleEx(*rightBuf) + SampleEx(rightOut));
-		leftBuf++;
-		rightBuf++;
-#endif
+		// The LA32 state machines advance sample by sample, so only the panning and mixing is done in blocks.
+		mixBuffer[mixLength++] = la32Pair.nextOutSample();
+		if (mixLength == MIX_BLOCK_SIZE) {
+			mixPanned(mixBuffer, leftBuf, rightBuf, mixLength, leftPanValue, rightPanValue);
+			leftBuf += mixLength;
+			rightBuf += mixLength;
+			mixLength = 0;
+		}
 	}
+	mixPanned(mixBuffer, leftBuf, rightBuf, mixLength, leftPanValue, rightPanValue);
 	sampleNum = 0;
 	return true;
 }
@@ -99,8 +99,36 @@
 #define MT32EMU_BOSS_REVERB_PRECISE_MODE 0
 #endif
 
+// SSE2 block kernels. They are built in when the compiler targets SSE2, as it always does on x86-64.
+// 32-bit x86 builds get them through a function attribute, and use them when hasSSE2() finds the CPU supports SSE2.
+#if defined(__SSE2__)
+#define MT32EMU_SSE2 1
+#define MT32EMU_SSE2_TARGET
+#elif defined(__i386__) && ((defined(__GNUC__) && __GNUC__ >= 5) || defined(__clang__))
+#define MT32EMU_SSE2 1
+#define MT32EMU_SSE2_TARGET __attribute__((target("sse2")))
+#else
+#define MT32EMU_SSE2 0
+#endif
+
 namespace MT32Emu {
 
+#if MT32EMU_SSE2
+static inline bool hasSSE2() {
+#if defined(__SSE2__)
+	return true;
+#else
+	// Every thread computes the same value, so racing on it is harmless
+	static int supported = -1;
+	if (supported < 0) {
+		__builtin_cpu_init();
+		supported = __builtin_cpu_supports("sse2") ? 1 : 0;
+	}
+	return supported != 0;
+#endif
+}
+#endif
+
 enum PolyState {
 	POLY_Playing,
 	POLY_Held, // This marks keys that have been released on the keyboard, but are being held by the pedal
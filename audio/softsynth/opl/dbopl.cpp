@@ -38,6 +38,12 @@
 
 #ifndef DISABLE_DOSBOX_OPL
 
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
 namespace OPL {
 namespace DOSBox {
 
@@ -90,6 +96,9 @@ namespace DBOPL {
 //Has to fit within 16bit lookuptable
 #define MUL_SH		16
 
+//Amount of samples the block renderer keeps on the stack per operator
+#define BLOCK_SAMPLES	64
+
 //Check some ranges
 #if ENV_EXTRA > 3
 #error Too many envelope bits
@@ -596,6 +605,99 @@ INLINE Bits Operator::GetSample( Bits modulation ) {
 	}
 }
 
+#if ( DBOPL_WAVE != WAVE_TABLEMUL )
+#error "The block renderer only supports WAVE_TABLEMUL"
+#endif
+
+//Multiplier GetWave uses for a volume, silent volumes get 0 which gives the 0 GetSample returns
+static INLINE Bit16u VolumeMul( Bitu vol ) {
+	return ENV_SILENT( vol ) ? 0 : MulTable[ vol >> ENV_EXTRA ];
+}
+
+//Multipliers for a whole block, the envelope itself stays a sample by sample state machine
+void Operator::BlockEnvelope( Bitu samples, Bit16u* mul ) {
+	Bitu i = 0;
+	while ( i < samples ) {
+		switch ( state ) {
+		case OFF:
+			//Nothing changes until the next keyon, which can't happen within a block
+			for ( ; i < samples; i++ )
+				mul[i] = VolumeMul( currentLevel + ENV_MAX );
+			break;
+		case RELEASE:
+			for ( ; i < samples && state == RELEASE; i++ )
+				mul[i] = VolumeMul( currentLevel + TemplateVolume< RELEASE >() );
+			break;
+		case SUSTAIN:
+			if ( reg20 & MASK_SUSTAIN ) {
+				const Bit16u held = VolumeMul( currentLevel + volume );
+				for ( ; i < samples; i++ )
+					mul[i] = held;
+				break;
+			}
+			for ( ; i < samples && state == SUSTAIN; i++ )
+				mul[i] = VolumeMul( currentLevel + TemplateVolume< SUSTAIN >() );
+			break;
+		case DECAY:
+			for ( ; i < samples && state == DECAY; i++ )
+				mul[i] = VolumeMul( currentLevel + TemplateVolume< DECAY >() );
+			break;
+		case ATTACK:
+			for ( ; i < samples && state == ATTACK; i++ )
+				mul[i] = VolumeMul( currentLevel + TemplateVolume< ATTACK >() );
+			break;
+		}
+	}
+}
+
+//Scale the looked up waves with their multipliers, ( wave * mul ) >> MUL_SH
+static void MulBlock( Bitu samples, const Bit16s* wave, const Bit16u* mul, Bit32s* output ) {
+	Bitu i = 0;
+#if defined(__SSE2__)
+	//Only the high half of the product is needed, mulhi is signed so correct
+	//for multipliers with the top bit set
+	for ( ; i + 8 <= samples; i += 8 ) {
+		__m128i w = _mm_loadu_si128( (const __m128i*)( wave + i ) );
+		__m128i m = _mm_loadu_si128( (const __m128i*)( mul + i ) );
+		__m128i hi = _mm_mulhi_epi16( w, m );
+		hi = _mm_add_epi16( hi, _mm_and_si128( w, _mm_srai_epi16( m, 15 ) ) );
+		__m128i sign = _mm_srai_epi16( hi, 15 );
+		_mm_storeu_si128( (__m128i*)( output + i ), _mm_unpacklo_epi16( hi, sign ) );
+		_mm_storeu_si128( (__m128i*)( output + i + 4 ), _mm_unpackhi_epi16( hi, sign ) );
+	}
+#elif defined(__ARM_NEON)
+	for ( ; i + 4 <= samples; i += 4 ) {
+		int32x4_t w = vmovl_s16( vld1_s16( wave + i ) );
+		int32x4_t m = vreinterpretq_s32_u32( vmovl_u16( vld1_u16( mul + i ) ) );
+		vst1q_s32( output + i, vshrq_n_s32( vmulq_s32( w, m ), MUL_SH ) );
+	}
+#endif
+	for ( ; i < samples; i++ )
+		output[i] = ( wave[i] * mul[i] ) >> MUL_SH;
+}
+
+void Operator::BlockWave( Bitu samples, const Bit16u* mul, const Bit32s* modulation, Bit32s* output ) {
+	Bit16s wave[ BLOCK_SAMPLES ];
+	//Locals, as the stores to wave could otherwise alias them
+	const Bit16s* base = waveBase;
+	const Bit32u mask = waveMask;
+	const Bit32u add = waveCurrent;
+	Bit32u index = waveIndex;
+	if ( modulation ) {
+		for ( Bitu i = 0; i < samples; i++ ) {
+			index += add;
+			wave[i] = base[ ( ( index >> WAVE_SH ) + modulation[i] ) & mask ];
+		}
+	} else {
+		for ( Bitu i = 0; i < samples; i++ ) {
+			index += add;
+			wave[i] = base[ ( index >> WAVE_SH ) & mask ];
+		}
+	}
+	waveIndex = index;
+	MulBlock( samples, wave, mul, output );
+}
+
 Operator::Operator() {
 	chanData = 0;
 	freqMul = 0;
@@ -839,6 +941,47 @@ INLINE void Channel::GeneratePercussion( Chip* chip, Bit32s* output ) {
 	}
 }
 
+template<SynthMode mode>
+void Channel::BlockSynth( Bitu samples, Bit32s* sample ) {
+	Bit16u mul[ BLOCK_SAMPLES ];
+	Bit32s next[ BLOCK_SAMPLES ];
+	Bit32s next2[ BLOCK_SAMPLES ];
+
+	//Operators only share their output, so each can run over the entire block
+	Op(1)->BlockEnvelope( samples, mul );
+	if ( mode == sm3FMFM ) {
+		Op(1)->BlockWave( samples, mul, sample, sample );
+		Op(2)->BlockEnvelope( samples, mul );
+		Op(2)->BlockWave( samples, mul, sample, sample );
+		Op(3)->BlockEnvelope( samples, mul );
+		Op(3)->BlockWave( samples, mul, sample, sample );
+	} else if ( mode == sm3AMFM ) {
+		Op(1)->BlockWave( samples, mul, 0, next );
+		Op(2)->BlockEnvelope( samples, mul );
+		Op(2)->BlockWave( samples, mul, next, next );
+		Op(3)->BlockEnvelope( samples, mul );
+		Op(3)->BlockWave( samples, mul, next, next );
+		for ( Bitu i = 0; i < samples; i++ )
+			sample[i] += next[i];
+	} else if ( mode == sm3FMAM ) {
+		Op(1)->BlockWave( samples, mul, sample, sample );
+		Op(2)->BlockEnvelope( samples, mul );
+		Op(2)->BlockWave( samples, mul, 0, next );
+		Op(3)->BlockEnvelope( samples, mul );
+		Op(3)->BlockWave( samples, mul, next, next );
+		for ( Bitu i = 0; i < samples; i++ )
+			sample[i] += next[i];
+	} else if ( mode == sm3AMAM ) {
+		Op(1)->BlockWave( samples, mul, 0, next );
+		Op(2)->BlockEnvelope( samples, mul );
+		Op(2)->BlockWave( samples, mul, next, next2 );
+		Op(3)->BlockEnvelope( samples, mul );
+		Op(3)->BlockWave( samples, mul, 0, next );
+		for ( Bitu i = 0; i < samples; i++ )
+			sample[i] += next[i] + next2[i];
+	}
+}
+
 template<SynthMode mode>
 Channel* Channel::BlockTemplate( Chip* chip, Bit32u samples, Bit32s* output ) {
 	switch( mode ) {
@@ -912,6 +1055,14 @@ Channel* Channel::BlockTemplate( Chip* chip, Bit32u samples, Bit32s* output ) {
 		Op( 4 )->Prepare( chip );
 		Op( 5 )->Prepare( chip );
 	}
+	if ( mode != sm2Percussion && mode != sm3Percussion && !chip->referenceSynth ) {
+		chip->blockChannel[ chip->blockCount ] = this;
+		chip->blockMode[ chip->blockCount ] = mode;
+		//2 operator channels are done entirely by Chip::GenerateQueued
+		chip->blockHandler[ chip->blockCount ] = ( mode > sm4Start ) ? &Channel::BlockSynth<mode> : 0;
+		chip->blockCount++;
+		return ( mode > sm4Start ) ? ( this + 2 ) : ( this + 1 );
+	}
 	for ( Bitu i = 0; i < samples; i++ ) {
 		//Early out for percussion handlers
 		if ( mode == sm2Percussion ) {
@@ -1025,6 +1176,8 @@ Chip::Chip() {
 	regBD = 0;
 	reg104 = 0;
 	opl3Active = 0;
+	referenceSynth = false;
+	blockCount = 0;
 }
 
 INLINE Bit32u Chip::ForwardNoise() {
@@ -1220,6 +1373,152 @@ Bit32u Chip::WriteAddr( Bit32u port, Bit8u val ) {
 	return 0;
 }
 
+//Operator state the block renderer keeps out of the Operator while running a block
+struct OperatorLane {
+	const Bit16u* mul;
+	const Bit16s* base;
+	Bit32u mask;
+	Bit32u add;
+	Bit32u index;
+
+	void Load( const Operator* op, const Bit16u* m ) {
+		mul = m;
+		base = op->waveBase;
+		mask = op->waveMask;
+		add = op->waveCurrent;
+		index = op->waveIndex;
+	}
+
+	//Same as Operator::GetSample with the multiplier from the block
+	INLINE Bits Sample( Bitu i, Bits modulation ) {
+		index += add;
+		return ( base[ ( ( index >> WAVE_SH ) + modulation ) & mask ] * mul[i] ) >> MUL_SH;
+	}
+};
+
+//A channel in the block renderer, for 2 operator channels the second operator
+//is done as well, for 4 operator channels only the first
+struct ChannelLane {
+	OperatorLane op[2];
+	Bit32s* output;
+	Bit32s old0, old1;
+	//Modulation and output masks that select between FM and AM
+	Bit32s modMask;
+	Bit32s outMask;
+	Bit8u shift;
+
+	template< bool twoOp >
+	INLINE void Step( Bitu i ) {
+		Bit32s mod = (Bit32u)((old0 + old1)) >> shift;
+		old0 = old1;
+		old1 = op[0].Sample( i, mod );
+		if ( twoOp ) {
+			output[i] = ( old0 & outMask ) + op[1].Sample( i, old0 & modMask );
+		} else {
+			output[i] = old0;
+		}
+	}
+};
+
+//The first operator of a channel modulates itself, so it can only be done
+//sample by sample. Running 4 channels side by side lets those dependency
+//chains overlap, 4 operator channels finish the other operators block by block.
+template< bool twoOp >
+static void GenerateLanes( Channel* const* channels, const SynthMode* modes, Bitu count, Bitu samples, Bit32s (*sample)[ BLOCK_SAMPLES ] ) {
+	Bit16u mul[ 4 ][ 2 ][ BLOCK_SAMPLES ];
+	for ( Bitu c = 0; c < count; c += 4 ) {
+		Bitu lanes = count - c > 4 ? 4 : count - c;
+		ChannelLane lane[ 4 ];
+		for ( Bitu l = 0; l < lanes; l++ ) {
+			Channel* ch = channels[ c + l ];
+			ch->Op( 0 )->BlockEnvelope( samples, mul[ l ][ 0 ] );
+			lane[ l ].op[0].Load( ch->Op( 0 ), mul[ l ][ 0 ] );
+			if ( twoOp ) {
+				ch->Op( 1 )->BlockEnvelope( samples, mul[ l ][ 1 ] );
+				lane[ l ].op[1].Load( ch->Op( 1 ), mul[ l ][ 1 ] );
+			}
+			lane[ l ].modMask = ( modes[ c + l ] == sm2AM || modes[ c + l ] == sm3AM ) ? 0 : -1;
+			lane[ l ].outMask = ~lane[ l ].modMask;
+			lane[ l ].output = sample[ c + l ];
+			lane[ l ].old0 = ch->old[0];
+			lane[ l ].old1 = ch->old[1];
+			lane[ l ].shift = ch->feedback;
+		}
+		if ( lanes == 4 ) {
+			for ( Bitu i = 0; i < samples; i++ ) {
+				lane[ 0 ].Step< twoOp >( i );
+				lane[ 1 ].Step< twoOp >( i );
+				lane[ 2 ].Step< twoOp >( i );
+				lane[ 3 ].Step< twoOp >( i );
+			}
+		} else {
+			for ( Bitu l = 0; l < lanes; l++ ) {
+				for ( Bitu i = 0; i < samples; i++ )
+					lane[ l ].Step< twoOp >( i );
+			}
+		}
+		for ( Bitu l = 0; l < lanes; l++ ) {
+			Channel* ch = channels[ c + l ];
+			ch->Op( 0 )->waveIndex = lane[ l ].op[0].index;
+			if ( twoOp )
+				ch->Op( 1 )->waveIndex = lane[ l ].op[1].index;
+			ch->old[0] = lane[ l ].old0;
+			ch->old[1] = lane[ l ].old1;
+		}
+	}
+}
+
+void Chip::GenerateQueued( Bitu total, Bitu stride, Bit32s* output ) {
+	Bit32s sample[ 18 ][ BLOCK_SAMPLES ];
+	Channel* twoOp[ 18 ];
+	SynthMode twoOpMode[ 18 ];
+	Channel* fourOp[ 18 ];
+	Bitu twoOpCount = 0, fourOpCount = 0;
+
+	//2 operator channels first, then the 4 operator ones
+	for ( Bitu c = 0; c < blockCount; c++ ) {
+		if ( !blockHandler[ c ] ) {
+			twoOpMode[ twoOpCount ] = blockMode[ c ];
+			twoOp[ twoOpCount++ ] = blockChannel[ c ];
+		}
+	}
+	for ( Bitu c = 0; c < blockCount; c++ ) {
+		if ( blockHandler[ c ] ) {
+			blockHandler[ fourOpCount ] = blockHandler[ c ];
+			blockMode[ fourOpCount ] = blockMode[ c ];
+			fourOp[ fourOpCount++ ] = blockChannel[ c ];
+		}
+	}
+
+	while ( total > 0 ) {
+		Bitu samples = total > BLOCK_SAMPLES ? BLOCK_SAMPLES : total;
+		GenerateLanes< true >( twoOp, twoOpMode, twoOpCount, samples, sample );
+		GenerateLanes< false >( fourOp, blockMode, fourOpCount, samples, sample + twoOpCount );
+		for ( Bitu c = 0; c < fourOpCount; c++ )
+			(fourOp[ c ]->*(blockHandler[ c ]))( samples, sample[ twoOpCount + c ] );
+
+		//Integer sums, so mixing in a different order gives the same output
+		for ( Bitu c = 0; c < twoOpCount + fourOpCount; c++ ) {
+			const Bit32s* in = sample[ c ];
+			if ( stride == 1 ) {
+				for ( Bitu i = 0; i < samples; i++ )
+					output[i] += in[i];
+			} else {
+				const Channel* ch = c < twoOpCount ? twoOp[ c ] : fourOp[ c - twoOpCount ];
+				const Bit32s left = ch->maskLeft;
+				const Bit32s right = ch->maskRight;
+				for ( Bitu i = 0; i < samples; i++ ) {
+					output[i * 2 + 0] += in[i] & left;
+					output[i * 2 + 1] += in[i] & right;
+				}
+			}
+		}
+		total -= samples;
+		output += samples * stride;
+	}
+	blockCount = 0;
+}
+
 void Chip::GenerateBlock2( Bitu total, Bit32s* output ) {
 	while ( total > 0 ) {
 		Bit32u samples = ForwardLFO( total );
@@ -1229,6 +1528,7 @@ void Chip::GenerateBlock2( Bitu total, Bit32s* output ) {
 			count++;
 			ch = (ch->*(ch->synthHandler))( this, samples, output );
 		}
+		GenerateQueued( samples, 1, output );
 		total -= samples;
 		output += samples;
 	}
@@ -1243,6 +1543,7 @@ void Chip::GenerateBlock3( Bitu total, Bit32s* output  ) {
 			count++;
 			ch = (ch->*(ch->synthHandler))( this, samples, output );
 		}
+		GenerateQueued( samples, 2, output );
 		total -= samples;
 		output += samples * 2;
 	}
@@ -68,6 +68,7 @@ typedef Bits ( DB_FASTCALL *WaveHandler) ( Bitu i, Bitu volume );
 
 typedef Bits ( DBOPL::Operator::*VolumeHandler) ( );
 typedef Channel* ( DBOPL::Channel::*SynthHandler) ( Chip* chip, Bit32u samples, Bit32s* output );
+typedef void ( DBOPL::Channel::*BlockHandler) ( Bitu samples, Bit32s* sample );
 
 //Different synth modes that can generate blocks of data
 typedef enum {
@@ -178,6 +179,10 @@ public:
 
 	Bits GetSample( Bits modulation );
 	Bits GetWave( Bitu index, Bitu vol );
+
+	//Block versions of ForwardVolume and GetSample, modulation can be 0 for none
+	void BlockEnvelope( Bitu samples, Bit16u* mul );
+	void BlockWave( Bitu samples, const Bit16u* mul, const Bit32s* modulation, Bit32s* output );
 public:
 	Operator();
 };
@@ -215,6 +220,10 @@ struct Channel {
 	//Generate blocks of data in specific modes
 	template<SynthMode mode>
 	Channel* BlockTemplate( Chip* chip, Bit32u samples, Bit32s* output );
+	//Remaining operators of a 4 operator channel for the block renderer, one at a time
+	//sample has to contain the output of the first operator, see Chip::GenerateQueued
+	template<SynthMode mode>
+	void BlockSynth( Bitu samples, Bit32s* sample );
 	Channel();
 };
 
@@ -253,6 +262,14 @@ struct Chip {
 	Bit8u waveFormMask;
 	//0 or -1 when enabled
 	Bit8s opl3Active;
+	//Render sample by sample instead of in blocks, only used to verify the block renderer
+	bool referenceSynth;
+
+	//Channels queued by their synth handler for the block renderer
+	Channel* blockChannel[ 18 ];
+	SynthMode blockMode[ 18 ];
+	BlockHandler blockHandler[ 18 ];
+	Bitu blockCount;
 
 	//Return the maximum amount of samples before and LFO change
 	Bit32u ForwardLFO( Bit32u samples );
@@ -265,6 +282,7 @@ struct Chip {
 
 	void GenerateBlock2( Bitu samples, Bit32s* output );
 	void GenerateBlock3( Bitu samples, Bit32s* output );
+	void GenerateQueued( Bitu samples, Bitu stride, Bit32s* output );
 
 	void Generate( Bit32u samples );
 	void Setup( Bit32u r );
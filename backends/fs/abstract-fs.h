@@ -173,6 +173,16 @@ public:
 	 */
 	virtual bool isWritable() const = 0;
 
+	/**
+	 * Retrieves the size and the time of the last modification of the file
+	 * referred by this path. The time is only meant to be compared against an
+	 * earlier result, to notice that the file changed.
+	 *
+	 * The default implementation is for backends which can't tell.
+	 *
+	 * @return bool true if both values are known, false otherwise.
+	 */
+	virtual bool getFileInfo(uint32 &size, uint32 &modificationTime) const { return false; }
 
 	/**
 	 * Creates a SeekableReadStream instance corresponding to the file
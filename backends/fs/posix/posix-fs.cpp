@@ -35,6 +35,7 @@
 #include "../../platform/libretro/libretro-common/include/retro_dirent.h"
 #include "../../platform/libretro/libretro-common/include/retro_stat.h"
 #include "../../platform/libretro/libretro-common/include/file/file_path.h"
+#include <sys/stat.h>
 #include <stdio.h>
 #include <errno.h>
 #include <fcntl.h>
@@ -157,6 +158,16 @@ AbstractFSNode *POSIXFilesystemNode::getParent() const
 	return makeNode(Common::String(start, end));
 }
 
+bool POSIXFilesystemNode::getFileInfo(uint32 &size, uint32 &modificationTime) const {
+	struct stat st;
+	if (stat(_path.c_str(), &st) != 0)
+		return false;
+
+	size = (uint32)st.st_size;
+	modificationTime = (uint32)st.st_mtime;
+	return true;
+}
+
 Common::SeekableReadStream *POSIXFilesystemNode::createReadStream() {
 	return StdioStream::makeFromPath(getPath(), false);
 }
@@ -55,6 +55,21 @@ bool WindowsFilesystemNode::isWritable() const {
 	return _access(_path.c_str(), W_OK) == 0;
 }
 
+bool WindowsFilesystemNode::getFileInfo(uint32 &size, uint32 &modificationTime) const {
+	WIN32_FILE_ATTRIBUTE_DATA data;
+	if (!GetFileAttributesEx(toUnicode(_path.c_str()), GetFileExInfoStandard, &data))
+		return false;
+
+	ULARGE_INTEGER time;
+	time.LowPart = data.ftLastWriteTime.dwLowDateTime;
+	time.HighPart = data.ftLastWriteTime.dwHighDateTime;
+
+	size = data.nFileSizeLow;
+	// FILETIME counts 100ns intervals, the seconds are only compared for equality so they may wrap
+	modificationTime = (uint32)(time.QuadPart / 10000000);
+	return true;
+}
+
 void WindowsFilesystemNode::addFile(AbstractFSList &list, ListMode mode, const char *base, bool hidden, WIN32_FIND_DATA* find_data) {
 	WindowsFilesystemNode entry;
 	char *asciiName = toAscii(find_data->cFileName);
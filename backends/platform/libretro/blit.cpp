@@ -0,0 +1,294 @@
+/* ScummVM - Graphic Adventure Engine
+ *
+ * ScummVM is the legal property of its developers, whose names
+ * are too numerous to list here. Please refer to the COPYRIGHT
+ * file distributed with this source distribution.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ */
+
+#include "blit.h"
+#include "libretro.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define RETRO_BLIT_SSE2
+#include <emmintrin.h>
+#endif
+
+#if (defined(__ARM_NEON__) || defined(__ARM_NEON)) && !defined(MSB_FIRST)
+#define RETRO_BLIT_NEON
+#include <arm_neon.h>
+#endif
+
+/*
+ * Scalar kernels. These are the reference the SIMD versions have to match
+ * bit for bit, and the remainder loop of those.
+ */
+
+static void clut8_scalar(uint16_t *out, const uint8_t *in, const uint16_t *lut, unsigned count)
+{
+   /* A gather from a 256 entry table does not map onto SSE2 or NEON, the
+    * unrolled table lookup is as fast as it gets. */
+   for(; count >= 4; count -= 4, in += 4, out += 4)
+   {
+      out[0] = lut[in[0]];
+      out[1] = lut[in[1]];
+      out[2] = lut[in[2]];
+      out[3] = lut[in[3]];
+   }
+
+   while(count--)
+      *out++ = lut[*in++];
+}
+
+static void rgb555ToRgb565_scalar(uint16_t *out, const uint16_t *in, unsigned count)
+{
+   while(count--)
+   {
+      const uint16_t val = *in++;
+      *out++ = ((val & 0x7FE0) << 1) | ((val & 0x0200) >> 4) | (val & 0x001F);
+   }
+}
+
+static void rgba8888ToRgb565_scalar(uint16_t *out, const uint32_t *in, unsigned count)
+{
+   while(count--)
+   {
+      const uint32_t val = *in++;
+      *out++ = ((val >> 16) & 0xF800) | ((val >> 13) & 0x07E0) | ((val >> 11) & 0x001F);
+   }
+}
+
+static void clut8To32_scalar(uint32_t *out, const uint8_t *in, const uint32_t *lut, unsigned count)
+{
+   for(; count >= 4; count -= 4, in += 4, out += 4)
+   {
+      out[0] = lut[in[0]];
+      out[1] = lut[in[1]];
+      out[2] = lut[in[2]];
+      out[3] = lut[in[3]];
+   }
+
+   while(count--)
+      *out++ = lut[*in++];
+}
+
+static void rgb565ToXrgb8888_scalar(uint32_t *out, const uint16_t *in, unsigned count)
+{
+   while(count--)
+   {
+      const uint32_t val = *in++;
+      *out++ = ((val & 0xF800) << 8) | ((val & 0xE000) << 3) |
+               ((val & 0x07E0) << 5) | ((val & 0x0600) >> 1) |
+               ((val & 0x001F) << 3) | ((val & 0x001C) >> 2);
+   }
+}
+
+static void rgba8888ToXrgb8888_scalar(uint32_t *out, const uint32_t *in, unsigned count)
+{
+   while(count--)
+      *out++ = *in++ >> 8;
+}
+
+static const RetroBlitKernels s_scalarKernels = {
+   "scalar",
+   clut8_scalar,
+   rgb555ToRgb565_scalar,
+   rgba8888ToRgb565_scalar,
+   clut8To32_scalar,
+   rgb565ToXrgb8888_scalar,
+   rgba8888ToXrgb8888_scalar
+};
+
+#ifdef RETRO_BLIT_SSE2
+static void rgb555ToRgb565_sse2(uint16_t *out, const uint16_t *in, unsigned count)
+{
+   const __m128i maskRG = _mm_set1_epi16(0x7FE0);
+   const __m128i maskG  = _mm_set1_epi16(0x0200);
+   const __m128i maskB  = _mm_set1_epi16(0x001F);
+
+   for(; count >= 8; count -= 8, in += 8, out += 8)
+   {
+      const __m128i val = _mm_loadu_si128((const __m128i *)in);
+      __m128i res = _mm_slli_epi16(_mm_and_si128(val, maskRG), 1);
+      res = _mm_or_si128(res, _mm_srli_epi16(_mm_and_si128(val, maskG), 4));
+      res = _mm_or_si128(res, _mm_and_si128(val, maskB));
+      _mm_storeu_si128((__m128i *)out, res);
+   }
+
+   rgb555ToRgb565_scalar(out, in, count);
+}
+
+static void rgba8888ToRgb565_sse2(uint16_t *out, const uint32_t *in, unsigned count)
+{
+   const __m128i maskR = _mm_set1_epi32(0xF800);
+   const __m128i maskG = _mm_set1_epi32(0x07E0);
+   const __m128i maskB = _mm_set1_epi32(0x001F);
+   /* SSE2 only packs with signed saturation, so bias into the signed range and back. */
+   const __m128i bias32 = _mm_set1_epi32(0x8000);
+   const __m128i bias16 = _mm_set1_epi16((short)0x8000);
+
+   for(; count >= 8; count -= 8, in += 8, out += 8)
+   {
+      __m128i lo = _mm_loadu_si128((const __m128i *)in);
+      __m128i hi = _mm_loadu_si128((const __m128i *)(in + 4));
+
+      lo = _mm_or_si128(_mm_or_si128(
+               _mm_and_si128(_mm_srli_epi32(lo, 16), maskR),
+               _mm_and_si128(_mm_srli_epi32(lo, 13), maskG)),
+               _mm_and_si128(_mm_srli_epi32(lo, 11), maskB));
+      hi = _mm_or_si128(_mm_or_si128(
+               _mm_and_si128(_mm_srli_epi32(hi, 16), maskR),
+               _mm_and_si128(_mm_srli_epi32(hi, 13), maskG)),
+               _mm_and_si128(_mm_srli_epi32(hi, 11), maskB));
+
+      const __m128i res = _mm_packs_epi32(_mm_sub_epi32(lo, bias32), _mm_sub_epi32(hi, bias32));
+      _mm_storeu_si128((__m128i *)out, _mm_xor_si128(res, bias16));
+   }
+
+   rgba8888ToRgb565_scalar(out, in, count);
+}
+
+static inline __m128i rgb565ToXrgb8888_sse2_4(__m128i val)
+{
+   const __m128i r = _mm_or_si128(_mm_slli_epi32(_mm_and_si128(val, _mm_set1_epi32(0xF800)), 8),
+                                  _mm_slli_epi32(_mm_and_si128(val, _mm_set1_epi32(0xE000)), 3));
+   const __m128i g = _mm_or_si128(_mm_slli_epi32(_mm_and_si128(val, _mm_set1_epi32(0x07E0)), 5),
+                                  _mm_srli_epi32(_mm_and_si128(val, _mm_set1_epi32(0x0600)), 1));
+   const __m128i b = _mm_or_si128(_mm_slli_epi32(_mm_and_si128(val, _mm_set1_epi32(0x001F)), 3),
+                                  _mm_srli_epi32(_mm_and_si128(val, _mm_set1_epi32(0x001C)), 2));
+   return _mm_or_si128(_mm_or_si128(r, g), b);
+}
+
+static void rgb565ToXrgb8888_sse2(uint32_t *out, const uint16_t *in, unsigned count)
+{
+   const __m128i zero = _mm_setzero_si128();
+
+   for(; count >= 8; count -= 8, in += 8, out += 8)
+   {
+      const __m128i val = _mm_loadu_si128((const __m128i *)in);
+      _mm_storeu_si128((__m128i *)out, rgb565ToXrgb8888_sse2_4(_mm_unpacklo_epi16(val, zero)));
+      _mm_storeu_si128((__m128i *)(out + 4), rgb565ToXrgb8888_sse2_4(_mm_unpackhi_epi16(val, zero)));
+   }
+
+   rgb565ToXrgb8888_scalar(out, in, count);
+}
+
+static void rgba8888ToXrgb8888_sse2(uint32_t *out, const uint32_t *in, unsigned count)
+{
+   for(; count >= 4; count -= 4, in += 4, out += 4)
+      _mm_storeu_si128((__m128i *)out, _mm_srli_epi32(_mm_loadu_si128((const __m128i *)in), 8));
+
+   rgba8888ToXrgb8888_scalar(out, in, count);
+}
+
+static const RetroBlitKernels s_sse2Kernels = {
+   "sse2",
+   clut8_scalar,
+   rgb555ToRgb565_sse2,
+   rgba8888ToRgb565_sse2,
+   clut8To32_scalar,
+   rgb565ToXrgb8888_sse2,
+   rgba8888ToXrgb8888_sse2
+};
+#endif
+
+#ifdef RETRO_BLIT_NEON
+static void rgb555ToRgb565_neon(uint16_t *out, const uint16_t *in, unsigned count)
+{
+   const uint16x8_t maskRG = vdupq_n_u16(0x7FE0);
+   const uint16x8_t maskG  = vdupq_n_u16(0x0200);
+   const uint16x8_t maskB  = vdupq_n_u16(0x001F);
+
+   for(; count >= 8; count -= 8, in += 8, out += 8)
+   {
+      const uint16x8_t val = vld1q_u16(in);
+      uint16x8_t res = vshlq_n_u16(vandq_u16(val, maskRG), 1);
+      res = vorrq_u16(res, vshrq_n_u16(vandq_u16(val, maskG), 4));
+      res = vorrq_u16(res, vandq_u16(val, maskB));
+      vst1q_u16(out, res);
+   }
+
+   rgb555ToRgb565_scalar(out, in, count);
+}
+
+static void rgba8888ToRgb565_neon(uint16_t *out, const uint32_t *in, unsigned count)
+{
+   for(; count >= 8; count -= 8, in += 8, out += 8)
+   {
+      /* Little endian RGBA8888 is stored as A, B, G, R bytes. */
+      const uint8x8x4_t val = vld4_u8((const uint8_t *)in);
+      uint16x8_t res = vshll_n_u8(val.val[3], 8);
+      res = vsriq_n_u16(res, vshll_n_u8(val.val[2], 8), 5);
+      res = vsriq_n_u16(res, vshll_n_u8(val.val[1], 8), 11);
+      vst1q_u16(out, res);
+   }
+
+   rgba8888ToRgb565_scalar(out, in, count);
+}
+
+static void rgb565ToXrgb8888_neon(uint32_t *out, const uint16_t *in, unsigned count)
+{
+   for(; count >= 8; count -= 8, in += 8, out += 8)
+   {
+      const uint16x8_t val = vld1q_u16(in);
+      uint8x8x4_t res;
+
+      /* Replicate the top bits of each component into its low bits. */
+      const uint8x8_t r = vshrn_n_u16(val, 8);
+      const uint8x8_t g = vshrn_n_u16(vshlq_n_u16(val, 5), 8);
+      const uint8x8_t b = vshrn_n_u16(vshlq_n_u16(val, 11), 8);
+      res.val[0] = vsri_n_u8(b, b, 5);
+      res.val[1] = vsri_n_u8(g, g, 6);
+      res.val[2] = vsri_n_u8(r, r, 5);
+      res.val[3] = vdup_n_u8(0);
+      vst4_u8((uint8_t *)out, res);
+   }
+
+   rgb565ToXrgb8888_scalar(out, in, count);
+}
+
+static void rgba8888ToXrgb8888_neon(uint32_t *out, const uint32_t *in, unsigned count)
+{
+   for(; count >= 4; count -= 4, in += 4, out += 4)
+      vst1q_u32(out, vshrq_n_u32(vld1q_u32(in), 8));
+
+   rgba8888ToXrgb8888_scalar(out, in, count);
+}
+
+static const RetroBlitKernels s_neonKernels = {
+   "neon",
+   clut8_scalar,
+   rgb555ToRgb565_neon,
+   rgba8888ToRgb565_neon,
+   clut8To32_scalar,
+   rgb565ToXrgb8888_neon,
+   rgba8888ToXrgb8888_neon
+};
+#endif
+
+const RetroBlitKernels *retroBlitSelect(uint64_t simdFlags)
+{
+#ifdef RETRO_BLIT_SSE2
+   if(simdFlags & RETRO_SIMD_SSE2)
+      return &s_sse2Kernels;
+#endif
+#ifdef RETRO_BLIT_NEON
+   if(simdFlags & RETRO_SIMD_NEON)
+      return &s_neonKernels;
+#endif
+   return &s_scalarKernels;
+}
@@ -0,0 +1,61 @@
+/* ScummVM - Graphic Adventure Engine
+ *
+ * ScummVM is the legal property of its developers, whose names
+ * are too numerous to list here. Please refer to the COPYRIGHT
+ * file distributed with this source distribution.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ */
+
+#ifndef BACKENDS_LIBRETRO_BLIT_H
+#define BACKENDS_LIBRETRO_BLIT_H
+
+#include <stdint.h>
+
+/**
+ * Row conversion kernels used to build the frame handed to the frontend.
+ * All of them convert @p count pixels from @p in to @p out.
+ */
+struct RetroBlitKernels
+{
+   const char *name;
+
+   /** Paletted source, expanded through a 256 entry table already in the output format. */
+   void (*clut8)(uint16_t *out, const uint8_t *in, const uint16_t *lut, unsigned count);
+
+   /** XRGB1555 source (RGB555 with the unused bit on top) to RGB565. */
+   void (*rgb555ToRgb565)(uint16_t *out, const uint16_t *in, unsigned count);
+
+   /** RGBA8888 source to RGB565. */
+   void (*rgba8888ToRgb565)(uint16_t *out, const uint32_t *in, unsigned count);
+
+   /** Paletted source, expanded through a 256 entry table in XRGB8888. */
+   void (*clut8To32)(uint32_t *out, const uint8_t *in, const uint32_t *lut, unsigned count);
+
+   /** RGB565 source to XRGB8888. */
+   void (*rgb565ToXrgb8888)(uint32_t *out, const uint16_t *in, unsigned count);
+
+   /** RGBA8888 source to XRGB8888. */
+   void (*rgba8888ToXrgb8888)(uint32_t *out, const uint32_t *in, unsigned count);
+};
+
+/**
+ * Returns the fastest kernels available for the given RETRO_SIMD_* mask.
+ * Passing 0 selects the portable scalar kernels.
+ */
+const RetroBlitKernels *retroBlitSelect(uint64_t simdFlags);
+
+#endif
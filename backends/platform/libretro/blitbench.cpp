@@ -0,0 +1,145 @@
+/* ScummVM - Graphic Adventure Engine
+ *
+ * ScummVM is the legal property of its developers, whose names
+ * are too numerous to list here. Please refer to the COPYRIGHT
+ * file distributed with this source distribution.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ */
+
+/*
+ * Micro-benchmark for the libretro blitters: times the scalar kernels
+ * against the SIMD ones compiled in, and checks they produce the same
+ * output. Build it with "make blitbench" from the build directory.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+#include "blit.h"
+#include "libretro.h"
+
+static const int kFrames = 200;
+
+static const struct {
+   int w, h;
+} s_sizes[] = {
+   { 320, 200 },
+   { 640, 480 },
+   { 800, 600 }
+};
+
+static double now()
+{
+   struct timeval t;
+   gettimeofday(&t, 0);
+   return t.tv_sec + t.tv_usec / 1000000.0;
+}
+
+enum Kernel {
+   kKernelCLUT8,
+   kKernelRGB555,
+   kKernelRGBA8888,
+   kKernelCLUT8To32,
+   kKernelRGB565To32,
+   kKernelRGBA8888To32
+};
+
+static double run(const RetroBlitKernels *k, Kernel kernel, int w, int h, const void *src, void *dst, const uint32_t *lut)
+{
+   const double start = now();
+
+   for(int frame = 0; frame < kFrames; frame++)
+   {
+      for(int y = 0; y < h; y++)
+      {
+         switch(kernel)
+         {
+            case kKernelCLUT8:
+               k->clut8((uint16_t *)dst + y * w, (const uint8_t *)src + y * w, (const uint16_t *)lut, w);
+               break;
+            case kKernelRGB555:
+               k->rgb555ToRgb565((uint16_t *)dst + y * w, (const uint16_t *)src + y * w, w);
+               break;
+            case kKernelRGBA8888:
+               k->rgba8888ToRgb565((uint16_t *)dst + y * w, (const uint32_t *)src + y * w, w);
+               break;
+            case kKernelCLUT8To32:
+               k->clut8To32((uint32_t *)dst + y * w, (const uint8_t *)src + y * w, lut, w);
+               break;
+            case kKernelRGB565To32:
+               k->rgb565ToXrgb8888((uint32_t *)dst + y * w, (const uint16_t *)src + y * w, w);
+               break;
+            case kKernelRGBA8888To32:
+               k->rgba8888ToXrgb8888((uint32_t *)dst + y * w, (const uint32_t *)src + y * w, w);
+               break;
+         }
+      }
+   }
+
+   return (now() - start) * 1000.0 / kFrames;
+}
+
+int main(int argc, char **argv)
+{
+   static const char *const kernelNames[] = { "clut8", "rgb555", "rgba8888", "clut8/32", "rgb565/32", "rgba8888/32" };
+
+   const RetroBlitKernels *scalar = retroBlitSelect(0);
+   const RetroBlitKernels *simd = retroBlitSelect(~(uint64_t)0);
+   bool ok = true;
+
+   uint32_t lut[256];
+   for(int i = 0; i < 256; i++)
+      lut[i] = ((uint32_t)rand() << 16) ^ (uint32_t)rand();
+
+   printf("%-11s %-9s %12s %12s %8s\n", "kernel", "size", scalar->name, simd->name, "speedup");
+
+   for(unsigned s = 0; s < sizeof(s_sizes) / sizeof(s_sizes[0]); s++)
+   {
+      const int w = s_sizes[s].w;
+      const int h = s_sizes[s].h;
+
+      uint32_t *src = (uint32_t *)malloc(w * h * 4);
+      uint32_t *ref = (uint32_t *)malloc(w * h * 4);
+      uint32_t *dst = (uint32_t *)malloc(w * h * 4);
+      for(int i = 0; i < w * h; i++)
+         src[i] = ((uint32_t)rand() << 16) ^ (uint32_t)rand();
+
+      for(int kernel = kKernelCLUT8; kernel <= kKernelRGBA8888To32; kernel++)
+      {
+         const double scalarTime = run(scalar, (Kernel)kernel, w, h, src, ref, lut);
+         const double simdTime = run(simd, (Kernel)kernel, w, h, src, dst, lut);
+
+         char size[16];
+         snprintf(size, sizeof(size), "%dx%d", w, h);
+         printf("%-11s %-9s %9.3f ms %9.3f ms %7.2fx\n", kernelNames[kernel], size, scalarTime, simdTime, scalarTime / simdTime);
+
+         if(memcmp(ref, dst, w * h * (kernel >= kKernelCLUT8To32 ? 4 : 2)))
+         {
+            printf("  MISMATCH between %s and %s output\n", scalar->name, simd->name);
+            ok = false;
+         }
+      }
+
+      free(src);
+      free(ref);
+      free(dst);
+   }
+
+   return ok ? 0 : 1;
+}
@@ -4,8 +4,10 @@
 #include "common/scummsys.h"
 #include "graphics/surface.libretro.h"
 #include "audio/mixer_intern.h"
+#include "common/memstream.h"
 #include "os.h"
 #include <libco.h>
+#include <retro_miscellaneous.h>
 #include "libretro.h"
 #include <unistd.h>
 /**
@@ -15,6 +17,10 @@
 #include <libgen.h>
 #include <string.h>
 
+#if defined(RETRO_HAVE_THREADS) && !defined(_WIN32)
+#include <pthread.h>
+#endif
+
 /**
  * Include base/internal_version.h to allow access to SCUMMVM_VERSION.
  * @see retro_get_system_info()
@@ -28,6 +34,7 @@ static retro_audio_sample_batch_t audio_batch_cb = NULL;
 static retro_environment_t environ_cb = NULL;
 static retro_input_poll_t poll_cb = NULL;
 static retro_input_state_t input_cb = NULL;
+static bool canDupe = false;
 
 void retro_set_video_refresh(retro_video_refresh_t cb) { video_cb = cb; }
 void retro_set_audio_sample(retro_audio_sample_t cb) { }
@@ -40,14 +47,106 @@ void retro_set_environment(retro_environment_t cb)
    environ_cb = cb;
    bool tmp = true;
    environ_cb(RETRO_ENVIRONMENT_SET_SUPPORT_NO_GAME, &tmp);
+
+   static const struct retro_variable vars[] = {
+      { "scummvm_deterministic", "Deterministic timing for run-ahead and netplay (restart); disabled|enabled" },
+      { "scummvm_savestate_size", "Savestate buffer size; auto|1MB|2MB|4MB|8MB|16MB|32MB" },
+      { "scummvm_video_format", "Video output format (restart); RGB565|XRGB8888" },
+      { "scummvm_audio_rate", "Audio output rate (restart); 44100|48000|32000|22050" },
+      { "scummvm_resampler", "Audio resampling quality (restart); linear|medium|high" },
+#ifdef RETRO_HAVE_THREADS
+      { "scummvm_audio_callback", "Mix audio on the frontend audio thread (restart); disabled|enabled" },
+      { "scummvm_threaded", "Run the engine on its own thread (restart); disabled|enabled" },
+#endif
+      { NULL, NULL },
+   };
+   environ_cb(RETRO_ENVIRONMENT_SET_VARIABLES, (void*)vars);
+}
+
+/* Fixed savestate size reported to the frontend, 0 to report the exact size. */
+static size_t stateSizeBound = 0;
+static bool wantXRGB8888 = false;
+static bool wantAudioCallback = false;
+static bool wantThreaded = false;
+static bool deterministic = false;
+
+static const double frameRate = 60.0;
+static unsigned audioSampleRate = 44100;
+/* 0 for the linear converters, 1 and 2 for the medium and high quality sinc filters. */
+static unsigned resamplerQuality = 0;
+/* Fraction of a sample frame carried over between retro_run calls. */
+static double audioFrameFraction = 0.0;
+/* Set by the frontend while it pulls audio through retro_audio_cb. */
+static volatile bool audioCallbackActive = false;
+
+static void retro_check_variables(void)
+{
+   struct retro_variable var;
+
+   var.key = "scummvm_deterministic";
+   var.value = NULL;
+   deterministic = (environ_cb(RETRO_ENVIRONMENT_GET_VARIABLE, &var) && var.value && strcmp(var.value, "enabled") == 0);
+
+   var.key = "scummvm_savestate_size";
+   var.value = NULL;
+   stateSizeBound = 0;
+   if (environ_cb(RETRO_ENVIRONMENT_GET_VARIABLE, &var) && var.value && strcmp(var.value, "auto") != 0)
+      stateSizeBound = (size_t)atoi(var.value) * 1024 * 1024;
+
+   var.key = "scummvm_video_format";
+   var.value = NULL;
+   wantXRGB8888 = (environ_cb(RETRO_ENVIRONMENT_GET_VARIABLE, &var) && var.value && strcmp(var.value, "XRGB8888") == 0);
+
+   var.key = "scummvm_audio_rate";
+   var.value = NULL;
+   audioSampleRate = 44100;
+   if (environ_cb(RETRO_ENVIRONMENT_GET_VARIABLE, &var) && var.value && atoi(var.value) > 0)
+      audioSampleRate = atoi(var.value);
+
+   var.key = "scummvm_resampler";
+   var.value = NULL;
+   resamplerQuality = 0;
+   if (environ_cb(RETRO_ENVIRONMENT_GET_VARIABLE, &var) && var.value)
+   {
+      if (strcmp(var.value, "medium") == 0)
+         resamplerQuality = 1;
+      else if (strcmp(var.value, "high") == 0)
+         resamplerQuality = 2;
+   }
+
+   var.key = "scummvm_audio_callback";
+   var.value = NULL;
+   wantAudioCallback = (environ_cb(RETRO_ENVIRONMENT_GET_VARIABLE, &var) && var.value && strcmp(var.value, "enabled") == 0);
+
+   var.key = "scummvm_threaded";
+   var.value = NULL;
+   wantThreaded = (environ_cb(RETRO_ENVIRONMENT_GET_VARIABLE, &var) && var.value && strcmp(var.value, "enabled") == 0);
+
+   /* Anything running beside the frontend thread would make timing depend on the host */
+   if (deterministic)
+   {
+      wantAudioCallback = false;
+      wantThreaded = false;
+   }
 }
 
 bool FRONTENDwantsExit;
-bool EMULATORexited;
+volatile uint32 EMULATORexited;
 
 cothread_t mainThread;
 cothread_t emuThread;
 
+/* Set when the engine runs on an OS thread instead of the emuThread coroutine. */
+static bool threaded = false;
+static bool shutdownRequested = false;
+#ifdef RETRO_HAVE_THREADS
+#ifdef _WIN32
+static HANDLE engineThread;
+#else
+static pthread_t engineThread;
+#endif
+#endif
+
 static char cmd_params[20][200];
 static char cmd_params_num;
 
@@ -56,16 +155,31 @@ void retro_leave_thread(void)
    co_switch(mainThread);
 }
 
+void retro_enter_thread(void)
+{
+   co_switch(emuThread);
+}
+
+bool retro_emulator_exited(void)
+{
+   return Common::atomicLoad(&EMULATORexited) != 0;
+}
+
+static bool retro_emulator_started(void)
+{
+   return threaded || emuThread;
+}
+
 static void retro_start_emulator(void)
 {
-   g_system = retroBuildOS();
+   Common::atomicStore(&g_system, retroBuildOS());
 
    static const char* argv[20];
    for(int i=0; i<cmd_params_num; i++)
       argv[i] = cmd_params[i];
 
    scummvm_main(cmd_params_num, argv);
-   EMULATORexited = true;
+   Common::atomicStore(&EMULATORexited, 1u);
 
    if (log_cb)
       log_cb(RETRO_LOG_INFO, "Emulator loop has ended.\n");
@@ -92,6 +206,38 @@ static void retro_wrap_emulator()
    }
 }
 
+#ifdef RETRO_HAVE_THREADS
+#ifdef _WIN32
+static DWORD WINAPI retro_thread_emulator(LPVOID)
+#else
+static void *retro_thread_emulator(void *)
+#endif
+{
+   retro_start_emulator();
+   return 0;
+}
+
+static bool retro_create_engine_thread(void)
+{
+#ifdef _WIN32
+   engineThread = CreateThread(NULL, 0, retro_thread_emulator, NULL, 0, NULL);
+   return engineThread != NULL;
+#else
+   return pthread_create(&engineThread, NULL, retro_thread_emulator, NULL) == 0;
+#endif
+}
+
+static void retro_join_engine_thread(void)
+{
+#ifdef _WIN32
+   WaitForSingleObject(engineThread, INFINITE);
+   CloseHandle(engineThread);
+#else
+   pthread_join(engineThread, NULL);
+#endif
+}
+#endif
+
 unsigned retro_api_version(void)
 {
    return RETRO_API_VERSION;
@@ -116,8 +262,8 @@ void retro_get_system_av_info(struct retro_system_av_info *info)
    info->geometry.max_width = RES_W;
    info->geometry.max_height = RES_H;
    info->geometry.aspect_ratio = 4.0f / 3.0f;
-   info->timing.fps = 60.0;
-   info->timing.sample_rate = 44100.0;
+   info->timing.fps = frameRate;
+   info->timing.sample_rate = audioSampleRate;
 }
 
 void retro_init (void)
@@ -128,6 +274,10 @@ void retro_init (void)
    else
       log_cb = NULL;
 
+   struct retro_perf_callback perf;
+   if (environ_cb(RETRO_ENVIRONMENT_GET_PERF_INTERFACE, &perf) && perf.get_cpu_features)
+      retroSetCpuFeatures(perf.get_cpu_features());
+
 }
 
 void retro_deinit(void)
@@ -202,6 +352,51 @@ char * dirname (char *path)
 }
 #endif
 
+static void retro_mix_audio(unsigned frames)
+{
+   Audio::MixerImpl *mixer = g_system ? (Audio::MixerImpl*)g_system->getMixer() : NULL;
+   int16_t buf[512 * 2];
+
+   while (frames)
+   {
+      const unsigned count = MIN<unsigned>(frames, 512);
+
+      /* The mixer zeroes the buffer, so silence still keeps the frontend fed */
+      if (threaded)
+      {
+         /* Already mixed on the engine thread, pad with silence if it fell behind */
+         const unsigned done = retroReadAudio(buf, count);
+         memset(buf + done * 2, 0, (count - done) * 4);
+      }
+      else if (mixer && mixer->isReady())
+         mixer->mixCallback((byte*)buf, count * 4);
+      else
+         memset(buf, 0, count * 4);
+
+      audio_batch_cb(buf, count);
+      frames -= count;
+   }
+}
+
+static void retro_audio_cb(void)
+{
+   if (EMULATORexited)
+      return;
+
+   /* About 10ms worth of audio per notification */
+   retro_mix_audio(audioSampleRate / 100);
+}
+
+static void retro_audio_set_state(bool enabled)
+{
+   audioCallbackActive = enabled;
+}
+
+static void retro_frame_time(retro_usec_t usec)
+{
+   retroSetFrameTime(usec);
+}
+
 bool retro_load_game(const struct retro_game_info *game)
 {
    const char* sysdir;
@@ -265,6 +460,34 @@ bool retro_load_game(const struct retro_game_info *game)
 
    environ_cb(RETRO_ENVIRONMENT_SET_INPUT_DESCRIPTORS, desc);
 
+   retro_check_variables();
+
+   if (!environ_cb(RETRO_ENVIRONMENT_GET_CAN_DUPE, &canDupe))
+      canDupe = false;
+
+   retroSetAudioRate(audioSampleRate);
+   retroSetResamplerQuality(resamplerQuality);
+   audioFrameFraction = 0.0;
+
+   /* The engine slice is budgeted from the time the frontend actually spends per frame */
+   struct retro_frame_time_callback frameTime = { retro_frame_time, (retro_usec_t)(1000000 / frameRate) };
+   retroSetFrameTime(frameTime.reference);
+   environ_cb(RETRO_ENVIRONMENT_SET_FRAME_TIME_CALLBACK, &frameTime);
+   retroSetDeterministic(deterministic, frameTime.reference);
+
+   /* Mixing from the frontend audio thread needs real mutexes in the backend */
+   bool haveAudioCallback = false;
+#ifdef RETRO_HAVE_THREADS
+   if (wantAudioCallback && !wantThreaded)
+   {
+      struct retro_audio_callback audio = { retro_audio_cb, retro_audio_set_state };
+      haveAudioCallback = environ_cb(RETRO_ENVIRONMENT_SET_AUDIO_CALLBACK, &audio);
+      if (!haveAudioCallback && log_cb)
+         log_cb(RETRO_LOG_WARN, "Frontend refused the audio callback, mixing in retro_run.\n");
+   }
+#endif
+   retroSetThreadSafe(haveAudioCallback || wantThreaded);
+
    /* Get color mode: 32 first as VGA has 6 bits per pixel */
 #if 0
    RDOSGFXcolorMode = RETRO_PIXEL_FORMAT_XRGB8888;
@@ -276,9 +499,20 @@ bool retro_load_game(const struct retro_game_info *game)
    }
 #endif
 
+   /* True color output avoids quantizing high color games down to 16 bits */
+   bool haveXRGB8888 = false;
+   if (wantXRGB8888)
+   {
+      enum retro_pixel_format xrgb8888 = RETRO_PIXEL_FORMAT_XRGB8888;
+      haveXRGB8888 = environ_cb(RETRO_ENVIRONMENT_SET_PIXEL_FORMAT, &xrgb8888);
+      if (!haveXRGB8888 && log_cb)
+         log_cb(RETRO_LOG_WARN, "Frontend does not support XRGB8888, falling back to 16 bit output.\n");
+   }
+   retroSetOutputXRGB8888(haveXRGB8888);
+
 #ifdef FRONTEND_SUPPORTS_RGB565
    enum retro_pixel_format rgb565 = RETRO_PIXEL_FORMAT_RGB565;
-   if (!environ_cb(RETRO_ENVIRONMENT_SET_PIXEL_FORMAT, &rgb565) && log_cb)
+   if (!haveXRGB8888 && !environ_cb(RETRO_ENVIRONMENT_SET_PIXEL_FORMAT, &rgb565) && log_cb)
       log_cb(RETRO_LOG_INFO, "Frontend supports RGB565 -will use that instead of XRGB1555.\n");
 #endif
 
@@ -303,7 +537,22 @@ bool retro_load_game(const struct retro_game_info *game)
       retroSetSaveDir(".");
    }
 
-   if(!emuThread && !mainThread)
+#ifdef RETRO_HAVE_THREADS
+   /* The engine thread hands frames and audio over to retro_run */
+   if(wantThreaded && !retro_emulator_started())
+   {
+      retroSetThreaded(true);
+      threaded = retro_create_engine_thread();
+      if(!threaded)
+      {
+         retroSetThreaded(false);
+         if (log_cb)
+            log_cb(RETRO_LOG_WARN, "Could not create the engine thread, running it as a coroutine.\n");
+      }
+   }
+#endif
+
+   if(!threaded && !emuThread && !mainThread)
    {
       mainThread = co_active();
       emuThread = co_create(65536*sizeof(void*), retro_wrap_emulator);
@@ -317,48 +566,158 @@ bool retro_load_game_special(unsigned game_type, const struct retro_game_info *i
    return false;
 }
 
+/* Snapshot taken by retro_serialize_size, reused by retro_serialize until the next frame. */
+static Common::MemoryWriteStreamDynamic *stateBuffer = NULL;
+static bool stateBufferValid = false;
+
+static bool retro_capture_state(void)
+{
+   if(stateBufferValid)
+      return true;
+
+   if(!retro_emulator_started() || !Common::atomicLoad(&g_system) || retro_emulator_exited())
+      return false;
+
+   delete stateBuffer;
+   stateBuffer = new Common::MemoryWriteStreamDynamic(DisposeAfterUse::YES);
+   stateBufferValid = retroSaveState(*stateBuffer);
+   return stateBufferValid;
+}
+
 void retro_run (void)
 {
-   if(!emuThread)
+   if(!retro_emulator_started())
       return;
 
+   stateBufferValid = false;
+
    /* Mouse */
-   if(g_system)
+   if(Common::atomicLoad(&g_system))
    {
       poll_cb();
       retroProcessMouse(input_cb);
    }
 
-   /* Run emu */
-   co_switch(emuThread);
+   /* Run emu, or just collect what the engine thread finished since the last frame */
+   if(!threaded)
+   {
+      co_switch(emuThread);
 
-   if(g_system)
+      if(deterministic && g_system && !EMULATORexited)
+         retroAdvanceClock();
+   }
+   else if(retro_emulator_exited() && !FRONTENDwantsExit && !shutdownRequested)
    {
-      /* Upload video: TODO: Check the CANDUPE env value */
+      shutdownRequested = true;
+      environ_cb(RETRO_ENVIRONMENT_SHUTDOWN, 0);
+   }
+
+   if(Common::atomicLoad(&g_system))
+   {
+      /* Upload video, or let the frontend repeat the last frame if nothing changed */
       const Graphics::Surface& screen = getScreen();
-      video_cb(screen.pixels, screen.w, screen.h, screen.pitch);
+      if (!screen.pixels)
+      {
+         if (canDupe)
+            video_cb(NULL, RES_W, RES_H, 0);
+      }
+      else if (retroScreenChanged() || !canDupe)
+         video_cb(screen.pixels, screen.w, screen.h, screen.pitch);
+      else
+         video_cb(NULL, screen.w, screen.h, screen.pitch);
 
-      // Upload audio
-      static uint32 buf[735];
-      int count = ((Audio::MixerImpl*)g_system->getMixer())->mixCallback((byte*)buf, 735*4);
-      audio_batch_cb((int16_t*)buf, count);
+      /* Upload audio, exactly sample_rate / fps frames per frame on average */
+      if (!audioCallbackActive)
+      {
+         audioFrameFraction += audioSampleRate / frameRate;
+         const unsigned frames = (unsigned)audioFrameFraction;
+         audioFrameFraction -= frames;
+         retro_mix_audio(frames);
+      }
    }
 }
 
 void retro_unload_game (void)
 {
-   if(!emuThread)
+   if(!retro_emulator_started())
       return;
 
+   if(!threaded && g_system && log_cb)
+   {
+      RetroSchedulerStats stats;
+      retroGetSchedulerStats(&stats);
+      log_cb(RETRO_LOG_INFO, "Engine ran %u slices for %u ms: %u frame, %u slice and %u delay yields.\n",
+             stats.slices, stats.engineMillis, stats.yields[kRetroYieldFrame], stats.yields[kRetroYieldSlice], stats.yields[kRetroYieldDelay]);
+   }
+
    FRONTENDwantsExit = true;
-   while(!EMULATORexited)
+
+#ifdef RETRO_HAVE_THREADS
+   if(threaded)
    {
-      retroPostQuit();
-      co_switch(emuThread);
+      while(!retro_emulator_exited())
+      {
+         if(Common::atomicLoad(&g_system))
+            retroPostQuit();
+         retro_sleep(10);
+      }
+
+      retro_join_engine_thread();
+      retroSetThreaded(false);
+      threaded = false;
    }
+   else
+#endif
+   {
+      while(!EMULATORexited)
+      {
+         retroPostQuit();
+         co_switch(emuThread);
+      }
+
+      co_delete(emuThread);
+      emuThread = 0;
+   }
+
+   delete stateBuffer;
+   stateBuffer = NULL;
+   stateBufferValid = false;
+}
+
+size_t retro_serialize_size (void)
+{
+   if(stateSizeBound)
+      return stateSizeBound;
+
+   if(!retro_capture_state())
+      return 0;
+
+   return stateBuffer->size();
+}
+
+bool retro_serialize(void *data, size_t size)
+{
+   if(!retro_capture_state() || stateBuffer->size() > size)
+   {
+      if (log_cb && stateBufferValid)
+         log_cb(RETRO_LOG_WARN, "Savestate needs %u bytes, only %u available.\n", (unsigned)stateBuffer->size(), (unsigned)size);
+      return false;
+   }
+
+   memcpy(data, stateBuffer->getData(), stateBuffer->size());
+   memset((byte*)data + stateBuffer->size(), 0, size - stateBuffer->size());
+   return true;
+}
+
+bool retro_unserialize(const void * data, size_t size)
+{
+   if(!retro_emulator_started() || !Common::atomicLoad(&g_system) || retro_emulator_exited())
+      return false;
+
+   stateBufferValid = false;
 
-   co_delete(emuThread);
-   emuThread = 0;
+   Common::MemoryReadStream in((const byte*)data, size);
+   return retroLoadState(in);
 }
 
 // Stubs
@@ -366,9 +725,6 @@ void retro_set_controller_port_device(unsigned in_port, unsigned device) { }
 void *retro_get_memory_data(unsigned type) { return 0; }
 size_t retro_get_memory_size(unsigned type) { return 0; }
 void retro_reset (void) { }
-size_t retro_serialize_size (void) { return 0; }
-bool retro_serialize(void *data, size_t size) { return false; }
-bool retro_unserialize(const void * data, size_t size) { return false; }
 void retro_cheat_reset(void) { }
 void retro_cheat_set(unsigned unused, bool unused1, const char* unused2) { }
 
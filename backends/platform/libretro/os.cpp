@@ -32,7 +32,12 @@
 #include "graphics/surface.libretro.h"
 #include "backends/base-backend.h"
 #include "common/events.h"
+#include "common/algorithm.h"
+#include "common/memstream.h"
+#include "common/mutex.h"
+#include "common/random.h"
 #include "audio/mixer_intern.h"
+#include "engines/engine.h"
 
 #if defined(_WIN32)
 #include "backends/fs/windows/windows-fs-factory.h"
@@ -62,9 +67,17 @@
 #endif
 
 #include "libretro.h"
+#include "blit.h"
+#include "os.h"
+
+#if defined(RETRO_HAVE_THREADS) && !defined(_WIN32)
+#include <pthread.h>
+#endif
 
 extern retro_log_printf_t log_cb;
 
+static const RetroBlitKernels *s_blitKernels = retroBlitSelect(0);
+
 struct RetroPalette
 {
    unsigned char _colors[256 * 3];
@@ -90,149 +103,74 @@ struct RetroPalette
    }
 };
 
-static INLINE void blit_uint8_uint16_fast(Graphics::Surface& aOut, const Graphics::Surface& aIn, const RetroPalette& aColors)
+template<typename TIn, typename TOut>
+static INLINE void blit_rect(Graphics::Surface& aOut, const Graphics::Surface& aIn, const Common::Rect& aRect)
 {
-   for(int i = 0; i < aIn.h; i ++)
+   for(int i = aRect.top; i < aRect.bottom; i ++)
    {
-      if(i >= aOut.h)
-         continue;
+      const TIn* const in = (const TIn*)aIn.getBasePtr(0, i);
+      TOut* const out = (TOut*)aOut.getBasePtr(0, i);
 
-      uint8_t * const in  = (uint8_t*)aIn.pixels + (i * aIn.w);
-      uint16_t* const out = (uint16_t*)aOut.pixels + (i * aOut.w);
-
-      for(int j = 0; j < aIn.w; j ++)
+      for(int j = aRect.left; j < aRect.right; j ++)
       {
-         if (j >= aOut.w)
-            continue;
-
          uint8 r, g, b;
 
-         const uint8_t val = in[j];
-         if(val != 0xFFFFFFFF)
-         {
-            if(aIn.format.bytesPerPixel == 1)
-            {
-               unsigned char *col = aColors.getColor(val);
-               r = *col++;
-               g = *col++;
-               b = *col++;
-            }
-            else
-               aIn.format.colorToRGB(in[j], r, g, b);
-
-            out[j] = aOut.format.RGBToColor(r, g, b);
-         }
+         aIn.format.colorToRGB(in[j], r, g, b);
+         out[j] = aOut.format.RGBToColor(r, g, b);
       }
    }
 }
 
-static INLINE void blit_uint32_uint16(Graphics::Surface& aOut, const Graphics::Surface& aIn, const RetroPalette& aColors)
+/* Converts a cursor image to a sprite in the output format, along with a mask of its opaque pixels. */
+template<typename TIn, typename TOut>
+static void convert_cursor(Graphics::Surface& aOut, byte *aMask, const Graphics::Surface& aIn, const RetroPalette& aColors, uint32 aKeyColor)
 {
    for(int i = 0; i < aIn.h; i ++)
    {
-      if(i >= aOut.h)
-         continue;
-
-      uint32_t* const in = (uint32_t*)aIn.pixels + (i * aIn.w);
-      uint16_t* const out = (uint16_t*)aOut.pixels + (i * aOut.w);
+      const TIn* const in = (const TIn*)aIn.getBasePtr(0, i);
+      TOut* const out = (TOut*)aOut.getBasePtr(0, i);
+      byte* const mask = aMask + i * aIn.w;
 
       for(int j = 0; j < aIn.w; j ++)
       {
-         if(j >= aOut.w)
-            continue;
-
          uint8 r, g, b;
 
-         const uint32_t val = in[j];
-         if(val != 0xFFFFFFFF)
+         mask[j] = (in[j] != aKeyColor);
+         if(!mask[j])
          {
-            aIn.format.colorToRGB(in[j], r, g, b);
-            out[j] = aOut.format.RGBToColor(r, g, b);
-         }
-      }
-   }
-}
-
-static INLINE void blit_uint16_uint16(Graphics::Surface& aOut, const Graphics::Surface& aIn, const RetroPalette& aColors)
-{
-   for(int i = 0; i < aIn.h; i ++)
-   {
-      if(i >= aOut.h)
-         continue;
-
-      uint16_t* const in = (uint16_t*)aIn.pixels + (i * aIn.w);
-      uint16_t* const out = (uint16_t*)aOut.pixels + (i * aOut.w);
-
-      for(int j = 0; j < aIn.w; j ++)
-      {
-         if(j >= aOut.w)
+            out[j] = 0;
             continue;
-
-         uint8 r, g, b;
-
-         const uint16_t val = in[j];
-         if(val != 0xFFFFFFFF)
-         {
-            aIn.format.colorToRGB(in[j], r, g, b);
-            out[j] = aOut.format.RGBToColor(r, g, b);
          }
-      }
-   }
-}
-
-static void blit_uint8_uint16(Graphics::Surface& aOut, const Graphics::Surface& aIn, int aX, int aY, const RetroPalette& aColors, uint32 aKeyColor)
-{
-   for(int i = 0; i < aIn.h; i ++)
-   {
-      if((i + aY) < 0 || (i + aY) >= aOut.h)
-         continue;
-
-      uint8_t* const in = (uint8_t*)aIn.pixels + (i * aIn.w);
-      uint16_t* const out = (uint16_t*)aOut.pixels + ((i + aY) * aOut.w);
 
-      for(int j = 0; j < aIn.w; j ++)
-      {
-         if((j + aX) < 0 || (j + aX) >= aOut.w)
-            continue;
-
-         uint8 r, g, b;
-
-         const uint8_t val = in[j];
-         if(val != aKeyColor)
+         if(sizeof(TIn) == 1)
          {
-            unsigned char *col = aColors.getColor(val);
-            r = *col++;
-            g = *col++;
-            b = *col++;
-            out[j + aX] = aOut.format.RGBToColor(r, g, b);
+            const unsigned char *col = aColors.getColor(in[j]);
+            r = col[0];
+            g = col[1];
+            b = col[2];
          }
+         else
+            aIn.format.colorToRGB(in[j], r, g, b);
+
+         out[j] = aOut.format.RGBToColor(r, g, b);
       }
    }
 }
 
-static void blit_uint16_uint16(Graphics::Surface& aOut, const Graphics::Surface& aIn, int aX, int aY, const RetroPalette& aColors, uint32 aKeyColor)
+/* Draws the part of a sprite at aX, aY that falls within aClip. */
+template<typename T>
+static void blit_sprite(Graphics::Surface& aOut, const Graphics::Surface& aSprite, const byte *aMask, int aX, int aY, const Common::Rect& aClip)
 {
-   for(int i = 0; i < aIn.h; i ++)
+   for(int i = aClip.top; i < aClip.bottom; i ++)
    {
-      if((i + aY) < 0 || (i + aY) >= aOut.h)
-         continue;
+      const T* const in = (const T*)aSprite.getBasePtr(0, i - aY) - aX;
+      const byte* const mask = aMask + (i - aY) * aSprite.w - aX;
+      T* const out = (T*)aOut.getBasePtr(0, i);
 
-      uint16_t* const in = (uint16_t*)aIn.pixels + (i * aIn.w);
-      uint16_t* const out = (uint16_t*)aOut.pixels + ((i + aY) * aOut.w);
-
-      for(int j = 0; j < aIn.w; j ++)
+      for(int j = aClip.left; j < aClip.right; j ++)
       {
-         if((j + aX) < 0 || (j + aX) >= aOut.w)
-            continue;
-
-         uint8 r, g, b;
-
-         const uint16_t val = in[j];
-         if(val != aKeyColor)
-         {
-            aIn.format.colorToRGB(in[j], r, g, b);
-            out[j + aX] = aOut.format.RGBToColor(r, g, b);
-         }
+         if(mask[j])
+            out[j] = in[j];
       }
    }
 }
@@ -251,6 +189,27 @@ static INLINE void copyRectToSurface(uint8_t *pixels, int out_pitch, const uint8
 
 static Common::String s_systemDir;
 static Common::String s_saveDir;
+static bool s_outputXRGB8888 = false;
+static unsigned s_audioRate = 44100;
+static Audio::RateConverterQuality s_resamplerQuality = Audio::kRateQualityLow;
+static bool s_threadSafe = false;
+static bool s_threaded = false;
+/* Engine time allowed per retro_run in coroutine mode, from the frontend frame time. */
+static uint32 s_sliceBudget = 12;
+/* Deterministic mode: the clock only moves with frames and engine delays. */
+static bool s_deterministic = false;
+static uint32 s_frameMicros = 16667;
+
+static Graphics::PixelFormat retroOutputFormat()
+{
+   if(s_outputXRGB8888)
+      return Graphics::PixelFormat(4, 8, 8, 8, 0, 16, 8, 0, 0);
+#ifdef FRONTEND_SUPPORTS_RGB565
+   return Graphics::PixelFormat(2, 5, 6, 5, 0, 11, 5, 0, 0);
+#else
+   return Graphics::PixelFormat(2, 5, 5, 5, 1, 10, 5, 0, 15);
+#endif
+}
 
 #ifdef FRONTEND_SUPPORTS_RGB565
 #define SURF_BPP 2
@@ -282,14 +241,297 @@ static Common::String s_saveDir;
 #define SURF_ASHIFT 15
 #endif
 
-std::list<Common::Event> _events;
+/**
+ * Non-owning WriteStream forwarder, so that a state capture buffer outlives
+ * the OutSaveFile the engine deletes once it is done saving.
+ */
+class RetroStateWriteStream : public Common::WriteStream {
+   Common::MemoryWriteStreamDynamic &_stream;
+
+   public:
+      RetroStateWriteStream(Common::MemoryWriteStreamDynamic &stream) : _stream(stream) { }
+
+      virtual uint32 write(const void *dataPtr, uint32 dataSize) { return _stream.write(dataPtr, dataSize); }
+      virtual int32 pos() const { return _stream.pos(); }
+};
+
+/**
+ * Read stream over a copy of a restored state file, which tells its
+ * savefile manager when the engine is done with it.
+ */
+class RetroStateReadStream : public Common::MemoryReadStream {
+   uint32 &_openCount;
+
+   static byte *copyData(Common::MemoryWriteStreamDynamic &stream)
+   {
+      byte *data = (byte *)malloc(MAX<uint32>(stream.size(), 1));
+      memcpy(data, stream.getData(), stream.size());
+      return data;
+   }
+
+   public:
+      RetroStateReadStream(Common::MemoryWriteStreamDynamic &stream, uint32 &openCount) :
+         Common::MemoryReadStream(copyData(stream), stream.size(), DisposeAfterUse::YES), _openCount(openCount)
+      {
+         _openCount++;
+      }
+
+      virtual ~RetroStateReadStream() { _openCount--; }
+};
+
+/**
+ * Savefile manager used by the libretro frontend savestates.
+ *
+ * While a state capture is active, every file the engine saves is kept in
+ * memory instead of the save directory. While a state restore is active,
+ * files present in the restored state shadow the ones on disk.
+ */
+class RetroSaveFileManager : public DefaultSaveFileManager {
+   public:
+      typedef Common::HashMap<Common::String, Common::MemoryWriteStreamDynamic *, Common::IgnoreCase_Hash, Common::IgnoreCase_EqualTo> StateFileMap;
+
+      RetroSaveFileManager(const Common::String &defaultSavepath) : DefaultSaveFileManager(defaultSavepath), _capturing(false), _stateFilesRead(false), _openStateFiles(0) { }
+
+      virtual ~RetroSaveFileManager()
+      {
+         clearStateFiles();
+      }
+
+      virtual Common::OutSaveFile *openForSaving(const Common::String &filename, bool compress = true)
+      {
+         if(!_capturing)
+            return DefaultSaveFileManager::openForSaving(filename, compress);
+
+         // Compression is skipped on purpose: states need to be fast, not small.
+         Common::MemoryWriteStreamDynamic *stream = new Common::MemoryWriteStreamDynamic(DisposeAfterUse::YES);
+         StateFileMap::iterator i = _stateFiles.find(filename);
+         if(i != _stateFiles.end())
+            delete i->_value;
+         _stateFiles[filename] = stream;
+
+         return new Common::OutSaveFile(new RetroStateWriteStream(*stream));
+      }
+
+      virtual Common::InSaveFile *openForLoading(const Common::String &filename)
+      {
+         if(!_capturing)
+         {
+            StateFileMap::iterator i = _stateFiles.find(filename);
+            if(i != _stateFiles.end())
+            {
+               _stateFilesRead = true;
+               return new RetroStateReadStream(*i->_value, _openStateFiles);
+            }
+         }
+
+         return DefaultSaveFileManager::openForLoading(filename);
+      }
+
+      virtual Common::StringArray listSavefiles(const Common::String &pattern)
+      {
+         Common::StringArray result = DefaultSaveFileManager::listSavefiles(pattern);
+
+         for(StateFileMap::const_iterator i = _stateFiles.begin(); i != _stateFiles.end(); ++i)
+         {
+            if(i->_key.matchString(pattern, true) && Common::find(result.begin(), result.end(), i->_key) == result.end())
+               result.push_back(i->_key);
+         }
+
+         return result;
+      }
+
+      void beginCapture()
+      {
+         clearStateFiles();
+         _capturing = true;
+      }
+
+      void endCapture()
+      {
+         _capturing = false;
+      }
+
+      void clearStateFiles()
+      {
+         for(StateFileMap::iterator i = _stateFiles.begin(); i != _stateFiles.end(); ++i)
+            delete i->_value;
+         _stateFiles.clear();
+         _stateFilesRead = false;
+      }
+
+      bool hasStateFiles() const
+      {
+         return !_stateFiles.empty();
+      }
+
+      /**
+       * Whether the engine has loaded the restored files: it opened them,
+       * and closed every one of them again.
+       */
+      bool isRestoreFinished() const
+      {
+         return _stateFilesRead && !_openStateFiles;
+      }
+
+      /**
+       * Layout: magic, version, payload size, file count, then for each file
+       * its name length, name, data size and data.
+       */
+      void writeStateFiles(Common::WriteStream &out) const
+      {
+         uint32 payloadSize = 4;
+         for(StateFileMap::const_iterator i = _stateFiles.begin(); i != _stateFiles.end(); ++i)
+            payloadSize += 2 + i->_key.size() + 4 + i->_value->size();
+
+         out.writeUint32BE(kStateMagic);
+         out.writeUint32BE(kStateVersion);
+         out.writeUint32BE(payloadSize);
+         out.writeUint32BE(_stateFiles.size());
+
+         for(StateFileMap::const_iterator i = _stateFiles.begin(); i != _stateFiles.end(); ++i)
+         {
+            out.writeUint16BE(i->_key.size());
+            out.write(i->_key.c_str(), i->_key.size());
+            out.writeUint32BE(i->_value->size());
+            out.write(i->_value->getData(), i->_value->size());
+         }
+      }
+
+      bool readStateFiles(Common::SeekableReadStream &in)
+      {
+         clearStateFiles();
+
+         if(in.readUint32BE() != kStateMagic || in.readUint32BE() != kStateVersion)
+            return false;
+
+         const uint32 payloadSize = in.readUint32BE();
+         if(in.eos() || payloadSize > (uint32)(in.size() - in.pos()))
+            return false;
+
+         uint32 count = in.readUint32BE();
+         while(count--)
+         {
+            const uint16 nameSize = in.readUint16BE();
+            Common::String name;
+            for(uint16 j = 0; j < nameSize; j++)
+               name += (char)in.readByte();
+
+            const uint32 dataSize = in.readUint32BE();
+            if(in.err() || in.eos() || dataSize > (uint32)(in.size() - in.pos()))
+            {
+               clearStateFiles();
+               return false;
+            }
+
+            Common::MemoryWriteStreamDynamic *stream = new Common::MemoryWriteStreamDynamic(DisposeAfterUse::YES);
+            byte buffer[4096];
+            for(uint32 left = dataSize; left; )
+            {
+               const uint32 chunk = MIN<uint32>(left, sizeof(buffer));
+               in.read(buffer, chunk);
+               stream->write(buffer, chunk);
+               left -= chunk;
+            }
+
+            _stateFiles[name] = stream;
+         }
+
+         return true;
+      }
+
+      static const uint32 kStateMagic = MKTAG('S', 'V', 'M', 'S');
+      static const uint32 kStateVersion = 1;
+
+   private:
+      StateFileMap _stateFiles;
+      bool _capturing;
+      bool _stateFilesRead;
+      uint32 _openStateFiles;
+};
+
+/**
+ * Savestate slot used for frontend savestates. The data never reaches the
+ * save directory, so the slot number only needs to be valid for the engine.
+ */
+#define RETRO_STATE_SLOT 0
+
+/**
+ * Past this many pending dirty rectangles the whole screen is converted.
+ */
+#define RETRO_MAX_DIRTY_RECTS 32
+
+/* Finished frames handed to the frontend in threaded mode. */
+#define RETRO_FRAME_INDEX_MASK 3
+#define RETRO_FRAME_FRESH 4
+
+/* Mixed audio queued for the frontend in threaded mode, in stereo frames. */
+#define RETRO_AUDIO_RING_FRAMES 8192
+
+/* Polls allowed per frame in deterministic mode, where there is no wall clock to end a slice. */
+#define RETRO_DETERMINISTIC_POLLS 64
+
+/* Date and time at startup in deterministic mode, 2000-01-01 00:00 UTC; never the wall clock. */
+#define RETRO_DETERMINISTIC_EPOCH 946684800
+
+/* Trailer appended to savestates in deterministic mode. */
+#define RETRO_DETERMINISTIC_MAGIC MKTAG('S','V','M','D')
+
+/* How long the frontend waits for the engine thread to pick up a state op, in milliseconds. */
+#define RETRO_STATE_OP_TIMEOUT 2000
+
+/* How often the frontend resumes the engine coroutine for it to reach pollEvent() and pick up a state op. */
+#define RETRO_STATE_OP_SLICES 8
+
+enum RetroStateOp {
+   kRetroStateNone,
+   kRetroStateSave,
+   kRetroStateLoad,
+   kRetroStateBusy  // Picked up by the engine thread
+};
+
+/**
+ * How the mouse position of a queued event is filled in. Input is read on
+ * the frontend thread, but the mouse position belongs to the engine thread,
+ * so moves are queued as deltas and applied in pollEvent().
+ */
+enum RetroMouseCoords {
+   kRetroMouseNone,     // Not a mouse event
+   kRetroMouseCurrent,  // At the current position
+   kRetroMouseRelative, // mouse holds the distance moved
+   kRetroMouseAbsolute  // mouse holds a pointer position, -0x7fff to 0x7fff
+};
+
+struct RetroQueuedEvent {
+   Common::Event event;
+   RetroMouseCoords coords;
+
+   RetroQueuedEvent(const Common::Event &e, RetroMouseCoords c = kRetroMouseNone) : event(e), coords(c) { }
+};
+
+std::list<RetroQueuedEvent> _events;
 
 class OSystem_RETRO : public EventsBaseBackend, public PaletteManager {
    public:
       Graphics::Surface _screen;
+      Common::Array<Common::Rect> _dirtyRects;
+      bool _screenDirty;
+      bool _screenChanged;
+      Common::Rect _cursorRect;
+      bool _cursorDirty;
+
+      // The cursor is kept converted to the output format, and the screen
+      // pixels it covers are saved so moving it never reconverts anything.
+      Graphics::Surface _cursorSprite;
+      Common::Array<byte> _cursorMask;
+      Graphics::Surface _cursorSaveUnder;
+      Common::Rect _cursorSaved;
 
       Graphics::Surface _gameScreen;
       RetroPalette _gamePalette;
+      uint16 _gamePaletteLUT[256];
+      uint32 _gamePaletteLUT32[256];
+      bool _gamePaletteLUTDirty;
+      bool _passThrough;
 
       Graphics::Surface _overlay;
       bool _overlayVisible;
@@ -311,21 +553,55 @@ class OSystem_RETRO : public EventsBaseBackend, public PaletteManager {
 
       uint32 _startTime;
       uint32 _threadExitTime;
-
+      uint32 _sliceStartTime;
+      RetroSchedulerStats _schedulerStats;
+
+      uint64 _clockMicros;
+      uint32 _clock;
+      uint32 _timeBase;
+      uint32 _slicePolls;
+
+      RetroStateOp _stateOp;
+      Common::SpinLock _stateOpLock;
+      bool _stateOpRunning;
+      bool _stateOpResult;
+      Common::WriteStream *_stateOut;
+      Common::SeekableReadStream *_stateIn;
+
+      MutexRef _eventsMutex;
+
+      // Threaded mode: the engine thread renders into _frames[_frameBack] and
+      // swaps it with _frameMiddle, retro_run takes it back as _frameFront.
+      Graphics::Surface _frames[3];
+      uint32 _frameBack;
+      uint32 _frameMiddle;
+      uint32 _frameFront;
+      bool _frameChanged;
+
+      int16 _audioRing[RETRO_AUDIO_RING_FRAMES * 2];
+      uint32 _audioWritePos;
+      uint32 _audioReadPos;
 
       Audio::MixerImpl* _mixer;
 
 
       OSystem_RETRO() :
+         _screenDirty(true), _screenChanged(true), _cursorDirty(false), _gamePaletteLUTDirty(true), _passThrough(false), _overlayVisible(false),
          _mousePaletteEnabled(false), _mouseVisible(false), _mouseX(0), _mouseY(0), _mouseHotspotX(0), _mouseHotspotY(0),
-         _mouseKeyColor(0), _mouseDontScale(false), _mixer(0), _startTime(0), _threadExitTime(10)
+         _mouseKeyColor(0), _mouseDontScale(false), _mixer(0), _startTime(0), _threadExitTime(10), _sliceStartTime(0),
+         _clockMicros(0), _clock(0), _timeBase(RETRO_DETERMINISTIC_EPOCH), _slicePolls(0),
+         _stateOp(kRetroStateNone), _stateOpRunning(false), _stateOpResult(false), _stateOut(0), _stateIn(0),
+         _frameBack(0), _frameMiddle(1), _frameFront(2), _frameChanged(false), _audioWritePos(0), _audioReadPos(0)
    {
       _fsFactory = new FS_SYSTEM_FACTORY();
       memset(_mouseButtons, 0, sizeof(_mouseButtons));
       memset(_joypadmouseButtons, 0, sizeof(_joypadmouseButtons));
       _joypadstartButton = false;
 
-      _startTime = getMillis();
+      _eventsMutex = createMutex();
+      memset(&_schedulerStats, 0, sizeof(_schedulerStats));
+
+      _startTime = getRealMillis();
 
       if(s_systemDir.empty())
          s_systemDir = ".";
@@ -339,20 +615,24 @@ class OSystem_RETRO : public EventsBaseBackend, public PaletteManager {
          _gameScreen.free();
          _overlay.free();
          _mouseImage.free();
+         _cursorSprite.free();
+         _cursorSaveUnder.free();
          _screen.free();
+         for(int i = 0; i < 3; i++)
+            _frames[i].free();
 
          delete _mixer;
+         deleteMutex(_eventsMutex);
       }
 
       virtual void initBackend()
       {
-         _savefileManager = new DefaultSaveFileManager(s_saveDir);
-#ifdef FRONTEND_SUPPORTS_RGB565
-         _overlay.create(RES_W, RES_H, Graphics::PixelFormat(2, 5, 6, 5, 0, 11, 5, 0, 0));
-#else
-         _overlay.create(RES_W, RES_H, Graphics::PixelFormat(2, 5, 5, 5, 1, 10, 5, 0, 15));
-#endif
-         _mixer = new Audio::MixerImpl(this, 44100);
+         _savefileManager = new RetroSaveFileManager(s_saveDir);
+         // The GUI draws straight into the output format, so composing the
+         // overlay is a copy at most.
+         _overlay.create(RES_W, RES_H, retroOutputFormat());
+         _mixer = new Audio::MixerImpl(this, s_audioRate);
+         _mixer->setRateConverterQuality(s_resamplerQuality);
          _timerManager = new DefaultTimerManager();
 
          _mixer->setReady(true);
@@ -368,7 +648,10 @@ class OSystem_RETRO : public EventsBaseBackend, public PaletteManager {
       virtual void setFeatureState(Feature f, bool enable)
       {
          if (f == kFeatureCursorPalette)
+         {
             _mousePaletteEnabled = enable;
+            _cursorDirty = true;
+         }
       }
 
       virtual bool getFeatureState(Feature f)
@@ -400,6 +683,7 @@ class OSystem_RETRO : public EventsBaseBackend, public PaletteManager {
       virtual void initSize(uint width, uint height, const Graphics::PixelFormat *format)
       {
          _gameScreen.create(width, height, format ? *format : Graphics::PixelFormat::createFormatCLUT8());
+         _screenDirty = true;
       }
 
       virtual int16 getHeight()
@@ -421,6 +705,10 @@ class OSystem_RETRO : public EventsBaseBackend, public PaletteManager {
       {
          Common::List<Graphics::PixelFormat> result;
 
+         /* XRGB8888 - the frontend format, drawn without any conversion */
+         if(s_outputXRGB8888)
+            result.push_back(retroOutputFormat());
+
          /* RGBA8888 */
          result.push_back(Graphics::PixelFormat(4, 8, 8, 8, 8, 24, 16, 8, 0));
 
@@ -444,6 +732,11 @@ class OSystem_RETRO : public EventsBaseBackend, public PaletteManager {
       virtual void setPalette(const byte *colors, uint start, uint num)
       {
          _gamePalette.set(colors, start, num);
+         _gamePaletteLUTDirty = true;
+         _screenDirty = true;
+
+         if(!_mousePaletteEnabled)
+            _cursorDirty = true;
       }
 
       virtual void grabPalette(byte *colors, uint start, uint num) const
@@ -458,39 +751,303 @@ class OSystem_RETRO : public EventsBaseBackend, public PaletteManager {
          const uint8_t *src = (const uint8_t*)buf;
          uint8_t *pix = (uint8_t*)_gameScreen.pixels;
          copyRectToSurface(pix, _gameScreen.pitch, src, pitch, x, y, w, h, _gameScreen.format.bytesPerPixel);
+
+         if(!_overlayVisible && w > 0 && h > 0)
+            addDirtyRect(Common::Rect(x, y, x + w, y + h));
       }
 
-      virtual void updateScreen()
+      void addDirtyRect(const Common::Rect &aRect)
+      {
+         if(_screenDirty || aRect.isEmpty())
+            return;
+
+         for(uint i = 0; i < _dirtyRects.size(); )
+         {
+            if(_dirtyRects[i].contains(aRect))
+               return;
+
+            if(aRect.contains(_dirtyRects[i]))
+               _dirtyRects.remove_at(i);
+            else
+               i++;
+         }
+
+         if(_dirtyRects.size() >= RETRO_MAX_DIRTY_RECTS)
+         {
+            _dirtyRects.clear();
+            _screenDirty = true;
+            return;
+         }
+
+         _dirtyRects.push_back(aRect);
+      }
+
+      bool resizeScreen(const Graphics::Surface& srcSurface)
+      {
+         if(srcSurface.w == _screen.w && srcSurface.h == _screen.h)
+            return false;
+
+         _screen.create(srcSurface.w, srcSurface.h, retroOutputFormat());
+         _gamePaletteLUTDirty = true;
+         _screenDirty = true;
+         return true;
+      }
+
+      void convertRect(const Graphics::Surface& srcSurface, const Common::Rect& aRect)
+      {
+         static const Graphics::PixelFormat rgb565(2, 5, 6, 5, 0, 11, 5, 0, 0);
+         static const Graphics::PixelFormat rgb555(2, 5, 5, 5, 1, 10, 5, 0, 15);
+         static const Graphics::PixelFormat rgba8888(4, 8, 8, 8, 8, 24, 16, 8, 0);
+
+         const int w = aRect.width();
+
+         if(srcSurface.format.bytesPerPixel == 1)
+         {
+            if(_gamePaletteLUTDirty)
+            {
+               for(int i = 0; i < 256; i++)
+               {
+                  const unsigned char *col = _gamePalette.getColor(i);
+                  if(_screen.format.bytesPerPixel == 4)
+                     _gamePaletteLUT32[i] = _screen.format.RGBToColor(col[0], col[1], col[2]);
+                  else
+                     _gamePaletteLUT[i] = _screen.format.RGBToColor(col[0], col[1], col[2]);
+               }
+               _gamePaletteLUTDirty = false;
+            }
+
+            for(int i = aRect.top; i < aRect.bottom; i++)
+            {
+               if(_screen.format.bytesPerPixel == 4)
+                  s_blitKernels->clut8To32((uint32_t*)_screen.getBasePtr(aRect.left, i), (const uint8_t*)srcSurface.getBasePtr(aRect.left, i), _gamePaletteLUT32, w);
+               else
+                  s_blitKernels->clut8((uint16_t*)_screen.getBasePtr(aRect.left, i), (const uint8_t*)srcSurface.getBasePtr(aRect.left, i), _gamePaletteLUT, w);
+            }
+            return;
+         }
+
+         if(srcSurface.format == _screen.format)
+         {
+            for(int i = aRect.top; i < aRect.bottom; i++)
+               memcpy(_screen.getBasePtr(aRect.left, i), srcSurface.getBasePtr(aRect.left, i), w * _screen.format.bytesPerPixel);
+            return;
+         }
+
+         if(_screen.format == rgb565)
+         {
+            if(srcSurface.format == rgb555)
+            {
+               for(int i = aRect.top; i < aRect.bottom; i++)
+                  s_blitKernels->rgb555ToRgb565((uint16_t*)_screen.getBasePtr(aRect.left, i), (const uint16_t*)srcSurface.getBasePtr(aRect.left, i), w);
+               return;
+            }
+
+            if(srcSurface.format == rgba8888)
+            {
+               for(int i = aRect.top; i < aRect.bottom; i++)
+                  s_blitKernels->rgba8888ToRgb565((uint16_t*)_screen.getBasePtr(aRect.left, i), (const uint32_t*)srcSurface.getBasePtr(aRect.left, i), w);
+               return;
+            }
+         }
+         else if(_screen.format.bytesPerPixel == 4)
+         {
+            if(srcSurface.format == rgb565)
+            {
+               for(int i = aRect.top; i < aRect.bottom; i++)
+                  s_blitKernels->rgb565ToXrgb8888((uint32_t*)_screen.getBasePtr(aRect.left, i), (const uint16_t*)srcSurface.getBasePtr(aRect.left, i), w);
+               return;
+            }
+
+            if(srcSurface.format == rgba8888)
+            {
+               for(int i = aRect.top; i < aRect.bottom; i++)
+                  s_blitKernels->rgba8888ToXrgb8888((uint32_t*)_screen.getBasePtr(aRect.left, i), (const uint32_t*)srcSurface.getBasePtr(aRect.left, i), w);
+               return;
+            }
+         }
+
+         if(_screen.format.bytesPerPixel == 4)
+         {
+            if(srcSurface.format.bytesPerPixel == 2)
+               blit_rect<uint16, uint32>(_screen, srcSurface, aRect);
+            else if(srcSurface.format.bytesPerPixel == 4)
+               blit_rect<uint32, uint32>(_screen, srcSurface, aRect);
+         }
+         else
+         {
+            if(srcSurface.format.bytesPerPixel == 2)
+               blit_rect<uint16, uint16>(_screen, srcSurface, aRect);
+            else if(srcSurface.format.bytesPerPixel == 4)
+               blit_rect<uint32, uint16>(_screen, srcSurface, aRect);
+         }
+      }
+
+      /**
+       * A game screen or overlay already in the frontend format is handed
+       * over as is, as long as nothing has to be drawn on top of it.
+       */
+      bool canPassThrough() const
       {
          const Graphics::Surface& srcSurface = (_overlayVisible) ? _overlay : _gameScreen;
-         if(srcSurface.w && srcSurface.h)
+         return srcSurface.format == _screen.format && _cursorRect.isEmpty();
+      }
+
+      virtual void updateScreen()
+      {
+         renderScreen();
+
+         if(s_threaded)
          {
-            switch(srcSurface.format.bytesPerPixel)
+            if(_screenChanged)
             {
-               case 1:
-               case 3:
-                  blit_uint8_uint16_fast(_screen, srcSurface, _gamePalette);
-                  break;
-               case 2:
-                  blit_uint16_uint16(_screen, srcSurface, _gamePalette);
-                  break;
-               case 4:
-                  blit_uint32_uint16(_screen, srcSurface, _gamePalette);
-                  break;
+               publishFrame();
+               _screenChanged = false;
             }
+
+            fillAudio();
+         }
+         else if(_screenChanged && !_stateOpRunning)
+         {
+            // A finished frame is the natural point to hand control back;
+            // anything the engine does next belongs to the next frame.
+            retroLeaveThread(kRetroYieldFrame);
          }
+      }
+
+      void renderScreen()
+      {
+         const Graphics::Surface& srcSurface = (_overlayVisible) ? _overlay : _gameScreen;
+         if(!srcSurface.w || !srcSurface.h)
+            return;
+
+         resizeScreen(srcSurface);
 
-         // Draw Mouse
+         Common::Rect cursorRect;
          if(_mouseVisible && _mouseImage.w && _mouseImage.h)
          {
             const int x = _mouseX - _mouseHotspotX;
             const int y = _mouseY - _mouseHotspotY;
+            cursorRect = Common::Rect(x, y, x + _mouseImage.w, y + _mouseImage.h);
+         }
+
+         bool cursorChanged = (cursorRect != _cursorRect);
+         if(_cursorDirty)
+         {
+            // The save-under may be reallocated with the sprite.
+            if(!_screenDirty && !_passThrough)
+               restoreUnderCursor();
+            _cursorSaved = Common::Rect();
+
+            updateCursorSprite();
+            cursorChanged = true;
+         }
+         _cursorRect = cursorRect;
+
+         if(canPassThrough())
+         {
+            if(_screenDirty || !_dirtyRects.empty() || cursorChanged)
+               _screenChanged = true;
+
+            _dirtyRects.clear();
+            _screenDirty = false;
+            _cursorSaved = Common::Rect();
+            _passThrough = true;
+            return;
+         }
+
+         if(_passThrough)
+         {
+            _passThrough = false;
+            _screenDirty = true;
+         }
 
-            if(_mouseImage.format.bytesPerPixel == 1)
-               blit_uint8_uint16(_screen, _mouseImage, x, y, _mousePaletteEnabled ? _mousePalette : _gamePalette, _mouseKeyColor);
+         if(!_screenDirty && _dirtyRects.empty() && !cursorChanged)
+            return;
+
+         // Take the cursor off first, so both the conversion and the next
+         // save-under see the plain screen. A full conversion redraws it anyway.
+         if(!_screenDirty)
+            restoreUnderCursor();
+         _cursorSaved = Common::Rect();
+
+         if(_screenDirty)
+         {
+            _dirtyRects.clear();
+            _dirtyRects.push_back(Common::Rect(srcSurface.w, srcSurface.h));
+         }
+
+         for(uint i = 0; i < _dirtyRects.size(); i++)
+         {
+            Common::Rect rect = _dirtyRects[i];
+            rect.clip(Common::Rect(MIN(srcSurface.w, _screen.w), MIN(srcSurface.h, _screen.h)));
+            if(!rect.isEmpty())
+               convertRect(srcSurface, rect);
+         }
+
+         _dirtyRects.clear();
+         _screenDirty = false;
+         _screenChanged = true;
+
+         if(!cursorRect.isEmpty())
+            drawCursor(cursorRect);
+      }
+
+      void updateCursorSprite()
+      {
+         const RetroPalette& palette = _mousePaletteEnabled ? _mousePalette : _gamePalette;
+         const Graphics::PixelFormat format = retroOutputFormat();
+
+         if(_cursorSprite.w != _mouseImage.w || _cursorSprite.h != _mouseImage.h || _cursorSprite.format != format)
+         {
+            _cursorSprite.create(_mouseImage.w, _mouseImage.h, format);
+            _cursorSaveUnder.create(_mouseImage.w, _mouseImage.h, format);
+            _cursorMask.resize(_mouseImage.w * _mouseImage.h);
+         }
+
+         if(_mouseImage.w && _mouseImage.h)
+         {
+            if(format.bytesPerPixel == 4)
+            {
+               if(_mouseImage.format.bytesPerPixel == 1)
+                  convert_cursor<uint8, uint32>(_cursorSprite, &_cursorMask[0], _mouseImage, palette, _mouseKeyColor);
+               else
+                  convert_cursor<uint16, uint32>(_cursorSprite, &_cursorMask[0], _mouseImage, palette, _mouseKeyColor);
+            }
             else
-               blit_uint16_uint16(_screen, _mouseImage, x, y, _mousePaletteEnabled ? _mousePalette : _gamePalette, _mouseKeyColor);
+            {
+               if(_mouseImage.format.bytesPerPixel == 1)
+                  convert_cursor<uint8, uint16>(_cursorSprite, &_cursorMask[0], _mouseImage, palette, _mouseKeyColor);
+               else
+                  convert_cursor<uint16, uint16>(_cursorSprite, &_cursorMask[0], _mouseImage, palette, _mouseKeyColor);
+            }
          }
+
+         _cursorDirty = false;
+      }
+
+      void restoreUnderCursor()
+      {
+         const int bpp = _screen.format.bytesPerPixel;
+         for(int i = 0; i < _cursorSaved.height(); i++)
+            memcpy(_screen.getBasePtr(_cursorSaved.left, _cursorSaved.top + i), _cursorSaveUnder.getBasePtr(0, i), _cursorSaved.width() * bpp);
+      }
+
+      void drawCursor(const Common::Rect& cursorRect)
+      {
+         Common::Rect clip = cursorRect;
+         clip.clip(Common::Rect(_screen.w, _screen.h));
+         if(clip.isEmpty() || _cursorSprite.w != cursorRect.width() || _cursorSprite.h != cursorRect.height())
+            return;
+
+         const int bpp = _screen.format.bytesPerPixel;
+         for(int i = 0; i < clip.height(); i++)
+            memcpy(_cursorSaveUnder.getBasePtr(0, i), _screen.getBasePtr(clip.left, clip.top + i), clip.width() * bpp);
+         _cursorSaved = clip;
+
+         if(bpp == 4)
+            blit_sprite<uint32>(_screen, _cursorSprite, &_cursorMask[0], cursorRect.left, cursorRect.top, clip);
+         else
+            blit_sprite<uint16>(_screen, _cursorSprite, &_cursorMask[0], cursorRect.left, cursorRect.top, clip);
       }
 
       virtual Graphics::Surface *lockScreen()
@@ -500,7 +1057,9 @@ class OSystem_RETRO : public EventsBaseBackend, public PaletteManager {
 
       virtual void unlockScreen()
       {
-         /* EMPTY */
+         // Engines can draw anywhere while the screen is locked.
+         if(!_overlayVisible)
+            _screenDirty = true;
       }
 
       virtual void setShakePos(int shakeOffset)
@@ -508,118 +1067,458 @@ class OSystem_RETRO : public EventsBaseBackend, public PaletteManager {
          // TODO
       }
 
-      virtual void showOverlay()
-      {
-         _overlayVisible = true;
+      virtual void showOverlay()
+      {
+         _overlayVisible = true;
+         _screenDirty = true;
+      }
+
+      virtual void hideOverlay()
+      {
+         _overlayVisible = false;
+         _screenDirty = true;
+      }
+
+      virtual void clearOverlay()
+      {
+         memset(_overlay.pixels, 0, _overlay.h * _overlay.pitch);
+
+         if(_overlayVisible)
+            _screenDirty = true;
+      }
+
+      virtual void grabOverlay(void *buf, int pitch)
+      {
+         const unsigned char *src = (unsigned char*)_overlay.pixels;
+         unsigned char *dst = (byte *)buf;
+         unsigned i = _overlay.h;
+
+         do{
+            memcpy(dst, src, _overlay.w * _overlay.format.bytesPerPixel);
+            dst += pitch;
+            src += _overlay.pitch;
+         }while(--i);
+      }
+
+      virtual void copyRectToOverlay(const void *buf, int pitch, int x, int y, int w, int h)
+      {
+         const uint8_t *src = (const uint8_t*)buf;
+         uint8_t *pix = (uint8_t*)_overlay.pixels;
+         copyRectToSurface(pix, _overlay.pitch, src, pitch, x, y, w, h, _overlay.format.bytesPerPixel);
+
+         if(_overlayVisible && w > 0 && h > 0)
+            addDirtyRect(Common::Rect(x, y, x + w, y + h));
+      }
+
+      virtual int16 getOverlayHeight()
+      {
+         return _overlay.h;
+      }
+
+      virtual int16 getOverlayWidth()
+      {
+         return _overlay.w;
+      }
+
+      virtual Graphics::PixelFormat getOverlayFormat() const
+      {
+         return _overlay.format;
+      }
+
+
+
+      virtual bool showMouse(bool visible)
+      {
+         const bool wasVisible = _mouseVisible;
+         _mouseVisible = visible;
+         return wasVisible;
+      }
+
+      virtual void warpMouse(int x, int y)
+      {
+         _mouseX = x;
+         _mouseY = y;
+      }
+
+      virtual void setMouseCursor(const void *buf, uint w, uint h, int hotspotX, int hotspotY, uint32 keycolor = 255, bool dontScale = false, const Graphics::PixelFormat *format = NULL)
+      {
+         const Graphics::PixelFormat mformat = format ? *format : Graphics::PixelFormat::createFormatCLUT8();
+
+         if(_mouseImage.w != w || _mouseImage.h != h || _mouseImage.format != mformat)
+         {
+            _mouseImage.create(w, h, mformat);
+         }
+
+         memcpy(_mouseImage.pixels, buf, h * _mouseImage.pitch);
+
+         _mouseHotspotX = hotspotX;
+         _mouseHotspotY = hotspotY;
+         _mouseKeyColor = keycolor;
+         _mouseDontScale = dontScale;
+         _cursorDirty = true;
+      }
+
+      virtual void setCursorPalette(const byte *colors, uint start, uint num)
+      {
+         _mousePalette.set(colors, start, num);
+         _mousePaletteEnabled = true;
+         _cursorDirty = true;
+      }
+
+      /**
+       * Copies the finished screen into the back buffer and swaps it into the
+       * middle slot, where retro_run picks it up without any locking.
+       */
+      void publishFrame()
+      {
+         const Graphics::Surface& src = _passThrough ? (_overlayVisible ? _overlay : _gameScreen) : _screen;
+         Graphics::Surface& back = _frames[_frameBack];
+
+         if(back.w != src.w || back.h != src.h || back.format != src.format)
+         {
+            back.free();
+            back.create(src.w, src.h, src.format);
+         }
+
+         for(int y = 0; y < src.h; y++)
+            memcpy(back.getBasePtr(0, y), src.getBasePtr(0, y), src.w * src.format.bytesPerPixel);
+
+         _frameBack = Common::atomicExchange(&_frameMiddle, _frameBack | RETRO_FRAME_FRESH) & RETRO_FRAME_INDEX_MASK;
+      }
+
+      /** Tops the audio ring up to about 50ms ahead of the frontend. */
+      void fillAudio()
+      {
+         if(!_mixer || !_mixer->isReady())
+            return;
+
+         const uint32 target = MIN<uint32>(s_audioRate / 20, RETRO_AUDIO_RING_FRAMES);
+         uint32 queued = _audioWritePos - Common::atomicLoad(&_audioReadPos);
+
+         while(queued < target)
+         {
+            const uint32 pos = _audioWritePos % RETRO_AUDIO_RING_FRAMES;
+            const uint32 count = MIN<uint32>(target - queued, RETRO_AUDIO_RING_FRAMES - pos);
+
+            _mixer->mixCallback((byte*)&_audioRing[pos * 2], count * 4);
+            Common::atomicStore(&_audioWritePos, _audioWritePos + count);
+            queued += count;
+         }
+      }
+
+      unsigned readAudio(int16_t *out, unsigned frames)
+      {
+         const uint32 available = Common::atomicLoad(&_audioWritePos) - _audioReadPos;
+         unsigned done = 0;
+
+         frames = MIN<uint32>(frames, available);
+         while(done < frames)
+         {
+            const uint32 pos = (_audioReadPos + done) % RETRO_AUDIO_RING_FRAMES;
+            const uint32 count = MIN<uint32>(frames - done, RETRO_AUDIO_RING_FRAMES - pos);
+
+            memcpy(out + done * 2, &_audioRing[pos * 2], count * 4);
+            done += count;
+         }
+
+         Common::atomicStore(&_audioReadPos, _audioReadPos + done);
+         return done;
+      }
+
+      bool retroCheckThread(uint32 offset = 0)
+      {
+         // Never yield while a savestate is being taken or restored, the
+         // frontend is waiting for the result.
+         if(_stateOpRunning)
+            return false;
+
+         // On a real thread there is nothing to yield to; serve the frontend
+         // from here instead and let the caller sleep as usual.
+         if(s_threaded)
+         {
+            fillAudio();
+
+            if(_threadExitTime <= getMillis())
+            {
+               finishStateRestore();
+               _threadExitTime = getMillis() + 10;
+            }
+
+            return false;
+         }
+
+         // Yield decisions may only depend on what the engine does, never on
+         // the wall clock; a busy-polling engine ends its frame after a while.
+         if(s_deterministic)
+         {
+            if(++_slicePolls < RETRO_DETERMINISTIC_POLLS)
+               return false;
+
+            retroLeaveThread(kRetroYieldSlice);
+            return true;
+         }
+
+         // Yield once the slice is used up, or when a delay would run past it.
+         if(_threadExitTime <= (getMillis() + offset))
+         {
+            retroLeaveThread(offset ? kRetroYieldDelay : kRetroYieldSlice);
+            return true;
+         }
+
+         return false;
       }
 
-      virtual void hideOverlay()
+      void retroLeaveThread(RetroYieldReason reason)
       {
-         _overlayVisible = false;
-      }
+         _schedulerStats.yields[reason]++;
+         _schedulerStats.engineMillis += getRealMillis() - _sliceStartTime;
 
-      virtual void clearOverlay()
-      {
-         _overlay.fillRect(Common::Rect(_overlay.w, _overlay.h), 0);
-      }
+         extern void retro_leave_thread();
+         retro_leave_thread();
 
-      virtual void grabOverlay(void *buf, int pitch)
-      {
-         const unsigned char *src = (unsigned char*)_overlay.pixels;
-         unsigned char *dst = (byte *)buf;
-         unsigned i = RES_H;
+         finishStateRestore();
 
-         do{
-            memcpy(dst, src, RES_W << 1);
-            dst += pitch;
-            src += RES_W << 1;
-         }while(--i);
-      }
+         _sliceStartTime = getRealMillis();
+         _threadExitTime = getMillis() + s_sliceBudget;
+         _schedulerStats.slices++;
 
-      virtual void copyRectToOverlay(const void *buf, int pitch, int x, int y, int w, int h)
-      {
-         const uint8_t *src = (const uint8_t*)buf;
-         uint8_t *pix = (uint8_t*)_overlay.pixels;
-         copyRectToSurface(pix, _overlay.pitch, src, pitch, x, y, w, h, _overlay.format.bytesPerPixel);
+         if(s_deterministic)
+         {
+            _clock = MAX<uint32>(_clock, _clockMicros / 1000);
+            _slicePolls = 0;
+         }
       }
 
-      virtual int16 getOverlayHeight()
+      /** Moves the deterministic clock on by one frontend frame. */
+      void advanceClock()
       {
-         return _overlay.h;
+         _clockMicros += s_frameMicros;
       }
 
-      virtual int16 getOverlayWidth()
+      /**
+       * The deterministic trailer holds the clock and the state of every
+       * live RandomSource, which savegames do not cover.
+       */
+      void writeDeterministicState(Common::WriteStream &out) const
       {
-         return _overlay.w;
-      }
+         Common::SpinLockHolder lock(Common::RandomSource::getListLock());
 
-      virtual Graphics::PixelFormat getOverlayFormat() const
-      {
-         return _overlay.format;
-      }
+         uint32 count = 0;
+         for(const Common::RandomSource *rnd = Common::RandomSource::getFirst(); rnd; rnd = rnd->getNext())
+            count++;
 
+         out.writeUint32BE(RETRO_DETERMINISTIC_MAGIC);
+         out.writeUint32BE((uint32)(_clockMicros >> 32));
+         out.writeUint32BE((uint32)_clockMicros);
+         out.writeUint32BE(_clock);
+         out.writeUint32BE(_timeBase);
+         out.writeUint32BE(count);
 
+         for(const Common::RandomSource *rnd = Common::RandomSource::getFirst(); rnd; rnd = rnd->getNext())
+         {
+            out.writeUint16BE(rnd->getName().size());
+            out.write(rnd->getName().c_str(), rnd->getName().size());
+            out.writeUint32BE(rnd->getSeed());
+         }
+      }
 
-      virtual bool showMouse(bool visible)
+      void readDeterministicState(Common::SeekableReadStream &in)
       {
-         const bool wasVisible = _mouseVisible;
-         _mouseVisible = visible;
-         return wasVisible;
+         // States taken outside deterministic mode simply lack the trailer.
+         if(in.readUint32BE() != RETRO_DETERMINISTIC_MAGIC || in.eos())
+            return;
+
+         const uint64 clockMicros = ((uint64)in.readUint32BE() << 32) | in.readUint32BE();
+         const uint32 clock = in.readUint32BE();
+         const uint32 timeBase = in.readUint32BE();
+         uint32 count = in.readUint32BE();
+         if(in.err() || in.eos())
+            return;
+
+         _clockMicros = clockMicros;
+         _clock = clock;
+         _timeBase = timeBase;
+
+         // Sources are matched in creation order, which is itself deterministic.
+         Common::SpinLockHolder lock(Common::RandomSource::getListLock());
+         Common::RandomSource *rnd = Common::RandomSource::getFirst();
+         while(count-- && rnd)
+         {
+            const uint16 nameSize = in.readUint16BE();
+            Common::String name;
+            for(uint16 j = 0; j < nameSize; j++)
+               name += (char)in.readByte();
+
+            const uint32 seed = in.readUint32BE();
+            if(in.err() || in.eos())
+               return;
+
+            if(rnd->getName() == name)
+               rnd->setSeed(seed);
+            rnd = rnd->getNext();
+         }
       }
 
-      virtual void warpMouse(int x, int y)
+      /**
+       * Drops the restored files once the engine has loaded them. Some
+       * engines only schedule the load and perform it in their main loop,
+       * so this can be a few slices after the state op.
+       */
+      void finishStateRestore()
       {
-         _mouseX = x;
-         _mouseY = y;
+         RetroSaveFileManager *saves = (RetroSaveFileManager*)_savefileManager;
+
+         if(saves->isRestoreFinished())
+            saves->clearStateFiles();
       }
 
-      virtual void setMouseCursor(const void *buf, uint w, uint h, int hotspotX, int hotspotY, uint32 keycolor = 255, bool dontScale = false, const Graphics::PixelFormat *format = NULL)
+      /**
+       * Only called from pollEvent(), between two iterations of the engine's
+       * main loop, where canSaveGameStateCurrently() and
+       * canLoadGameStateCurrently() apply.
+       */
+      void runStateOp()
       {
-         const Graphics::PixelFormat mformat = format ? *format : Graphics::PixelFormat::createFormatCLUT8();
+         RetroSaveFileManager *saves = (RetroSaveFileManager*)_savefileManager;
+         RetroStateOp op;
 
-         if(_mouseImage.w != w || _mouseImage.h != h || _mouseImage.format != mformat)
+         // The frontend may have given up on the request in the meantime
          {
-            _mouseImage.create(w, h, mformat);
+            Common::SpinLockHolder lock(_stateOpLock);
+            op = _stateOp;
+            if(op == kRetroStateNone)
+               return;
+            _stateOp = kRetroStateBusy;
          }
 
-         memcpy(_mouseImage.pixels, buf, h * _mouseImage.pitch);
+         _stateOpRunning = true;
+         _stateOpResult = false;
 
-         _mouseHotspotX = hotspotX;
-         _mouseHotspotY = hotspotY;
-         _mouseKeyColor = keycolor;
-         _mouseDontScale = dontScale;
-      }
+         // Files of an earlier restore which the engine never loaded must
+         // not shadow the save directory any longer
+         saves->clearStateFiles();
 
-      virtual void setCursorPalette(const byte *colors, uint start, uint num)
-      {
-         _mousePalette.set(colors, start, num);
-         _mousePaletteEnabled = true;
+         if(op == kRetroStateSave)
+         {
+            if(g_engine && g_engine->hasFeature(Engine::kSupportsSavingDuringRuntime) && g_engine->canSaveGameStateCurrently())
+            {
+               saves->beginCapture();
+               const Common::Error result = g_engine->saveGameState(RETRO_STATE_SLOT, "libretro");
+               saves->endCapture();
+
+               // Engines which defer saving to their main loop leave nothing
+               // behind here; report those as unsupported.
+               if(result.getCode() == Common::kNoError && saves->hasStateFiles())
+               {
+                  saves->writeStateFiles(*_stateOut);
+                  if(s_deterministic)
+                     writeDeterministicState(*_stateOut);
+                  _stateOpResult = true;
+               }
+
+               saves->clearStateFiles();
+            }
+         }
+         else if(op == kRetroStateLoad)
+         {
+            if(g_engine && g_engine->hasFeature(Engine::kSupportsLoadingDuringRuntime) && g_engine->canLoadGameStateCurrently() &&
+               saves->readStateFiles(*_stateIn))
+            {
+               _stateOpResult = (g_engine->loadGameState(RETRO_STATE_SLOT).getCode() == Common::kNoError);
+
+               if(_stateOpResult && s_deterministic)
+                  readDeterministicState(*_stateIn);
+            }
+
+            // Nothing will be loaded from the files after a failure. Most
+            // engines have loaded them already, the others do it in their
+            // main loop, see finishStateRestore().
+            if(!_stateOpResult)
+               saves->clearStateFiles();
+            else
+               finishStateRestore();
+         }
+
+         _stateOpRunning = false;
+         Common::atomicStore(&_stateOp, kRetroStateNone);
       }
 
-      bool retroCheckThread(uint32 offset = 0)
+      bool requestStateOp(RetroStateOp op, Common::WriteStream *out, Common::SeekableReadStream *in)
       {
-         if(_threadExitTime <= (getMillis() + offset))
+         _stateOut = out;
+         _stateIn = in;
+         _stateOpResult = false;
+         Common::atomicStore(&_stateOp, op);
+
+         // The engine thread picks the request up on its next poll.
+         if(s_threaded)
          {
-            extern void retro_leave_thread();
-            retro_leave_thread();
+            extern bool retro_emulator_exited();
+            const uint32 start = getRealMillis();
 
-            _threadExitTime = getMillis() + 10;
-            return true;
+            while(Common::atomicLoad(&_stateOp) != kRetroStateNone && !retro_emulator_exited())
+            {
+               // An engine which doesn't poll, e.g. during a long load, fails
+               // the state op instead of hanging the frontend. Once picked
+               // up, the op runs to the end.
+               if(getRealMillis() - start > RETRO_STATE_OP_TIMEOUT)
+               {
+                  Common::SpinLockHolder lock(_stateOpLock);
+                  if(_stateOp == op)
+                  {
+                     _stateOp = kRetroStateNone;
+                     if (log_cb)
+                        log_cb(RETRO_LOG_WARN, "The engine is busy, savestate not %s.\n", op == kRetroStateSave ? "saved" : "loaded");
+                     break;
+                  }
+               }
+
+               retro_sleep(1);
+            }
+         }
+         else
+         {
+            // The coroutine may be resumed anywhere, e.g. within a frame, so
+            // let it run until it polls. It hands control back right after
+            // the state op.
+            extern void retro_enter_thread();
+            extern bool retro_emulator_exited();
+            for(int slices = 0; slices < RETRO_STATE_OP_SLICES && Common::atomicLoad(&_stateOp) != kRetroStateNone && !retro_emulator_exited(); slices++)
+               retro_enter_thread();
+
+            if(_stateOp != kRetroStateNone && log_cb)
+               log_cb(RETRO_LOG_WARN, "The engine is busy, savestate not %s.\n", op == kRetroStateSave ? "saved" : "loaded");
          }
 
-         return false;
+         _stateOp = kRetroStateNone;
+         _stateOut = 0;
+         _stateIn = 0;
+         return _stateOpResult;
       }
 
       virtual bool pollEvent(Common::Event &event)
       {
          retroCheckThread();
 
-         ((DefaultTimerManager*)_timerManager)->handler();
+         // Savestates are only taken or restored here, never in the middle
+         // of a frame or a script which yields through updateScreen() or
+         // delayMillis().
+         if(Common::atomicLoad(&_stateOp) != kRetroStateNone)
+         {
+            runStateOp();
+
+            // The frontend is waiting for the result
+            if(!s_threaded)
+               retroLeaveThread(kRetroYieldStateOp);
+         }
 
+         ((DefaultTimerManager*)_timerManager)->handler();
 
+         Common::StackLock lock(_eventsMutex);
          if(!_events.empty())
          {
-            event = _events.front();
+            event = _events.front().event;
+            applyMouseCoords(event, _events.front().coords);
             _events.pop_front();
             return true;
          }
@@ -627,8 +1526,38 @@ class OSystem_RETRO : public EventsBaseBackend, public PaletteManager {
          return false;
       }
 
+      void applyMouseCoords(Common::Event &event, RetroMouseCoords coords)
+      {
+         switch(coords)
+         {
+            case kRetroMouseNone:
+               return;
+            case kRetroMouseCurrent:
+               break;
+            case kRetroMouseRelative:
+               _mouseX = CLIP<int>(_mouseX + event.mouse.x, 0, _screen.w);
+               _mouseY = CLIP<int>(_mouseY + event.mouse.y, 0, _screen.h);
+               break;
+            case kRetroMouseAbsolute:
+               _mouseX = (int)((event.mouse.x + 0x7fff) * _screen.w / 0xffff);
+               _mouseY = (int)((event.mouse.y + 0x7fff) * _screen.h / 0xffff);
+               break;
+         }
+
+         event.mouse.x = _mouseX;
+         event.mouse.y = _mouseY;
+      }
+
       virtual uint32 getMillis(bool skipRecord = false)
       {
+         if(s_deterministic)
+            return _clock;
+
+         return getRealMillis();
+      }
+
+      uint32 getRealMillis() const
+      {
 #if (defined(GEKKO) && !defined(WIIU))
          return (ticks_to_microsecs(gettime()) / 1000.0) - _startTime;
 #elif defined(WIIU)
@@ -645,29 +1574,99 @@ class OSystem_RETRO : public EventsBaseBackend, public PaletteManager {
 
       virtual void delayMillis(uint msecs)
       {
+         // Delays end frames instead of sleeping, the frontend paces them.
+         if(s_deterministic)
+         {
+            const uint32 target = _clock + msecs;
+            while(!_stateOpRunning && target > (_clockMicros + s_frameMicros) / 1000)
+               retroLeaveThread(kRetroYieldDelay);
+
+            _clock = MAX<uint32>(_clock, target);
+            return;
+         }
+
+         // Sleep in short steps so audio and savestate requests keep being
+         // served during long delays.
+         if(s_threaded)
+         {
+            const uint32 end = getMillis() + msecs;
+            for(uint32 now = getMillis(); now < end; now = getMillis())
+            {
+               retroCheckThread();
+               retro_sleep(MIN<uint32>(end - now, 5));
+            }
+            return;
+         }
+
          if(!retroCheckThread(msecs))
             retro_sleep(msecs);
       }
 
 
+      // Mutexes are only needed when the frontend calls into the core from
+      // another thread, or the engine runs on its own thread; the engine
+      // coroutine itself never runs concurrently.
       virtual MutexRef createMutex(void)
       {
+#ifdef RETRO_HAVE_THREADS
+         if(s_threadSafe)
+         {
+#ifdef _WIN32
+            CRITICAL_SECTION *mutex = new CRITICAL_SECTION;
+            InitializeCriticalSection(mutex);
+#else
+            pthread_mutex_t *mutex = new pthread_mutex_t;
+            pthread_mutexattr_t attr;
+            pthread_mutexattr_init(&attr);
+            pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+            pthread_mutex_init(mutex, &attr);
+            pthread_mutexattr_destroy(&attr);
+#endif
+            return (MutexRef)mutex;
+         }
+#endif
          return MutexRef();
       }
 
       virtual void lockMutex(MutexRef mutex)
       {
-         /* EMPTY */
+#ifdef RETRO_HAVE_THREADS
+         if(!mutex)
+            return;
+#ifdef _WIN32
+         EnterCriticalSection((CRITICAL_SECTION*)mutex);
+#else
+         pthread_mutex_lock((pthread_mutex_t*)mutex);
+#endif
+#endif
       }
 
       virtual void unlockMutex(MutexRef mutex)
       {
-         /* EMPTY */
+#ifdef RETRO_HAVE_THREADS
+         if(!mutex)
+            return;
+#ifdef _WIN32
+         LeaveCriticalSection((CRITICAL_SECTION*)mutex);
+#else
+         pthread_mutex_unlock((pthread_mutex_t*)mutex);
+#endif
+#endif
       }
 
       virtual void deleteMutex(MutexRef mutex)
       {
-         /* EMPTY */
+#ifdef RETRO_HAVE_THREADS
+         if(!mutex)
+            return;
+#ifdef _WIN32
+         DeleteCriticalSection((CRITICAL_SECTION*)mutex);
+         delete (CRITICAL_SECTION*)mutex;
+#else
+         pthread_mutex_destroy((pthread_mutex_t*)mutex);
+         delete (pthread_mutex_t*)mutex;
+#endif
+#endif
       }
 
       virtual void quit()
@@ -682,7 +1681,7 @@ class OSystem_RETRO : public EventsBaseBackend, public PaletteManager {
 
       virtual void getTimeAndDate(TimeDate &t) const
       {
-         time_t curTime = time(NULL);
+         time_t curTime = s_deterministic ? (time_t)(_timeBase + _clock / 1000) : time(NULL);
 
 #define YEAR0 1900
 #define EPOCH_YR 1970
@@ -734,19 +1733,39 @@ class OSystem_RETRO : public EventsBaseBackend, public PaletteManager {
 
       const Graphics::Surface& getScreen()
       {
+         // The engine thread owns everything but the front buffer.
+         if(s_threaded)
+         {
+            if(Common::atomicLoad(&_frameMiddle) & RETRO_FRAME_FRESH)
+            {
+               _frameFront = Common::atomicExchange(&_frameMiddle, _frameFront) & RETRO_FRAME_INDEX_MASK;
+               _frameChanged = true;
+            }
+
+            return _frames[_frameFront];
+         }
+
          const Graphics::Surface& srcSurface = (_overlayVisible) ? _overlay : _gameScreen;
 
-         if(srcSurface.w != _screen.w || srcSurface.h != _screen.h)
+         // Called from retro_run, so this must never yield.
+         if(resizeScreen(srcSurface))
+            renderScreen();
+
+         return _passThrough ? srcSurface : _screen;
+      }
+
+      bool screenChanged()
+      {
+         if(s_threaded)
          {
-#ifdef FRONTEND_SUPPORTS_RGB565
-            _screen.create(srcSurface.w, srcSurface.h, Graphics::PixelFormat(2, 5, 6, 5, 0, 11, 5, 0, 0));
-#else
-            _screen.create(srcSurface.w, srcSurface.h, Graphics::PixelFormat(2, 5, 5, 5, 1, 10, 5, 0, 15));
-#endif
+            const bool changed = _frameChanged;
+            _frameChanged = false;
+            return changed;
          }
 
-
-         return _screen;
+         const bool changed = _screenChanged;
+         _screenChanged = false;
+         return changed;
       }
 
 #define ANALOG_VALUE_X_ADD 1
@@ -755,11 +1774,32 @@ class OSystem_RETRO : public EventsBaseBackend, public PaletteManager {
 #define ANALOG_THRESHOLD2 23000
 #define ANALOG_THRESHOLD3 31000
 
+      static int analogStep(int16_t value)
+      {
+         const int magnitude = ABS((int)value);
+         const int step = (magnitude > ANALOG_THRESHOLD3) ? 4 : (magnitude > ANALOG_THRESHOLD2) ? 2 : (magnitude > ANALOG_THRESHOLD1) ? 1 : 0;
+         return (value < 0) ? -step : step;
+      }
+
+      void queueMouseEvent(Common::EventType type, RetroMouseCoords coords, int x = 0, int y = 0)
+      {
+         Common::Event ev;
+         ev.type = type;
+         ev.mouse.x = x;
+         ev.mouse.y = y;
+         _events.push_back(RetroQueuedEvent(ev, coords));
+      }
+
+      // Runs on the frontend thread in threaded mode, so it may not touch
+      // the mouse position or the screen; see RetroMouseCoords.
       void processMouse(retro_input_state_t aCallback)
       {
          int16_t joy_x, joy_y, x, y;
+         int joy_dx, joy_dy;
          bool do_joystick, down;
 
+         Common::StackLock lock(_eventsMutex);
+
          static const uint32_t retroButtons[2] = {RETRO_DEVICE_ID_MOUSE_LEFT, RETRO_DEVICE_ID_MOUSE_RIGHT};
          static const Common::EventType eventID[2][2] =
          {
@@ -767,131 +1807,37 @@ class OSystem_RETRO : public EventsBaseBackend, public PaletteManager {
             {Common::EVENT_RBUTTONDOWN, Common::EVENT_RBUTTONUP}
          };
 
-         down = false;
-         do_joystick = false;
          x = aCallback(0, RETRO_DEVICE_MOUSE, 0, RETRO_DEVICE_ID_MOUSE_X);
          y = aCallback(0, RETRO_DEVICE_MOUSE, 0, RETRO_DEVICE_ID_MOUSE_Y);
          joy_x = aCallback(0, RETRO_DEVICE_ANALOG, RETRO_DEVICE_INDEX_ANALOG_LEFT, RETRO_DEVICE_ID_ANALOG_X);
          joy_y = aCallback(0, RETRO_DEVICE_ANALOG, RETRO_DEVICE_INDEX_ANALOG_LEFT, RETRO_DEVICE_ID_ANALOG_Y);
 
-         if (joy_x > ANALOG_THRESHOLD3)
-         {
-            _mouseX += 4*ANALOG_VALUE_X_ADD;
-            _mouseX = (_mouseX < 0) ? 0 : _mouseX;
-            _mouseX = (_mouseX >= _screen.w) ? _screen.w : _mouseX;
-            do_joystick = true;
-         }
-         else if (joy_x < -ANALOG_THRESHOLD3)
-         {
-            _mouseX -= 4*ANALOG_VALUE_X_ADD;
-            _mouseX = (_mouseX < 0) ? 0 : _mouseX;
-            _mouseX = (_mouseX >= _screen.w) ? _screen.w : _mouseX;
-            do_joystick = true;
-         }
-         else if (joy_x > ANALOG_THRESHOLD2)
-         {
-            _mouseX += 2*ANALOG_VALUE_X_ADD;
-            _mouseX = (_mouseX < 0) ? 0 : _mouseX;
-            _mouseX = (_mouseX >= _screen.w) ? _screen.w : _mouseX;
-            do_joystick = true;
-         }
-         else if (joy_x < -ANALOG_THRESHOLD2)
-         {
-            _mouseX -= 2*ANALOG_VALUE_X_ADD;
-            _mouseX = (_mouseX < 0) ? 0 : _mouseX;
-            _mouseX = (_mouseX >= _screen.w) ? _screen.w : _mouseX;
-            do_joystick = true;
-         }
-         else if (joy_x > ANALOG_THRESHOLD1)
-         {
-            _mouseX += ANALOG_VALUE_X_ADD;
-            _mouseX = (_mouseX < 0) ? 0 : _mouseX;
-            _mouseX = (_mouseX >= _screen.w) ? _screen.w : _mouseX;
-            do_joystick = true;
-         }
-         else if (joy_x < -ANALOG_THRESHOLD1)
-         {
-            _mouseX -= ANALOG_VALUE_X_ADD;
-            _mouseX = (_mouseX < 0) ? 0 : _mouseX;
-            _mouseX = (_mouseX >= _screen.w) ? _screen.w : _mouseX;
-            do_joystick = true;
-         }
+         joy_dx = analogStep(joy_x) * ANALOG_VALUE_X_ADD;
+         joy_dy = analogStep(joy_y) * ANALOG_VALUE_Y_ADD;
+         do_joystick = joy_dx || joy_dy;
 
-         if (joy_y > ANALOG_THRESHOLD3)
-         {
-            _mouseY += 4*ANALOG_VALUE_Y_ADD;
-            _mouseY = (_mouseY < 0) ? 0 : _mouseY;
-            _mouseY = (_mouseY >= _screen.h) ? _screen.h : _mouseY;
-            do_joystick = true;
-         }
-         else if (joy_y < -ANALOG_THRESHOLD3)
-         {
-            _mouseY -= 4*ANALOG_VALUE_Y_ADD;
-            _mouseY = (_mouseY < 0) ? 0 : _mouseY;
-            _mouseY = (_mouseY >= _screen.h) ? _screen.h : _mouseY;
-            do_joystick = true;
-         }
-         else if (joy_y > ANALOG_THRESHOLD2)
-         {
-            _mouseY += 2*ANALOG_VALUE_Y_ADD;
-            _mouseY = (_mouseY < 0) ? 0 : _mouseY;
-            _mouseY = (_mouseY >= _screen.h) ? _screen.h : _mouseY;
-            do_joystick = true;
-         }
-         else if (joy_y < -ANALOG_THRESHOLD2)
+         if (aCallback(0, RETRO_DEVICE_JOYPAD, 0, RETRO_DEVICE_ID_JOYPAD_LEFT))
          {
-            _mouseY -= 2*ANALOG_VALUE_Y_ADD;
-            _mouseY = (_mouseY < 0) ? 0 : _mouseY;
-            _mouseY = (_mouseY >= _screen.h) ? _screen.h : _mouseY;
+            joy_dx -= 2*ANALOG_VALUE_X_ADD;
             do_joystick = true;
          }
-         else if (joy_y > ANALOG_THRESHOLD1)
+
+         if (aCallback(0, RETRO_DEVICE_JOYPAD, 0, RETRO_DEVICE_ID_JOYPAD_RIGHT))
          {
-            _mouseY += ANALOG_VALUE_Y_ADD; 
-            _mouseY = (_mouseY < 0) ? 0 : _mouseY;
-            _mouseY = (_mouseY >= _screen.h) ? _screen.h : _mouseY;
+            joy_dx += 2*ANALOG_VALUE_X_ADD;
             do_joystick = true;
          }
-         else if (joy_y < -ANALOG_THRESHOLD1)
+
+         if (aCallback(0, RETRO_DEVICE_JOYPAD, 0, RETRO_DEVICE_ID_JOYPAD_UP))
          {
-            _mouseY -= ANALOG_VALUE_Y_ADD; 
-            _mouseY = (_mouseY < 0) ? 0 : _mouseY;
-            _mouseY = (_mouseY >= _screen.h) ? _screen.h : _mouseY;
+            joy_dy -= 2*ANALOG_VALUE_Y_ADD;
             do_joystick = true;
          }
 
+         if (aCallback(0, RETRO_DEVICE_JOYPAD, 0, RETRO_DEVICE_ID_JOYPAD_DOWN))
          {
-            if (aCallback(0, RETRO_DEVICE_JOYPAD, 0, RETRO_DEVICE_ID_JOYPAD_LEFT))
-            {
-               _mouseX -= 2*ANALOG_VALUE_X_ADD;
-               _mouseX = (_mouseX < 0) ? 0 : _mouseX;
-               _mouseX = (_mouseX >= _screen.w) ? _screen.w : _mouseX;
-               do_joystick = true;
-            }
-
-            if (aCallback(0, RETRO_DEVICE_JOYPAD, 0, RETRO_DEVICE_ID_JOYPAD_RIGHT))
-            {
-               _mouseX += 2*ANALOG_VALUE_X_ADD;
-               _mouseX = (_mouseX < 0) ? 0 : _mouseX;
-               _mouseX = (_mouseX >= _screen.w) ? _screen.w : _mouseX;
-               do_joystick = true;
-            }
-
-            if (aCallback(0, RETRO_DEVICE_JOYPAD, 0, RETRO_DEVICE_ID_JOYPAD_UP))
-            {
-               _mouseY -= 2*ANALOG_VALUE_Y_ADD; 
-               _mouseY = (_mouseY < 0) ? 0 : _mouseY;
-               _mouseY = (_mouseY >= _screen.h) ? _screen.h : _mouseY;
-               do_joystick = true;
-            }
-
-            if (aCallback(0, RETRO_DEVICE_JOYPAD, 0, RETRO_DEVICE_ID_JOYPAD_DOWN))
-            {
-               _mouseY += 2*ANALOG_VALUE_Y_ADD; 
-               _mouseY = (_mouseY < 0) ? 0 : _mouseY;
-               _mouseY = (_mouseY >= _screen.h) ? _screen.h : _mouseY;
-               do_joystick = true;
-            }
+            joy_dy += 2*ANALOG_VALUE_Y_ADD;
+            do_joystick = true;
          }
 
          if (aCallback(0, RETRO_DEVICE_JOYPAD, 0, RETRO_DEVICE_ID_JOYPAD_SELECT))
@@ -904,65 +1850,35 @@ class OSystem_RETRO : public EventsBaseBackend, public PaletteManager {
 	int p_x = aCallback(0, RETRO_DEVICE_POINTER, 0, RETRO_DEVICE_ID_POINTER_X);
 	int p_y = aCallback(0, RETRO_DEVICE_POINTER, 0, RETRO_DEVICE_ID_POINTER_Y);
 	int p_press  = aCallback(0, RETRO_DEVICE_POINTER, 0,RETRO_DEVICE_ID_POINTER_PRESSED);
-	int px=(int)((p_x+0x7fff)*_screen.w /0xffff);
-	int py=(int)((p_y+0x7fff)*_screen.h/0xffff);
-	//printf("(%d,%d) p:%d\n",px,py,pp);
 
 	static int ptrhold=0;
 
 	if(p_press)ptrhold++;
 	else ptrhold=0;
 
-	if(ptrhold>0){
-	   _mouseX = px;
-	   _mouseY = py;
-
-            Common::Event ev;
-            ev.type = Common::EVENT_MOUSEMOVE;
-            ev.mouse.x = _mouseX;
-            ev.mouse.y = _mouseY;
-            _events.push_back(ev);
-	}
+	if(ptrhold>0)
+	    queueMouseEvent(Common::EVENT_MOUSEMOVE, kRetroMouseAbsolute, p_x, p_y);
 
 	if(ptrhold>10 && _ptrmouseButton==0){
 	    _ptrmouseButton=1;
-            Common::Event ev;
-            ev.type = eventID[0][_ptrmouseButton ? 0 : 1];
-            ev.mouse.x = _mouseX;
-            ev.mouse.y = _mouseY;
-            _events.push_back(ev);
+	    queueMouseEvent(eventID[0][_ptrmouseButton ? 0 : 1], kRetroMouseCurrent);
 	}
 	else if (ptrhold==0 && _ptrmouseButton==1){
 	    _ptrmouseButton=0;
-            Common::Event ev;
-            ev.type = eventID[0][_ptrmouseButton ? 0 : 1];
-            ev.mouse.x = _mouseX;
-            ev.mouse.y = _mouseY;
-            _events.push_back(ev);
+	    queueMouseEvent(eventID[0][_ptrmouseButton ? 0 : 1], kRetroMouseCurrent);
 	}
 
 #endif
 
          if (do_joystick)
-         {
-            Common::Event ev;
-            ev.type = Common::EVENT_MOUSEMOVE;
-            ev.mouse.x = _mouseX;
-            ev.mouse.y = _mouseY;
-            _events.push_back(ev);
-         }
+            queueMouseEvent(Common::EVENT_MOUSEMOVE, kRetroMouseRelative, joy_dx, joy_dy);
 
          down = aCallback(0, RETRO_DEVICE_JOYPAD, 0, RETRO_DEVICE_ID_JOYPAD_A);
 
          if(down != _joypadmouseButtons[0])
          {
             _joypadmouseButtons[0] = down;
-
-            Common::Event ev;
-            ev.type = eventID[0][down ? 0 : 1];
-            ev.mouse.x = _mouseX;
-            ev.mouse.y = _mouseY;
-            _events.push_back(ev);
+            queueMouseEvent(eventID[0][down ? 0 : 1], kRetroMouseCurrent);
          }
 
          down = aCallback(0, RETRO_DEVICE_JOYPAD, 0, RETRO_DEVICE_ID_JOYPAD_B);
@@ -970,12 +1886,7 @@ class OSystem_RETRO : public EventsBaseBackend, public PaletteManager {
          if(down != _joypadmouseButtons[1])
          {
             _joypadmouseButtons[1] = down;
-
-            Common::Event ev;
-            ev.type = eventID[1][down ? 0 : 1];
-            ev.mouse.x = _mouseX;
-            ev.mouse.y = _mouseY;
-            _events.push_back(ev);
+            queueMouseEvent(eventID[1][down ? 0 : 1], kRetroMouseCurrent);
          }
 
          down = aCallback(0, RETRO_DEVICE_JOYPAD, 0, RETRO_DEVICE_ID_JOYPAD_START);
@@ -987,37 +1898,16 @@ class OSystem_RETRO : public EventsBaseBackend, public PaletteManager {
          }
 
          if(x || y)
-         {
-            _mouseX += x;
-            _mouseX = (_mouseX < 0) ? 0 : _mouseX;
-            _mouseX = (_mouseX >= _screen.w) ? _screen.w : _mouseX;
-
-            _mouseY += y;
-            _mouseY = (_mouseY < 0) ? 0 : _mouseY;
-            _mouseY = (_mouseY >= _screen.h) ? _screen.h : _mouseY;
-
-            Common::Event ev;
-            ev.type = Common::EVENT_MOUSEMOVE;
-            ev.mouse.x = _mouseX;
-            ev.mouse.y = _mouseY;
-            _events.push_back(ev);
-         }
-
+            queueMouseEvent(Common::EVENT_MOUSEMOVE, kRetroMouseRelative, x, y);
 
          for(int i = 0; i < 2; i ++)
          {
-            Common::Event ev;
             bool down = aCallback(0, RETRO_DEVICE_MOUSE, 0, retroButtons[i]);
             if(down != _mouseButtons[i])
             {
                _mouseButtons[i] = down;
-
-               ev.type = eventID[i][down ? 0 : 1];
-               ev.mouse.x = _mouseX;
-               ev.mouse.y = _mouseY;
-               _events.push_back(ev);
+               queueMouseEvent(eventID[i][down ? 0 : 1], kRetroMouseCurrent);
             }
-
          }
       }
 
@@ -1045,6 +1935,7 @@ class OSystem_RETRO : public EventsBaseBackend, public PaletteManager {
          if(ev.kbd.ascii >= 97 && ev.kbd.ascii <= 122 && (_keyflags & Common::KBD_SHIFT))
             ev.kbd.ascii = ev.kbd.ascii & ~0x20;
 
+         Common::StackLock lock(_eventsMutex);
          _events.push_back(ev);
       }
 
@@ -1052,6 +1943,8 @@ class OSystem_RETRO : public EventsBaseBackend, public PaletteManager {
       {
          Common::Event ev;
          ev.type = Common::EVENT_QUIT;
+
+         Common::StackLock lock(_eventsMutex);
          _events.push_back(ev);
       }
 };
@@ -1066,6 +1959,11 @@ const Graphics::Surface& getScreen()
    return ((OSystem_RETRO*)g_system)->getScreen();
 }
 
+bool retroScreenChanged()
+{
+   return ((OSystem_RETRO*)g_system)->screenChanged();
+}
+
 void retroProcessMouse(retro_input_state_t aCallback)
 {
    ((OSystem_RETRO*)g_system)->processMouse(aCallback);
@@ -1076,6 +1974,76 @@ void retroPostQuit()
    ((OSystem_RETRO*)g_system)->postQuit();
 }
 
+bool retroSaveState(Common::WriteStream &aOut)
+{
+   return ((OSystem_RETRO*)g_system)->requestStateOp(kRetroStateSave, &aOut, 0);
+}
+
+bool retroLoadState(Common::SeekableReadStream &aIn)
+{
+   return ((OSystem_RETRO*)g_system)->requestStateOp(kRetroStateLoad, 0, &aIn);
+}
+
+void retroSetCpuFeatures(uint64_t aFlags)
+{
+   s_blitKernels = retroBlitSelect(aFlags);
+
+   if (log_cb)
+      log_cb(RETRO_LOG_INFO, "Using %s blitters.\n", s_blitKernels->name);
+}
+
+void retroSetOutputXRGB8888(bool aEnable)
+{
+   s_outputXRGB8888 = aEnable;
+}
+
+void retroSetAudioRate(unsigned aRate)
+{
+   s_audioRate = aRate;
+}
+
+void retroSetResamplerQuality(unsigned aQuality)
+{
+   s_resamplerQuality = (Audio::RateConverterQuality)MIN<unsigned>(aQuality, Audio::kRateQualityHigh);
+}
+
+void retroSetThreadSafe(bool aEnable)
+{
+   s_threadSafe = aEnable;
+}
+
+void retroSetThreaded(bool aEnable)
+{
+   s_threaded = aEnable;
+}
+
+void retroSetFrameTime(uint32_t aMicros)
+{
+   // Leave a quarter of the frame to the frontend.
+   s_sliceBudget = CLIP<uint32>(aMicros * 3 / 4000, 1, 50);
+}
+
+void retroSetDeterministic(bool aEnable, uint32_t aFrameMicros)
+{
+   s_deterministic = aEnable;
+   s_frameMicros = aFrameMicros;
+}
+
+void retroAdvanceClock()
+{
+   ((OSystem_RETRO*)g_system)->advanceClock();
+}
+
+void retroGetSchedulerStats(RetroSchedulerStats *aStats)
+{
+   *aStats = ((OSystem_RETRO*)g_system)->_schedulerStats;
+}
+
+unsigned retroReadAudio(int16_t *aOut, unsigned aFrames)
+{
+   return ((OSystem_RETRO*)g_system)->readAudio(aOut, aFrames);
+}
+
 void retroSetSystemDir(const char* aPath)
 {
    s_systemDir = Common::String(aPath ? aPath : ".");
@@ -25,6 +25,7 @@
 
 #define FORBIDDEN_SYMBOL_ALLOW_ALL
 #include "libretro.h"
+#include "common/atomic.h"
 
 #ifndef F_OK
 #define F_OK 0
@@ -42,12 +43,56 @@
 extern int access(const char *path, int amode);
 #endif
 
+/* Platforms where the backend can hand out real mutexes. */
+#if (defined(_WIN32) && !defined(_XBOX)) || ((defined(__unix__) || defined(__APPLE__)) && !defined(GEKKO) && !defined(__CELLOS_LV2__))
+#define RETRO_HAVE_THREADS
+#endif
+
+
 OSystem* retroBuildOS();
 const Graphics::Surface& getScreen();
+bool retroScreenChanged();
 
 void retroProcessMouse(retro_input_state_t aCallback);
 void retroPostQuit();
 
+namespace Common {
+class WriteStream;
+class SeekableReadStream;
+}
+
+/* Why the engine coroutine handed control back to retro_run. */
+enum RetroYieldReason
+{
+   kRetroYieldFrame,   /* updateScreen produced a new frame */
+   kRetroYieldSlice,   /* the time slice ran out while polling */
+   kRetroYieldDelay,   /* a delay would have run past the slice */
+   kRetroYieldStateOp, /* pollEvent ran a state op for the frontend */
+   kRetroYieldReasons
+};
+
+struct RetroSchedulerStats
+{
+   unsigned yields[kRetroYieldReasons];
+   unsigned slices;
+   unsigned engineMillis;
+};
+
+void retroGetSchedulerStats(RetroSchedulerStats *aStats);
+
+bool retroSaveState(Common::WriteStream &aOut);
+bool retroLoadState(Common::SeekableReadStream &aIn);
+
+void retroSetCpuFeatures(uint64_t aFlags);
+void retroSetOutputXRGB8888(bool aEnable);
+void retroSetAudioRate(unsigned aRate);
+void retroSetResamplerQuality(unsigned aQuality);
+void retroSetThreadSafe(bool aEnable);
+void retroSetThreaded(bool aEnable);
+void retroSetFrameTime(uint32_t aMicros);
+void retroSetDeterministic(bool aEnable, uint32_t aFrameMicros);
+void retroAdvanceClock();
+unsigned retroReadAudio(int16_t *aOut, unsigned aFrames);
 void retroSetSystemDir(const char* aPath);
 void retroSetSaveDir(const char* aPath);
 
@@ -81,6 +81,8 @@ static const char HELP_STRING[] =
 	"                           and start the first one. Use --path=PATH before --auto-detect\n"
 	"                           to specify a directory.\n"
 	"  --recursive              In combination with --add or --detect recurse down all subdirectories\n"
+	"  --detect-benchmark       Like --detect, but display the time spent in the detector\n"
+	"                           of each engine instead of the games found\n"
 #if defined(WIN32) && !defined(_WIN32_WCE) && !defined(__SYMBIAN32__)
 	"  --console                Enable the console window (default:enabled)\n"
 #endif
@@ -132,6 +134,7 @@ static const char HELP_STRING[] =
 	"  --enable-gs              Enable Roland GS mode for MIDI playback\n"
 	"  --output-rate=RATE       Select output sample rate in Hz (e.g. 22050)\n"
 	"  --opl-driver=DRIVER      Select AdLib (OPL) emulator (db, mame)\n"
+	"  --opl-capture=FILE       Log all AdLib (OPL) register writes to FILE\n"
 	"  --aspect-ratio           Enable aspect ratio correction\n"
 	"  --render-mode=MODE       Enable additional render modes (hercGreen, hercAmber,\n"
 	"                           cga, ega, vga, amiga, fmtowns, pc9821, pc9801, 2gs,\n"
@@ -224,6 +227,9 @@ void registerDefaults() {
 	ConfMan.registerDefault("cdrom", 0);
 
 	ConfMan.registerDefault("enable_unsupported_game_warning", true);
+	ConfMan.registerDefault("detection_cache", true);
+	ConfMan.registerDefault("detection_threads", 0);
+	ConfMan.registerDefault("video_decode_ahead", 0);
 
 	// Game specific
 	ConfMan.registerDefault("path", "");
@@ -428,6 +434,9 @@ Common::String parseCommandLine(Common::StringMap &settings, int argc, const cha
 			DO_LONG_COMMAND("detect")
 			END_COMMAND
 
+			DO_LONG_COMMAND("detect-benchmark")
+			END_COMMAND
+
 			DO_LONG_COMMAND("auto-detect")
 			END_COMMAND
 
@@ -494,6 +503,9 @@ Common::String parseCommandLine(Common::StringMap &settings, int argc, const cha
 			DO_LONG_OPTION("opl-driver")
 			END_OPTION
 
+			DO_LONG_OPTION("opl-capture")
+			END_OPTION
+
 			DO_OPTION('g', "gfx-mode")
 			END_OPTION
 
@@ -806,24 +818,75 @@ static void listAudioDevices() {
 	}
 }
 
-/** Display all games in the given directory, or current directory if empty */
-static GameList getGameList(const Common::FSNode &dir) {
-	Common::FSList files;
+/** The games detected in a directory by scanGames() */
+struct ScannedDirectory {
+	Common::String path;
+	bool listed;
+	GameList games;
+	Common::Array<uint> subdirectories;
+};
 
-	//Collect all files from directory
-	if (!dir.getChildren(files, Common::FSNode::kListAll)) {
-		printf("Path %s does not exist or is not a directory.\n", dir.getPath().c_str());
-		return GameList();
-	}
+typedef Common::Array<ScannedDirectory> ScannedDirectoryList;
 
-	// detect Games
-	GameList candidates(EngineMan.detectGames(files));
-	Common::String dataPath = dir.getPath();
-	// add game data path
-	for (GameList::iterator v = candidates.begin(); v != candidates.end(); ++v) {
-		(*v)["path"] = dataPath;
+static void addPreOrder(const ScannedDirectoryList &scanned, uint index, ScannedDirectoryList &ordered) {
+	ordered.push_back(scanned[index]);
+	for (uint i = 0; i < scanned[index].subdirectories.size(); ++i)
+		addPreOrder(scanned, scanned[index].subdirectories[i], ordered);
+}
+
+/**
+ * Detect all games in the given directory, and optionally its subdirectories.
+ * All directories of one level are listed and detected in parallel. The
+ * result is ordered as if the directories were visited depth first.
+ */
+static ScannedDirectoryList scanGames(const Common::FSNode &dir, bool recursive, DetectionTimingList *timings = 0) {
+	ScannedDirectoryList scanned;
+	DetectionDirectoryList level;
+	level.push_back(DetectionDirectory(dir));
+
+	while (!level.empty()) {
+		DetectionTimingList levelTimings;
+		EngineMan.listDirectories(level);
+		EngineMan.detectGames(level, timings ? &levelTimings : 0);
+
+		if (timings) {
+			// Each level runs the same engines in the same order
+			if (timings->empty()) {
+				*timings = levelTimings;
+			} else {
+				for (uint i = 0; i < timings->size() && i < levelTimings.size(); ++i)
+					(*timings)[i].milliseconds += levelTimings[i].milliseconds;
+			}
+		}
+
+		const uint first = scanned.size();
+		DetectionDirectoryList next;
+		for (uint i = 0; i < level.size(); ++i) {
+			ScannedDirectory result;
+			result.path = level[i].node.getPath();
+			result.listed = level[i].listed;
+			result.games = level[i].games;
+
+			// add game data path
+			for (GameList::iterator v = result.games.begin(); v != result.games.end(); ++v)
+				(*v)["path"] = result.path;
+
+			if (recursive) {
+				for (Common::FSList::const_iterator file = level[i].files.begin(); file != level[i].files.end(); ++file) {
+					if (file->isDirectory()) {
+						result.subdirectories.push_back(first + level.size() + next.size());
+						next.push_back(DetectionDirectory(*file));
+					}
+				}
+			}
+			scanned.push_back(result);
+		}
+		level = next;
 	}
-	return candidates;
+
+	ScannedDirectoryList ordered;
+	addPreOrder(scanned, 0, ordered);
+	return ordered;
 }
 
 static bool addGameToConf(const GameDescriptor &gd) {
@@ -853,17 +916,19 @@ static bool addGameToConf(const GameDescriptor &gd) {
 }
 
 static GameList recListGames(const Common::FSNode &dir, const Common::String &gameId, bool recursive) {
-	GameList list = getGameList(dir);
+	const ScannedDirectoryList scanned = scanGames(dir, recursive);
+	GameList list;
 
-	if (recursive) {
-		Common::FSList files;
-		dir.getChildren(files, Common::FSNode::kListDirectoriesOnly);
-		for (Common::FSList::const_iterator file = files.begin(); file != files.end(); ++file) {
-			GameList rec = recListGames(*file, gameId, recursive);
-			for (GameList::const_iterator game = rec.begin(); game != rec.end(); ++game) {
-				if (gameId.empty() || game->gameid().c_str() == gameId)
-					list.push_back(*game);
-			}
+	for (uint i = 0; i < scanned.size(); ++i) {
+		if (!scanned[i].listed) {
+			printf("Path %s does not exist or is not a directory.\n", scanned[i].path.c_str());
+			continue;
+		}
+
+		// Only the games found in subdirectories are filtered
+		for (GameList::const_iterator game = scanned[i].games.begin(); game != scanned[i].games.end(); ++game) {
+			if (i == 0 || gameId.empty() || game->gameid().c_str() == gameId)
+				list.push_back(*game);
 		}
 	}
 
@@ -899,24 +964,23 @@ static Common::String detectGames(const Common::String &path, const Common::Stri
 
 static int recAddGames(const Common::FSNode &dir, const Common::String &game, bool recursive) {
 	int count = 0;
-	GameList list = getGameList(dir);
-	for (GameList::iterator v = list.begin(); v != list.end(); ++v) {
-		if (v->gameid().c_str() != game && !game.empty()) {
-			printf("Found %s, only adding %s per --game option, ignoring...\n", v->gameid().c_str(), game.c_str());
-		} else if (!addGameToConf(*v)) {
-			// TODO Is it reall the case that !addGameToConf iff already added?
-			printf("Found %s, but has already been added, skipping\n", v->gameid().c_str());
-		} else {
-			printf("Found %s, adding...\n", v->gameid().c_str());
-			count++;
+	const ScannedDirectoryList scanned = scanGames(dir, recursive);
+
+	for (uint i = 0; i < scanned.size(); ++i) {
+		if (!scanned[i].listed) {
+			printf("Path %s does not exist or is not a directory.\n", scanned[i].path.c_str());
+			continue;
 		}
-	}
 
-	if (recursive) {
-		Common::FSList files;
-		if (dir.getChildren(files, Common::FSNode::kListDirectoriesOnly)) {
-			for (Common::FSList::const_iterator file = files.begin(); file != files.end(); ++file) {
-				count += recAddGames(*file, game, recursive);
+		for (GameList::const_iterator v = scanned[i].games.begin(); v != scanned[i].games.end(); ++v) {
+			if (v->gameid().c_str() != game && !game.empty()) {
+				printf("Found %s, only adding %s per --game option, ignoring...\n", v->gameid().c_str(), game.c_str());
+			} else if (!addGameToConf(*v)) {
+				// TODO Is it reall the case that !addGameToConf iff already added?
+				printf("Found %s, but has already been added, skipping\n", v->gameid().c_str());
+			} else {
+				printf("Found %s, adding...\n", v->gameid().c_str());
+				count++;
 			}
 		}
 	}
@@ -936,6 +1000,37 @@ static bool addGames(const Common::String &path, const Common::String &game, boo
 	return true;
 }
 
+static bool compareTimings(const DetectionTiming &a, const DetectionTiming &b) {
+	if (a.milliseconds != b.milliseconds)
+		return a.milliseconds > b.milliseconds;
+	return scumm_stricmp(a.engine.c_str(), b.engine.c_str()) < 0;
+}
+
+/** Detect the games in the given directory and display the time spent in each engine */
+static void runDetectBenchmark(const Common::String &path, bool recursive) {
+	Common::FSNode dir(path);
+	DetectionTimingList timings;
+
+	const uint32 start = g_system->getMillis();
+	const ScannedDirectoryList scanned = scanGames(dir, recursive, &timings);
+	const uint32 total = g_system->getMillis() - start;
+
+	uint games = 0;
+	for (uint i = 0; i < scanned.size(); ++i)
+		games += scanned[i].games.size();
+
+	Common::sort(timings.begin(), timings.end(), compareTimings);
+	printf("Engine               Time (ms)\n");
+	printf("-------------------- ---------\n");
+	for (DetectionTimingList::const_iterator t = timings.begin(); t != timings.end(); ++t)
+		printf("%-20s %9u\n", t->engine.c_str(), t->milliseconds);
+
+	printf("\nDetected %u games in %u directories in %u ms using up to %u threads\n",
+			games, scanned.size(), total, EngineManager::getDetectionThreadCount());
+	if (ConfMan.getBool("detection_cache"))
+		printf("Checksums were read from the detection cache where possible, disable detection_cache to time a cold run\n");
+}
+
 #ifdef DETECTOR_TESTING_HACK
 static void runDetectorTest() {
 	// HACK: The following code can be used to test the detection code of our
@@ -1186,6 +1281,9 @@ bool processSettings(Common::String &command, Common::StringMap &settings, Commo
 	} else if (command == "add") {
 		addGames(settings["path"], settings["game"], settings["recursive"] == "true");
 		return true;
+	} else if (command == "detect-benchmark") {
+		runDetectBenchmark(settings["path"], settings["recursive"] == "true");
+		return true;
 	}
 #ifdef DETECTOR_TESTING_HACK
 	else if (command == "test-detector") {
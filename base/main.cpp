@@ -32,6 +32,7 @@
 #define FORBIDDEN_SYMBOL_EXCEPTION_printf
 
 #include "engines/engine.h"
+#include "engines/detectioncache.h"
 #include "engines/metaengine.h"
 #include "base/commandLine.h"
 #include "base/plugins.h"
@@ -428,6 +429,8 @@ extern "C" int scummvm_main(int argc, const char * const argv[]) {
 	if (Base::processSettings(command, settings, res)) {
 		if (res.getCode() != Common::kNoError)
 			warning("%s", res.getDesc().c_str());
+		// Commands like --add and --detect may have filled the detection cache
+		DetectionCache::instance().flush(true);
 		return res.getCode();
 	}
 
@@ -616,6 +619,8 @@ extern "C" int scummvm_main(int argc, const char * const argv[]) {
 	PluginManager::instance().unloadAllPlugins();
 	PluginManager::destroy();
 	GUI::GuiManager::destroy();
+	// Writes the cache, which needs the config manager
+	DetectionCache::destroy();
 	Common::ConfigManager::destroy();
 	Common::DebugManager::destroy();
 	Common::OSDMessageQueue::destroy();
@@ -444,8 +444,13 @@ void PluginManager::addToPluginsInMemList(Plugin *plugin) {
 
 // Engine plugins
 
+#include "engines/detectioncache.h"
 #include "engines/metaengine.h"
 
+#include "common/atomic.h"
+#include "common/system.h"
+#include "common/workerpool.h"
+
 namespace Common {
 DECLARE_SINGLETON(EngineManager);
 }
@@ -527,6 +532,7 @@ GameList EngineManager::detectGames(const Common::FSList &fslist) const {
 			candidates.push_back((**iter)->detectGames(fslist));
 		}
 	} while (PluginManager::instance().loadNextPlugin());
+	DetectionCache::instance().flush();
 	return candidates;
 }
 
@@ -534,6 +540,173 @@ const EnginePlugin::List &EngineManager::getPlugins() const {
 	return (const EnginePlugin::List &)PluginManager::instance().getPlugins(PLUGIN_TYPE_ENGINE);
 }
 
+uint EngineManager::getDetectionThreadCount() {
+	const int threads = ConfMan.getInt("detection_threads");
+	if (threads > 0)
+		return threads;
+
+	// Detection mostly waits for the disk, so use more threads than cores
+	return 2 * Common::WorkerPool::getCPUCount();
+}
+
+namespace {
+
+/** Lists one directory per job. */
+class DirectoryLister {
+public:
+	DirectoryLister(DetectionDirectoryList &dirs, uint first) : _dirs(dirs), _first(first) {}
+
+	void list(uint index) {
+		DetectionDirectory &dir = _dirs[_first + index];
+		dir.files.clear();
+		dir.listed = dir.node.getChildren(dir.files, Common::FSNode::kListAll);
+	}
+
+private:
+	DetectionDirectoryList &_dirs;
+	const uint _first;
+};
+
+/**
+ * Runs the parallel detectors of a batch of plugins on a list of directories.
+ *
+ * Each job handles one directory for every chunks-th of these plugins. As
+ * FSNodes must not be shared between threads, the first chunk uses the
+ * directory listing while the others list the directory again by themselves.
+ */
+class ParallelDetector {
+public:
+	ParallelDetector(const DetectionDirectoryList &dirs, const EnginePlugin::List &plugins, const Common::Array<uint> &parallel, uint chunks, Common::Array<GameList> &results)
+		: _dirs(dirs), _plugins(plugins), _parallel(parallel), _chunks(chunks), _results(results), _times(new uint32[plugins.size()]) {
+		for (uint i = 0; i < plugins.size(); ++i)
+			_times[i] = 0;
+
+		_nodes.resize(dirs.size() * chunks);
+		for (uint i = 0; i < dirs.size(); ++i) {
+			for (uint chunk = 1; chunk < chunks; ++chunk) {
+				if (dirs[i].listed)
+					_nodes[i * chunks + chunk] = Common::FSNode(Common::String(dirs[i].node.getPath().c_str()));
+			}
+		}
+	}
+
+	~ParallelDetector() {
+		delete[] _times;
+	}
+
+	uint getJobCount() const { return _dirs.size() * _chunks; }
+
+	uint32 getTime(uint plugin) const { return Common::atomicLoad(&_times[plugin]); }
+
+	void detect(uint index) {
+		const uint dir = index / _chunks;
+		const uint chunk = index % _chunks;
+		if (!_dirs[dir].listed)
+			return;
+
+		const Common::FSList *files = &_dirs[dir].files;
+		Common::FSList ownFiles;
+		if (chunk > 0) {
+			if (!_nodes[index].getChildren(ownFiles, Common::FSNode::kListAll))
+				return;
+			files = &ownFiles;
+		}
+
+		for (uint i = chunk; i < _parallel.size(); i += _chunks) {
+			const uint plugin = _parallel[i];
+			const uint32 start = g_system->getMillis();
+			_results[dir * _plugins.size() + plugin] = (*_plugins[plugin])->detectGames(*files);
+			Common::atomicAdd(&_times[plugin], g_system->getMillis() - start);
+		}
+	}
+
+private:
+	const DetectionDirectoryList &_dirs;
+	const EnginePlugin::List &_plugins;
+	const Common::Array<uint> &_parallel;
+	const uint _chunks;
+	Common::Array<GameList> &_results;
+	Common::Array<Common::FSNode> _nodes;
+	volatile uint32 *_times;
+};
+
+} // End of anonymous namespace
+
+void EngineManager::listDirectories(DetectionDirectoryList &dirs, uint first) const {
+	if (first >= dirs.size())
+		return;
+
+	DirectoryLister lister(dirs, first);
+	Common::WorkerPool pool(getDetectionThreadCount());
+	pool.run(Common::Functor1Mem<uint, void, DirectoryLister>(&lister, &DirectoryLister::list), dirs.size() - first);
+}
+
+void EngineManager::detectGames(DetectionDirectoryList &dirs, DetectionTimingList *timings) const {
+	for (uint i = 0; i < dirs.size(); ++i)
+		dirs[i].games.clear();
+	if (timings)
+		timings->clear();
+
+	// The cache has to exist before the worker threads use it
+	DetectionCache::instance().load();
+
+	Common::WorkerPool pool(getDetectionThreadCount());
+	PluginManager::instance().loadFirstPlugin();
+	do {
+		const EnginePlugin::List &plugins = getPlugins();
+		Common::Array<GameList> results;
+		results.resize(dirs.size() * plugins.size());
+
+		Common::Array<uint> parallel;
+		for (uint plugin = 0; plugin < plugins.size(); ++plugin) {
+			if ((*plugins[plugin])->supportsParallelDetection())
+				parallel.push_back(plugin);
+		}
+
+		// Split the engines up as well, when there are fewer directories than threads
+		uint chunks = 1;
+		if (!dirs.empty() && dirs.size() < pool.getThreadCount())
+			chunks = CLIP<uint>(pool.getThreadCount() / dirs.size(), 1, MAX<uint>(parallel.size(), 1));
+
+		ParallelDetector detector(dirs, plugins, parallel, chunks, results);
+		if (!parallel.empty())
+			pool.run(Common::Functor1Mem<uint, void, ParallelDetector>(&detector, &ParallelDetector::detect), detector.getJobCount());
+
+		// Everything else runs on this thread, after the workers finished
+		Common::Array<uint32> serialTimes;
+		serialTimes.resize(plugins.size());
+		for (uint plugin = 0; plugin < plugins.size(); ++plugin) {
+			serialTimes[plugin] = 0;
+			if ((*plugins[plugin])->supportsParallelDetection())
+				continue;
+
+			for (uint dir = 0; dir < dirs.size(); ++dir) {
+				if (!dirs[dir].listed)
+					continue;
+				const uint32 start = g_system->getMillis();
+				results[dir * plugins.size() + plugin] = (*plugins[plugin])->detectGames(dirs[dir].files);
+				serialTimes[plugin] += g_system->getMillis() - start;
+			}
+		}
+
+		// Merge in plugin order, like detectGames(const Common::FSList &) does
+		for (uint dir = 0; dir < dirs.size(); ++dir) {
+			for (uint plugin = 0; plugin < plugins.size(); ++plugin)
+				dirs[dir].games.push_back(results[dir * plugins.size() + plugin]);
+		}
+
+		if (timings) {
+			for (uint plugin = 0; plugin < plugins.size(); ++plugin) {
+				DetectionTiming timing;
+				timing.engine = plugins[plugin]->getName();
+				timing.milliseconds = serialTimes[plugin] + detector.getTime(plugin);
+				timings->push_back(timing);
+			}
+		}
+	} while (PluginManager::instance().loadNextPlugin());
+	DetectionCache::instance().flush();
+}
+
 
 // Music plugins
 
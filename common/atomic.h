@@ -0,0 +1,208 @@
+/* ScummVM - Graphic Adventure Engine
+ *
+ * ScummVM is the legal property of its developers, whose names
+ * are too numerous to list here. Please refer to the COPYRIGHT
+ * file distributed with this source distribution.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ */
+
+#ifndef COMMON_ATOMIC_H
+#define COMMON_ATOMIC_H
+
+#include "common/scummsys.h"
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+namespace Common {
+
+/**
+ * @name Atomic operations
+ *
+ * A minimal set of lock-free primitives, for state shared between engine
+ * code and the threads some backends run callbacks on (audio, timers).
+ *
+ * atomicLoad() has acquire and atomicStore() release semantics, they work
+ * on naturally aligned 32 bit integers and pointers. atomicExchange() and
+ * atomicAdd() work on 32 bit integers and are full barriers, as is
+ * memoryBarrier().
+ *
+ * On compilers without any support for these, plain memory accesses are
+ * used; that is only correct on single threaded ports.
+ * @{
+ */
+
+#if defined(__clang__) || (defined(__GNUC__) && (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 7)))
+
+template<typename T>
+inline T atomicLoad(const volatile T *ptr) {
+	return __atomic_load_n(ptr, __ATOMIC_ACQUIRE);
+}
+
+template<typename T>
+inline void atomicStore(volatile T *ptr, T value) {
+	__atomic_store_n(ptr, value, __ATOMIC_RELEASE);
+}
+
+template<typename T>
+inline T atomicExchange(volatile T *ptr, T value) {
+	return __atomic_exchange_n(ptr, value, __ATOMIC_SEQ_CST);
+}
+
+template<typename T>
+inline T atomicAdd(volatile T *ptr, T value) {
+	return __atomic_add_fetch(ptr, value, __ATOMIC_SEQ_CST);
+}
+
+inline void memoryBarrier() {
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+}
+
+#elif defined(__GNUC__)
+
+template<typename T>
+inline T atomicLoad(const volatile T *ptr) {
+	T value = *ptr;
+	__sync_synchronize();
+	return value;
+}
+
+template<typename T>
+inline void atomicStore(volatile T *ptr, T value) {
+	__sync_synchronize();
+	*ptr = value;
+}
+
+template<typename T>
+inline T atomicExchange(volatile T *ptr, T value) {
+	// __sync_lock_test_and_set is only an acquire barrier
+	__sync_synchronize();
+	return __sync_lock_test_and_set(ptr, value);
+}
+
+template<typename T>
+inline T atomicAdd(volatile T *ptr, T value) {
+	return __sync_add_and_fetch(ptr, value);
+}
+
+inline void memoryBarrier() {
+	__sync_synchronize();
+}
+
+#elif defined(_MSC_VER)
+
+template<typename T>
+inline T atomicLoad(const volatile T *ptr) {
+	T value = *ptr;
+	_ReadWriteBarrier();
+	return value;
+}
+
+template<typename T>
+inline void atomicStore(volatile T *ptr, T value) {
+	_ReadWriteBarrier();
+	*ptr = value;
+}
+
+inline int32 atomicExchange(volatile int32 *ptr, int32 value) {
+	return _InterlockedExchange((volatile long *)ptr, value);
+}
+
+inline uint32 atomicExchange(volatile uint32 *ptr, uint32 value) {
+	return (uint32)_InterlockedExchange((volatile long *)ptr, (long)value);
+}
+
+inline int32 atomicAdd(volatile int32 *ptr, int32 value) {
+	return _InterlockedExchangeAdd((volatile long *)ptr, value) + value;
+}
+
+inline uint32 atomicAdd(volatile uint32 *ptr, uint32 value) {
+	return (uint32)_InterlockedExchangeAdd((volatile long *)ptr, (long)value) + value;
+}
+
+inline void memoryBarrier() {
+	volatile long barrier = 0;
+	_InterlockedExchange(&barrier, 0);
+}
+
+#else
+
+template<typename T>
+inline T atomicLoad(const volatile T *ptr) {
+	return *ptr;
+}
+
+template<typename T>
+inline void atomicStore(volatile T *ptr, T value) {
+	*ptr = value;
+}
+
+template<typename T>
+inline T atomicExchange(volatile T *ptr, T value) {
+	T old = *ptr;
+	*ptr = value;
+	return old;
+}
+
+template<typename T>
+inline T atomicAdd(volatile T *ptr, T value) {
+	return *ptr += value;
+}
+
+inline void memoryBarrier() {
+}
+
+#endif
+
+/** @} */
+
+/**
+ * Busy waiting lock for very short critical sections, for example around
+ * lookups in a table shared between the threads of a Common::WorkerPool.
+ * Holders must not block or take long, since waiters spin on the CPU.
+ */
+class SpinLock {
+public:
+	SpinLock() : _locked(0) {}
+
+	void lock() {
+		while (atomicExchange(&_locked, 1u))
+			;
+	}
+
+	void unlock() {
+		atomicStore(&_locked, 0u);
+	}
+
+private:
+	volatile uint32 _locked;
+};
+
+/** Holds a SpinLock for as long as it is in scope. */
+class SpinLockHolder {
+public:
+	explicit SpinLockHolder(SpinLock &lock) : _lock(lock) { _lock.lock(); }
+	~SpinLockHolder() { _lock.unlock(); }
+
+private:
+	SpinLock &_lock;
+};
+
+} // End of namespace Common
+
+#endif
@@ -213,6 +213,16 @@ public:
 	 */
 	bool isWritable() const;
 
+	/**
+	 * Retrieves the size and the time of the last modification of the file
+	 * referred by this node, without opening it. The time is only meaningful
+	 * when compared against an earlier result for the same node.
+	 *
+	 * @return true if both values are known, false if the node does not
+	 *         exist or the backend can't provide them.
+	 */
+	bool getFileInfo(uint32 &size, uint32 &modificationTime) const;
+
 	/**
 	 * Creates a SeekableReadStream instance corresponding to the file
 	 * referred by this node. This assumes that the node actually refers
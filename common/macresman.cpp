@@ -246,6 +246,17 @@ bool MacResManager::open(const FSNode &path, const String &fileName) {
 	return false;
 }
 
+void MacResManager::listForkFiles(const FSNode &path, const String &fileName, FSList &files) {
+	// Keep in sync with open() above
+#ifdef MACOSX
+	files.push_back(FSNode(path.getPath() + "/" + fileName + "/..namedfork/rsrc"));
+#endif
+	files.push_back(path.getChild(fileName + ".rsrc"));
+	files.push_back(path.getChild(constructAppleDoubleName(fileName)));
+	files.push_back(path.getChild(fileName + ".bin"));
+	files.push_back(path.getChild(fileName));
+}
+
 bool MacResManager::exists(const String &fileName) {
 	// Try the file name by itself
 	if (File::exists(fileName))
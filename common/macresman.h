@@ -75,6 +75,17 @@ public:
 	 */
 	bool open(const FSNode &path, const String &fileName);
 
+	/**
+	 * List the files open(const FSNode &, const String &) may read the
+	 * forks from, whether they exist or not. Callers caching results
+	 * derived from the forks can use them to notice changes.
+	 *
+	 * @param path The path that holds the forks
+	 * @param fileName The base file name of the file
+	 * @param files Receives the candidate files
+	 */
+	static void listForkFiles(const FSNode &path, const String &fileName, FSList &files);
+
 	/**
 	 * See if a Mac data/resource fork pair exists.
 	 * @param fileName The base file name of the file
@@ -42,6 +42,7 @@ MODULE_OBJS := \
 	winexe.o \
 	winexe_ne.o \
 	winexe_pe.o \
+	workerpool.o \
 	xmlparser.o \
 	zlib.o
 
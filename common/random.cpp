@@ -27,16 +27,57 @@
 
 namespace Common {
 
-RandomSource::RandomSource(const String &name) {
+RandomSource *RandomSource::_first = 0;
+RandomSource *RandomSource::_last = 0;
+SpinLock RandomSource::_listLock;
+
+RandomSource::RandomSource(const String &name) : _name(name), _prev(0), _next(0) {
 	// Use system time as RNG seed. Normally not a good idea, if you are using
 	// a RNG for security purposes, but good enough for our purposes.
-	assert(g_system);
-
+	// Offline tools like devtools/render_opl run without a backend, they
+	// get a fixed seed.
 #ifdef ENABLE_EVENTRECORDER
-	setSeed(g_eventRec.getRandomSeed(name));
+	setSeed(g_system ? g_eventRec.getRandomSeed(name) : 0);
 #else
-	setSeed(g_system->getMillis());
+	setSeed(g_system ? g_system->getMillis() : 0);
 #endif
+
+	link();
+}
+
+RandomSource::RandomSource(const RandomSource &other) : _randSeed(other._randSeed), _name(other._name), _prev(0), _next(0) {
+	link();
+}
+
+RandomSource &RandomSource::operator=(const RandomSource &other) {
+	_randSeed = other._randSeed;
+	_name = other._name;
+	return *this;
+}
+
+void RandomSource::link() {
+	SpinLockHolder lock(_listLock);
+
+	// Append, so that the list order only depends on the creation order
+	_prev = _last;
+	if (_last)
+		_last->_next = this;
+	else
+		_first = this;
+	_last = this;
+}
+
+RandomSource::~RandomSource() {
+	SpinLockHolder lock(_listLock);
+
+	if (_prev)
+		_prev->_next = _next;
+	else
+		_first = _next;
+	if (_next)
+		_next->_prev = _prev;
+	else
+		_last = _prev;
 }
 
 void RandomSource::setSeed(uint32 seed) {
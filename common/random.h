@@ -24,11 +24,11 @@
 #define COMMON_RANDOM_H
 
 #include "common/scummsys.h"
+#include "common/atomic.h"
+#include "common/str.h"
 
 namespace Common {
 
-class String;
-
 /**
  * Simple random number generator. Although it is definitely not suitable for
  * cryptographic purposes, it serves our purposes just fine.
@@ -36,6 +36,15 @@ class String;
 class RandomSource {
 private:
 	uint32 _randSeed;
+	String _name;
+
+	RandomSource *_prev;
+	RandomSource *_next;
+	static RandomSource *_first;
+	static RandomSource *_last;
+	static SpinLock _listLock;
+
+	void link();
 
 public:
 	/**
@@ -45,6 +54,32 @@ public:
 	 * if any.
 	 */
 	RandomSource(const String &name);
+	RandomSource(const RandomSource &other);
+	~RandomSource();
+
+	RandomSource &operator=(const RandomSource &other);
+
+	const String &getName() const {
+		return _name;
+	}
+
+	/**
+	 * Live randomness sources, in creation order. Backends use this to
+	 * snapshot and restore the generator state alongside their own.
+	 * Sources may be created on any thread, so hold getListLock() while
+	 * walking the list.
+	 */
+	static RandomSource *getFirst() {
+		return _first;
+	}
+
+	static SpinLock &getListLock() {
+		return _listLock;
+	}
+
+	RandomSource *getNext() const {
+		return _next;
+	}
 
 	void setSeed(uint32 seed);
 
@@ -20,6 +20,7 @@
  *
  */
 
+#include "common/atomic.h"
 #include "common/hash-str.h"
 #include "common/list.h"
 #include "common/memorypool.h"
@@ -29,6 +30,9 @@
 namespace Common {
 
 MemoryPool *g_refCountPool = 0; // FIXME: This is never freed right now
+// Strings are used on worker threads, e.g. during game detection, so the
+// shared pool needs a lock. The counts themselves are still not atomic.
+SpinLock g_refCountPoolLock;
 
 static uint32 computeCapacity(uint32 len) {
 	// By default, for the capacity we use the next multiple of 32
@@ -173,6 +177,7 @@ void String::ensureCapacity(uint32 new_size, bool keep_old) {
 void String::incRefCount() const {
 	assert(!isStorageIntern());
 	if (_extern._refCount == 0) {
+		SpinLockHolder lock(g_refCountPoolLock);
 		if (g_refCountPool == 0) {
 			g_refCountPool = new MemoryPool(sizeof(int));
 			assert(g_refCountPool);
@@ -197,6 +202,7 @@ void String::decRefCount(int *oldRefCount) {
 		// and the ref count storage.
 		if (oldRefCount) {
 			assert(g_refCountPool);
+			SpinLockHolder lock(g_refCountPoolLock);
 			g_refCountPool->freeChunk(oldRefCount);
 		}
 		delete[] _str;
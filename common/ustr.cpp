@@ -21,12 +21,14 @@
  */
 
 #include "common/ustr.h"
+#include "common/atomic.h"
 #include "common/memorypool.h"
 #include "common/util.h"
 
 namespace Common {
 
 extern MemoryPool *g_refCountPool;
+extern SpinLock g_refCountPoolLock;
 
 static uint32 computeCapacity(uint32 len) {
 	// By default, for the capacity we use the next multiple of 32
@@ -273,6 +275,7 @@ void U32String::ensureCapacity(uint32 new_size, bool keep_old) {
 void U32String::incRefCount() const {
 	assert(!isStorageIntern());
 	if (_extern._refCount == 0) {
+		SpinLockHolder lock(g_refCountPoolLock);
 		if (g_refCountPool == 0) {
 			g_refCountPool = new MemoryPool(sizeof(int));
 			assert(g_refCountPool);
@@ -297,6 +300,7 @@ void U32String::decRefCount(int *oldRefCount) {
 		// and the ref count storage.
 		if (oldRefCount) {
 			assert(g_refCountPool);
+			SpinLockHolder lock(g_refCountPoolLock);
 			g_refCountPool->freeChunk(oldRefCount);
 		}
 		delete[] _str;
@@ -0,0 +1,314 @@
+/* ScummVM - Graphic Adventure Engine
+ *
+ * ScummVM is the legal property of its developers, whose names
+ * are too numerous to list here. Please refer to the COPYRIGHT
+ * file distributed with this source distribution.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ */
+
+// The thread APIs need the system headers
+#define FORBIDDEN_SYMBOL_ALLOW_ALL
+
+#include "common/workerpool.h"
+#include "common/atomic.h"
+#include "common/util.h"
+
+#if defined(USE_PTHREADS)
+#include <pthread.h>
+#include <unistd.h>
+#elif defined(WIN32)
+#include <windows.h>
+#endif
+
+namespace Common {
+
+namespace {
+
+struct WorkerState {
+	const WorkerPool::Job *job;
+	uint32 count;
+	volatile uint32 next;
+	volatile uint32 done;
+};
+
+void work(WorkerState &state) {
+	for (;;) {
+		const uint32 index = atomicAdd(&state.next, 1u) - 1;
+		if (index >= state.count)
+			break;
+		(*state.job)(index);
+		atomicAdd(&state.done, 1u);
+	}
+}
+
+#if defined(USE_PTHREADS)
+typedef pthread_t ThreadHandle;
+
+/** Counting semaphore; POSIX semaphores are not available everywhere. */
+class Semaphore {
+public:
+	Semaphore() : _count(0) {
+		pthread_mutex_init(&_mutex, 0);
+		pthread_cond_init(&_cond, 0);
+	}
+
+	~Semaphore() {
+		pthread_cond_destroy(&_cond);
+		pthread_mutex_destroy(&_mutex);
+	}
+
+	void post(uint count) {
+		pthread_mutex_lock(&_mutex);
+		_count += count;
+		pthread_cond_broadcast(&_cond);
+		pthread_mutex_unlock(&_mutex);
+	}
+
+	void wait() {
+		pthread_mutex_lock(&_mutex);
+		while (!_count)
+			pthread_cond_wait(&_cond, &_mutex);
+		_count--;
+		pthread_mutex_unlock(&_mutex);
+	}
+
+private:
+	pthread_mutex_t _mutex;
+	pthread_cond_t _cond;
+	uint _count;
+};
+
+void *workerThread(void *arg);
+
+bool startThread(ThreadHandle &handle, void *arg) {
+	return pthread_create(&handle, 0, workerThread, arg) == 0;
+}
+
+void joinThread(ThreadHandle &handle) {
+	pthread_join(handle, 0);
+}
+#elif defined(WIN32)
+typedef HANDLE ThreadHandle;
+
+class Semaphore {
+public:
+	Semaphore() : _handle(CreateSemaphore(NULL, 0, 0x7FFFFFFF, NULL)) {}
+	~Semaphore() { CloseHandle(_handle); }
+
+	void post(uint count) {
+		if (count)
+			ReleaseSemaphore(_handle, count, NULL);
+	}
+
+	void wait() {
+		WaitForSingleObject(_handle, INFINITE);
+	}
+
+private:
+	HANDLE _handle;
+};
+
+DWORD WINAPI workerThread(LPVOID arg);
+
+bool startThread(ThreadHandle &handle, void *arg) {
+	handle = CreateThread(NULL, 0, workerThread, arg, 0, NULL);
+	return handle != NULL;
+}
+
+void joinThread(ThreadHandle &handle) {
+	WaitForSingleObject(handle, INFINITE);
+	CloseHandle(handle);
+}
+#else
+typedef int ThreadHandle;
+
+class Semaphore {
+public:
+	void post(uint count) {}
+	void wait() {}
+};
+
+bool startThread(ThreadHandle &handle, void *arg) {
+	return false;
+}
+
+void joinThread(ThreadHandle &handle) {
+}
+#endif
+
+/**
+ * The threads are started when a batch first needs them and then wait on
+ * wake for the following ones. Starting a batch posts one token per thread
+ * it uses; every thread that takes one works on the batch and checks out
+ * through left, the last one posting idle for finish().
+ */
+struct WorkerThreads {
+	WorkerState jobs;
+	ThreadHandle *threads;
+	/** Number of threads started. */
+	uint started;
+	/** Number of threads working on the current batch. */
+	uint32 wanted;
+	volatile uint32 left;
+	volatile uint32 quit;
+	Semaphore wake, idle;
+
+	/** Starts threads until there are count of them, as far as possible. */
+	void startThreads(uint count) {
+		while (started < count && startThread(threads[started], this))
+			started++;
+	}
+
+	/** Lets up to count threads work on the jobs. */
+	void begin(const WorkerPool::Job &job, uint count, uint threadCount) {
+		jobs.job = &job;
+		jobs.count = count;
+		jobs.next = 0;
+		jobs.done = 0;
+
+		startThreads(threadCount);
+		wanted = MIN(threadCount, started);
+		left = 0;
+		wake.post(wanted);
+	}
+
+	void serve() {
+		for (;;) {
+			wake.wait();
+			if (atomicLoad(&quit))
+				break;
+
+			// Read before checking out, after that a new batch may change it
+			const uint32 batchThreads = wanted;
+			work(jobs);
+			if (atomicAdd(&left, 1u) == batchThreads)
+				idle.post(1);
+		}
+	}
+};
+
+#if defined(USE_PTHREADS)
+void *workerThread(void *arg) {
+	((WorkerThreads *)arg)->serve();
+	return 0;
+}
+#elif defined(WIN32)
+DWORD WINAPI workerThread(LPVOID arg) {
+	((WorkerThreads *)arg)->serve();
+	return 0;
+}
+#endif
+
+} // End of anonymous namespace
+
+struct WorkerPool::State : public WorkerThreads {
+};
+
+WorkerPool::WorkerPool(uint threads) : _threadCount(threads), _state(new State()) {
+	if (!_threadCount)
+		_threadCount = getCPUCount();
+	if (!isThreaded())
+		_threadCount = 1;
+
+	_state->jobs.job = 0;
+	_state->jobs.count = 0;
+	_state->jobs.next = 0;
+	_state->jobs.done = 0;
+	_state->threads = new ThreadHandle[_threadCount];
+	_state->started = 0;
+	_state->wanted = 0;
+	_state->left = 0;
+	_state->quit = 0;
+}
+
+WorkerPool::~WorkerPool() {
+	finish();
+
+	atomicStore(&_state->quit, 1u);
+	_state->wake.post(_state->started);
+	for (uint i = 0; i < _state->started; i++)
+		joinThread(_state->threads[i]);
+
+	delete[] _state->threads;
+	delete _state;
+}
+
+void WorkerPool::run(const Job &job, uint count) {
+	start(job, count);
+	finish();
+}
+
+void WorkerPool::start(const Job &job, uint count) {
+	finish();
+
+	// The calling thread is one of the workers, once it calls finish()
+	_state->begin(job, count, count ? MIN(_threadCount, count) - 1 : 0);
+}
+
+bool WorkerPool::startBackground(const Job &job, uint count) {
+	finish();
+
+	_state->begin(job, count, MIN(_threadCount, count));
+
+	if (count && !_state->wanted) {
+		_state->jobs.job = 0;
+		return false;
+	}
+
+	return true;
+}
+
+void WorkerPool::finish() {
+	if (!_state->jobs.job)
+		return;
+
+	work(_state->jobs);
+
+	// Wait until every thread of the batch is done with it, so the next
+	// batch does not find one still looking at the old jobs
+	if (_state->wanted)
+		_state->idle.wait();
+	_state->wanted = 0;
+	_state->jobs.job = 0;
+}
+
+bool WorkerPool::isFinished() const {
+	return !_state->jobs.job || atomicLoad(&_state->jobs.done) == _state->jobs.count;
+}
+
+uint WorkerPool::getCPUCount() {
+#if defined(USE_PTHREADS) && defined(_SC_NPROCESSORS_ONLN)
+	const long count = sysconf(_SC_NPROCESSORS_ONLN);
+	return count > 0 ? (uint)count : 1;
+#elif defined(WIN32)
+	SYSTEM_INFO info;
+	GetSystemInfo(&info);
+	return info.dwNumberOfProcessors > 0 ? (uint)info.dwNumberOfProcessors : 1;
+#else
+	return 1;
+#endif
+}
+
+bool WorkerPool::isThreaded() {
+#if defined(USE_PTHREADS) || defined(WIN32)
+	return true;
+#else
+	return false;
+#endif
+}
+
+} // End of namespace Common
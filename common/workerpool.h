@@ -0,0 +1,108 @@
+/* ScummVM - Graphic Adventure Engine
+ *
+ * ScummVM is the legal property of its developers, whose names
+ * are too numerous to list here. Please refer to the COPYRIGHT
+ * file distributed with this source distribution.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ */
+
+#ifndef COMMON_WORKERPOOL_H
+#define COMMON_WORKERPOOL_H
+
+#include "common/scummsys.h"
+#include "common/func.h"
+#include "common/noncopyable.h"
+
+namespace Common {
+
+/**
+ * Runs a number of independent jobs on several threads.
+ *
+ * This is meant for coarse grained work which mostly waits for I/O, like
+ * detecting games in many directories. Jobs must not touch anything shared
+ * with other jobs or the calling thread without locking it themselves. Note
+ * that this includes copying Common::String and Common::SharedPtr (and so
+ * Common::FSNode) instances, since their reference counts are not atomic.
+ *
+ * Threads are available with POSIX threads and on Windows. On other ports,
+ * and when only a single thread is requested, the jobs simply run one after
+ * the other on the calling thread. The threads are started when first
+ * needed and wait for further jobs until the pool is destroyed, so a pool
+ * can be kept around for frequent small batches.
+ */
+class WorkerPool : NonCopyable {
+public:
+	typedef Functor1<uint, void> Job;
+
+	/**
+	 * @param threads	the maximum number of threads to use, including the
+	 *			calling one; 0 uses one thread per CPU core
+	 */
+	explicit WorkerPool(uint threads = 0);
+	~WorkerPool();
+
+	/** The maximum number of threads run() uses. */
+	uint getThreadCount() const { return _threadCount; }
+
+	/**
+	 * Call job(i) once for every i from 0 to count - 1, in no particular
+	 * order, and return once all calls returned. The calling thread works
+	 * on the jobs as well.
+	 */
+	void run(const Job &job, uint count);
+
+	/**
+	 * Like run(), but return right away while other threads start working
+	 * on the jobs, so the calling thread can do something else meanwhile.
+	 * The job has to stay valid until finish() is called.
+	 */
+	void start(const Job &job, uint count);
+
+	/**
+	 * Like start(), but leave all jobs to other threads, so the calling
+	 * thread is free until it calls finish().
+	 *
+	 * @return false if no thread could be started, in which case the jobs
+	 *         are dropped
+	 */
+	bool startBackground(const Job &job, uint count);
+
+	/**
+	 * Work on the jobs passed to start() which were not picked up yet, and
+	 * return once all of them are done.
+	 */
+	void finish();
+
+	/** Whether all jobs passed to start() are done, so finish() won't wait. */
+	bool isFinished() const;
+
+	/** The number of CPU cores, or 1 if it can't be determined. */
+	static uint getCPUCount();
+
+	/** Whether run() can use more than one thread on this port. */
+	static bool isThreaded();
+
+private:
+	uint _threadCount;
+
+	struct State;
+	State *_state;
+};
+
+} // End of namespace Common
+
+#endif
@@ -44,6 +44,11 @@ devtools/make-scumm-fontdata$(EXEEXT): $(srcdir)/devtools/make-scumm-fontdata.c
 	$(QUIET)$(MKDIR) devtools/$(DEPDIR)
 	$(QUIET_LINK)$(LD) $(CFLAGS) -Wall -o $@ $<
 
+# Not part of DEVTOOLS, since it needs the libraries of a configured build
+devtools/render_opl$(EXEEXT): $(srcdir)/devtools/render_opl.cpp audio/libaudio.a common/libcommon.a
+	$(QUIET)$(MKDIR) devtools/$(DEPDIR)
+	$(QUIET_LINK)$(CXX) $(CXXFLAGS) $(CPPFLAGS) -O2 -o $@ $+ $(LDFLAGS) $(LIBS)
+
 # Rule to explicitly rebuild the wwwroot archive
 wwwroot:
 	$(srcdir)/devtools/make-www-archive.py $(srcdir)/dists/networking/
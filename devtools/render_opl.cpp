@@ -0,0 +1,418 @@
+/* ScummVM - Graphic Adventure Engine
+ *
+ * ScummVM is the legal property of its developers, whose names
+ * are too numerous to list here. Please refer to the COPYRIGHT
+ * file distributed with this source distribution.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ */
+
+
+/*
+ * Offline OPL renderer: replays a register write capture, as written with
+ * the --opl-capture option, through the OPL emulators as fast as they go.
+ * Reports the speed of every emulator, and how far its output is from the
+ * output of the original DOSBox sample by sample renderer.
+ *
+ * "dosbox" and "dbopl" both feed DBOPL the same way the DOSBox OPL driver
+ * does, the first one with the sample by sample renderer, the second with
+ * the block renderer used in the game. "mame" only renders OPL2 captures.
+ *
+ * Build with "make devtools/render_opl".
+ */
+
+#define FORBIDDEN_SYMBOL_ALLOW_ALL
+
+#include "audio/fmopl.h"
+#include "audio/softsynth/opl/dbopl.h"
+#include "audio/softsynth/opl/mame.h"
+#include "common/array.h"
+#include "common/endian.h"
+#include "common/util.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+namespace {
+
+using OPL::Config;
+
+struct Write {
+	uint32 time;
+	uint16 address;
+	uint8 value;
+};
+
+typedef Common::Array<Write> WriteLog;
+typedef Common::Array<int16> Samples;
+
+bool loadCapture(const char *fileName, Config::OplType &type, WriteLog &log) {
+	FILE *file = fopen(fileName, "rb");
+	if (!file) {
+		fprintf(stderr, "Could not open '%s'\n", fileName);
+		return false;
+	}
+
+	Common::Array<byte> data;
+	byte buffer[4096];
+	size_t read;
+	while ((read = fread(buffer, 1, sizeof(buffer), file)) > 0)
+		for (size_t i = 0; i < read; ++i)
+			data.push_back(buffer[i]);
+	fclose(file);
+
+	if (data.size() < 6 || READ_BE_UINT32(&data[0]) != OPL::kCaptureTag) {
+		fprintf(stderr, "'%s' is not an OPL capture\n", fileName);
+		return false;
+	}
+	if (data[4] != OPL::kCaptureVersion) {
+		fprintf(stderr, "'%s' has unsupported version %d\n", fileName, data[4]);
+		return false;
+	}
+	if (data[5] > Config::kOpl3) {
+		fprintf(stderr, "'%s' has unknown OPL type %d\n", fileName, data[5]);
+		return false;
+	}
+	type = (Config::OplType)data[5];
+
+	uint32 time = 0;
+	uint pos = 6;
+	while (pos < data.size()) {
+		uint32 delta = 0;
+		int shift = 0;
+		while (pos < data.size() && (data[pos] & 0x80)) {
+			delta |= (data[pos++] & 0x7F) << shift;
+			shift += 7;
+		}
+		if (pos + 4 > data.size()) {
+			fprintf(stderr, "'%s' is truncated, ignoring the last write\n", fileName);
+			break;
+		}
+		delta |= data[pos++] << shift;
+		time += delta;
+
+		Write write;
+		write.time = time;
+		write.address = READ_LE_UINT16(&data[pos]);
+		write.value = data[pos + 2];
+		log.push_back(write);
+		pos += 3;
+	}
+	return true;
+}
+
+class Renderer {
+public:
+	virtual ~Renderer() {}
+
+	virtual const char *getName() const = 0;
+	virtual bool supports(Config::OplType type) const = 0;
+
+	/** Starts over with a new chip. */
+	virtual void reset(Config::OplType type, int rate) = 0;
+	virtual void write(int a, int v) = 0;
+	virtual void writeReg(int r, int v) = 0;
+
+	/** Renders frames samples, interleaved in stereo for OPL3 and dual OPL2. */
+	virtual void generate(int16 *buffer, int frames) = 0;
+};
+
+class MameRenderer : public Renderer {
+public:
+	MameRenderer() : _opl(0) {}
+	~MameRenderer() { free(); }
+
+	const char *getName() const { return "mame"; }
+	bool supports(Config::OplType type) const { return type == Config::kOpl2; }
+
+	void reset(Config::OplType type, int rate) {
+		free();
+		_opl = OPL::MAME::makeAdLibOPL(rate);
+	}
+
+	void write(int a, int v) { OPL::MAME::OPLWrite(_opl, a, v); }
+	void writeReg(int r, int v) { OPL::MAME::OPLWriteReg(_opl, r, v); }
+	void generate(int16 *buffer, int frames) { OPL::MAME::YM3812UpdateOne(_opl, buffer, frames); }
+
+private:
+	void free() {
+		if (_opl)
+			OPL::MAME::OPLDestroy(_opl);
+		_opl = 0;
+	}
+
+	OPL::MAME::FM_OPL *_opl;
+};
+
+#ifndef DISABLE_DOSBOX_OPL
+
+using OPL::DOSBox::DBOPL::Chip;
+
+/** Port and register handling of OPL::DOSBox::OPL, without the timers. */
+class DBOPLRenderer : public Renderer {
+public:
+	DBOPLRenderer(bool reference) : _reference(reference), _chip(0) {}
+	~DBOPLRenderer() { delete _chip; }
+
+	const char *getName() const { return _reference ? "dosbox" : "dbopl"; }
+	bool supports(Config::OplType type) const { return true; }
+
+	void reset(Config::OplType type, int rate) {
+		delete _chip;
+		OPL::DOSBox::DBOPL::InitTables();
+		_chip = new Chip();
+		_chip->Setup(rate);
+		_chip->referenceSynth = _reference;
+		_type = type;
+		_normal = 0;
+		_dual[0] = _dual[1] = 0;
+
+		if (_type == Config::kDualOpl2)
+			_chip->WriteReg(0x105, 1);
+	}
+
+	void write(int port, int val) {
+		if (port & 1) {
+			if (_type != Config::kDualOpl2) {
+				if (!isTimer(_normal))
+					_chip->WriteReg(_normal, val);
+			} else if (!(port & 0x8)) {
+				const int index = (port & 2) >> 1;
+				dualWrite(index, _dual[index], val);
+			} else {
+				dualWrite(0, _dual[0], val);
+				dualWrite(1, _dual[1], val);
+			}
+		} else if (_type != Config::kDualOpl2) {
+			_normal = _chip->WriteAddr(port, val) & (_type == Config::kOpl3 ? 0x1ff : 0xff);
+		} else if (!(port & 0x8)) {
+			_dual[(port & 2) >> 1] = val & 0xff;
+		} else {
+			_dual[0] = _dual[1] = val & 0xff;
+		}
+	}
+
+	void writeReg(int r, int v) {
+		const uint32 old = _normal;
+		if (_type == Config::kOpl3 && r >= 0x100) {
+			write(0x222, r);
+			write(0x223, v);
+		} else {
+			write(0x388, r);
+			write(0x389, v);
+		}
+
+		if (_type == Config::kOpl3 && old >= 0x100)
+			write(0x222, old & ~0x100);
+		else
+			write(0x388, old);
+	}
+
+	void generate(int16 *buffer, int frames) {
+		const int stereo = (_type != Config::kOpl2);
+		int32 temp[512 * 2];
+
+		while (frames > 0) {
+			const int samples = MIN<int>(frames, 512);
+			if (_chip->opl3Active) {
+				_chip->GenerateBlock3(samples, temp);
+				for (int i = 0; i < samples * 2; ++i)
+					buffer[i] = temp[i];
+			} else {
+				_chip->GenerateBlock2(samples, temp);
+				for (int i = 0; i < samples; ++i) {
+					buffer[i << stereo] = temp[i];
+					if (stereo)
+						buffer[2 * i + 1] = temp[i];
+				}
+			}
+			buffer += samples << stereo;
+			frames -= samples;
+		}
+	}
+
+private:
+	static bool isTimer(uint32 reg) {
+		return reg >= 0x02 && reg <= 0x04;
+	}
+
+	void dualWrite(int index, uint8 reg, uint8 val) {
+		// Same restrictions as the DOSBox driver, see OPL::DOSBox::OPL::dualWrite
+		if (reg == 5 || isTimer(reg))
+			return;
+		if (reg >= 0xE0 && reg <= 0xE8)
+			val &= 3;
+		if (reg >= 0xC0 && reg <= 0xC8) {
+			val &= 15;
+			val |= index ? 0xA0 : 0x50;
+		}
+		_chip->WriteReg(reg + (index ? 0x100 : 0), val);
+	}
+
+	bool _reference;
+	Chip *_chip;
+	Config::OplType _type;
+	uint32 _normal;
+	uint8 _dual[2];
+};
+
+#endif
+
+/** Renders the whole log, returns the CPU time taken in seconds. */
+double render(Renderer &renderer, const WriteLog &log, Config::OplType type, int rate, Samples &output) {
+	const int channels = (type == Config::kOpl2) ? 1 : 2;
+	output.clear();
+
+	const clock_t start = clock();
+	renderer.reset(type, rate);
+
+	uint32 rendered = 0;
+	for (uint i = 0; i <= log.size(); ++i) {
+		// Render up to the write, or a bit of silence after the last one
+		const double time = (i < log.size()) ? log[i].time : log.back().time + 1000000.0;
+		const uint32 target = (uint32)(time * rate / 1000000.0);
+
+		if (target > rendered) {
+			const uint oldSize = output.size();
+			output.resize(oldSize + (target - rendered) * channels);
+			renderer.generate(&output[oldSize], target - rendered);
+			rendered = target;
+		}
+
+		if (i == log.size())
+			break;
+		if (log[i].address & OPL::kCapturePort)
+			renderer.write(log[i].address & ~OPL::kCapturePort, log[i].value);
+		else
+			renderer.writeReg(log[i].address, log[i].value);
+	}
+
+	return (clock() - start) / (double)CLOCKS_PER_SEC;
+}
+
+void compare(const Samples &output, const Samples &reference, int channels, int rate) {
+	const uint size = MIN(output.size(), reference.size());
+	int maxDiff = 0;
+	double energy = 0.0;
+	int firstDiff = -1;
+
+	for (uint i = 0; i < size; ++i) {
+		const int diff = ABS(output[i] - reference[i]);
+		if (diff && firstDiff < 0)
+			firstDiff = i / channels;
+		maxDiff = MAX(maxDiff, diff);
+		energy += (double)diff * diff;
+	}
+
+	if (firstDiff < 0) {
+		printf("  bit exact\n");
+		return;
+	}
+	const double rms = sqrt(energy / size);
+	printf("  max diff %5d  rms diff %6.1f dBFS  first diff at %.3fs\n",
+	       maxDiff, 20.0 * log10(rms / 32768.0), firstDiff / (double)rate);
+}
+
+void usage(const char *name) {
+	printf("Usage: %s [--rate=RATE] [--repeat=COUNT] FILE\n"
+	       "\n"
+	       "Renders an OPL capture written with --opl-capture with all OPL emulators,\n"
+	       "and reports their speed and the difference to the dosbox output.\n"
+	       "\n"
+	       "  --rate=RATE      Output sample rate (default: 44100)\n"
+	       "  --repeat=COUNT   Render COUNT times, report the fastest (default: 3)\n",
+	       name);
+}
+
+} // End of anonymous namespace
+
+int main(int argc, char *argv[]) {
+	int rate = 44100;
+	int repeat = 3;
+	const char *fileName = 0;
+
+	for (int i = 1; i < argc; ++i) {
+		if (!strncmp(argv[i], "--rate=", 7)) {
+			rate = atoi(argv[i] + 7);
+		} else if (!strncmp(argv[i], "--repeat=", 9)) {
+			repeat = atoi(argv[i] + 9);
+		} else if (argv[i][0] != '-' && !fileName) {
+			fileName = argv[i];
+		} else {
+			usage(argv[0]);
+			return 1;
+		}
+	}
+	if (!fileName || rate <= 0 || repeat <= 0) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	Config::OplType type;
+	WriteLog log;
+	if (!loadCapture(fileName, type, log))
+		return 1;
+	if (log.empty()) {
+		fprintf(stderr, "'%s' has no writes\n", fileName);
+		return 1;
+	}
+
+	static const char *const typeNames[] = { "OPL2", "Dual OPL2", "OPL3" };
+	const int channels = (type == Config::kOpl2) ? 1 : 2;
+	const double seconds = log.back().time / 1000000.0 + 1.0;
+	printf("%s, %u writes, %.1fs at %dHz\n", typeNames[type], log.size(), seconds, rate);
+
+	Common::Array<Renderer *> renderers;
+#ifndef DISABLE_DOSBOX_OPL
+	renderers.push_back(new DBOPLRenderer(true));
+	renderers.push_back(new DBOPLRenderer(false));
+#endif
+	renderers.push_back(new MameRenderer());
+
+	Samples reference;
+	for (uint i = 0; i < renderers.size(); ++i) {
+		Renderer &renderer = *renderers[i];
+		printf("%-8s", renderer.getName());
+		if (!renderer.supports(type)) {
+			printf("  does not support %s\n", typeNames[type]);
+			continue;
+		}
+
+		Samples output;
+		double best = 0.0;
+		for (int run = 0; run < repeat; ++run) {
+			const double cpu = render(renderer, log, type, rate, output);
+			if (!run || cpu < best)
+				best = cpu;
+		}
+
+		printf("%8.1f ms  %8.1fx realtime", best * 1000.0, best > 0.0 ? seconds / best : 0.0);
+		// The first renderer is the reference
+		if (reference.empty()) {
+			reference = output;
+			printf("  (reference)\n");
+		} else {
+			compare(output, reference, channels, rate);
+		}
+	}
+
+	for (uint i = 0; i < renderers.size(); ++i)
+		delete renderers[i];
+	return 0;
+}
@@ -31,6 +31,7 @@
 #include "common/translation.h"
 #include "gui/EventRecorder.h"
 #include "engines/advancedDetector.h"
+#include "engines/detectioncache.h"
 #include "engines/obsolete.h"
 
 static GameDescriptor toGameDescriptor(const ADGameDescription &g, const PlainGameDescriptor *sg) {
@@ -402,14 +403,26 @@ bool AdvancedMetaEngine::getFileProperties(const Common::FSNode &parent, const F
 	// FIXME/TODO: We don't handle the case that a file is listed as a regular
 	// file and as one with resource fork.
 
+	// The checksums are looked up in the detection cache first, which saves
+	// opening and reading every candidate file when detecting large
+	// collections repeatedly
+	DetectionCache &cache = DetectionCache::instance();
+
 	if (game.flags & ADGF_MACRESFORK) {
-		Common::MacResManager macResMan;
+		Common::FSList forkFiles;
+		Common::MacResManager::listForkFiles(parent, fname, forkFiles);
+		const Common::String key = Common::String::format("resfork:%u:%s", _md5Bytes, parent.getChild(fname).getPath().c_str());
+
+		if (!cache.lookup(key, forkFiles, fileProps.md5, fileProps.size)) {
+			Common::MacResManager macResMan;
 
-		if (!macResMan.open(parent, fname))
-			return false;
+			if (!macResMan.open(parent, fname))
+				return false;
 
-		fileProps.md5 = macResMan.computeResForkMD5AsString(_md5Bytes);
-		fileProps.size = macResMan.getResForkDataSize();
+			fileProps.md5 = macResMan.computeResForkMD5AsString(_md5Bytes);
+			fileProps.size = macResMan.getResForkDataSize();
+			cache.store(key, forkFiles, fileProps.md5, fileProps.size);
+		}
 
 		if (fileProps.size != 0)
 			return true;
@@ -418,13 +431,22 @@ bool AdvancedMetaEngine::getFileProperties(const Common::FSNode &parent, const F
 	if (!allFiles.contains(fname))
 		return false;
 
+	const Common::FSNode &node = allFiles[fname];
+	Common::FSList files;
+	files.push_back(node);
+	const Common::String key = Common::String::format("md5:%u:%s", _md5Bytes, node.getPath().c_str());
+
+	if (cache.lookup(key, files, fileProps.md5, fileProps.size))
+		return true;
+
 	Common::File testFile;
 
-	if (!testFile.open(allFiles[fname]))
+	if (!testFile.open(node))
 		return false;
 
 	fileProps.size = (int32)testFile.size();
 	fileProps.md5 = Common::computeStreamMD5AsString(testFile, _md5Bytes);
+	cache.store(key, files, fileProps.md5, fileProps.size);
 	return true;
 }
 
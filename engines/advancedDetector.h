@@ -280,6 +280,14 @@ public:
 
 	virtual GameList detectGames(const Common::FSList &fslist) const;
 
+	/**
+	 * The generic detection is thread safe, engines overriding
+	 * fallbackDetect() with one that isn't have to return false.
+	 */
+	virtual bool supportsParallelDetection() const {
+		return true;
+	}
+
 	virtual Common::Error createInstance(OSystem *syst, Engine **engine) const;
 
 	virtual const ExtraGuiOptions getExtraGuiOptions(const Common::String &target) const;
@@ -221,6 +221,11 @@ public:
 	SaveStateDescriptor querySaveMetaInfos(const char *target, int slot) const;
 
 	const ADGameDescription *fallbackDetect(const FileMap &allFiles, const Common::FSList &fslist) const;
+
+	// The fallback detector keeps its results in the mutable members
+	bool supportsParallelDetection() const {
+		return false;
+	}
 };
 
 bool AgiMetaEngine::hasFeature(MetaEngineFeature f) const {
@@ -0,0 +1,200 @@
+/* ScummVM - Graphic Adventure Engine
+ *
+ * ScummVM is the legal property of its developers, whose names
+ * are too numerous to list here. Please refer to the COPYRIGHT
+ * file distributed with this source distribution.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ */
+
+#include "engines/detectioncache.h"
+
+#include "common/config-manager.h"
+#include "common/debug.h"
+#include "common/endian.h"
+#include "common/savefile.h"
+#include "common/system.h"
+
+namespace Common {
+DECLARE_SINGLETON(DetectionCache);
+}
+
+static const char *const kCacheFileName = "detection.cache";
+
+enum {
+	kCacheTag = MKTAG('D','E','T','C'),
+	kCacheVersion = 1
+};
+
+static Common::String readString(Common::SeekableReadStream &stream) {
+	const uint16 length = stream.readUint16BE();
+	Common::String str;
+	for (uint16 i = 0; i < length && !stream.eos(); ++i)
+		str += (char)stream.readByte();
+	return str;
+}
+
+static void writeString(Common::WriteStream &stream, const Common::String &str) {
+	stream.writeUint16BE(str.size());
+	stream.write(str.c_str(), str.size());
+}
+
+DetectionCache::DetectionCache() : _loaded(false), _enabled(false), _dirty(false), _lastFlush(0) {
+}
+
+DetectionCache::~DetectionCache() {
+	flush(true);
+}
+
+bool DetectionCache::isEnabled() const {
+	return ConfMan.getBool("detection_cache");
+}
+
+bool DetectionCache::computeStamp(const Common::FSList &files, Common::String &stamp) {
+	stamp.clear();
+	for (Common::FSList::const_iterator file = files.begin(); file != files.end(); ++file) {
+		uint32 size, modificationTime;
+		if (file->getFileInfo(size, modificationTime))
+			stamp += Common::String::format("%u:%u;", size, modificationTime);
+		else if (!file->exists())
+			stamp += "-;";
+		else
+			return false;
+	}
+	return true;
+}
+
+bool DetectionCache::lookup(const Common::String &key, const Common::FSList &files, Common::String &md5, int32 &size) {
+	load();
+	if (!_enabled)
+		return false;
+
+	// Stat the files before taking the lock, other threads may be waiting
+	Common::String stamp;
+	if (!computeStamp(files, stamp))
+		return false;
+
+	Common::SpinLockHolder lock(_lock);
+	EntryMap::iterator entry = _entries.find(key);
+	if (entry == _entries.end())
+		return false;
+
+	if (stamp != entry->_value.stamp) {
+		debug(4, "DetectionCache: '%s' changed", key.c_str());
+		return false;
+	}
+
+	// String reference counts are not atomic, so the cached strings must
+	// never share their storage with ones handed out to other threads
+	entry->_value.used = true;
+	md5 = entry->_value.md5.c_str();
+	size = entry->_value.size;
+	return true;
+}
+
+void DetectionCache::store(const Common::String &key, const Common::FSList &files, const Common::String &md5, int32 size) {
+	load();
+	if (!_enabled)
+		return;
+
+	Common::String stamp;
+	if (!computeStamp(files, stamp))
+		return;
+
+	// Copy every string into the map, assigning them would share their
+	// storage and reference counts with the caller's thread
+	Common::SpinLockHolder lock(_lock);
+	Entry &entry = _entries[Common::String(key.c_str())];
+	entry.stamp = Common::String(stamp.c_str());
+	entry.md5 = Common::String(md5.c_str());
+	entry.size = size;
+	entry.used = true;
+	_dirty = true;
+}
+
+void DetectionCache::load() {
+	if (_loaded)
+		return;
+	_loaded = true;
+	_enabled = isEnabled();
+	if (!_enabled)
+		return;
+	_lastFlush = g_system->getMillis();
+
+	Common::InSaveFile *in = g_system->getSavefileManager()->openForLoading(kCacheFileName);
+	if (!in)
+		return;
+
+	if (in->readUint32BE() != kCacheTag || in->readUint32BE() != kCacheVersion) {
+		warning("DetectionCache: Ignoring '%s', it is outdated or damaged", kCacheFileName);
+		delete in;
+		return;
+	}
+
+	const uint32 count = in->readUint32BE();
+	for (uint32 i = 0; i < count && !in->err() && !in->eos(); ++i) {
+		const Common::String key = readString(*in);
+		Entry entry;
+		entry.stamp = readString(*in);
+		entry.md5 = readString(*in);
+		entry.size = in->readSint32BE();
+		entry.used = false;
+		if (in->eos() || in->err())
+			break;
+		_entries[key] = entry;
+	}
+	debug(2, "DetectionCache: Loaded %u entries", _entries.size());
+
+	delete in;
+}
+
+void DetectionCache::flush(bool force) {
+	if (!_dirty)
+		return;
+	if (!force && g_system->getMillis() - _lastFlush < kFlushInterval)
+		return;
+
+	if (_entries.size() > kMaxEntries) {
+		for (EntryMap::iterator entry = _entries.begin(); entry != _entries.end(); ++entry) {
+			if (!entry->_value.used)
+				_entries.erase(entry);
+		}
+	}
+
+	Common::OutSaveFile *out = g_system->getSavefileManager()->openForSaving(kCacheFileName, false);
+	if (!out) {
+		warning("DetectionCache: Could not write '%s'", kCacheFileName);
+		_dirty = false;
+		return;
+	}
+
+	out->writeUint32BE(kCacheTag);
+	out->writeUint32BE(kCacheVersion);
+	out->writeUint32BE(_entries.size());
+	for (EntryMap::const_iterator entry = _entries.begin(); entry != _entries.end(); ++entry) {
+		writeString(*out, entry->_key);
+		writeString(*out, entry->_value.stamp);
+		writeString(*out, entry->_value.md5);
+		out->writeSint32BE(entry->_value.size);
+	}
+	out->finalize();
+	if (out->err())
+		warning("DetectionCache: Could not write '%s'", kCacheFileName);
+	delete out;
+
+	_dirty = false;
+	_lastFlush = g_system->getMillis();
+}
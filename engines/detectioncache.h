@@ -0,0 +1,111 @@
+/* ScummVM - Graphic Adventure Engine
+ *
+ * ScummVM is the legal property of its developers, whose names
+ * are too numerous to list here. Please refer to the COPYRIGHT
+ * file distributed with this source distribution.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ */
+
+#ifndef ENGINES_DETECTIONCACHE_H
+#define ENGINES_DETECTIONCACHE_H
+
+#include "common/atomic.h"
+#include "common/fs.h"
+#include "common/hash-str.h"
+#include "common/singleton.h"
+#include "common/str.h"
+
+/**
+ * Persistent cache for the checksums computed while detecting games.
+ *
+ * Each entry is identified by a key naming the checksum, for example the
+ * path of the file and the number of bytes hashed, and remembers the size
+ * and modification time of the files the checksum was computed from. An
+ * entry is ignored and later replaced as soon as any of these files
+ * changes, appears or disappears, so stale checksums are never returned.
+ * Files on backends which can't report their modification time are never
+ * cached.
+ *
+ * The cache lives in the save path as "detection.cache". Setting the
+ * "detection_cache" config key to false disables it.
+ *
+ * lookup() and store() may be called from several threads at once, once
+ * load() was called on the main thread.
+ */
+class DetectionCache : public Common::Singleton<DetectionCache> {
+public:
+	DetectionCache();
+	~DetectionCache();
+
+	/**
+	 * Look up a checksum stored earlier.
+	 *
+	 * @param key	the key the checksum was stored with
+	 * @param files	the files the checksum depends on
+	 * @param md5	receives the checksum, on success only
+	 * @param size	receives the size stored with the checksum, on success only
+	 * @return true if the entry exists and none of the files changed since
+	 */
+	bool lookup(const Common::String &key, const Common::FSList &files, Common::String &md5, int32 &size);
+
+	/**
+	 * Store a checksum computed from the given files.
+	 */
+	void store(const Common::String &key, const Common::FSList &files, const Common::String &md5, int32 size);
+
+	/**
+	 * Read the cache from disk, unless that was done already or the cache
+	 * is disabled. This happens on first use, but has to be done up front
+	 * before using the cache from worker threads.
+	 */
+	void load();
+
+	/**
+	 * Write the cache to disk, if it changed. Unless forced, writing is
+	 * skipped until a few seconds passed since the previous write, so
+	 * detecting many directories in a row does not rewrite it every time.
+	 */
+	void flush(bool force = false);
+
+private:
+	enum {
+		kFlushInterval = 10 * 1000,
+		// Entries not used in this session are dropped above this count
+		kMaxEntries = 100000
+	};
+
+	struct Entry {
+		Common::String stamp;
+		Common::String md5;
+		int32 size;
+		bool used;
+	};
+
+	typedef Common::HashMap<Common::String, Entry> EntryMap;
+
+	EntryMap _entries;
+	Common::SpinLock _lock;
+	bool _loaded;
+	bool _enabled;
+	bool _dirty;
+	uint32 _lastFlush;
+
+	bool isEnabled() const;
+	static bool computeStamp(const Common::FSList &files, Common::String &stamp);
+};
+
+#endif
@@ -113,6 +113,11 @@ public:
 	}
 
 	const ADGameDescription *fallbackDetect(const FileMap &allFiles, const Common::FSList &fslist) const;
+
+	// The fallback detector fills in the static s_fallbackDesc
+	bool supportsParallelDetection() const {
+		return false;
+	}
 	virtual bool createInstance(OSystem *syst, Engine **engine, const ADGameDescription *desc) const;
 };
 
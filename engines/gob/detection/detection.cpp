@@ -37,6 +37,11 @@ public:
 
 	virtual const ADGameDescription *fallbackDetect(const FileMap &allFiles, const Common::FSList &fslist) const;
 
+	// The fallback detector resets SearchMan
+	virtual bool supportsParallelDetection() const {
+		return false;
+	}
+
 	virtual const char *getName() const;
 	virtual const char *getOriginalCopyright() const;
 
@@ -537,6 +537,11 @@ public:
 
 	const ADGameDescription *fallbackDetect(const FileMap &allFiles, const Common::FSList &fslist) const;
 
+	// The fallback detector fills in the static g_fallbackDesc
+	bool supportsParallelDetection() const {
+		return false;
+	}
+
 };
 
 bool MadeMetaEngine::hasFeature(MetaEngineFeature f) const {
@@ -26,6 +26,7 @@
 #include "common/scummsys.h"
 #include "common/error.h"
 #include "common/array.h"
+#include "common/fs.h"
 
 #include "engines/game.h"
 #include "engines/savestate.h"
@@ -36,7 +37,6 @@ class Engine;
 class OSystem;
 
 namespace Common {
-class FSList;
 class String;
 }
 
@@ -81,6 +81,18 @@ public:
 	 */
 	virtual GameList detectGames(const Common::FSList &fslist) const = 0;
 
+	/**
+	 * Returns whether detectGames() may run on several threads at once, see
+	 * EngineManager::detectGames(DetectionDirectoryList &). That requires
+	 * it to only look at the given files, and to not use SearchMan, ConfMan
+	 * or any other modifiable global or static state.
+	 *
+	 * The default implementation returns false.
+	 */
+	virtual bool supportsParallelDetection() const {
+		return false;
+	}
+
 	/**
 	 * Tries to instantiate an engine instance based on the settings of
 	 * the currently active ConfMan target. That is, the MetaEngine should
@@ -267,6 +279,30 @@ public:
 
 typedef PluginSubclass<MetaEngine> EnginePlugin;
 
+/**
+ * A directory to detect games in with
+ * EngineManager::detectGames(DetectionDirectoryList &).
+ */
+struct DetectionDirectory {
+	Common::FSNode node;
+	Common::FSList files;	///< contents of the directory, once listed
+	bool listed;			///< whether listing the contents succeeded
+	GameList games;			///< the detected games
+
+	DetectionDirectory() : listed(false) {}
+	explicit DetectionDirectory(const Common::FSNode &dir) : node(dir), listed(false) {}
+};
+
+typedef Common::Array<DetectionDirectory> DetectionDirectoryList;
+
+/** Time spent in the detector of an engine, summed over all threads. */
+struct DetectionTiming {
+	Common::String engine;
+	uint32 milliseconds;
+};
+
+typedef Common::Array<DetectionTiming> DetectionTimingList;
+
 /**
  * Singleton class which manages all Engine plugins.
  */
@@ -276,6 +312,27 @@ public:
 	GameDescriptor findGame(const Common::String &gameName, const EnginePlugin **plugin = NULL) const;
 	GameList detectGames(const Common::FSList &fslist) const;
 	const EnginePlugin::List &getPlugins() const;
+
+	/**
+	 * List the contents of the given directories, starting at the given
+	 * index, using up to "detection_threads" threads.
+	 */
+	void listDirectories(DetectionDirectoryList &dirs, uint first = 0) const;
+
+	/**
+	 * Detect the games in all of the given directories, which need to be
+	 * listed already. The directories and the engines which support it are
+	 * handled in parallel, using up to "detection_threads" threads. The
+	 * result for each directory is the same as detectGames(dir.files) would
+	 * give, including its order.
+	 *
+	 * @param dirs		the directories, receiving the detected games
+	 * @param timings	if set, receives the time spent in each engine
+	 */
+	void detectGames(DetectionDirectoryList &dirs, DetectionTimingList *timings = 0) const;
+
+	/** The number of threads used for detection, according to "detection_threads". */
+	static uint getDetectionThreadCount();
 };
 
 /** Convenience shortcut for accessing the engine manager. */
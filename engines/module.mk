@@ -2,6 +2,7 @@ MODULE := engines
 
 MODULE_OBJS := \
 	advancedDetector.o \
+	detectioncache.o \
 	dialogs.o \
 	engine.o \
 	game.o \
@@ -448,6 +448,11 @@ public:
 	virtual void removeSaveState(const char *target, int slot) const;
 
 	const ADGameDescription *fallbackDetect(const FileMap &allFiles, const Common::FSList &fslist) const;
+
+	// The fallback detector returns a static descriptor it fills in
+	bool supportsParallelDetection() const {
+		return false;
+	}
 };
 
 bool QueenMetaEngine::hasFeature(MetaEngineFeature f) const {
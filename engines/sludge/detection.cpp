@@ -101,6 +101,11 @@ public:
 
 	// for fall back detection
 	virtual const ADGameDescription *fallbackDetect(const FileMap &allFiles, const Common::FSList &fslist) const;
+
+	// The fallback detector fills in the static s_fallbackDesc
+	virtual bool supportsParallelDetection() const {
+		return false;
+	}
 };
 
 const ADGameDescription *SludgeMetaEngine::fallbackDetect(const FileMap &allFiles, const Common::FSList &fslist) const {
@@ -135,6 +135,11 @@ public:
 		return 0;
 	}
 
+	// The fallback detector fills in the static s_fallbackDesc
+	virtual bool supportsParallelDetection() const {
+		return false;
+	}
+
 	virtual bool createInstance(OSystem *syst, Engine **engine, const ADGameDescription *desc) const {
 		assert(syst);
 		assert(engine);
@@ -83,15 +83,41 @@
 // BASIS, AND BROWN UNIVERSITY HAS NO OBLIGATION TO PROVIDE MAINTENANCE,
 // SUPPORT, UPDATES, ENHANCEMENTS, OR MODIFICATIONS.
 
+#include "common/endian.h"
+#include "common/util.h"
 #include "graphics/surface.h"
 #include "graphics/yuv_to_rgb.h"
 
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+// The AVX2 kernel is built with a function attribute, so it does not need
+// -mavx2, and is only used when the CPU supports it.
+#if defined(__SSE2__) && (defined(__x86_64__) || defined(__i386__)) && \
+	((defined(__GNUC__) && __GNUC__ >= 5) || defined(__clang__))
+#include <immintrin.h>
+#define YUV_TO_RGB_AVX2 __attribute__((target("avx2")))
+#endif
+
 namespace Common {
 DECLARE_SINGLETON(Graphics::YUVToRGBManager);
 }
 
 namespace Graphics {
 
+/**
+ * How the SIMD kernels build the pixels of a format from the components,
+ * in the same way as PixelFormat::RGBToColor().
+ */
+struct YUVToRGBPacking {
+	int rLoss, gLoss, bLoss;
+	int rShift, gShift, bShift;
+	uint32 alpha;
+};
+
 class YUVToRGBLookup {
 public:
 	YUVToRGBLookup(Graphics::PixelFormat format, YUVToRGBManager::LuminanceScale scale);
@@ -99,10 +125,12 @@ public:
 	Graphics::PixelFormat getFormat() const { return _format; }
 	YUVToRGBManager::LuminanceScale getScale() const { return _scale; }
 	const uint32 *getRGBToPix() const { return _rgbToPix; }
+	const YUVToRGBPacking &getPacking() const { return _packing; }
 
 private:
 	Graphics::PixelFormat _format;
 	YUVToRGBManager::LuminanceScale _scale;
+	YUVToRGBPacking _packing;
 	uint32 _rgbToPix[3 * 768]; // 9216 bytes
 };
 
@@ -110,6 +138,14 @@ YUVToRGBLookup::YUVToRGBLookup(Graphics::PixelFormat format, YUVToRGBManager::Lu
 	_format = format;
 	_scale = scale;
 
+	_packing.rLoss = format.rLoss;
+	_packing.gLoss = format.gLoss;
+	_packing.bLoss = format.bLoss;
+	_packing.rShift = format.rShift;
+	_packing.gShift = format.gShift;
+	_packing.bShift = format.bShift;
+	_packing.alpha = format.RGBToColor(0, 0, 0);
+
 	uint32 *r_2_pix_alloc = &_rgbToPix[0 * 768];
 	uint32 *g_2_pix_alloc = &_rgbToPix[1 * 768];
 	uint32 *b_2_pix_alloc = &_rgbToPix[2 * 768];
@@ -158,7 +194,11 @@ YUVToRGBLookup::YUVToRGBLookup(Graphics::PixelFormat format, YUVToRGBManager::Lu
 }
 
 YUVToRGBManager::YUVToRGBManager() {
-	_lookup = 0;
+	// Pick the fastest kernel
+	_kernel = kKernelScalar;
+	static const Kernel kernels[] = { kKernelNEON, kKernelSSE2, kKernelAVX2 };
+	for (int i = 0; i < ARRAYSIZE(kernels); i++)
+		setKernel(kernels[i]);
 
 	int16 *Cr_r_tab = &_colorTab[0 * 256];
 	int16 *Cr_g_tab = &_colorTab[1 * 256];
@@ -180,22 +220,477 @@ YUVToRGBManager::YUVToRGBManager() {
 }
 
 YUVToRGBManager::~YUVToRGBManager() {
-	delete _lookup;
+	for (uint i = 0; i < _lookups.size(); i++)
+		delete _lookups[i];
+}
+
+bool YUVToRGBManager::isKernelSupported(Kernel kernel) {
+	switch (kernel) {
+	case kKernelScalar:
+		return true;
+#if defined(__SSE2__)
+	case kKernelSSE2:
+		return true;
+#endif
+#if defined(YUV_TO_RGB_AVX2)
+	case kKernelAVX2:
+		__builtin_cpu_init();
+		return __builtin_cpu_supports("avx2");
+#endif
+#if defined(__ARM_NEON)
+	case kKernelNEON:
+		return true;
+#endif
+	default:
+		return false;
+	}
+}
+
+bool YUVToRGBManager::setKernel(Kernel kernel) {
+	if (!isKernelSupported(kernel))
+		return false;
+
+	_kernel = kernel;
+	return true;
 }
 
 const YUVToRGBLookup *YUVToRGBManager::getLookup(Graphics::PixelFormat format, YUVToRGBManager::LuminanceScale scale) {
-	if (_lookup && _lookup->getFormat() == format && _lookup->getScale() == scale)
-		return _lookup;
+	Common::SpinLockHolder lock(_lookupLock);
+
+	for (uint i = 0; i < _lookups.size(); i++) {
+		if (_lookups[i]->getFormat() == format && _lookups[i]->getScale() == scale)
+			return _lookups[i];
+	}
 
-	delete _lookup;
-	_lookup = new YUVToRGBLookup(format, scale);
-	return _lookup;
+	YUVToRGBLookup *lookup = new YUVToRGBLookup(format, scale);
+	_lookups.push_back(lookup);
+	return lookup;
 }
 
 #define PUT_PIXEL(s, d) \
 	L = &rgbToPix[(s)]; \
 	*((PixelInt *)(d)) = (L[cr_r] | L[crb_g] | L[cb_b])
 
+#pragma mark --- SIMD kernels ---
+
+/**
+ * The colour tables as fixed point factors. For every chroma value x in
+ * [-128, 127], sign(x) * (((|x| << shift) * factor) >> 16) is exactly the
+ * truncated table value, so the SIMD kernels give the same pixels as the
+ * lookup tables.
+ */
+enum {
+	kCrRFactor = 717,   kCrRShift = 7, //  (0.419 / 0.299)
+	kCrGFactor = 731,   kCrGShift = 6, // -(0.299 / 0.419)
+	kCbGFactor = 2821,  kCbGShift = 3, // -(0.114 / 0.331)
+	kCbBFactor = 29055, kCbBShift = 2, //  (0.587 / 0.331)
+
+	// Stretches [0, 219] to [0, 255], exactly like x * 255 / 219
+	kITUFactor = 9539,  kITUShift = 3
+};
+
+/**
+ * Converts the first pixels of one row, or of two rows sharing the chroma
+ * row for 420, and returns how many it did per row. The rest goes through
+ * the lookup tables.
+ */
+typedef int (*ConvertRowProc)(byte *dst, int dstPitch, const YUVToRGBPacking &packing, const byte *ySrc, int yPitch, const byte *uSrc, const byte *vSrc, int width);
+
+#if defined(__SSE2__)
+
+template<int kShift, int kFactor>
+static inline __m128i scaleChromaSSE2(__m128i abs, __m128i sign) {
+	const __m128i scaled = _mm_mulhi_epu16(_mm_slli_epi16(abs, kShift), _mm_set1_epi16(kFactor));
+	return _mm_sub_epi16(_mm_xor_si128(scaled, sign), sign);
+}
+
+template<bool kITU>
+static inline __m128i clampComponentSSE2(__m128i c) {
+	if (!kITU)
+		return _mm_min_epi16(_mm_max_epi16(c, _mm_setzero_si128()), _mm_set1_epi16(255));
+
+	c = _mm_min_epi16(_mm_max_epi16(c, _mm_set1_epi16(16)), _mm_set1_epi16(235));
+	return _mm_mulhi_epu16(_mm_slli_epi16(_mm_sub_epi16(c, _mm_set1_epi16(16)), kITUShift), _mm_set1_epi16(kITUFactor));
+}
+
+/** Converts 8 pixels, given the chroma offsets of the red, green and blue components */
+template<typename PixelInt, bool kITU>
+static inline void storePixelsSSE2(byte *dst, const byte *ySrc, __m128i rOffset, __m128i gOffset, __m128i bOffset, const __m128i *packing) {
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i y = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)ySrc), zero);
+
+	const __m128i r = _mm_srl_epi16(clampComponentSSE2<kITU>(_mm_add_epi16(y, rOffset)), packing[0]);
+	const __m128i g = _mm_srl_epi16(clampComponentSSE2<kITU>(_mm_sub_epi16(y, gOffset)), packing[1]);
+	const __m128i b = _mm_srl_epi16(clampComponentSSE2<kITU>(_mm_add_epi16(y, bOffset)), packing[2]);
+
+	if (sizeof(PixelInt) == 2) {
+		__m128i pixels = _mm_or_si128(packing[6], _mm_sll_epi16(r, packing[3]));
+		pixels = _mm_or_si128(pixels, _mm_or_si128(_mm_sll_epi16(g, packing[4]), _mm_sll_epi16(b, packing[5])));
+		_mm_storeu_si128((__m128i *)dst, pixels);
+	} else {
+		__m128i lo = _mm_or_si128(packing[6], _mm_sll_epi32(_mm_unpacklo_epi16(r, zero), packing[3]));
+		lo = _mm_or_si128(lo, _mm_sll_epi32(_mm_unpacklo_epi16(g, zero), packing[4]));
+		lo = _mm_or_si128(lo, _mm_sll_epi32(_mm_unpacklo_epi16(b, zero), packing[5]));
+		__m128i hi = _mm_or_si128(packing[6], _mm_sll_epi32(_mm_unpackhi_epi16(r, zero), packing[3]));
+		hi = _mm_or_si128(hi, _mm_sll_epi32(_mm_unpackhi_epi16(g, zero), packing[4]));
+		hi = _mm_or_si128(hi, _mm_sll_epi32(_mm_unpackhi_epi16(b, zero), packing[5]));
+		_mm_storeu_si128((__m128i *)dst, lo);
+		_mm_storeu_si128((__m128i *)(dst + 16), hi);
+	}
+}
+
+template<typename PixelInt, bool k420, bool kITU>
+static int convertRowSSE2(byte *dst, int dstPitch, const YUVToRGBPacking &packing, const byte *ySrc, int yPitch, const byte *uSrc, const byte *vSrc, int width) {
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i bias = _mm_set1_epi16(128);
+
+	// Losses, shifts and alpha
+	const __m128i pack[7] = {
+		_mm_cvtsi32_si128(packing.rLoss), _mm_cvtsi32_si128(packing.gLoss), _mm_cvtsi32_si128(packing.bLoss),
+		_mm_cvtsi32_si128(packing.rShift), _mm_cvtsi32_si128(packing.gShift), _mm_cvtsi32_si128(packing.bShift),
+		sizeof(PixelInt) == 2 ? _mm_set1_epi16((int16)packing.alpha) : _mm_set1_epi32(packing.alpha)
+	};
+
+	int x = 0;
+	for (; x + 8 <= width; x += 8) {
+		__m128i u, v;
+		if (k420) {
+			u = _mm_cvtsi32_si128(READ_UINT32(uSrc + x / 2));
+			v = _mm_cvtsi32_si128(READ_UINT32(vSrc + x / 2));
+			u = _mm_unpacklo_epi8(u, u);
+			v = _mm_unpacklo_epi8(v, v);
+		} else {
+			u = _mm_loadl_epi64((const __m128i *)(uSrc + x));
+			v = _mm_loadl_epi64((const __m128i *)(vSrc + x));
+		}
+
+		u = _mm_sub_epi16(_mm_unpacklo_epi8(u, zero), bias);
+		v = _mm_sub_epi16(_mm_unpacklo_epi8(v, zero), bias);
+
+		const __m128i uSign = _mm_srai_epi16(u, 15);
+		const __m128i vSign = _mm_srai_epi16(v, 15);
+		const __m128i uAbs = _mm_sub_epi16(_mm_xor_si128(u, uSign), uSign);
+		const __m128i vAbs = _mm_sub_epi16(_mm_xor_si128(v, vSign), vSign);
+
+		const __m128i rOffset = scaleChromaSSE2<kCrRShift, kCrRFactor>(vAbs, vSign);
+		const __m128i gOffset = _mm_add_epi16(scaleChromaSSE2<kCrGShift, kCrGFactor>(vAbs, vSign), scaleChromaSSE2<kCbGShift, kCbGFactor>(uAbs, uSign));
+		const __m128i bOffset = scaleChromaSSE2<kCbBShift, kCbBFactor>(uAbs, uSign);
+
+		storePixelsSSE2<PixelInt, kITU>(dst + x * sizeof(PixelInt), ySrc + x, rOffset, gOffset, bOffset, pack);
+		if (k420)
+			storePixelsSSE2<PixelInt, kITU>(dst + dstPitch + x * sizeof(PixelInt), ySrc + yPitch + x, rOffset, gOffset, bOffset, pack);
+	}
+
+	return x;
+}
+
+#endif
+
+#if defined(YUV_TO_RGB_AVX2)
+
+template<int kShift, int kFactor>
+YUV_TO_RGB_AVX2 static inline __m256i scaleChromaAVX2(__m256i x) {
+	const __m256i scaled = _mm256_mulhi_epu16(_mm256_slli_epi16(_mm256_abs_epi16(x), kShift), _mm256_set1_epi16(kFactor));
+	return _mm256_sign_epi16(scaled, x);
+}
+
+template<bool kITU>
+YUV_TO_RGB_AVX2 static inline __m256i clampComponentAVX2(__m256i c) {
+	if (!kITU)
+		return _mm256_min_epi16(_mm256_max_epi16(c, _mm256_setzero_si256()), _mm256_set1_epi16(255));
+
+	c = _mm256_min_epi16(_mm256_max_epi16(c, _mm256_set1_epi16(16)), _mm256_set1_epi16(235));
+	return _mm256_mulhi_epu16(_mm256_slli_epi16(_mm256_sub_epi16(c, _mm256_set1_epi16(16)), kITUShift), _mm256_set1_epi16(kITUFactor));
+}
+
+/** Converts 16 pixels, given the chroma offsets of the red, green and blue components */
+template<typename PixelInt, bool kITU>
+YUV_TO_RGB_AVX2 static inline void storePixelsAVX2(byte *dst, const byte *ySrc, __m256i rOffset, __m256i gOffset, __m256i bOffset, const __m128i *packing, __m256i alpha) {
+	const __m256i y = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *)ySrc));
+
+	const __m256i r = _mm256_srl_epi16(clampComponentAVX2<kITU>(_mm256_add_epi16(y, rOffset)), packing[0]);
+	const __m256i g = _mm256_srl_epi16(clampComponentAVX2<kITU>(_mm256_sub_epi16(y, gOffset)), packing[1]);
+	const __m256i b = _mm256_srl_epi16(clampComponentAVX2<kITU>(_mm256_add_epi16(y, bOffset)), packing[2]);
+
+	if (sizeof(PixelInt) == 2) {
+		__m256i pixels = _mm256_or_si256(alpha, _mm256_sll_epi16(r, packing[3]));
+		pixels = _mm256_or_si256(pixels, _mm256_or_si256(_mm256_sll_epi16(g, packing[4]), _mm256_sll_epi16(b, packing[5])));
+		_mm256_storeu_si256((__m256i *)dst, pixels);
+	} else {
+		__m256i lo = _mm256_or_si256(alpha, _mm256_sll_epi32(_mm256_cvtepu16_epi32(_mm256_castsi256_si128(r)), packing[3]));
+		lo = _mm256_or_si256(lo, _mm256_sll_epi32(_mm256_cvtepu16_epi32(_mm256_castsi256_si128(g)), packing[4]));
+		lo = _mm256_or_si256(lo, _mm256_sll_epi32(_mm256_cvtepu16_epi32(_mm256_castsi256_si128(b)), packing[5]));
+		__m256i hi = _mm256_or_si256(alpha, _mm256_sll_epi32(_mm256_cvtepu16_epi32(_mm256_extracti128_si256(r, 1)), packing[3]));
+		hi = _mm256_or_si256(hi, _mm256_sll_epi32(_mm256_cvtepu16_epi32(_mm256_extracti128_si256(g, 1)), packing[4]));
+		hi = _mm256_or_si256(hi, _mm256_sll_epi32(_mm256_cvtepu16_epi32(_mm256_extracti128_si256(b, 1)), packing[5]));
+		_mm256_storeu_si256((__m256i *)dst, lo);
+		_mm256_storeu_si256((__m256i *)(dst + 32), hi);
+	}
+}
+
+template<typename PixelInt, bool k420, bool kITU>
+YUV_TO_RGB_AVX2 static int convertRowAVX2(byte *dst, int dstPitch, const YUVToRGBPacking &packing, const byte *ySrc, int yPitch, const byte *uSrc, const byte *vSrc, int width) {
+	const __m256i bias = _mm256_set1_epi16(128);
+
+	// Losses and shifts
+	const __m128i pack[6] = {
+		_mm_cvtsi32_si128(packing.rLoss), _mm_cvtsi32_si128(packing.gLoss), _mm_cvtsi32_si128(packing.bLoss),
+		_mm_cvtsi32_si128(packing.rShift), _mm_cvtsi32_si128(packing.gShift), _mm_cvtsi32_si128(packing.bShift)
+	};
+	const __m256i alpha = sizeof(PixelInt) == 2 ? _mm256_set1_epi16((int16)packing.alpha) : _mm256_set1_epi32(packing.alpha);
+
+	int x = 0;
+	for (; x + 16 <= width; x += 16) {
+		__m128i u8, v8;
+		if (k420) {
+			u8 = _mm_loadl_epi64((const __m128i *)(uSrc + x / 2));
+			v8 = _mm_loadl_epi64((const __m128i *)(vSrc + x / 2));
+			u8 = _mm_unpacklo_epi8(u8, u8);
+			v8 = _mm_unpacklo_epi8(v8, v8);
+		} else {
+			u8 = _mm_loadu_si128((const __m128i *)(uSrc + x));
+			v8 = _mm_loadu_si128((const __m128i *)(vSrc + x));
+		}
+
+		const __m256i u = _mm256_sub_epi16(_mm256_cvtepu8_epi16(u8), bias);
+		const __m256i v = _mm256_sub_epi16(_mm256_cvtepu8_epi16(v8), bias);
+
+		const __m256i rOffset = scaleChromaAVX2<kCrRShift, kCrRFactor>(v);
+		const __m256i gOffset = _mm256_add_epi16(scaleChromaAVX2<kCrGShift, kCrGFactor>(v), scaleChromaAVX2<kCbGShift, kCbGFactor>(u));
+		const __m256i bOffset = scaleChromaAVX2<kCbBShift, kCbBFactor>(u);
+
+		storePixelsAVX2<PixelInt, kITU>(dst + x * sizeof(PixelInt), ySrc + x, rOffset, gOffset, bOffset, pack, alpha);
+		if (k420)
+			storePixelsAVX2<PixelInt, kITU>(dst + dstPitch + x * sizeof(PixelInt), ySrc + yPitch + x, rOffset, gOffset, bOffset, pack, alpha);
+	}
+
+	return x;
+}
+
+#endif
+
+#if defined(__ARM_NEON)
+
+template<int kShift, int kFactor>
+static inline int16x8_t scaleChromaNEON(int16x8_t x) {
+	// vqdmulh doubles the product, hence one bit less of shift
+	const int16x8_t sign = vshrq_n_s16(x, 15);
+	const int16x8_t scaled = vqdmulhq_s16(vshlq_n_s16(vabsq_s16(x), kShift - 1), vdupq_n_s16(kFactor));
+	return vsubq_s16(veorq_s16(scaled, sign), sign);
+}
+
+template<bool kITU>
+static inline uint16x8_t clampComponentNEON(int16x8_t c) {
+	if (!kITU)
+		return vreinterpretq_u16_s16(vminq_s16(vmaxq_s16(c, vdupq_n_s16(0)), vdupq_n_s16(255)));
+
+	c = vsubq_s16(vminq_s16(vmaxq_s16(c, vdupq_n_s16(16)), vdupq_n_s16(235)), vdupq_n_s16(16));
+	return vreinterpretq_u16_s16(vqdmulhq_s16(vshlq_n_s16(c, kITUShift - 1), vdupq_n_s16(kITUFactor)));
+}
+
+/** Converts 8 pixels, given the chroma offsets of the red, green and blue components */
+template<typename PixelInt, bool kITU>
+static inline void storePixelsNEON(byte *dst, const byte *ySrc, int16x8_t rOffset, int16x8_t gOffset, int16x8_t bOffset, const YUVToRGBPacking &packing) {
+	const int16x8_t y = vreinterpretq_s16_u16(vmovl_u8(vld1_u8(ySrc)));
+
+	// Right shifts are left shifts by a negative count
+	const uint16x8_t r = vshlq_u16(clampComponentNEON<kITU>(vaddq_s16(y, rOffset)), vdupq_n_s16(-packing.rLoss));
+	const uint16x8_t g = vshlq_u16(clampComponentNEON<kITU>(vsubq_s16(y, gOffset)), vdupq_n_s16(-packing.gLoss));
+	const uint16x8_t b = vshlq_u16(clampComponentNEON<kITU>(vaddq_s16(y, bOffset)), vdupq_n_s16(-packing.bLoss));
+
+	if (sizeof(PixelInt) == 2) {
+		uint16x8_t pixels = vorrq_u16(vdupq_n_u16((uint16)packing.alpha), vshlq_u16(r, vdupq_n_s16(packing.rShift)));
+		pixels = vorrq_u16(pixels, vshlq_u16(g, vdupq_n_s16(packing.gShift)));
+		pixels = vorrq_u16(pixels, vshlq_u16(b, vdupq_n_s16(packing.bShift)));
+		vst1q_u16((uint16 *)dst, pixels);
+	} else {
+		const uint32x4_t alpha = vdupq_n_u32(packing.alpha);
+		const int32x4_t rShift = vdupq_n_s32(packing.rShift);
+		const int32x4_t gShift = vdupq_n_s32(packing.gShift);
+		const int32x4_t bShift = vdupq_n_s32(packing.bShift);
+
+		uint32x4_t lo = vorrq_u32(alpha, vshlq_u32(vmovl_u16(vget_low_u16(r)), rShift));
+		lo = vorrq_u32(lo, vshlq_u32(vmovl_u16(vget_low_u16(g)), gShift));
+		lo = vorrq_u32(lo, vshlq_u32(vmovl_u16(vget_low_u16(b)), bShift));
+		uint32x4_t hi = vorrq_u32(alpha, vshlq_u32(vmovl_u16(vget_high_u16(r)), rShift));
+		hi = vorrq_u32(hi, vshlq_u32(vmovl_u16(vget_high_u16(g)), gShift));
+		hi = vorrq_u32(hi, vshlq_u32(vmovl_u16(vget_high_u16(b)), bShift));
+		vst1q_u32((uint32 *)dst, lo);
+		vst1q_u32((uint32 *)(dst + 16), hi);
+	}
+}
+
+template<typename PixelInt, bool k420, bool kITU>
+static int convertRowNEON(byte *dst, int dstPitch, const YUVToRGBPacking &packing, const byte *ySrc, int yPitch, const byte *uSrc, const byte *vSrc, int width) {
+	const int16x8_t bias = vdupq_n_s16(128);
+
+	int x = 0;
+	for (; x + 8 <= width; x += 8) {
+		uint8x8_t u8, v8;
+		if (k420) {
+			u8 = vreinterpret_u8_u32(vdup_n_u32(READ_UINT32(uSrc + x / 2)));
+			v8 = vreinterpret_u8_u32(vdup_n_u32(READ_UINT32(vSrc + x / 2)));
+			u8 = vzip_u8(u8, u8).val[0];
+			v8 = vzip_u8(v8, v8).val[0];
+		} else {
+			u8 = vld1_u8(uSrc + x);
+			v8 = vld1_u8(vSrc + x);
+		}
+
+		const int16x8_t u = vsubq_s16(vreinterpretq_s16_u16(vmovl_u8(u8)), bias);
+		const int16x8_t v = vsubq_s16(vreinterpretq_s16_u16(vmovl_u8(v8)), bias);
+
+		const int16x8_t rOffset = scaleChromaNEON<kCrRShift, kCrRFactor>(v);
+		const int16x8_t gOffset = vaddq_s16(scaleChromaNEON<kCrGShift, kCrGFactor>(v), scaleChromaNEON<kCbGShift, kCbGFactor>(u));
+		const int16x8_t bOffset = scaleChromaNEON<kCbBShift, kCbBFactor>(u);
+
+		storePixelsNEON<PixelInt, kITU>(dst + x * sizeof(PixelInt), ySrc + x, rOffset, gOffset, bOffset, packing);
+		if (k420)
+			storePixelsNEON<PixelInt, kITU>(dst + dstPitch + x * sizeof(PixelInt), ySrc + yPitch + x, rOffset, gOffset, bOffset, packing);
+	}
+
+	return x;
+}
+
+#endif
+
+#define YUV_TO_RGB_ROW_PROCS(kernel) { \
+		kernel<uint16, false, false>, kernel<uint16, false, true>, \
+		kernel<uint16, true,  false>, kernel<uint16, true,  true>, \
+		kernel<uint32, false, false>, kernel<uint32, false, true>, \
+		kernel<uint32, true,  false>, kernel<uint32, true,  true> \
+	}
+
+static ConvertRowProc getConvertRowProc(YUVToRGBManager::Kernel kernel, int bytesPerPixel, bool is420, bool itu) {
+	const int index = (bytesPerPixel == 4 ? 4 : 0) + (is420 ? 2 : 0) + (itu ? 1 : 0);
+
+	switch (kernel) {
+#if defined(__SSE2__)
+	case YUVToRGBManager::kKernelSSE2: {
+		static const ConvertRowProc procs[] = YUV_TO_RGB_ROW_PROCS(convertRowSSE2);
+		return procs[index];
+	}
+#endif
+#if defined(YUV_TO_RGB_AVX2)
+	case YUVToRGBManager::kKernelAVX2: {
+		static const ConvertRowProc procs[] = YUV_TO_RGB_ROW_PROCS(convertRowAVX2);
+		return procs[index];
+	}
+#endif
+#if defined(__ARM_NEON)
+	case YUVToRGBManager::kKernelNEON: {
+		static const ConvertRowProc procs[] = YUV_TO_RGB_ROW_PROCS(convertRowNEON);
+		return procs[index];
+	}
+#endif
+	default:
+		return 0;
+	}
+}
+
+#undef YUV_TO_RGB_ROW_PROCS
+
+/**
+ * Converts pixels [start, width) of a row through the lookup tables. The
+ * chroma is sampled at x >> chromaShift.
+ */
+template<typename PixelInt>
+void convertPixelsToRGB(byte *dstPtr, const YUVToRGBLookup *lookup, const int16 *colorTab, const byte *ySrc, const byte *uSrc, const byte *vSrc, int start, int width, int chromaShift) {
+	const int16 *Cr_r_tab = colorTab;
+	const int16 *Cr_g_tab = Cr_r_tab + 256;
+	const int16 *Cb_g_tab = Cr_g_tab + 256;
+	const int16 *Cb_b_tab = Cb_g_tab + 256;
+	const uint32 *rgbToPix = lookup->getRGBToPix();
+
+	for (int x = start; x < width; x++) {
+		const uint32 *L;
+
+		const byte u = uSrc[x >> chromaShift];
+		const byte v = vSrc[x >> chromaShift];
+		int16 cr_r  = Cr_r_tab[v];
+		int16 crb_g = Cr_g_tab[v] + Cb_g_tab[u];
+		int16 cb_b  = Cb_b_tab[u];
+
+		PUT_PIXEL(ySrc[x], dstPtr + x * sizeof(PixelInt));
+	}
+}
+
+/**
+ * Converts 444 images with a SIMD kernel.
+ */
+template<typename PixelInt>
+void convertYUV444ToRGBRows(ConvertRowProc convertRow, byte *dstPtr, int dstPitch, const YUVToRGBLookup *lookup, const int16 *colorTab, const byte *ySrc, const byte *uSrc, const byte *vSrc, int yWidth, int yHeight, int yPitch, int uvPitch) {
+	for (int h = 0; h < yHeight; h++) {
+		const int done = convertRow(dstPtr, dstPitch, lookup->getPacking(), ySrc, yPitch, uSrc, vSrc, yWidth);
+		convertPixelsToRGB<PixelInt>(dstPtr, lookup, colorTab, ySrc, uSrc, vSrc, done, yWidth, 0);
+
+		dstPtr += dstPitch;
+		ySrc += yPitch;
+		uSrc += uvPitch;
+		vSrc += uvPitch;
+	}
+}
+
+/**
+ * Converts 420 images with a SIMD kernel, two rows at a time.
+ */
+template<typename PixelInt>
+void convertYUV420ToRGBRows(ConvertRowProc convertRow, byte *dstPtr, int dstPitch, const YUVToRGBLookup *lookup, const int16 *colorTab, const byte *ySrc, const byte *uSrc, const byte *vSrc, int yWidth, int yHeight, int yPitch, int uvPitch) {
+	for (int h = 0; h < yHeight; h += 2) {
+		const int done = convertRow(dstPtr, dstPitch, lookup->getPacking(), ySrc, yPitch, uSrc, vSrc, yWidth);
+		convertPixelsToRGB<PixelInt>(dstPtr, lookup, colorTab, ySrc, uSrc, vSrc, done, yWidth, 1);
+		convertPixelsToRGB<PixelInt>(dstPtr + dstPitch, lookup, colorTab, ySrc + yPitch, uSrc, vSrc, done, yWidth, 1);
+
+		dstPtr += dstPitch << 1;
+		ySrc += yPitch << 1;
+		uSrc += uvPitch;
+		vSrc += uvPitch;
+	}
+}
+
+/**
+ * Converts 410 images with a SIMD kernel. The chroma of each row is
+ * interpolated into a buffer first, then converted like 444.
+ */
+template<typename PixelInt>
+void convertYUV410ToRGBRows(ConvertRowProc convertRow, byte *dstPtr, int dstPitch, const YUVToRGBLookup *lookup, const int16 *colorTab, const byte *ySrc, const byte *uSrc, const byte *vSrc, int yWidth, int yHeight, int yPitch, int uvPitch) {
+	const int quarterWidth = yWidth >> 2;
+	byte *uRow = new byte[yWidth * 2];
+	byte *vRow = uRow + yWidth;
+
+	for (int y = 0; y < yHeight; y++) {
+		const int yDiff = y & 3;
+		const byte *uLine = uSrc + (y >> 2) * uvPitch;
+		const byte *vLine = vSrc + (y >> 2) * uvPitch;
+
+		// The same bilinear interpolation as convertYUV410ToRGB(), blending
+		// the two chroma rows first and then along the row
+		int uLeft = uLine[0] * (4 - yDiff) + uLine[uvPitch] * yDiff;
+		int vLeft = vLine[0] * (4 - yDiff) + vLine[uvPitch] * yDiff;
+
+		for (int x = 0; x < quarterWidth; x++) {
+			const int uRight = uLine[x + 1] * (4 - yDiff) + uLine[x + 1 + uvPitch] * yDiff;
+			const int vRight = vLine[x + 1] * (4 - yDiff) + vLine[x + 1 + uvPitch] * yDiff;
+
+			for (int xDiff = 0; xDiff < 4; xDiff++) {
+				uRow[x * 4 + xDiff] = (uLeft * (4 - xDiff) + uRight * xDiff) >> 4;
+				vRow[x * 4 + xDiff] = (vLeft * (4 - xDiff) + vRight * xDiff) >> 4;
+			}
+
+			uLeft = uRight;
+			vLeft = vRight;
+		}
+
+		const int done = convertRow(dstPtr, dstPitch, lookup->getPacking(), ySrc, yPitch, uRow, vRow, yWidth);
+		convertPixelsToRGB<PixelInt>(dstPtr, lookup, colorTab, ySrc, uRow, vRow, done, yWidth, 0);
+
+		dstPtr += dstPitch;
+		ySrc += yPitch;
+	}
+
+	delete[] uRow;
+}
+
 template<typename PixelInt>
 void convertYUV444ToRGB(byte *dstPtr, int dstPitch, const YUVToRGBLookup *lookup, int16 *colorTab, const byte *ySrc, const byte *uSrc, const byte *vSrc, int yWidth, int yHeight, int yPitch, int uvPitch) {
 	// Keep the tables in pointers here to avoid a dereference on each pixel
@@ -235,6 +730,15 @@ void YUVToRGBManager::convert444(Graphics::Surface *dst, YUVToRGBManager::Lumina
 
 	const YUVToRGBLookup *lookup = getLookup(dst->format, scale);
 
+	ConvertRowProc convertRow = getConvertRowProc(_kernel, dst->format.bytesPerPixel, false, scale == kScaleITU);
+	if (convertRow) {
+		if (dst->format.bytesPerPixel == 2)
+			convertYUV444ToRGBRows<uint16>(convertRow, (byte *)dst->getPixels(), dst->pitch, lookup, _colorTab, ySrc, uSrc, vSrc, yWidth, yHeight, yPitch, uvPitch);
+		else
+			convertYUV444ToRGBRows<uint32>(convertRow, (byte *)dst->getPixels(), dst->pitch, lookup, _colorTab, ySrc, uSrc, vSrc, yWidth, yHeight, yPitch, uvPitch);
+		return;
+	}
+
 	// Use a templated function to avoid an if check on every pixel
 	if (dst->format.bytesPerPixel == 2)
 		convertYUV444ToRGB<uint16>((byte *)dst->getPixels(), dst->pitch, lookup, _colorTab, ySrc, uSrc, vSrc, yWidth, yHeight, yPitch, uvPitch);
@@ -274,7 +778,7 @@ void convertYUV420ToRGB(byte *dstPtr, int dstPitch, const YUVToRGBLookup *lookup
 			dstPtr += sizeof(PixelInt);
 		}
 
-		dstPtr += dstPitch;
+		dstPtr += (dstPitch << 1) - yWidth * sizeof(PixelInt);
 		ySrc += (yPitch << 1) - yWidth;
 		uSrc += uvPitch - halfWidth;
 		vSrc += uvPitch - halfWidth;
@@ -291,6 +795,15 @@ void YUVToRGBManager::convert420(Graphics::Surface *dst, YUVToRGBManager::Lumina
 
 	const YUVToRGBLookup *lookup = getLookup(dst->format, scale);
 
+	ConvertRowProc convertRow = getConvertRowProc(_kernel, dst->format.bytesPerPixel, true, scale == kScaleITU);
+	if (convertRow) {
+		if (dst->format.bytesPerPixel == 2)
+			convertYUV420ToRGBRows<uint16>(convertRow, (byte *)dst->getPixels(), dst->pitch, lookup, _colorTab, ySrc, uSrc, vSrc, yWidth, yHeight, yPitch, uvPitch);
+		else
+			convertYUV420ToRGBRows<uint32>(convertRow, (byte *)dst->getPixels(), dst->pitch, lookup, _colorTab, ySrc, uSrc, vSrc, yWidth, yHeight, yPitch, uvPitch);
+		return;
+	}
+
 	// Use a templated function to avoid an if check on every pixel
 	if (dst->format.bytesPerPixel == 2)
 		convertYUV420ToRGB<uint16>((byte *)dst->getPixels(), dst->pitch, lookup, _colorTab, ySrc, uSrc, vSrc, yWidth, yHeight, yPitch, uvPitch);
@@ -376,6 +889,15 @@ void YUVToRGBManager::convert410(Graphics::Surface *dst, YUVToRGBManager::Lumina
 
 	const YUVToRGBLookup *lookup = getLookup(dst->format, scale);
 
+	ConvertRowProc convertRow = getConvertRowProc(_kernel, dst->format.bytesPerPixel, false, scale == kScaleITU);
+	if (convertRow) {
+		if (dst->format.bytesPerPixel == 2)
+			convertYUV410ToRGBRows<uint16>(convertRow, (byte *)dst->getPixels(), dst->pitch, lookup, _colorTab, ySrc, uSrc, vSrc, yWidth, yHeight, yPitch, uvPitch);
+		else
+			convertYUV410ToRGBRows<uint32>(convertRow, (byte *)dst->getPixels(), dst->pitch, lookup, _colorTab, ySrc, uSrc, vSrc, yWidth, yHeight, yPitch, uvPitch);
+		return;
+	}
+
 	// Use a templated function to avoid an if check on every pixel
 	if (dst->format.bytesPerPixel == 2)
 		convertYUV410ToRGB<uint16>((byte *)dst->getPixels(), dst->pitch, lookup, _colorTab, ySrc, uSrc, vSrc, yWidth, yHeight, yPitch, uvPitch);
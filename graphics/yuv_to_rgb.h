@@ -39,6 +39,8 @@
 #define GRAPHICS_YUV_TO_RGB_H
 
 #include "common/scummsys.h"
+#include "common/array.h"
+#include "common/atomic.h"
 #include "common/singleton.h"
 #include "graphics/surface.h"
 
@@ -54,6 +56,36 @@ public:
 		kScaleITU   /** Luminance values range from [16, 235], the range from ITU-R BT.601 */
 	};
 
+	/**
+	 * The implementations of the conversions. All of them give the same
+	 * results, the SIMD ones only differ in speed.
+	 */
+	enum Kernel {
+		kKernelScalar, /** Portable code going through lookup tables */
+		kKernelSSE2,   /** SSE2, 8 pixels at a time */
+		kKernelAVX2,   /** AVX2, 16 pixels at a time */
+		kKernelNEON    /** ARM NEON, 8 pixels at a time */
+	};
+
+	/**
+	 * Check whether a kernel is built in and supported by the CPU.
+	 */
+	static bool isKernelSupported(Kernel kernel);
+
+	/**
+	 * Get the kernel used for the conversions. This is the fastest
+	 * supported one unless another one was selected.
+	 */
+	Kernel getKernel() const { return _kernel; }
+
+	/**
+	 * Select the kernel used for the conversions, e.g. to compare them.
+	 *
+	 * @param kernel the kernel to use
+	 * @return true if the kernel is supported and selected
+	 */
+	bool setKernel(Kernel kernel);
+
 	/**
 	 * Convert a YUV444 image to an RGB surface
 	 *
@@ -110,10 +142,18 @@ private:
 	YUVToRGBManager();
 	~YUVToRGBManager();
 
+	/**
+	 * Get the tables for a format and scale, building them on first use.
+	 * Safe to call from several threads; the tables are kept until the
+	 * manager is destroyed and never change, so decoders on other threads
+	 * can use them while the main thread converts to another format.
+	 */
 	const YUVToRGBLookup *getLookup(Graphics::PixelFormat format, LuminanceScale scale);
 
-	YUVToRGBLookup *_lookup;
+	Common::Array<YUVToRGBLookup *> _lookups;
+	Common::SpinLock _lookupLock;
 	int16 _colorTab[4 * 256]; // 2048 bytes
+	Kernel _kernel;
 };
 
 } // End of namespace Graphics
@@ -31,6 +31,12 @@
 
 #include "graphics/surface.h"
 
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
 // Code here partially based off of ffmpeg ;)
 
 namespace Image {
@@ -49,6 +55,17 @@ inline uint32 convertYUVToColor(const byte *clipTable, const Graphics::PixelForm
 	return format.RGBToColor(r, g, b);
 }
 
+/**
+ * Pack two 16bpp pixels into what is one row of two pixels in memory
+ */
+inline uint32 packPixelPair(uint32 left, uint32 right) {
+#ifdef SCUMM_BIG_ENDIAN
+	return (left << 16) | right;
+#else
+	return left | (right << 16);
+#endif
+}
+
 inline uint16 createDitherTableIndex(const byte *clipTable, byte y, int8 u, int8 v) {
 	byte r, g, b;
 	convertYUVToRGB(clipTable, y, u, v, r, g, b);
@@ -295,6 +312,138 @@ struct CodebookConverterDitherQT {
 	}
 };
 
+/**
+ * Codebook converter for true color output, which copies the codebooks
+ * already converted to the output format by CinepakDecoder::expandCodebook().
+ */
+struct CodebookConverterExpanded {
+	static inline void decodeBlock1(byte codebookIndex, const CinepakStrip &strip, uint32 *(&rows)[4], const byte *clipTable, const byte *colorMap, const Graphics::PixelFormat &format) {
+		const uint32 *colorPtr = strip.v1_pixels + (codebookIndex << 2);
+#if defined(__SSE2__)
+		const __m128i colors = _mm_loadu_si128((const __m128i *)colorPtr);
+		const __m128i top = _mm_shuffle_epi32(colors, _MM_SHUFFLE(1, 1, 0, 0));
+		const __m128i bottom = _mm_shuffle_epi32(colors, _MM_SHUFFLE(3, 3, 2, 2));
+		_mm_storeu_si128((__m128i *)rows[0], top);
+		_mm_storeu_si128((__m128i *)rows[1], top);
+		_mm_storeu_si128((__m128i *)rows[2], bottom);
+		_mm_storeu_si128((__m128i *)rows[3], bottom);
+#elif defined(__ARM_NEON)
+		const uint32x4_t colors = vld1q_u32(colorPtr);
+		const uint32x4x2_t halves = vzipq_u32(colors, colors);
+		vst1q_u32(rows[0], halves.val[0]);
+		vst1q_u32(rows[1], halves.val[0]);
+		vst1q_u32(rows[2], halves.val[1]);
+		vst1q_u32(rows[3], halves.val[1]);
+#else
+		for (int i = 0; i < 2; i++) {
+			rows[i][0] = rows[i][1] = colorPtr[0];
+			rows[i][2] = rows[i][3] = colorPtr[1];
+			rows[i + 2][0] = rows[i + 2][1] = colorPtr[2];
+			rows[i + 2][2] = rows[i + 2][3] = colorPtr[3];
+		}
+#endif
+	}
+
+	static inline void decodeBlock4(const byte (&codebookIndex)[4], const CinepakStrip &strip, uint32 *(&rows)[4], const byte *clipTable, const byte *colorMap, const Graphics::PixelFormat &format) {
+		const uint32 *colorPtr1 = strip.v4_pixels + (codebookIndex[0] << 2);
+		const uint32 *colorPtr2 = strip.v4_pixels + (codebookIndex[1] << 2);
+		const uint32 *colorPtr3 = strip.v4_pixels + (codebookIndex[2] << 2);
+		const uint32 *colorPtr4 = strip.v4_pixels + (codebookIndex[3] << 2);
+#if defined(__SSE2__)
+		const __m128i colors1 = _mm_loadu_si128((const __m128i *)colorPtr1);
+		const __m128i colors2 = _mm_loadu_si128((const __m128i *)colorPtr2);
+		const __m128i colors3 = _mm_loadu_si128((const __m128i *)colorPtr3);
+		const __m128i colors4 = _mm_loadu_si128((const __m128i *)colorPtr4);
+		_mm_storeu_si128((__m128i *)rows[0], _mm_unpacklo_epi64(colors1, colors2));
+		_mm_storeu_si128((__m128i *)rows[1], _mm_unpackhi_epi64(colors1, colors2));
+		_mm_storeu_si128((__m128i *)rows[2], _mm_unpacklo_epi64(colors3, colors4));
+		_mm_storeu_si128((__m128i *)rows[3], _mm_unpackhi_epi64(colors3, colors4));
+#elif defined(__ARM_NEON)
+		const uint32x4_t colors1 = vld1q_u32(colorPtr1);
+		const uint32x4_t colors2 = vld1q_u32(colorPtr2);
+		const uint32x4_t colors3 = vld1q_u32(colorPtr3);
+		const uint32x4_t colors4 = vld1q_u32(colorPtr4);
+		vst1q_u32(rows[0], vcombine_u32(vget_low_u32(colors1), vget_low_u32(colors2)));
+		vst1q_u32(rows[1], vcombine_u32(vget_high_u32(colors1), vget_high_u32(colors2)));
+		vst1q_u32(rows[2], vcombine_u32(vget_low_u32(colors3), vget_low_u32(colors4)));
+		vst1q_u32(rows[3], vcombine_u32(vget_high_u32(colors3), vget_high_u32(colors4)));
+#else
+		rows[0][0] = colorPtr1[0];
+		rows[0][1] = colorPtr1[1];
+		rows[1][0] = colorPtr1[2];
+		rows[1][1] = colorPtr1[3];
+		rows[0][2] = colorPtr2[0];
+		rows[0][3] = colorPtr2[1];
+		rows[1][2] = colorPtr2[2];
+		rows[1][3] = colorPtr2[3];
+		rows[2][0] = colorPtr3[0];
+		rows[2][1] = colorPtr3[1];
+		rows[3][0] = colorPtr3[2];
+		rows[3][1] = colorPtr3[3];
+		rows[2][2] = colorPtr4[0];
+		rows[2][3] = colorPtr4[1];
+		rows[3][2] = colorPtr4[2];
+		rows[3][3] = colorPtr4[3];
+#endif
+	}
+
+	static inline void decodeBlock1(byte codebookIndex, const CinepakStrip &strip, uint16 *(&rows)[4], const byte *clipTable, const byte *colorMap, const Graphics::PixelFormat &format) {
+		const uint32 *pairPtr = strip.v1_pixels + (codebookIndex << 2);
+#if defined(__SSE2__)
+		const __m128i pairs = _mm_loadu_si128((const __m128i *)pairPtr);
+		const __m128i bottom = _mm_unpackhi_epi64(pairs, pairs);
+		_mm_storel_epi64((__m128i *)rows[0], pairs);
+		_mm_storel_epi64((__m128i *)rows[1], pairs);
+		_mm_storel_epi64((__m128i *)rows[2], bottom);
+		_mm_storel_epi64((__m128i *)rows[3], bottom);
+#elif defined(__ARM_NEON)
+		const uint32x4_t pairs = vld1q_u32(pairPtr);
+		vst1_u32((uint32 *)rows[0], vget_low_u32(pairs));
+		vst1_u32((uint32 *)rows[1], vget_low_u32(pairs));
+		vst1_u32((uint32 *)rows[2], vget_high_u32(pairs));
+		vst1_u32((uint32 *)rows[3], vget_high_u32(pairs));
+#else
+		for (int i = 0; i < 2; i++) {
+			WRITE_UINT32(rows[i] + 0, pairPtr[0]);
+			WRITE_UINT32(rows[i] + 2, pairPtr[1]);
+			WRITE_UINT32(rows[i + 2] + 0, pairPtr[2]);
+			WRITE_UINT32(rows[i + 2] + 2, pairPtr[3]);
+		}
+#endif
+	}
+
+	static inline void decodeBlock4(const byte (&codebookIndex)[4], const CinepakStrip &strip, uint16 *(&rows)[4], const byte *clipTable, const byte *colorMap, const Graphics::PixelFormat &format) {
+		const uint32 *pairPtr1 = strip.v4_pixels + (codebookIndex[0] << 2);
+		const uint32 *pairPtr2 = strip.v4_pixels + (codebookIndex[1] << 2);
+		const uint32 *pairPtr3 = strip.v4_pixels + (codebookIndex[2] << 2);
+		const uint32 *pairPtr4 = strip.v4_pixels + (codebookIndex[3] << 2);
+#if defined(__SSE2__)
+		const __m128i top = _mm_unpacklo_epi32(_mm_loadl_epi64((const __m128i *)pairPtr1), _mm_loadl_epi64((const __m128i *)pairPtr2));
+		const __m128i bottom = _mm_unpacklo_epi32(_mm_loadl_epi64((const __m128i *)pairPtr3), _mm_loadl_epi64((const __m128i *)pairPtr4));
+		_mm_storel_epi64((__m128i *)rows[0], top);
+		_mm_storel_epi64((__m128i *)rows[1], _mm_unpackhi_epi64(top, top));
+		_mm_storel_epi64((__m128i *)rows[2], bottom);
+		_mm_storel_epi64((__m128i *)rows[3], _mm_unpackhi_epi64(bottom, bottom));
+#elif defined(__ARM_NEON)
+		const uint32x2x2_t top = vzip_u32(vld1_u32(pairPtr1), vld1_u32(pairPtr2));
+		const uint32x2x2_t bottom = vzip_u32(vld1_u32(pairPtr3), vld1_u32(pairPtr4));
+		vst1_u32((uint32 *)rows[0], top.val[0]);
+		vst1_u32((uint32 *)rows[1], top.val[1]);
+		vst1_u32((uint32 *)rows[2], bottom.val[0]);
+		vst1_u32((uint32 *)rows[3], bottom.val[1]);
+#else
+		WRITE_UINT32(rows[0] + 0, pairPtr1[0]);
+		WRITE_UINT32(rows[1] + 0, pairPtr1[1]);
+		WRITE_UINT32(rows[0] + 2, pairPtr2[0]);
+		WRITE_UINT32(rows[1] + 2, pairPtr2[1]);
+		WRITE_UINT32(rows[2] + 0, pairPtr3[0]);
+		WRITE_UINT32(rows[3] + 0, pairPtr3[1]);
+		WRITE_UINT32(rows[2] + 2, pairPtr4[0]);
+		WRITE_UINT32(rows[3] + 2, pairPtr4[1]);
+#endif
+	}
+};
+
 template<typename PixelInt, typename CodebookConverter>
 void decodeVectorsTmpl(CinepakFrame &frame, const byte *clipTable, const byte *colorMap, Common::SeekableReadStream &stream, uint16 strip, byte chunkID, uint32 chunkSize) {
 	uint32 flag = 0, mask = 0;
@@ -303,9 +452,9 @@ void decodeVectorsTmpl(CinepakFrame &frame, const byte *clipTable, const byte *c
 
 	for (uint16 y = frame.strips[strip].rect.top; y < frame.strips[strip].rect.bottom; y += 4) {
 		iy[0] = (PixelInt *)frame.surface->getBasePtr(frame.strips[strip].rect.left, + y);
-		iy[1] = iy[0] + frame.width;
-		iy[2] = iy[1] + frame.width;
-		iy[3] = iy[2] + frame.width;
+		iy[1] = iy[0] + frame.surface->pitch / sizeof(PixelInt);
+		iy[2] = iy[1] + frame.surface->pitch / sizeof(PixelInt);
+		iy[3] = iy[2] + frame.surface->pitch / sizeof(PixelInt);
 
 		for (uint16 x = frame.strips[strip].rect.left; x < frame.strips[strip].rect.right; x += 4) {
 			if ((chunkID & 0x01) && !(mask >>= 1)) {
@@ -353,20 +502,15 @@ void decodeVectorsTmpl(CinepakFrame &frame, const byte *clipTable, const byte *c
 CinepakDecoder::CinepakDecoder(int bitsPerPixel) : Codec(), _bitsPerPixel(bitsPerPixel) {
 	_curFrame.surface = 0;
 	_curFrame.strips = 0;
+	_ownSurface = 0;
 	_y = 0;
 	_colorMap = 0;
 	_ditherPalette = 0;
 	_ditherType = kDitherTypeUnknown;
 
-	if (bitsPerPixel == 8) {
+	// The true color format is picked by getPixelFormat(), unless it is set
+	if (bitsPerPixel == 8)
 		_pixelFormat = Graphics::PixelFormat::createFormatCLUT8();
-	} else {
-		_pixelFormat = g_system->getScreenFormat();
-
-		// Default to a 32bpp format, if in 8bpp mode
-		if (_pixelFormat.bytesPerPixel == 1)
-			_pixelFormat = Graphics::PixelFormat(4, 8, 8, 8, 8, 8, 16, 24, 0);
-	}
 
 	// Create a lookup for the clip function
 	// This dramatically improves the performance of the color conversion
@@ -385,9 +529,9 @@ CinepakDecoder::CinepakDecoder(int bitsPerPixel) : Codec(), _bitsPerPixel(bitsPe
 }
 
 CinepakDecoder::~CinepakDecoder() {
-	if (_curFrame.surface) {
-		_curFrame.surface->free();
-		delete _curFrame.surface;
+	if (_ownSurface) {
+		_ownSurface->free();
+		delete _ownSurface;
 	}
 
 	delete[] _curFrame.strips;
@@ -397,6 +541,18 @@ CinepakDecoder::~CinepakDecoder() {
 	delete[] _ditherPalette;
 }
 
+Graphics::PixelFormat CinepakDecoder::getPixelFormat() const {
+	if (!_pixelFormat.bytesPerPixel) {
+		_pixelFormat = g_system->getScreenFormat();
+
+		// Default to a 32bpp format, if in 8bpp mode
+		if (_pixelFormat.bytesPerPixel == 1)
+			_pixelFormat = Graphics::PixelFormat(4, 8, 8, 8, 8, 8, 16, 24, 0);
+	}
+
+	return _pixelFormat;
+}
+
 const Graphics::Surface *CinepakDecoder::decodeFrame(Common::SeekableReadStream &stream) {
 	_curFrame.flags = stream.readByte();
 	_curFrame.length = (stream.readByte() << 16);
@@ -419,11 +575,20 @@ const Graphics::Surface *CinepakDecoder::decodeFrame(Common::SeekableReadStream
 			stream.seek(-2, SEEK_CUR);
 	}
 
-	if (!_curFrame.surface) {
-		_curFrame.surface = new Graphics::Surface();
-		_curFrame.surface->create(_curFrame.width, _curFrame.height, _pixelFormat);
+	if (!_ownSurface) {
+		_ownSurface = new Graphics::Surface();
+		_ownSurface->create(_curFrame.width, _curFrame.height, getPixelFormat());
+
+		// An output surface set before the first frame can only be checked now
+		if (_curFrame.surface && (_curFrame.surface->w < _curFrame.width || _curFrame.surface->h < _curFrame.height)) {
+			warning("Cinepak output surface is smaller than the frames, not using it");
+			_curFrame.surface = 0;
+		}
 	}
 
+	if (!_curFrame.surface)
+		_curFrame.surface = _ownSurface;
+
 	// Reset the y variable.
 	_y = 0;
 
@@ -436,8 +601,16 @@ const Graphics::Surface *CinepakDecoder::decodeFrame(Common::SeekableReadStream
 			}
 
 			// Copy the QuickTime dither tables
-			memcpy(_curFrame.strips[i].v1_dither, _curFrame.strips[i - 1].v1_dither, 256 * 4 * 4 * 4);
-			memcpy(_curFrame.strips[i].v4_dither, _curFrame.strips[i - 1].v4_dither, 256 * 4 * 4 * 4);
+			if (_ditherType == kDitherTypeQT) {
+				memcpy(_curFrame.strips[i].v1_dither, _curFrame.strips[i - 1].v1_dither, 256 * 4 * 4 * 4);
+				memcpy(_curFrame.strips[i].v4_dither, _curFrame.strips[i - 1].v4_dither, 256 * 4 * 4 * 4);
+			}
+
+			// Copy the converted codebooks
+			if (isExpandingCodebooks()) {
+				memcpy(_curFrame.strips[i].v1_pixels, _curFrame.strips[i - 1].v1_pixels, sizeof(_curFrame.strips[i].v1_pixels));
+				memcpy(_curFrame.strips[i].v4_pixels, _curFrame.strips[i - 1].v4_pixels, sizeof(_curFrame.strips[i].v4_pixels));
+			}
 		}
 
 		_curFrame.strips[i].id = stream.readUint16BE();
@@ -505,6 +678,7 @@ void CinepakDecoder::loadCodebook(Common::SeekableReadStream &stream, uint16 str
 
 	int32 startPos = stream.pos();
 	uint32 flag = 0, mask = 0;
+	const bool expand = isExpandingCodebooks();
 
 	for (uint16 i = 0; i < 256; i++) {
 		if ((chunkID & 0x01) && !(mask >>= 1)) {
@@ -536,10 +710,37 @@ void CinepakDecoder::loadCodebook(Common::SeekableReadStream &stream, uint16 str
 			// Dither the codebook if we're dithering for QuickTime
 			if (_ditherType == kDitherTypeQT)
 				ditherCodebookQT(strip, codebookType, i);
+			else if (expand)
+				expandCodebook(strip, codebookType, i);
 		}
 	}
 }
 
+bool CinepakDecoder::isExpandingCodebooks() const {
+	return !_ditherPalette && _pixelFormat.bytesPerPixel != 1;
+}
+
+void CinepakDecoder::expandCodebook(uint16 strip, byte codebookType, uint16 codebookIndex) {
+	const CinepakCodebook &codebook = (codebookType == 1) ? _curFrame.strips[strip].v1_codebook[codebookIndex] : _curFrame.strips[strip].v4_codebook[codebookIndex];
+	uint32 *output = ((codebookType == 1) ? _curFrame.strips[strip].v1_pixels : _curFrame.strips[strip].v4_pixels) + (codebookIndex << 2);
+
+	uint32 colors[4];
+	for (int i = 0; i < 4; i++)
+		colors[i] = convertYUVToColor(_clipTable, _pixelFormat, codebook.y[i], codebook.u, codebook.v);
+
+	if (_pixelFormat.bytesPerPixel == 4) {
+		memcpy(output, colors, sizeof(colors));
+	} else if (codebookType == 1) {
+		// Every color covers two pixels of a row
+		for (int i = 0; i < 4; i++)
+			output[i] = packPixelPair(colors[i], colors[i]);
+	} else {
+		// The two rows of the vector
+		output[0] = packPixelPair(colors[0], colors[1]);
+		output[1] = packPixelPair(colors[2], colors[3]);
+	}
+}
+
 void CinepakDecoder::ditherCodebookQT(uint16 strip, byte codebookType, uint16 codebookIndex) {
 	if (codebookType == 1) {
 		const CinepakCodebook &codebook = _curFrame.strips[strip].v1_codebook[codebookIndex];
@@ -602,12 +803,40 @@ void CinepakDecoder::decodeVectors(Common::SeekableReadStream &stream, uint16 st
 	if (_curFrame.surface->format.bytesPerPixel == 1) {
 		decodeVectorsTmpl<byte, CodebookConverterRaw>(_curFrame, _clipTable, _colorMap, stream, strip, chunkID, chunkSize);
 	} else if (_curFrame.surface->format.bytesPerPixel == 2) {
-		decodeVectorsTmpl<uint16, CodebookConverterRaw>(_curFrame, _clipTable, _colorMap, stream, strip, chunkID, chunkSize);
+		decodeVectorsTmpl<uint16, CodebookConverterExpanded>(_curFrame, _clipTable, _colorMap, stream, strip, chunkID, chunkSize);
 	} else if (_curFrame.surface->format.bytesPerPixel == 4) {
-		decodeVectorsTmpl<uint32, CodebookConverterRaw>(_curFrame, _clipTable, _colorMap, stream, strip, chunkID, chunkSize);
+		decodeVectorsTmpl<uint32, CodebookConverterExpanded>(_curFrame, _clipTable, _colorMap, stream, strip, chunkID, chunkSize);
 	}
 }
 
+bool CinepakDecoder::setOutputPixelFormat(const Graphics::PixelFormat &format) {
+	if (!canOutputPixelFormat(format))
+		return false;
+
+	_pixelFormat = format;
+	return true;
+}
+
+bool CinepakDecoder::canOutputPixelFormat(const Graphics::PixelFormat &format) const {
+	if (format == _pixelFormat)
+		return true;
+
+	// Any true color format works, as long as nothing was decoded yet
+	return _bitsPerPixel != 8 && !_ditherPalette && !_curFrame.surface && (format.bytesPerPixel == 2 || format.bytesPerPixel == 4);
+}
+
+bool CinepakDecoder::setOutputSurface(Graphics::Surface *surface) {
+	if (_ownSurface)
+		return switchOutputSurface(_curFrame.surface, _ownSurface, surface, _ownSurface->w, _ownSurface->h);
+
+	// The frame size is only known once the first frame is decoded
+	if (surface && surface->format != getPixelFormat())
+		return false;
+
+	_curFrame.surface = surface;
+	return true;
+}
+
 bool CinepakDecoder::canDither(DitherType type) const {
 	return (type == kDitherTypeVFW || type == kDitherTypeQT) && _bitsPerPixel == 24;
 }
@@ -47,6 +47,10 @@ struct CinepakStrip {
 	Common::Rect rect;
 	CinepakCodebook v1_codebook[256], v4_codebook[256];
 	byte v1_dither[256 * 4 * 4 * 4], v4_dither[256 * 4 * 4 * 4];
+
+	// The codebooks converted to the output pixel format, four entries per
+	// vector: one pixel each in 32bpp, two pixels of a row each in 16bpp
+	uint32 v1_pixels[256 * 4], v4_pixels[256 * 4];
 };
 
 struct CinepakFrame {
@@ -74,7 +78,10 @@ public:
 	~CinepakDecoder();
 
 	const Graphics::Surface *decodeFrame(Common::SeekableReadStream &stream);
-	Graphics::PixelFormat getPixelFormat() const { return _pixelFormat; }
+	Graphics::PixelFormat getPixelFormat() const;
+	bool setOutputPixelFormat(const Graphics::PixelFormat &format);
+	bool canOutputPixelFormat(const Graphics::PixelFormat &format) const;
+	bool setOutputSurface(Graphics::Surface *surface);
 
 	bool containsPalette() const { return _ditherPalette != 0; }
 	const byte *getPalette() { _dirtyPalette = false; return _ditherPalette; }
@@ -84,9 +91,10 @@ public:
 
 private:
 	CinepakFrame _curFrame;
+	Graphics::Surface *_ownSurface;
 	int32 _y;
 	int _bitsPerPixel;
-	Graphics::PixelFormat _pixelFormat;
+	mutable Graphics::PixelFormat _pixelFormat;
 	byte *_clipTable, *_clipTableBuf;
 
 	byte *_ditherPalette;
@@ -95,6 +103,8 @@ private:
 	DitherType _ditherType;
 
 	void loadCodebook(Common::SeekableReadStream &stream, uint16 strip, byte codebookType, byte chunkID, uint32 chunkSize);
+	bool isExpandingCodebooks() const;
+	void expandCodebook(uint16 strip, byte codebookType, uint16 codebookIndex);
 	void decodeVectors(Common::SeekableReadStream &stream, uint16 strip, byte chunkID, uint32 chunkSize);
 
 	byte findNearestRGB(int index) const;
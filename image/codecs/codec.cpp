@@ -195,6 +195,25 @@ byte *Codec::createQuickTimeDitherTable(const byte *palette, uint colorCount) {
 	return buf;
 }
 
+bool Codec::switchOutputSurface(Graphics::Surface *&surface, Graphics::Surface *own, Graphics::Surface *output, uint width, uint height) {
+	Graphics::Surface *target = output ? output : own;
+
+	if (target == surface)
+		return true;
+
+	if (output && (output->format != own->format || output->w < (int)width || output->h < (int)height))
+		return false;
+
+	// Carry the current frame over, the next one may only update parts of it
+	if (surface && surface->getPixels() && target->getPixels()) {
+		for (uint y = 0; y < height; y++)
+			memcpy(target->getBasePtr(0, y), surface->getBasePtr(0, y), width * own->format.bytesPerPixel);
+	}
+
+	surface = target;
+	return true;
+}
+
 Codec *createBitmapCodec(uint32 tag, int width, int height, int bitsPerPixel) {
 	switch (tag) {
 	case SWAP_CONSTANT_32(0):
@@ -86,6 +86,38 @@ public:
 	 */
 	virtual Graphics::PixelFormat getPixelFormat() const = 0;
 
+	/**
+	 * Set the format frames are decoded in, so that they don't have to be
+	 * converted afterwards.
+	 *
+	 * This should be called before the first frame is decoded.
+	 *
+	 * @return true if frames are now decoded in this format, false otherwise
+	 */
+	virtual bool setOutputPixelFormat(const Graphics::PixelFormat &format) { return canOutputPixelFormat(format); }
+
+	/**
+	 * Check whether setOutputPixelFormat() would accept a format, without
+	 * changing anything.
+	 */
+	virtual bool canOutputPixelFormat(const Graphics::PixelFormat &format) const { return format == getPixelFormat(); }
+
+	/**
+	 * Decode frames straight into the given surface, for example the pixels
+	 * of the screen the video is drawn to, instead of into a surface of the
+	 * codec. decodeFrame() then returns this surface.
+	 *
+	 * The surface must be in the format of the codec, and at least as large
+	 * as the frames, rounded up to whole blocks for codecs working on
+	 * blocks. Since a frame may only update parts of the previous
+	 * one, the current frame is copied over, and the pixels of the surface
+	 * must be left alone between frames. Passing 0 goes back to decoding
+	 * into the surface of the codec.
+	 *
+	 * @return true on success, false if the codec can't decode into the surface
+	 */
+	virtual bool setOutputSurface(Graphics::Surface *surface) { return false; }
+
 	/**
 	 * Can this codec's frames contain a palette?
 	 */
@@ -115,6 +147,20 @@ public:
 	 * Create a dither table, as used by QuickTime codecs.
 	 */
 	static byte *createQuickTimeDitherTable(const byte *palette, uint colorCount);
+
+protected:
+	/**
+	 * Switch the surface a codec decodes into, for setOutputSurface().
+	 *
+	 * @param surface	the surface decoded into so far, replaced on success
+	 * @param own		the surface of the codec, used when output is 0
+	 * @param output	the surface to decode into from now on, or 0
+	 * @param width		the width the codec writes to, including padding
+	 * @param height	the height the codec writes to, including padding
+	 * @return true on success, false if output is too small or in the
+	 *         wrong format
+	 */
+	static bool switchOutputSurface(Graphics::Surface *&surface, Graphics::Surface *own, Graphics::Surface *output, uint width, uint height);
 };
 
 /**
@@ -499,6 +499,22 @@ IndeoDecoderBase::~IndeoDecoderBase() {
 	delete _ctx._pFrame;
 }
 
+bool IndeoDecoderBase::setOutputPixelFormat(const Graphics::PixelFormat &format) {
+	if (format == _pixelFormat)
+		return true;
+
+	if (!canOutputPixelFormat(format))
+		return false;
+
+	_pixelFormat = format;
+	_surface.convertToInPlace(_pixelFormat);
+	return true;
+}
+
+bool IndeoDecoderBase::canOutputPixelFormat(const Graphics::PixelFormat &format) const {
+	return format == _pixelFormat || format.bytesPerPixel == 2 || format.bytesPerPixel == 4;
+}
+
 int IndeoDecoderBase::decodeIndeoFrame() {
 	int result;
 	AVFrame frameData;
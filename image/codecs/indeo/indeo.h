@@ -534,6 +534,12 @@ protected:
 	 */
 	virtual Graphics::PixelFormat getPixelFormat() const { return _pixelFormat; }
 
+	/**
+	 * Select the pixel format the planes are converted to
+	 */
+	virtual bool setOutputPixelFormat(const Graphics::PixelFormat &format);
+	virtual bool canOutputPixelFormat(const Graphics::PixelFormat &format) const;
+
 	/**
 	 * Decode the Indeo picture header.
 	 * @returns		0 = Ok, negative number = error
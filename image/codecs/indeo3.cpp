@@ -62,16 +62,17 @@ Indeo3Decoder::Indeo3Decoder(uint16 width, uint16 height, uint bitsPerPixel) : _
 		break;
 	}
 
-	_surface = new Graphics::Surface;
-	_surface->create(width, height, _pixelFormat);
+	_ownSurface = new Graphics::Surface;
+	_ownSurface->create(width, height, _pixelFormat);
+	_surface = _ownSurface;
 
 	buildModPred();
 	allocFrames();
 }
 
 Indeo3Decoder::~Indeo3Decoder() {
-	_surface->free();
-	delete _surface;
+	_ownSurface->free();
+	delete _ownSurface;
 
 	delete[] _iv_frame[0].the_buf;
 	delete[] _ModPred;
@@ -82,6 +83,32 @@ Graphics::PixelFormat Indeo3Decoder::getPixelFormat() const {
 	return _pixelFormat;
 }
 
+bool Indeo3Decoder::setOutputPixelFormat(const Graphics::PixelFormat &format) {
+	if (format == _pixelFormat)
+		return true;
+
+	if (!canOutputPixelFormat(format))
+		return false;
+
+	// Every frame is converted from YUV as a whole, so nothing needs to be kept
+	_pixelFormat = format;
+	const uint16 width = _ownSurface->w, height = _ownSurface->h;
+	_ownSurface->free();
+	_ownSurface->create(width, height, _pixelFormat);
+	return true;
+}
+
+bool Indeo3Decoder::canOutputPixelFormat(const Graphics::PixelFormat &format) const {
+	if (format == _pixelFormat)
+		return true;
+
+	return _surface == _ownSurface && (format.bytesPerPixel == 2 || format.bytesPerPixel == 4);
+}
+
+bool Indeo3Decoder::setOutputSurface(Graphics::Surface *surface) {
+	return switchOutputSurface(_surface, _ownSurface, surface, _ownSurface->w, _ownSurface->h);
+}
+
 bool Indeo3Decoder::isIndeo3(Common::SeekableReadStream &stream) {
 	// Less than 16 bytes? This can't be right
 	if (stream.size() < 16)
@@ -131,8 +158,8 @@ void Indeo3Decoder::buildModPred() {
 }
 
 void Indeo3Decoder::allocFrames() {
-	int32 luma_width   = (_surface->w + 3) & (~3);
-	int32 luma_height  = (_surface->h + 3) & (~3);
+	int32 luma_width   = (_ownSurface->w + 3) & (~3);
+	int32 luma_height  = (_ownSurface->h + 3) & (~3);
 
 	int32 chroma_width  = ((luma_width  >> 2) + 3) & (~3);
 	int32 chroma_height = ((luma_height >> 2) + 3) & (~3);
@@ -299,8 +326,8 @@ const Graphics::Surface *Indeo3Decoder::decodeFrame(Common::SeekableReadStream &
 			chromaWidth + 1);
 
 	// Blit the frame onto the surface
-	uint32 scaleWidth  = _surface->w / fWidth;
-	uint32 scaleHeight = _surface->h / fHeight;
+	uint32 scaleWidth  = _ownSurface->w / fWidth;
+	uint32 scaleHeight = _ownSurface->h / fHeight;
 
 	if (scaleWidth == 1 && scaleHeight == 1) {
 		// Shortcut: Don't need to scale so we can decode straight to the surface
@@ -315,8 +342,8 @@ const Graphics::Surface *Indeo3Decoder::decodeFrame(Common::SeekableReadStream &
 				fWidth, fHeight, fWidth, chromaWidth + 1);
 
 		// Upscale
-		for (int y = 0; y < _surface->h; y++) {
-			for (int x = 0; x < _surface->w; x++) {
+		for (int y = 0; y < _ownSurface->h; y++) {
+			for (int x = 0; x < _ownSurface->w; x++) {
 				if (_surface->format.bytesPerPixel == 1)
 					*((byte *)_surface->getBasePtr(x, y)) = *((byte *)tempSurface.getBasePtr(x / scaleWidth, y / scaleHeight));
 				else if (_surface->format.bytesPerPixel == 2)
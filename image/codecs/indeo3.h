@@ -51,11 +51,15 @@ public:
 
 	const Graphics::Surface *decodeFrame(Common::SeekableReadStream &stream);
 	Graphics::PixelFormat getPixelFormat() const;
+	bool setOutputPixelFormat(const Graphics::PixelFormat &format);
+	bool canOutputPixelFormat(const Graphics::PixelFormat &format) const;
+	bool setOutputSurface(Graphics::Surface *surface);
 
 	static bool isIndeo3(Common::SeekableReadStream &stream);
 
 private:
 	Graphics::Surface *_surface;
+	Graphics::Surface *_ownSurface;
 
 	Graphics::PixelFormat _pixelFormat;
 
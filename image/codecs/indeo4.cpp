@@ -92,6 +92,16 @@ const Graphics::Surface *Indeo4Decoder::decodeFrame(Common::SeekableReadStream &
 	return (err < 0) ? nullptr : &_surface;
 }
 
+bool Indeo4Decoder::canOutputPixelFormat(const Graphics::PixelFormat &format) const {
+	if (format == _pixelFormat)
+		return true;
+
+	// Any frame may carry a transparency plane, which is only drawn into
+	// 32bpp surfaces with an alpha channel, and would promote any other
+	// format to ARGB
+	return format.bytesPerPixel == 4 && format.aBits() != 0;
+}
+
 int Indeo4Decoder::decodePictureHeader() {
 	int pic_size_indx, i, p;
 	IVIPicConfig picConf;
@@ -58,6 +58,8 @@ public:
 	virtual const Graphics::Surface *decodeFrame(Common::SeekableReadStream &stream);
 
 	static bool isIndeo4(Common::SeekableReadStream &stream);
+
+	virtual bool canOutputPixelFormat(const Graphics::PixelFormat &format) const;
 protected:
 	/**
 	 * Decode the Indeo 4 picture header.
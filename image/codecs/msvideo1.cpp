@@ -35,26 +35,31 @@ namespace Image {
   }
 
 MSVideo1Decoder::MSVideo1Decoder(uint16 width, uint16 height, byte bitsPerPixel) : Codec() {
-	_surface = new Graphics::Surface();
-	_surface->create(width, height, (bitsPerPixel == 8) ? Graphics::PixelFormat::createFormatCLUT8() :
-                                                          Graphics::PixelFormat(2, 5, 5, 5, 0, 10, 5, 0, 0));
+	_ownSurface = new Graphics::Surface();
+	_ownSurface->create(width, height, (bitsPerPixel == 8) ? Graphics::PixelFormat::createFormatCLUT8() :
+                                                             Graphics::PixelFormat(2, 5, 5, 5, 0, 10, 5, 0, 0));
+	_surface = _ownSurface;
 
 	_bitsPerPixel = bitsPerPixel;
 }
 
 MSVideo1Decoder::~MSVideo1Decoder() {
-	_surface->free();
-	delete _surface;
+	_ownSurface->free();
+	delete _ownSurface;
+}
+
+bool MSVideo1Decoder::setOutputSurface(Graphics::Surface *surface) {
+	return switchOutputSurface(_surface, _ownSurface, surface, _ownSurface->w, _ownSurface->h);
 }
 
 void MSVideo1Decoder::decode8(Common::SeekableReadStream &stream) {
     byte colors[8];
     byte *pixels = (byte *)_surface->getPixels();
-    uint16 stride = _surface->w;
+    uint16 stride = _surface->pitch;
 
     int skipBlocks = 0;
-    uint16 blocks_wide = _surface->w / 4;
-    uint16 blocks_high = _surface->h / 4;
+    uint16 blocks_wide = _ownSurface->w / 4;
+    uint16 blocks_high = _ownSurface->h / 4;
     uint32 totalBlocks = blocks_wide * blocks_high;
     uint32 blockInc = 4;
     uint16 rowDec = stride + 4;
@@ -130,11 +135,11 @@ void MSVideo1Decoder::decode16(Common::SeekableReadStream &stream) {
     /* decoding parameters */
     uint16 colors[8];
     uint16 *pixels = (uint16 *)_surface->getPixels();
-    int32 stride = _surface->w;
+    int32 stride = _surface->pitch / 2;
 
     int32 skip_blocks = 0;
-    int32 blocks_wide = _surface->w / 4;
-    int32 blocks_high = _surface->h / 4;
+    int32 blocks_wide = _ownSurface->w / 4;
+    int32 blocks_high = _ownSurface->h / 4;
     int32 total_blocks = blocks_wide * blocks_high;
     int32 block_inc = 4;
     int32 row_dec = stride + 4;
@@ -38,12 +38,14 @@ public:
 	~MSVideo1Decoder();
 
 	const Graphics::Surface *decodeFrame(Common::SeekableReadStream &stream);
-	Graphics::PixelFormat getPixelFormat() const { return _surface->format; }
+	Graphics::PixelFormat getPixelFormat() const { return _ownSurface->format; }
+	bool setOutputSurface(Graphics::Surface *surface);
 
 private:
 	byte _bitsPerPixel;
 
 	Graphics::Surface *_surface;
+	Graphics::Surface *_ownSurface;
 
 	void decode8(Common::SeekableReadStream &stream);
 	void decode16(Common::SeekableReadStream &stream);
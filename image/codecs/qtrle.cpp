@@ -41,6 +41,9 @@ QTRLEDecoder::QTRLEDecoder(uint16 width, uint16 height, byte bitsPerPixel) : Cod
 	_width = width;
 	_height = height;
 	_surface = 0;
+	_ownSurface = 0;
+	_pitch = 0;
+	_trueColorFormat = Graphics::PixelFormat(4, 8, 8, 8, 8, 16, 8, 0, 24);
 	_dirtyPalette = false;
 	_colorMap = 0;
 
@@ -52,9 +55,9 @@ QTRLEDecoder::QTRLEDecoder(uint16 width, uint16 height, byte bitsPerPixel) : Cod
 }
 
 QTRLEDecoder::~QTRLEDecoder() {
-	if (_surface) {
-		_surface->free();
-		delete _surface;
+	if (_ownSurface) {
+		_ownSurface->free();
+		delete _ownSurface;
 	}
 
 	delete[] _colorMap;
@@ -71,8 +74,8 @@ QTRLEDecoder::~QTRLEDecoder() {
 
 #define CHECK_PIXEL_PTR(n) \
 	do { \
-		if ((int32)pixelPtr + n > (int)_paddedWidth * _surface->h) { \
-			warning("QTRLE Problem: pixel ptr = %d, pixel limit = %d", pixelPtr + n, _paddedWidth * _surface->h); \
+		if ((int32)pixelPtr + n > (int)_pitch * _height) { \
+			warning("QTRLE Problem: pixel ptr = %d, pixel limit = %d", pixelPtr + n, _pitch * _height); \
 			return; \
 		} \
 	} while (0)
@@ -91,7 +94,7 @@ void QTRLEDecoder::decode1(Common::SeekableReadStream &stream, uint32 rowPtr, ui
 
 		if (skip & 0x80) {
 			linesToChange--;
-			rowPtr += _paddedWidth;
+			rowPtr += _pitch;
 			pixelPtr = rowPtr + 2 * (skip & 0x7f);
 		} else
 			pixelPtr += 2 * skip;
@@ -177,7 +180,7 @@ void QTRLEDecoder::decode2_4(Common::SeekableReadStream &stream, uint32 rowPtr,
 			}
 		}
 
-		rowPtr += _paddedWidth;
+		rowPtr += _pitch;
 	}
 }
 
@@ -222,7 +225,7 @@ void QTRLEDecoder::decode8(Common::SeekableReadStream &stream, uint32 rowPtr, ui
 			}
 		}
 
-		rowPtr += _paddedWidth;
+		rowPtr += _pitch;
 	}
 }
 
@@ -260,7 +263,7 @@ void QTRLEDecoder::decode16(Common::SeekableReadStream &stream, uint32 rowPtr, u
 			}
 		}
 
-		rowPtr += _paddedWidth;
+		rowPtr += _pitch;
 	}
 }
 
@@ -306,7 +309,7 @@ void QTRLEDecoder::decode24(Common::SeekableReadStream &stream, uint32 rowPtr, u
 			}
 		}
 
-		rowPtr += _paddedWidth;
+		rowPtr += _pitch;
 	}
 }
 
@@ -370,7 +373,7 @@ void QTRLEDecoder::dither24(Common::SeekableReadStream &stream, uint32 rowPtr, u
 			}
 		}
 
-		rowPtr += _paddedWidth;
+		rowPtr += _pitch;
 		curColorTableOffset = (curColorTableOffset + 1) & 3;
 	}
 }
@@ -419,14 +422,19 @@ void QTRLEDecoder::decode32(Common::SeekableReadStream &stream, uint32 rowPtr, u
 			}
 		}
 
-		rowPtr += _paddedWidth;
+		rowPtr += _pitch;
 	}
 }
 
 const Graphics::Surface *QTRLEDecoder::decodeFrame(Common::SeekableReadStream &stream) {
-	if (!_surface)
+	if (!_ownSurface)
 		createSurface();
 
+	if (!_surface)
+		_surface = _ownSurface;
+
+	_pitch = _surface->pitch / _surface->format.bytesPerPixel;
+
 	uint16 startLine = 0;
 	uint16 height = _height;
 
@@ -451,7 +459,7 @@ const Graphics::Surface *QTRLEDecoder::decodeFrame(Common::SeekableReadStream &s
 		stream.readUint16BE(); // Unknown
 	}
 
-	uint32 rowPtr = _paddedWidth * startLine;
+	uint32 rowPtr = _pitch * startLine;
 
 	switch (_bitsPerPixel) {
 	case 1:
@@ -507,7 +515,7 @@ Graphics::PixelFormat QTRLEDecoder::getPixelFormat() const {
 		return Graphics::PixelFormat(2, 5, 5, 5, 0, 10, 5, 0, 0);
 	case 24:
 	case 32:
-		return Graphics::PixelFormat(4, 8, 8, 8, 8, 16, 8, 0, 24);
+		return _trueColorFormat;
 	default:
 		error("Unsupported QTRLE bits per pixel %d", _bitsPerPixel);
 	}
@@ -515,6 +523,32 @@ Graphics::PixelFormat QTRLEDecoder::getPixelFormat() const {
 	return Graphics::PixelFormat();
 }
 
+bool QTRLEDecoder::setOutputPixelFormat(const Graphics::PixelFormat &format) {
+	if (format == getPixelFormat())
+		return true;
+
+	if (!canOutputPixelFormat(format))
+		return false;
+
+	_trueColorFormat = format;
+	return true;
+}
+
+bool QTRLEDecoder::canOutputPixelFormat(const Graphics::PixelFormat &format) const {
+	if (format == getPixelFormat())
+		return true;
+
+	// 24-bit and 32-bit pixels are converted anyway, but only to 32bpp
+	return !_ownSurface && !_ditherPalette && (_bitsPerPixel == 24 || _bitsPerPixel == 32) && format.bytesPerPixel == 4;
+}
+
+bool QTRLEDecoder::setOutputSurface(Graphics::Surface *surface) {
+	if (!_ownSurface)
+		createSurface();
+
+	return switchOutputSurface(_surface, _ownSurface, surface, _paddedWidth, _height);
+}
+
 bool QTRLEDecoder::canDither(DitherType type) const {
 	// Only 24-bit dithering is implemented at the moment
 	return type == kDitherTypeQT && _bitsPerPixel == 24;
@@ -532,14 +566,9 @@ void QTRLEDecoder::setDither(DitherType type, const byte *palette) {
 }
 
 void QTRLEDecoder::createSurface() {
-	if (_surface) {
-		_surface->free();
-		delete _surface;
-	}
-
-	_surface = new Graphics::Surface();
-	_surface->create(_paddedWidth, _height, getPixelFormat());
-	_surface->w = _width;
+	_ownSurface = new Graphics::Surface();
+	_ownSurface->create(_paddedWidth, _height, getPixelFormat());
+	_ownSurface->w = _width;
 }
 
 } // End of namespace Image
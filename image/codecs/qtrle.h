@@ -40,6 +40,9 @@ public:
 
 	const Graphics::Surface *decodeFrame(Common::SeekableReadStream &stream);
 	Graphics::PixelFormat getPixelFormat() const;
+	bool setOutputPixelFormat(const Graphics::PixelFormat &format);
+	bool canOutputPixelFormat(const Graphics::PixelFormat &format) const;
+	bool setOutputSurface(Graphics::Surface *surface);
 
 	bool containsPalette() const { return _ditherPalette != 0; }
 	const byte *getPalette() { _dirtyPalette = false; return _ditherPalette; }
@@ -50,6 +53,9 @@ public:
 private:
 	byte _bitsPerPixel;
 	Graphics::Surface *_surface;
+	Graphics::Surface *_ownSurface;
+	uint32 _pitch; ///< The pitch of _surface, in pixels
+	Graphics::PixelFormat _trueColorFormat;
 	uint16 _width, _height;
 	uint32 _paddedWidth;
 	byte *_ditherPalette;
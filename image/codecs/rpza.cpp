@@ -41,12 +41,13 @@ RPZADecoder::RPZADecoder(uint16 width, uint16 height) : Codec() {
 	_blockWidth = (width + 3) / 4;
 	_blockHeight = (height + 3) / 4;
 	_surface = 0;
+	_ownSurface = 0;
 }
 
 RPZADecoder::~RPZADecoder() {
-	if (_surface) {
-		_surface->free();
-		delete _surface;
+	if (_ownSurface) {
+		_ownSurface->free();
+		delete _ownSurface;
 	}
 
 	delete[] _ditherPalette;
@@ -56,8 +57,8 @@ RPZADecoder::~RPZADecoder() {
 #define ADVANCE_BLOCK() \
 	blockPtr += 4; \
 	if (blockPtr >= endPtr) { \
-		blockPtr += pitch * 3; \
-		endPtr = blockPtr + pitch; \
+		blockPtr = endPtr + pitch * 4 - blockWidth * 4; \
+		endPtr += pitch * 4; \
 	} \
 	totalBlocks--; \
 	if (totalBlocks < 0) \
@@ -211,7 +212,7 @@ static inline void decodeFrameTmpl(Common::SeekableReadStream &stream, PixelInt
 	uint16 color4[4];
 
 	PixelInt *blockPtr = ptr;
-	PixelInt *endPtr = ptr + pitch;
+	PixelInt *endPtr = ptr + blockWidth * 4;
 	uint16 ta;
 	uint16 tb;
 
@@ -327,17 +328,30 @@ static inline void decodeFrameTmpl(Common::SeekableReadStream &stream, PixelInt
 	}
 }
 
-const Graphics::Surface *RPZADecoder::decodeFrame(Common::SeekableReadStream &stream) {
-	if (!_surface) {
-		_surface = new Graphics::Surface();
+void RPZADecoder::createSurface() {
+	_ownSurface = new Graphics::Surface();
 
-		// Allocate enough space in the surface for the blocks
-		_surface->create(_blockWidth * 4, _blockHeight * 4, getPixelFormat());
+	// Allocate enough space in the surface for the blocks
+	_ownSurface->create(_blockWidth * 4, _blockHeight * 4, getPixelFormat());
 
-		// Adjust width/height to be the right ones
-		_surface->w = _width;
-		_surface->h = _height;
-	}
+	// Adjust width/height to be the right ones
+	_ownSurface->w = _width;
+	_ownSurface->h = _height;
+}
+
+bool RPZADecoder::setOutputSurface(Graphics::Surface *surface) {
+	if (!_ownSurface)
+		createSurface();
+
+	return switchOutputSurface(_surface, _ownSurface, surface, _blockWidth * 4, _blockHeight * 4);
+}
+
+const Graphics::Surface *RPZADecoder::decodeFrame(Common::SeekableReadStream &stream) {
+	if (!_ownSurface)
+		createSurface();
+
+	if (!_surface)
+		_surface = _ownSurface;
 
 	if (_colorMap)
 		decodeFrameTmpl<byte, BlockDecoderDither>(stream, (byte *)_surface->getPixels(), _surface->pitch, _blockWidth, _blockHeight, _colorMap);
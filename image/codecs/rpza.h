@@ -40,6 +40,7 @@ public:
 
 	const Graphics::Surface *decodeFrame(Common::SeekableReadStream &stream);
 	Graphics::PixelFormat getPixelFormat() const { return _format; }
+	bool setOutputSurface(Graphics::Surface *surface);
 
 	bool containsPalette() const { return _ditherPalette != 0; }
 	const byte *getPalette() { _dirtyPalette = false; return _ditherPalette; }
@@ -50,11 +51,14 @@ public:
 private:
 	Graphics::PixelFormat _format;
 	Graphics::Surface *_surface;
+	Graphics::Surface *_ownSurface;
 	byte *_ditherPalette;
 	bool _dirtyPalette;
 	byte *_colorMap;
 	uint16 _width, _height;
 	uint16 _blockWidth, _blockHeight;
+
+	void createSurface();
 };
 
 } // End of namespace Image
@@ -34,9 +34,9 @@ namespace Image {
 #define ADVANCE_BLOCK() \
 { \
 	pixelPtr += 4; \
-	if (pixelPtr >= _surface->w) { \
+	if (pixelPtr >= width) { \
 		pixelPtr = 0; \
-		rowPtr += _surface->w * 4; \
+		rowPtr += pitch * 4; \
 	} \
 	totalBlocks--; \
 	if (totalBlocks < 0) { \
@@ -46,24 +46,37 @@ namespace Image {
 }
 
 SMCDecoder::SMCDecoder(uint16 width, uint16 height) {
-	_surface = new Graphics::Surface();
-	_surface->create(width, height, Graphics::PixelFormat::createFormatCLUT8());
+	_ownSurface = new Graphics::Surface();
+
+	// Blocks on the right and bottom edges are written whole, so allocate
+	// enough space for them and then adjust width/height to the right ones
+	_ownSurface->create((width + 3) & ~3, (height + 3) & ~3, Graphics::PixelFormat::createFormatCLUT8());
+	_ownSurface->w = width;
+	_ownSurface->h = height;
+	_surface = _ownSurface;
 }
 
 SMCDecoder::~SMCDecoder() {
-	_surface->free();
-	delete _surface;
+	_ownSurface->free();
+	delete _ownSurface;
+}
+
+bool SMCDecoder::setOutputSurface(Graphics::Surface *surface) {
+	return switchOutputSurface(_surface, _ownSurface, surface, (_ownSurface->w + 3) & ~3, (_ownSurface->h + 3) & ~3);
 }
 
 const Graphics::Surface *SMCDecoder::decodeFrame(Common::SeekableReadStream &stream) {
 	byte *pixels = (byte *)_surface->getPixels();
+	const int32 width = _ownSurface->w;
+	const int32 height = _ownSurface->h;
+	const int32 pitch = _surface->pitch;
 
 	uint32 numBlocks = 0;
 	uint32 colorFlags = 0;
 	uint32 colorFlagsA = 0;
 	uint32 colorFlagsB = 0;
 
-	const uint16 rowInc = _surface->w - 4;
+	const uint16 rowInc = pitch - 4;
 	int32 rowPtr = 0;
 	int32 pixelPtr = 0;
 	uint32 blockPtr = 0;
@@ -81,7 +94,7 @@ const Graphics::Surface *SMCDecoder::decodeFrame(Common::SeekableReadStream &str
 	if (chunkSize != stream.size())
 		warning("MOV chunk size != SMC chunk size (%d != %d); ignoring SMC chunk size", chunkSize, stream.size());
 
-	int32 totalBlocks = ((_surface->w + 3) / 4) * ((_surface->h + 3) / 4);
+	int32 totalBlocks = ((width + 3) / 4) * ((height + 3) / 4);
 
 	// traverse through the blocks
 	while (totalBlocks != 0) {
@@ -94,8 +107,8 @@ const Graphics::Surface *SMCDecoder::decodeFrame(Common::SeekableReadStream &str
 		}
 
 		// make sure the row pointer hasn't gone wild
-		if (rowPtr >= _surface->w * _surface->h) {
-			warning("SMC decoder just went out of bounds (row ptr = %d, size = %d)", rowPtr, _surface->w * _surface->h);
+		if (rowPtr >= pitch * height) {
+			warning("SMC decoder just went out of bounds (row ptr = %d, size = %d)", rowPtr, pitch * height);
 			return _surface;
 		}
 
@@ -124,7 +137,7 @@ const Graphics::Surface *SMCDecoder::decodeFrame(Common::SeekableReadStream &str
 
 			// figure out where the previous block started
 			if (pixelPtr == 0)
-				prevBlockPtr1 = (rowPtr - _surface->w * 4) + _surface->w - 4;
+				prevBlockPtr1 = (rowPtr - pitch * 4) + width - 4;
 			else
 				prevBlockPtr1 = rowPtr + pixelPtr - 4;
 
@@ -155,14 +168,14 @@ const Graphics::Surface *SMCDecoder::decodeFrame(Common::SeekableReadStream &str
 
 			// figure out where the previous 2 blocks started
 			if (pixelPtr == 0)
-				prevBlockPtr1 = (rowPtr - _surface->w * 4) + _surface->w - 4 * 2;
+				prevBlockPtr1 = (rowPtr - pitch * 4) + width - 4 * 2;
 			else if (pixelPtr == 4)
-				prevBlockPtr1 = (rowPtr - _surface->w * 4) + rowInc;
+				prevBlockPtr1 = (rowPtr - pitch * 4) + width - 4;
 			else
 				prevBlockPtr1 = rowPtr + pixelPtr - 4 * 2;
 
 			if (pixelPtr == 0)
-				prevBlockPtr2 = (rowPtr - _surface->w * 4) + rowInc;
+				prevBlockPtr2 = (rowPtr - pitch * 4) + width - 4;
 			else
 				prevBlockPtr2 = rowPtr + pixelPtr - 4;
 
@@ -46,9 +46,11 @@ public:
 
 	const Graphics::Surface *decodeFrame(Common::SeekableReadStream &stream);
 	Graphics::PixelFormat getPixelFormat() const { return Graphics::PixelFormat::createFormatCLUT8(); }
+	bool setOutputSurface(Graphics::Surface *surface);
 
 private:
 	Graphics::Surface *_surface;
+	Graphics::Surface *_ownSurface;
 
 	// SMC color tables
 	byte _colorPairs[COLORS_PER_TABLE * CPAIR];
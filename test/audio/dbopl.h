@@ -0,0 +1,133 @@
+#include <cxxtest/TestSuite.h>
+
+#include "audio/softsynth/opl/dbopl.h"
+#include "common/array.h"
+
+class DBOPLTestSuite : public CxxTest::TestSuite
+{
+#ifndef DISABLE_DOSBOX_OPL
+private:
+	/** One logged register write, done after rendering delay samples. */
+	struct RegisterWrite {
+		uint32 delay;
+		uint16 reg;
+		uint8 val;
+	};
+
+	typedef Common::Array<RegisterWrite> RegisterLog;
+
+	static void addWrite(RegisterLog &log, uint32 delay, uint16 reg, uint8 val) {
+		RegisterWrite write = { delay, reg, val };
+		log.push_back(write);
+	}
+
+	/**
+	 * Log of random writes to every operator and channel register, with
+	 * some percussion and LFO depth changes in between. The random notes
+	 * cover all envelope states, waveforms, feedback and in OPL3 mode all
+	 * four operator connections and panning.
+	 */
+	static RegisterLog createRandomLog(uint32 seed, bool opl3, int writes) {
+		static const uint8 operatorRegs[5] = { 0x20, 0x40, 0x60, 0x80, 0xE0 };
+		static const uint8 channelRegs[3] = { 0xA0, 0xB0, 0xC0 };
+
+		RegisterLog log;
+		// Waveform select for OPL2, the OPL3 register set otherwise
+		addWrite(log, 0, 0x01, 0x20);
+		if (opl3)
+			addWrite(log, 0, 0x105, 0x01);
+
+		for (int i = 0; i < writes; ++i) {
+			seed = seed * 1103515245 + 12345;
+			const uint32 r = seed >> 8;
+			seed = seed * 1103515245 + 12345;
+			const uint16 bank = (opl3 && (r & 0x100)) ? 0x100 : 0;
+			const uint32 delay = (r & 0x7) ? 0 : (seed >> 24) * 3;
+
+			uint16 reg;
+			uint8 val = (uint8)(seed >> 16);
+			switch ((r >> 9) & 0xF) {
+			case 0:
+				reg = opl3 ? 0x104 : 0xBD;
+				val &= opl3 ? 0x3F : 0xFF;
+				break;
+			case 1:
+				reg = 0xBD;
+				break;
+			case 2:
+			case 3:
+			case 4:
+				reg = bank + channelRegs[(r >> 13) % 3] + (r >> 15) % 9;
+				break;
+			default:
+				// Keep the volumes up, so most operators are audible
+				reg = bank + operatorRegs[(r >> 13) % 5] + (r >> 16) % 22;
+				if ((reg & 0xE0) == 0x40)
+					val &= 0x9F;
+				break;
+			}
+			addWrite(log, delay, reg, val);
+		}
+		addWrite(log, 2000, 0xBD, 0);
+		return log;
+	}
+
+	static Common::Array<int32> render(const RegisterLog &log, int rate, bool reference) {
+		OPL::DOSBox::DBOPL::InitTables();
+		OPL::DOSBox::DBOPL::Chip chip;
+		chip.Setup(rate);
+		chip.referenceSynth = reference;
+
+		Common::Array<int32> output;
+		int32 buffer[512 * 2];
+		for (uint i = 0; i < log.size(); ++i) {
+			uint32 delay = log[i].delay;
+			while (delay > 0) {
+				const uint32 samples = MIN<uint32>(delay, 512);
+				const uint32 channels = chip.opl3Active ? 2 : 1;
+				if (chip.opl3Active)
+					chip.GenerateBlock3(samples, buffer);
+				else
+					chip.GenerateBlock2(samples, buffer);
+				for (uint32 j = 0; j < samples * channels; ++j)
+					output.push_back(buffer[j]);
+				delay -= samples;
+			}
+			chip.WriteReg(log[i].reg, log[i].val);
+		}
+		return output;
+	}
+
+	static void checkBitExact(const RegisterLog &log, int rate) {
+		const Common::Array<int32> expected = render(log, rate, true);
+		const Common::Array<int32> actual = render(log, rate, false);
+
+		TS_ASSERT_EQUALS(actual.size(), expected.size());
+		uint audible = 0, mismatch = 0;
+		for (uint i = 0; i < expected.size() && i < actual.size(); ++i) {
+			if (expected[i] != 0)
+				++audible;
+			if (actual[i] != expected[i] && !mismatch++)
+				TS_ASSERT_EQUALS(actual[i], expected[i]);
+		}
+		TS_ASSERT_EQUALS(mismatch, 0u);
+		// The comparison is meaningless if the log left the chip silent
+		TS_ASSERT_LESS_THAN(expected.size() / 4, audible);
+	}
+#endif
+
+public:
+	void test_block_synth_opl2() {
+#ifndef DISABLE_DOSBOX_OPL
+		checkBitExact(createRandomLog(1, false, 3000), 44100);
+		checkBitExact(createRandomLog(2, false, 3000), 22050);
+#endif
+	}
+
+	void test_block_synth_opl3() {
+#ifndef DISABLE_DOSBOX_OPL
+		checkBitExact(createRandomLog(3, true, 6000), 44100);
+		checkBitExact(createRandomLog(4, true, 6000), 49716);
+#endif
+	}
+};
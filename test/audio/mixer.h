@@ -0,0 +1,194 @@
+#include <cxxtest/TestSuite.h>
+
+#include "audio/audiostream.h"
+#include "audio/mixer_intern.h"
+#include "common/system.h"
+#include "graphics/pixelformat.h"
+
+/**
+ * Just enough of a backend for the mixer: recursive mutexes, a clock which
+ * stands still, and no threads. mixCallback() is called by the test itself,
+ * so it runs on the same thread as the engine side, like it does on the
+ * audio thread when a stream calls the mixer.
+ */
+class MixerTestSystem : public OSystem {
+public:
+	MixerTestSystem() : _delays(0) {}
+
+	uint _delays;
+
+	virtual const GraphicsMode *getSupportedGraphicsModes() const { return 0; }
+	virtual int getDefaultGraphicsMode() const { return 0; }
+	virtual bool setGraphicsMode(int mode) { return false; }
+	virtual int getGraphicsMode() const { return 0; }
+	virtual Graphics::PixelFormat getScreenFormat() const { return Graphics::PixelFormat::createFormatCLUT8(); }
+	virtual Common::List<Graphics::PixelFormat> getSupportedFormats() const { return Common::List<Graphics::PixelFormat>(); }
+	virtual void initSize(uint width, uint height, const Graphics::PixelFormat *format = NULL) {}
+	virtual int16 getHeight() { return 0; }
+	virtual int16 getWidth() { return 0; }
+	virtual PaletteManager *getPaletteManager() { return 0; }
+	virtual void copyRectToScreen(const void *buf, int pitch, int x, int y, int w, int h) {}
+	virtual Graphics::Surface *lockScreen() { return 0; }
+	virtual void unlockScreen() {}
+	virtual void fillScreen(uint32 col) {}
+	virtual void updateScreen() {}
+	virtual void setShakePos(int shakeOffset) {}
+	virtual void showOverlay() {}
+	virtual void hideOverlay() {}
+	virtual Graphics::PixelFormat getOverlayFormat() const { return Graphics::PixelFormat::createFormatCLUT8(); }
+	virtual void clearOverlay() {}
+	virtual void grabOverlay(void *buf, int pitch) {}
+	virtual void copyRectToOverlay(const void *buf, int pitch, int x, int y, int w, int h) {}
+	virtual int16 getOverlayHeight() { return 0; }
+	virtual int16 getOverlayWidth() { return 0; }
+	virtual bool showMouse(bool visible) { return false; }
+	virtual void warpMouse(int x, int y) {}
+	virtual void setMouseCursor(const void *buf, uint w, uint h, int hotspotX, int hotspotY, uint32 keycolor, bool dontScale = false, const Graphics::PixelFormat *format = NULL) {}
+	virtual uint32 getMillis(bool skipRecord = false) { return 1; }
+	virtual void delayMillis(uint msecs) { _delays++; }
+	virtual void getTimeAndDate(TimeDate &t) const {}
+
+	virtual MutexRef createMutex() { return (MutexRef)new int(0); }
+	virtual void lockMutex(MutexRef mutex) { ++*(int *)mutex; }
+	virtual void unlockMutex(MutexRef mutex) { TS_ASSERT_LESS_THAN(0, (*(int *)mutex)--); }
+	virtual void deleteMutex(MutexRef mutex) {
+		TS_ASSERT_EQUALS(*(int *)mutex, 0);
+		delete (int *)mutex;
+	}
+
+	virtual Audio::Mixer *getMixer() { return 0; }
+	virtual void quit() {}
+	virtual void displayMessageOnOSD(const char *msg) {}
+	virtual void displayActivityIconOnOSD(const Graphics::Surface *icon) {}
+	virtual void logMessage(LogMessageType::Type type, const char *message) {}
+};
+
+class MixerTestSuite : public CxxTest::TestSuite
+{
+private:
+	enum {
+		kRate = 22050,
+		kBufferBytes = 256
+	};
+
+	/** Silence, which stops a sound the first time it is read. */
+	class StoppingStream : public Audio::AudioStream {
+	public:
+		StoppingStream(Audio::Mixer &mixer, bool &deleted) : _mixer(mixer), _deleted(deleted), _reads(0) {
+			_deleted = false;
+		}
+
+		~StoppingStream() {
+			_deleted = true;
+		}
+
+		Audio::SoundHandle _stop;
+		int _reads;
+
+		virtual int readBuffer(int16 *buffer, const int numSamples) {
+			if (!_reads++)
+				_mixer.stopHandle(_stop);
+
+			// Stopping a sound, even this one, must not delete it while
+			// it is being mixed
+			TS_ASSERT(!_deleted);
+
+			memset(buffer, 0, numSamples * sizeof(int16));
+			return numSamples;
+		}
+
+		virtual bool isStereo() const { return false; }
+		virtual int getRate() const { return kRate; }
+		virtual bool endOfData() const { return false; }
+
+	private:
+		Audio::Mixer &_mixer;
+		bool &_deleted;
+	};
+
+	/** Silence, forever. */
+	class SilentStream : public Audio::AudioStream {
+	public:
+		SilentStream(bool &deleted) : _deleted(deleted) { _deleted = false; }
+		~SilentStream() { _deleted = true; }
+
+		virtual int readBuffer(int16 *buffer, const int numSamples) {
+			memset(buffer, 0, numSamples * sizeof(int16));
+			return numSamples;
+		}
+
+		virtual bool isStereo() const { return false; }
+		virtual int getRate() const { return kRate; }
+		virtual bool endOfData() const { return false; }
+
+	private:
+		bool &_deleted;
+	};
+
+	OSystem *_oldSystem;
+	MixerTestSystem *_system;
+
+public:
+	void setUp() {
+		_oldSystem = g_system;
+		_system = new MixerTestSystem();
+		g_system = _system;
+	}
+
+	void tearDown() {
+		g_system = _oldSystem;
+		delete _system;
+	}
+
+	void test_stop_own_handle_from_stream() {
+		Audio::MixerImpl *mixer = new Audio::MixerImpl(_system, kRate);
+		mixer->setReady(true);
+
+		bool deleted;
+		StoppingStream *stream = new StoppingStream(*mixer, deleted);
+		Audio::SoundHandle handle;
+		mixer->playStream(Audio::Mixer::kPlainSoundType, &handle, stream, -1, Audio::Mixer::kMaxChannelVolume, 0, DisposeAfterUse::YES, false, false);
+		stream->_stop = handle;
+
+		byte samples[kBufferBytes];
+		mixer->mixCallback(samples, kBufferBytes);
+
+		// The mix is over, so the next call on the engine side deletes it
+		TS_ASSERT(!deleted);
+		TS_ASSERT(!mixer->isSoundHandleActive(handle));
+		TS_ASSERT(deleted);
+		TS_ASSERT_EQUALS(_system->_delays, 0u);
+
+		delete mixer;
+	}
+
+	void test_stop_other_handle_from_stream() {
+		Audio::MixerImpl *mixer = new Audio::MixerImpl(_system, kRate);
+		mixer->setReady(true);
+
+		bool silentDeleted, stoppingDeleted;
+		Audio::SoundHandle silentHandle, stoppingHandle;
+		mixer->playStream(Audio::Mixer::kPlainSoundType, &silentHandle, new SilentStream(silentDeleted), -1, Audio::Mixer::kMaxChannelVolume, 0, DisposeAfterUse::YES, false, false);
+		StoppingStream *stream = new StoppingStream(*mixer, stoppingDeleted);
+		mixer->playStream(Audio::Mixer::kPlainSoundType, &stoppingHandle, stream, -1, Audio::Mixer::kMaxChannelVolume, 0, DisposeAfterUse::YES, false, false);
+		stream->_stop = silentHandle;
+
+		byte samples[kBufferBytes];
+		mixer->mixCallback(samples, kBufferBytes);
+		TS_ASSERT(!mixer->isSoundHandleActive(silentHandle));
+		TS_ASSERT(silentDeleted);
+
+		// The stream which stopped the other one keeps playing
+		mixer->mixCallback(samples, kBufferBytes);
+		TS_ASSERT(mixer->isSoundHandleActive(stoppingHandle));
+		TS_ASSERT_EQUALS(stream->_reads, 2);
+		TS_ASSERT(!stoppingDeleted);
+
+		// Stopping it from the engine side deletes it right away
+		mixer->stopHandle(stoppingHandle);
+		TS_ASSERT(stoppingDeleted);
+		TS_ASSERT_EQUALS(_system->_delays, 0u);
+
+		delete mixer;
+	}
+};
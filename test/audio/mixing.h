@@ -0,0 +1,121 @@
+#include <cxxtest/TestSuite.h>
+
+#include "audio/mixer.h"
+#include "audio/rate.h"
+
+#include "helper.h"
+
+class MixingTestSuite : public CxxTest::TestSuite
+{
+private:
+	static int16 *createRamp(int pairs) {
+		int16 *samples = new int16[pairs * 2];
+		for (int i = 0; i < pairs * 2; ++i)
+			samples[i] = (int16)((i * 2731) % 65536 - 32768);
+		return samples;
+	}
+
+public:
+	void test_mix_to_accumulator_matches_scalar_scaling() {
+		// An odd pair count covers both the vector loop and its tail
+		const int pairs = 37;
+		int16 *in = createRamp(pairs);
+		int32 acc[pairs * 2];
+
+		for (int i = 0; i < pairs * 2; ++i)
+			acc[i] = i - pairs;
+
+		Audio::mixToAccumulator(acc, in, pairs, 255, 7);
+
+		for (int i = 0; i < pairs; ++i) {
+			TS_ASSERT_EQUALS(acc[2 * i    ], 2 * i     - pairs + (in[2 * i    ] * 255) / Audio::Mixer::kMaxMixerVolume);
+			TS_ASSERT_EQUALS(acc[2 * i + 1], 2 * i + 1 - pairs + (in[2 * i + 1] *   7) / Audio::Mixer::kMaxMixerVolume);
+		}
+
+		delete[] in;
+	}
+
+	void test_saturate_accumulator() {
+		const int32 acc[10] = { 0, 1, -1, 32767, 32768, -32768, -32769, 100000, -100000, 1234 };
+		int16 out[10];
+
+		Audio::saturateAccumulator(out, acc, 5);
+
+		const int16 expected[10] = { 0, 1, -1, 32767, 32767, -32768, -32768, 32767, -32768, 1234 };
+		for (int i = 0; i < 10; ++i) {
+#ifdef OUTPUT_UNSIGNED_AUDIO
+			TS_ASSERT_EQUALS(out[i], (int16)(expected[i] ^ 0x8000));
+#else
+			TS_ASSERT_EQUALS(out[i], expected[i]);
+#endif
+		}
+	}
+
+	void test_copy_convert_mono() {
+		int16 *sine;
+		Audio::SeekableAudioStream *s = createSineStream<int16>(11025, 1, &sine, false, false);
+		Audio::RateConverter *converter = Audio::makeRateConverter(11025, 11025, false);
+
+		int16 out[256 * 2];
+		TS_ASSERT_EQUALS(converter->convert(*s, out, 256), 256);
+		for (int i = 0; i < 256; ++i) {
+			TS_ASSERT_EQUALS(out[2 * i    ], sine[i]);
+			TS_ASSERT_EQUALS(out[2 * i + 1], sine[i]);
+		}
+
+		delete converter;
+		delete[] sine;
+		delete s;
+	}
+
+	void test_copy_convert_reverse_stereo() {
+		int16 *sine;
+		Audio::SeekableAudioStream *s = createSineStream<int16>(11025, 1, &sine, false, true);
+		Audio::RateConverter *converter = Audio::makeRateConverter(11025, 11025, true, true);
+
+		int16 out[256 * 2];
+		TS_ASSERT_EQUALS(converter->convert(*s, out, 256), 256);
+		for (int i = 0; i < 256; ++i) {
+			TS_ASSERT_EQUALS(out[2 * i    ], sine[2 * i + 1]);
+			TS_ASSERT_EQUALS(out[2 * i + 1], sine[2 * i    ]);
+		}
+
+		delete converter;
+		delete[] sine;
+		delete s;
+	}
+
+	void test_flow_adds_with_clamping() {
+		int16 *sine;
+		Audio::SeekableAudioStream *s = createSineStream<int16>(22050, 1, &sine, false, false);
+		Audio::RateConverter *converter = Audio::makeRateConverter(22050, 22050, false);
+
+		// Start close to the limits, so that the addition has to clamp
+		int16 out[1000 * 2];
+		for (int i = 0; i < 1000 * 2; ++i)
+			out[i] = (i & 1) ? -32000 : 32000;
+
+		TS_ASSERT_EQUALS(converter->flow(*s, out, 1000, 256, 128), 1000);
+		for (int i = 0; i < 1000; ++i) {
+			TS_ASSERT_EQUALS(out[2 * i    ], (int16)CLIP<int>(32000 + sine[i], -32768, 32767));
+			TS_ASSERT_EQUALS(out[2 * i + 1], (int16)CLIP<int>(-32000 + (sine[i] * 128) / 256, -32768, 32767));
+		}
+
+		delete converter;
+		delete[] sine;
+		delete s;
+	}
+
+	void test_flow_stops_at_end_of_stream() {
+		Audio::SeekableAudioStream *s = createSineStream<int16>(8000, 1, 0, false, false);
+		Audio::RateConverter *converter = Audio::makeRateConverter(8000, 8000, false);
+
+		int16 *out = new int16[9000 * 2];
+		memset(out, 0, sizeof(int16) * 9000 * 2);
+		TS_ASSERT_EQUALS(converter->flow(*s, out, 9000, 256, 256), 8000);
+
+		delete[] out;
+		delete converter;
+		delete s;
+	}
+};
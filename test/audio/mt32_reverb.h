@@ -0,0 +1,119 @@
+#include <cxxtest/TestSuite.h>
+
+#include "common/scummsys.h"
+
+#ifdef USE_MT32EMU
+#include "audio/softsynth/mt32/BReverbModel.h"
+#endif
+
+class MT32ReverbTestSuite : public CxxTest::TestSuite
+{
+#ifdef USE_MT32EMU
+private:
+	enum {
+		kLength = 24000,
+		kMaxRun = 700
+	};
+
+	/**
+	 * Dry input with loud bursts, quiet noise and silence, so the combs
+	 * both saturate the output stage and decay into the reverb noise.
+	 */
+	static void createInput(MT32Emu::Sample *left, MT32Emu::Sample *right, uint32 seed) {
+		for (int i = 0; i < kLength; ++i) {
+			seed = seed * 1103515245 + 12345;
+			const int16 noise = (int16)(seed >> 16);
+			switch ((i / 3000) % 4) {
+			case 0:
+				left[i] = noise;
+				right[i] = (int16)(seed >> 8);
+				break;
+			case 1:
+				left[i] = (i & 64) ? 32767 : -32768;
+				right[i] = left[i];
+				break;
+			case 2:
+				left[i] = noise >> 6;
+				right[i] = -(noise >> 7);
+				break;
+			default:
+				left[i] = right[i] = 0;
+				break;
+			}
+		}
+	}
+
+	/**
+	 * Renders the input in runs of varying length, changing the reverb
+	 * time and level every few runs.
+	 */
+	static void render(MT32Emu::ReverbMode mode, bool mt32, bool reference, const MT32Emu::Sample *inLeft, const MT32Emu::Sample *inRight, MT32Emu::Sample *outLeft, MT32Emu::Sample *outRight) {
+		MT32Emu::BReverbModel model(mode, mt32);
+		model.open();
+
+		uint32 seed = 42;
+		int run = 0;
+		for (int pos = 0; pos < kLength; ++run) {
+			seed = seed * 1103515245 + 12345;
+			if ((run % 8) == 0)
+				model.setParameters((seed >> 16) & 7, ((seed >> 20) & 7) | 1);
+			const int length = MIN<int>(kLength - pos, 1 + (seed >> 8) % kMaxRun);
+			// Leave out the left channel once in a while, like the synth does for unused streams
+			MT32Emu::Sample *left = (run % 5) == 4 ? NULL : outLeft + pos;
+			if (reference)
+				model.processReference(inLeft + pos, inRight + pos, left, outRight + pos, length);
+			else
+				model.process(inLeft + pos, inRight + pos, left, outRight + pos, length);
+			pos += length;
+		}
+	}
+
+	static void checkBitExact(MT32Emu::ReverbMode mode, bool mt32) {
+		MT32Emu::Sample *inLeft = new MT32Emu::Sample[kLength];
+		MT32Emu::Sample *inRight = new MT32Emu::Sample[kLength];
+		MT32Emu::Sample *expected = new MT32Emu::Sample[kLength * 2];
+		MT32Emu::Sample *actual = new MT32Emu::Sample[kLength * 2];
+		memset(expected, 0, kLength * 2 * sizeof(MT32Emu::Sample));
+		memset(actual, 0, kLength * 2 * sizeof(MT32Emu::Sample));
+
+		createInput(inLeft, inRight, mode * 2 + (mt32 ? 1 : 0));
+		render(mode, mt32, true, inLeft, inRight, expected, expected + kLength);
+		render(mode, mt32, false, inLeft, inRight, actual, actual + kLength);
+
+		int audible = 0, mismatch = 0;
+		for (int i = 0; i < kLength * 2; ++i) {
+			if (expected[i] != 0)
+				++audible;
+			if (actual[i] != expected[i] && !mismatch++)
+				TS_ASSERT_EQUALS(actual[i], expected[i]);
+		}
+		TS_ASSERT_EQUALS(mismatch, 0);
+		// The comparison is meaningless if the reverb stayed silent
+		TS_ASSERT_LESS_THAN(kLength / 2, audible);
+
+		delete[] inLeft;
+		delete[] inRight;
+		delete[] expected;
+		delete[] actual;
+	}
+#endif
+
+public:
+	void test_block_reverb_cm32l() {
+#ifdef USE_MT32EMU
+		checkBitExact(MT32Emu::REVERB_MODE_ROOM, false);
+		checkBitExact(MT32Emu::REVERB_MODE_HALL, false);
+		checkBitExact(MT32Emu::REVERB_MODE_PLATE, false);
+		checkBitExact(MT32Emu::REVERB_MODE_TAP_DELAY, false);
+#endif
+	}
+
+	void test_block_reverb_mt32() {
+#ifdef USE_MT32EMU
+		checkBitExact(MT32Emu::REVERB_MODE_ROOM, true);
+		checkBitExact(MT32Emu::REVERB_MODE_HALL, true);
+		checkBitExact(MT32Emu::REVERB_MODE_PLATE, true);
+		checkBitExact(MT32Emu::REVERB_MODE_TAP_DELAY, true);
+#endif
+	}
+};
@@ -0,0 +1,193 @@
+#include <cxxtest/TestSuite.h>
+
+#include "audio/audiostream.h"
+#include "audio/rate.h"
+#include "common/util.h"
+
+#include "helper.h"
+
+#include <math.h>
+
+/** Endless sine tone, optionally on the left channel only. */
+class ToneStream : public Audio::AudioStream {
+public:
+	ToneStream(int rate, double frequency, bool stereo) : _rate(rate), _frequency(frequency), _stereo(stereo), _pos(0) {}
+
+	int readBuffer(int16 *buffer, const int numSamples) {
+		for (int i = 0; i < numSamples; i += (_stereo ? 2 : 1)) {
+			buffer[i] = (int16)floor(16000.0 * sin(2.0 * M_PI * _frequency * _pos / _rate) + 0.5);
+			if (_stereo)
+				buffer[i + 1] = 0;
+			_pos++;
+		}
+		return numSamples;
+	}
+
+	bool isStereo() const { return _stereo; }
+	int getRate() const { return _rate; }
+	bool endOfData() const { return false; }
+
+private:
+	int _rate;
+	double _frequency;
+	bool _stereo;
+	int _pos;
+};
+
+class ResamplerTestSuite : public CxxTest::TestSuite
+{
+private:
+	enum {
+		kOutputPairs = 8192,
+		// Skip the start, where the filter history is still empty
+		kSettle = 256
+	};
+
+	static int16 *resample(int inRate, int outRate, double frequency, Audio::RateConverterQuality quality) {
+		ToneStream stream(inRate, frequency, false);
+		Audio::RateConverter *converter = Audio::makeRateConverter(inRate, outRate, false, false, quality);
+
+		int16 *out = new int16[kOutputPairs * 2];
+		TS_ASSERT_EQUALS(converter->convert(stream, out, kOutputPairs), kOutputPairs);
+
+		delete converter;
+		return out;
+	}
+
+	/** Signal to noise ratio in dB, against the ideal tone at the output rate. */
+	static double snr(const int16 *out, int outRate, double frequency) {
+		double signal = 0.0, noise = 0.0;
+		for (int i = kSettle; i < kOutputPairs; i++) {
+			const double ideal = 16000.0 * sin(2.0 * M_PI * frequency * i / outRate);
+			signal += ideal * ideal;
+			noise += (out[2 * i] - ideal) * (out[2 * i] - ideal);
+		}
+		return 10.0 * log10(signal / noise);
+	}
+
+	/** Power at the given frequency, using a Hann windowed Goertzel filter. */
+	static double power(const int16 *out, int outRate, double frequency) {
+		const int count = kOutputPairs - kSettle;
+		const double coeff = 2.0 * cos(2.0 * M_PI * frequency / outRate);
+		double s1 = 0.0, s2 = 0.0;
+
+		for (int i = 0; i < count; i++) {
+			const double window = 0.5 - 0.5 * cos(2.0 * M_PI * i / (count - 1));
+			const double s0 = out[2 * (i + kSettle)] * window + coeff * s1 - s2;
+			s2 = s1;
+			s1 = s0;
+		}
+		return s1 * s1 + s2 * s2 - coeff * s1 * s2;
+	}
+
+	static double levelDb(const int16 *out, int outRate, double frequency, double reference) {
+		return 10.0 * log10(power(out, outRate, frequency) / power(out, outRate, reference));
+	}
+
+public:
+	void test_snr_upsample() {
+		int16 *medium = resample(22050, 44100, 1000.0, Audio::kRateQualityMedium);
+		int16 *high = resample(22050, 44100, 1000.0, Audio::kRateQualityHigh);
+
+		TS_ASSERT_LESS_THAN(55.0, snr(medium, 44100, 1000.0));
+		TS_ASSERT_LESS_THAN(80.0, snr(high, 44100, 1000.0));
+
+		delete[] medium;
+		delete[] high;
+	}
+
+	void test_snr_fractional_ratio() {
+		// 11025 to 48000 Hz needs 640 phases
+		int16 *high = resample(11025, 48000, 440.0, Audio::kRateQualityHigh);
+		TS_ASSERT_LESS_THAN(70.0, snr(high, 48000, 440.0));
+		delete[] high;
+
+		// 11127 to 48000 Hz would need 48000, and is rounded to fewer phases
+		high = resample(11127, 48000, 440.0, Audio::kRateQualityHigh);
+		TS_ASSERT_LESS_THAN(60.0, snr(high, 48000, 440.0));
+		delete[] high;
+	}
+
+	void test_image_rejection() {
+		// Upsampling a 4kHz tone from 11025Hz leaves an image at 7025Hz
+		int16 *low = resample(11025, 44100, 4000.0, Audio::kRateQualityLow);
+		int16 *medium = resample(11025, 44100, 4000.0, Audio::kRateQualityMedium);
+		int16 *high = resample(11025, 44100, 4000.0, Audio::kRateQualityHigh);
+
+		TS_ASSERT_LESS_THAN(-40.0, levelDb(low, 44100, 7025.0, 4000.0));
+		TS_ASSERT_LESS_THAN(levelDb(medium, 44100, 7025.0, 4000.0), -60.0);
+		TS_ASSERT_LESS_THAN(levelDb(high, 44100, 7025.0, 4000.0), -80.0);
+
+		delete[] low;
+		delete[] medium;
+		delete[] high;
+	}
+
+	void test_alias_rejection() {
+		// Downsampling a 15kHz tone to 22050Hz would alias it to 7050Hz
+		int16 *high = resample(44100, 22050, 15000.0, Audio::kRateQualityHigh);
+
+		double energy = 0.0;
+		for (int i = kSettle; i < kOutputPairs; i++)
+			energy += high[2 * i] * (double)high[2 * i];
+		const double rms = sqrt(energy / (kOutputPairs - kSettle));
+
+		// Relative to the 16000 amplitude (11314 rms) of the input
+		TS_ASSERT_LESS_THAN(20.0 * log10(rms / 11314.0), -80.0);
+
+		delete[] high;
+	}
+
+	void test_stereo_reverse() {
+		ToneStream stream(22050, 1000.0, true);
+		Audio::RateConverter *converter = Audio::makeRateConverter(22050, 44100, true, true, Audio::kRateQualityHigh);
+
+		int16 out[1024 * 2];
+		TS_ASSERT_EQUALS(converter->convert(stream, out, 1024), 1024);
+
+		// The tone is on the left input channel, so it has to end up right
+		bool silentLeft = true, toneRight = false;
+		for (int i = 0; i < 1024; i++) {
+			silentLeft = silentLeft && out[2 * i] == 0;
+			toneRight = toneRight || ABS(out[2 * i + 1]) > 10000;
+		}
+		TS_ASSERT(silentLeft);
+		TS_ASSERT(toneRight);
+
+		delete converter;
+	}
+
+	void test_flushes_end_of_stream() {
+		// One second at 22050Hz has to give exactly one second at 44100Hz
+		Audio::SeekableAudioStream *s = createSineStream<int16>(22050, 1, 0, false, false);
+		Audio::RateConverter *converter = Audio::makeRateConverter(22050, 44100, false, false, Audio::kRateQualityMedium);
+
+		int16 *out = new int16[50000 * 2];
+		TS_ASSERT_EQUALS(converter->convert(*s, out, 50000), 44100);
+		TS_ASSERT_EQUALS(converter->convert(*s, out, 50000), 0);
+
+		delete[] out;
+		delete converter;
+		delete s;
+	}
+
+	void test_shared_filter() {
+		// Converters for the same ratio share their coefficients, which have
+		// to stay valid until the last of them is gone
+		ToneStream stream1(11025, 1000.0, false), stream2(11025, 1000.0, false);
+		Audio::RateConverter *first = Audio::makeRateConverter(11025, 48000, false, false, Audio::kRateQualityHigh);
+		Audio::RateConverter *second = Audio::makeRateConverter(11025, 48000, false, false, Audio::kRateQualityHigh);
+
+		int16 *out1 = new int16[kOutputPairs * 2];
+		int16 *out2 = new int16[kOutputPairs * 2];
+		TS_ASSERT_EQUALS(first->convert(stream1, out1, kOutputPairs), kOutputPairs);
+		delete first;
+		TS_ASSERT_EQUALS(second->convert(stream2, out2, kOutputPairs), kOutputPairs);
+		delete second;
+
+		TS_ASSERT_EQUALS(memcmp(out1, out2, sizeof(int16) * kOutputPairs * 2), 0);
+
+		delete[] out1;
+		delete[] out2;
+	}
+};
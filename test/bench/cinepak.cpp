@@ -0,0 +1,87 @@
+/* ScummVM - Graphic Adventure Engine
+ *
+ * ScummVM is the legal property of its developers, whose names
+ * are too numerous to list here. Please refer to the COPYRIGHT
+ * file distributed with this source distribution.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ */
+
+
+/*
+ * Cinepak benchmark: decodes generated 320x240 streams, made of key frames
+ * and frames which only update parts of the codebooks and the picture,
+ * and reports the CPU time per frame. Run with "make bench".
+ */
+
+#define FORBIDDEN_SYMBOL_ALLOW_ALL
+
+#include "common/array.h"
+#include "common/memstream.h"
+#include "graphics/surface.h"
+#include "image/codecs/cinepak.h"
+
+#include "test/image/cinepak_stream.h"
+
+#include <stdio.h>
+#include <time.h>
+
+namespace {
+
+const int kWidth = 320;
+const int kHeight = 240;
+const int kStrips = 4;
+const int kFrames = 30;
+const int kKeyFrameInterval = 15;
+const int kLoops = 40;
+
+/** Returns the CPU time per frame, in milliseconds. */
+double run(const Graphics::PixelFormat &format, const Common::Array<byte> *frames) {
+	Image::CinepakDecoder decoder;
+	if (!decoder.setOutputPixelFormat(format))
+		return -1;
+
+	const clock_t start = clock();
+
+	for (int loop = 0; loop < kLoops; loop++) {
+		for (int i = 0; i < kFrames; i++) {
+			Common::MemoryReadStream stream(frames[i].begin(), frames[i].size());
+			decoder.decodeFrame(stream);
+		}
+	}
+
+	const double elapsed = (double)(clock() - start) / CLOCKS_PER_SEC;
+	return elapsed * 1000 / (kLoops * kFrames);
+}
+
+} // End of anonymous namespace
+
+int main(int argc, char *argv[]) {
+	CinepakStreamWriter writer(kWidth, kHeight, kStrips, true);
+	Common::Array<byte> *frames = new Common::Array<byte>[kFrames];
+	for (int i = 0; i < kFrames; i++)
+		frames[i] = writer.writeFrame(i % kKeyFrameInterval == 0);
+
+	printf("Decoding %dx%d Cinepak frames, CPU time per frame\n", kWidth, kHeight);
+
+	for (int bpp = 2; bpp <= 4; bpp += 2) {
+		const Graphics::PixelFormat format = bpp == 2 ? Graphics::PixelFormat(2, 5, 6, 5, 0, 11, 5, 0, 0) : Graphics::PixelFormat(4, 8, 8, 8, 8, 24, 16, 8, 0);
+		printf("%2d bpp %9.3f ms\n", bpp * 8, run(format, frames));
+	}
+
+	delete[] frames;
+	return 0;
+}
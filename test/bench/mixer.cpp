@@ -0,0 +1,151 @@
+/* ScummVM - Graphic Adventure Engine
+ *
+ * ScummVM is the legal property of its developers, whose names
+ * are too numerous to list here. Please refer to the COPYRIGHT
+ * file distributed with this source distribution.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ */
+
+/*
+ * Mixer benchmark: mixes 1, 8 and 16 channels of typical game audio to
+ * 44.1kHz, once by clamping every channel into the 16 bit output and once
+ * through the 32 bit accumulator the mixer uses. Run with "make bench".
+ */
+
+#define FORBIDDEN_SYMBOL_ALLOW_ALL
+
+#include "audio/audiostream.h"
+#include "audio/rate.h"
+#include "common/util.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+namespace {
+
+/** Endless noise, so every channel keeps playing. */
+class NoiseStream : public Audio::AudioStream {
+public:
+	NoiseStream(int rate, bool stereo, uint32 seed) : _rate(rate), _stereo(stereo), _seed(seed) {}
+
+	int readBuffer(int16 *buffer, const int numSamples) {
+		for (int i = 0; i < numSamples; i++) {
+			_seed = _seed * 1103515245 + 12345;
+			buffer[i] = (int16)(_seed >> 16);
+		}
+		return numSamples;
+	}
+
+	bool isStereo() const { return _stereo; }
+	int getRate() const { return _rate; }
+	bool endOfData() const { return false; }
+
+private:
+	int _rate;
+	bool _stereo;
+	uint32 _seed;
+};
+
+const int kOutputRate = 44100;
+const int kBlock = 1024;
+const int kSeconds = 20;
+
+struct Voice {
+	NoiseStream *stream;
+	Audio::RateConverter *converter;
+	Audio::st_volume_t volL, volR;
+};
+
+void createVoices(Voice *voices, int count) {
+	// A mix of speech, effects and music rates as found in most games
+	static const int rates[] = { 11025, 22050, 44100, 22050 };
+
+	for (int i = 0; i < count; i++) {
+		const int rate = rates[i % 4];
+		const bool stereo = (rate == 44100);
+		voices[i].stream = new NoiseStream(rate, stereo, i + 1);
+		voices[i].converter = Audio::makeRateConverter(rate, kOutputRate, stereo);
+		voices[i].volL = 64 + i * 8;
+		voices[i].volR = 192 - i * 8;
+	}
+}
+
+void destroyVoices(Voice *voices, int count) {
+	for (int i = 0; i < count; i++) {
+		delete voices[i].converter;
+		delete voices[i].stream;
+	}
+}
+
+double runClamped(int channels) {
+	Voice voices[16];
+	createVoices(voices, channels);
+
+	int16 out[kBlock * 2];
+	const clock_t start = clock();
+
+	for (int block = 0; block < kSeconds * kOutputRate / kBlock; block++) {
+		memset(out, 0, sizeof(out));
+		for (int i = 0; i < channels; i++)
+			voices[i].converter->flow(*voices[i].stream, out, kBlock, voices[i].volL, voices[i].volR);
+	}
+
+	const double elapsed = (double)(clock() - start) / CLOCKS_PER_SEC;
+	destroyVoices(voices, channels);
+	return elapsed;
+}
+
+double runAccumulated(int channels) {
+	Voice voices[16];
+	createVoices(voices, channels);
+
+	int16 out[kBlock * 2];
+	int16 scratch[kBlock * 2];
+	int32 acc[kBlock * 2];
+	const clock_t start = clock();
+
+	for (int block = 0; block < kSeconds * kOutputRate / kBlock; block++) {
+		memset(acc, 0, sizeof(acc));
+		for (int i = 0; i < channels; i++) {
+			const int len = voices[i].converter->convert(*voices[i].stream, scratch, kBlock);
+			Audio::mixToAccumulator(acc, scratch, len, voices[i].volL, voices[i].volR);
+		}
+		Audio::saturateAccumulator(out, acc, kBlock);
+	}
+
+	const double elapsed = (double)(clock() - start) / CLOCKS_PER_SEC;
+	destroyVoices(voices, channels);
+	return elapsed;
+}
+
+} // End of anonymous namespace
+
+int main(int argc, char *argv[]) {
+	static const int channelCounts[] = { 1, 8, 16 };
+
+	printf("Mixing %d seconds of audio at %d Hz\n", kSeconds, kOutputRate);
+	printf("%-9s %14s %14s %8s\n", "channels", "clamped", "accumulated", "speedup");
+
+	for (int i = 0; i < ARRAYSIZE(channelCounts); i++) {
+		const double clamped = runClamped(channelCounts[i]);
+		const double accumulated = runAccumulated(channelCounts[i]);
+		printf("%-9d %11.1f ms %11.1f ms %7.2fx\n", channelCounts[i], clamped * 1000, accumulated * 1000, clamped / accumulated);
+	}
+
+	return 0;
+}
@@ -0,0 +1,138 @@
+/* ScummVM - Graphic Adventure Engine
+ *
+ * ScummVM is the legal property of its developers, whose names
+ * are too numerous to list here. Please refer to the COPYRIGHT
+ * file distributed with this source distribution.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ */
+
+
+/*
+ * DOSBox OPL benchmark: renders all channels playing a held note in OPL2,
+ * OPL3 and OPL3 four operator mode, sample by sample and with the block
+ * renderer, and reports the CPU cost per second of output. Run with
+ * "make bench".
+ */
+
+#define FORBIDDEN_SYMBOL_ALLOW_ALL
+
+#include "audio/softsynth/opl/dbopl.h"
+#include "common/util.h"
+
+#include <stdio.h>
+#include <time.h>
+
+#ifndef DISABLE_DOSBOX_OPL
+
+namespace {
+
+using OPL::DOSBox::DBOPL::Chip;
+
+const int kOutputRate = 44100;
+const int kBlock = 512;
+const int kSeconds = 4;
+const int kRuns = 5;
+
+enum Setup {
+	kOpl2,
+	kOpl3,
+	kOpl3FourOp
+};
+
+void keyOn(Chip &chip, Setup setup) {
+	static const uint8 operatorOffsets[9] = { 0x00, 0x01, 0x02, 0x08, 0x09, 0x0A, 0x10, 0x11, 0x12 };
+
+	chip.WriteReg(0x01, 0x20);
+	if (setup != kOpl2)
+		chip.WriteReg(0x105, 0x01);
+	if (setup == kOpl3FourOp)
+		chip.WriteReg(0x104, 0x3F);
+	// Vibrato and tremolo on every operator, to get the LFO going
+	chip.WriteReg(0xBD, 0xC0);
+
+	for (int bank = 0; bank < (setup == kOpl2 ? 1 : 2); bank++) {
+		for (int i = 0; i < 9; i++) {
+			const uint16 op = bank * 0x100 + operatorOffsets[i];
+			const uint16 ch = bank * 0x100 + i;
+			for (int j = 0; j < 2; j++) {
+				chip.WriteReg(op + j * 3 + 0x20, 0xE1);
+				chip.WriteReg(op + j * 3 + 0x40, j ? 0x00 : 0x10);
+				chip.WriteReg(op + j * 3 + 0x60, 0xF2);
+				chip.WriteReg(op + j * 3 + 0x80, 0x24);
+				chip.WriteReg(op + j * 3 + 0xE0, i & 3);
+			}
+			// Alternate FM and AM, with feedback
+			chip.WriteReg(ch + 0xC0, 0x3C | (i & 1));
+			chip.WriteReg(ch + 0xA0, 0x6B + i * 16);
+			chip.WriteReg(ch + 0xB0, 0x31);
+		}
+	}
+}
+
+/** Returns the CPU time per second of output, in milliseconds. */
+double run(Setup setup, bool reference) {
+	OPL::DOSBox::DBOPL::InitTables();
+	Chip chip;
+	chip.Setup(kOutputRate);
+	chip.referenceSynth = reference;
+	keyOn(chip, setup);
+
+	int32 out[kBlock * 2];
+	double best = 0.0;
+
+	// Best of several runs, to filter out other load on the machine
+	for (int run = 0; run < kRuns; run++) {
+		const clock_t start = clock();
+		for (int block = 0; block < kSeconds * kOutputRate / kBlock; block++) {
+			if (setup == kOpl2)
+				chip.GenerateBlock2(kBlock, out);
+			else
+				chip.GenerateBlock3(kBlock, out);
+		}
+		const double elapsed = (double)(clock() - start) / CLOCKS_PER_SEC;
+		if (run == 0 || elapsed < best)
+			best = elapsed;
+	}
+
+	return best * 1000 / kSeconds;
+}
+
+} // End of anonymous namespace
+
+int main(int argc, char *argv[]) {
+	static const char *const setupNames[] = { "OPL2", "OPL3", "OPL3 4op" };
+
+	printf("Rendering at %d Hz, CPU time per second of output\n", kOutputRate);
+	printf("%-9s %12s %12s\n", "mode", "per sample", "block");
+	for (int setup = 0; setup < ARRAYSIZE(setupNames); setup++) {
+		printf("%-9s", setupNames[setup]);
+		printf(" %9.2f ms", run((Setup)setup, true));
+		printf(" %9.2f ms", run((Setup)setup, false));
+		printf("\n");
+	}
+
+	return 0;
+}
+
+#else
+
+int main(int argc, char *argv[]) {
+	printf("DOSBox OPL emulator disabled\n");
+	return 0;
+}
+
+#endif
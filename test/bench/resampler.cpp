@@ -0,0 +1,106 @@
+/* ScummVM - Graphic Adventure Engine
+ *
+ * ScummVM is the legal property of its developers, whose names
+ * are too numerous to list here. Please refer to the COPYRIGHT
+ * file distributed with this source distribution.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ */
+
+
+/*
+ * Resampler benchmark: converts game audio rates to 48kHz with every rate
+ * converter quality, and reports the CPU cost per second of output for one
+ * channel. Run with "make bench".
+ */
+
+#define FORBIDDEN_SYMBOL_ALLOW_ALL
+
+#include "audio/audiostream.h"
+#include "audio/rate.h"
+#include "common/util.h"
+
+#include <stdio.h>
+#include <time.h>
+
+namespace {
+
+/** Endless noise, so the converter never runs dry. */
+class NoiseStream : public Audio::AudioStream {
+public:
+	NoiseStream(int rate, bool stereo) : _rate(rate), _stereo(stereo), _seed(1) {}
+
+	int readBuffer(int16 *buffer, const int numSamples) {
+		for (int i = 0; i < numSamples; i++) {
+			_seed = _seed * 1103515245 + 12345;
+			buffer[i] = (int16)(_seed >> 16);
+		}
+		return numSamples;
+	}
+
+	bool isStereo() const { return _stereo; }
+	int getRate() const { return _rate; }
+	bool endOfData() const { return false; }
+
+private:
+	int _rate;
+	bool _stereo;
+	uint32 _seed;
+};
+
+const int kOutputRate = 48000;
+const int kBlock = 1024;
+const int kSeconds = 20;
+
+/** Returns the CPU time per second of output, in milliseconds. */
+double run(int rate, bool stereo, Audio::RateConverterQuality quality) {
+	NoiseStream stream(rate, stereo);
+	Audio::RateConverter *converter = Audio::makeRateConverter(rate, kOutputRate, stereo, false, quality);
+
+	int16 out[kBlock * 2];
+	const clock_t start = clock();
+
+	for (int block = 0; block < kSeconds * kOutputRate / kBlock; block++)
+		converter->convert(stream, out, kBlock);
+
+	const double elapsed = (double)(clock() - start) / CLOCKS_PER_SEC;
+	delete converter;
+	return elapsed * 1000 / kSeconds;
+}
+
+} // End of anonymous namespace
+
+int main(int argc, char *argv[]) {
+	static const int rates[] = { 11025, 22050, 44100 };
+	static const char *const qualityNames[] = { "low", "medium", "high" };
+
+	printf("Converting to %d Hz, CPU time per second of output\n", kOutputRate);
+	printf("%-8s %-7s", "rate", "format");
+	for (int quality = 0; quality < ARRAYSIZE(qualityNames); quality++)
+		printf(" %12s", qualityNames[quality]);
+	printf("\n");
+
+	for (int i = 0; i < ARRAYSIZE(rates); i++) {
+		for (int stereo = 0; stereo < 2; stereo++) {
+			printf("%-8d %-7s", rates[i], stereo ? "stereo" : "mono");
+			for (int quality = 0; quality < ARRAYSIZE(qualityNames); quality++)
+				printf(" %9.2f ms", run(rates[i], stereo != 0, (Audio::RateConverterQuality)quality));
+			printf("\n");
+		}
+	}
+
+	return 0;
+}
@@ -0,0 +1,124 @@
+/* ScummVM - Graphic Adventure Engine
+ *
+ * ScummVM is the legal property of its developers, whose names
+ * are too numerous to list here. Please refer to the COPYRIGHT
+ * file distributed with this source distribution.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ */
+
+
+/*
+ * YUV to RGB benchmark: converts 640x480 frames with every supported kernel
+ * and reports the CPU time per frame. Run with "make bench".
+ */
+
+#define FORBIDDEN_SYMBOL_ALLOW_ALL
+
+#include "common/util.h"
+#include "graphics/surface.h"
+#include "graphics/yuv_to_rgb.h"
+
+#include <stdio.h>
+#include <time.h>
+
+namespace {
+
+const int kWidth = 640;
+const int kHeight = 480;
+const int kFrames = 500;
+
+enum Subsampling {
+	k444,
+	k420,
+	k410
+};
+
+/** Returns the CPU time per frame, in milliseconds. */
+double run(Graphics::YUVToRGBManager::Kernel kernel, Subsampling subsampling, const Graphics::PixelFormat &format, const byte *y, const byte *u, const byte *v) {
+	Graphics::Surface surface;
+	surface.create(kWidth, kHeight, format);
+	YUVToRGBMan.setKernel(kernel);
+
+	const clock_t start = clock();
+
+	for (int frame = 0; frame < kFrames; frame++) {
+		switch (subsampling) {
+		case k444:
+			YUVToRGBMan.convert444(&surface, Graphics::YUVToRGBManager::kScaleITU, y, u, v, kWidth, kHeight, kWidth, kWidth + 1);
+			break;
+		case k420:
+			YUVToRGBMan.convert420(&surface, Graphics::YUVToRGBManager::kScaleITU, y, u, v, kWidth, kHeight, kWidth, kWidth + 1);
+			break;
+		case k410:
+			YUVToRGBMan.convert410(&surface, Graphics::YUVToRGBManager::kScaleITU, y, u, v, kWidth, kHeight, kWidth, kWidth + 1);
+			break;
+		}
+	}
+
+	const double elapsed = (double)(clock() - start) / CLOCKS_PER_SEC;
+	surface.free();
+	return elapsed * 1000 / kFrames;
+}
+
+} // End of anonymous namespace
+
+int main(int argc, char *argv[]) {
+	static const Graphics::YUVToRGBManager::Kernel kernels[] = {
+		Graphics::YUVToRGBManager::kKernelScalar, Graphics::YUVToRGBManager::kKernelSSE2,
+		Graphics::YUVToRGBManager::kKernelAVX2, Graphics::YUVToRGBManager::kKernelNEON
+	};
+	static const char *const kernelNames[] = { "scalar", "sse2", "avx2", "neon" };
+	static const char *const subsamplingNames[] = { "444", "420", "410" };
+
+	// Full resolution chroma planes with an extra row and column, which
+	// is enough for every subsampling
+	const int planeSize = (kWidth + 1) * (kHeight + 1);
+	byte *y = new byte[planeSize];
+	byte *u = new byte[planeSize];
+	byte *v = new byte[planeSize];
+	uint32 seed = 1;
+	for (int i = 0; i < planeSize; i++) {
+		seed = seed * 1103515245 + 12345;
+		y[i] = (byte)(seed >> 24);
+		u[i] = (byte)(seed >> 16);
+		v[i] = (byte)(seed >> 8);
+	}
+
+	printf("Converting %dx%d frames, CPU time per frame\n", kWidth, kHeight);
+	printf("%-8s %-5s", "kernel", "bpp");
+	for (int i = 0; i < ARRAYSIZE(subsamplingNames); i++)
+		printf(" %12s", subsamplingNames[i]);
+	printf("\n");
+
+	for (int i = 0; i < ARRAYSIZE(kernels); i++) {
+		if (!Graphics::YUVToRGBManager::isKernelSupported(kernels[i]))
+			continue;
+
+		for (int bpp = 2; bpp <= 4; bpp += 2) {
+			const Graphics::PixelFormat format = bpp == 2 ? Graphics::PixelFormat(2, 5, 6, 5, 0, 11, 5, 0, 0) : Graphics::PixelFormat(4, 8, 8, 8, 8, 24, 16, 8, 0);
+			printf("%-8s %-5d", kernelNames[i], bpp * 8);
+			for (int subsampling = k444; subsampling <= k410; subsampling++)
+				printf(" %9.3f ms", run(kernels[i], (Subsampling)subsampling, format, y, u, v));
+			printf("\n");
+		}
+	}
+
+	delete[] y;
+	delete[] u;
+	delete[] v;
+	return 0;
+}
@@ -0,0 +1,140 @@
+#include <cxxtest/TestSuite.h>
+
+#include "common/atomic.h"
+#include "common/str.h"
+#include "common/workerpool.h"
+
+class WorkerPoolTestSuite : public CxxTest::TestSuite
+{
+private:
+	enum {
+		kJobs = 1000
+	};
+
+	struct Counter {
+		volatile uint32 calls[kJobs];
+
+		Counter() {
+			for (int i = 0; i < kJobs; ++i)
+				calls[i] = 0;
+		}
+
+		void count(uint index) {
+			Common::atomicAdd(&calls[index], 1u);
+		}
+
+		/**
+		 * Builds and copies strings too long for the internal storage, on
+		 * every thread, so their reference counts come from the shared pool
+		 */
+		void copyStrings(uint index) {
+			Common::String path = Common::String::format("/some/rather/long/path/to/a/game/number/%u", index);
+			const uint size = path.size();
+			for (int i = 0; i < 50; ++i) {
+				Common::String copy(path);
+				path = copy + "/";
+			}
+			Common::atomicAdd(&calls[index], path.size() == size + 50 ? 1u : 0u);
+		}
+	};
+
+	static void checkCounts(const Counter &counter, uint count) {
+		uint wrong = 0;
+		for (uint i = 0; i < kJobs; ++i) {
+			if (counter.calls[i] != (i < count ? 1 : 0) && !wrong++)
+				TS_ASSERT_EQUALS(counter.calls[i], i < count ? 1u : 0u);
+		}
+		TS_ASSERT_EQUALS(wrong, 0u);
+	}
+
+public:
+	void test_runs_every_job_once() {
+		Common::WorkerPool pool(8);
+		TS_ASSERT_LESS_THAN_EQUALS(1u, pool.getThreadCount());
+
+		Counter counter;
+		pool.run(Common::Functor1Mem<uint, void, Counter>(&counter, &Counter::count), kJobs);
+		checkCounts(counter, kJobs);
+	}
+
+	void test_fewer_jobs_than_threads() {
+		Common::WorkerPool pool(16);
+		Counter counter;
+		pool.run(Common::Functor1Mem<uint, void, Counter>(&counter, &Counter::count), 3);
+		checkCounts(counter, 3);
+
+		pool.run(Common::Functor1Mem<uint, void, Counter>(&counter, &Counter::count), 0);
+		checkCounts(counter, 3);
+	}
+
+	void test_single_thread() {
+		Common::WorkerPool pool(1);
+		TS_ASSERT_EQUALS(pool.getThreadCount(), 1u);
+
+		Counter counter;
+		pool.run(Common::Functor1Mem<uint, void, Counter>(&counter, &Counter::count), kJobs);
+		checkCounts(counter, kJobs);
+	}
+
+	void test_start_and_finish() {
+		Common::WorkerPool pool(4);
+		Counter counter;
+		Common::Functor1Mem<uint, void, Counter> job(&counter, &Counter::count);
+
+		pool.start(job, kJobs);
+		// The calling thread is free until it calls finish()
+		Counter other;
+		for (uint i = 0; i < 10; ++i)
+			other.count(i);
+		pool.finish();
+
+		checkCounts(counter, kJobs);
+		checkCounts(other, 10);
+
+		// Finishing twice, or without starting, does nothing
+		pool.finish();
+		checkCounts(counter, kJobs);
+	}
+
+	void test_start_background() {
+		Common::WorkerPool pool(1);
+		TS_ASSERT(pool.isFinished());
+
+		Counter counter;
+		Common::Functor1Mem<uint, void, Counter> job(&counter, &Counter::count);
+		if (!pool.startBackground(job, kJobs)) {
+			// No threads on this port
+			checkCounts(counter, 0);
+			return;
+		}
+
+		while (!pool.isFinished())
+			;
+		checkCounts(counter, kJobs);
+		pool.finish();
+		TS_ASSERT(pool.isFinished());
+	}
+
+	void test_reuses_threads() {
+		// Many short batches in a row, each handed to the same threads
+		Common::WorkerPool pool(4);
+		for (uint batch = 0; batch < 200; ++batch) {
+			Counter counter;
+			Common::Functor1Mem<uint, void, Counter> job(&counter, &Counter::count);
+			if (batch & 1) {
+				pool.run(job, batch % 7);
+			} else {
+				pool.start(job, kJobs);
+				pool.finish();
+			}
+			checkCounts(counter, (batch & 1) ? batch % 7 : (uint)kJobs);
+		}
+	}
+
+	void test_strings_on_threads() {
+		Common::WorkerPool pool(8);
+		Counter counter;
+		pool.run(Common::Functor1Mem<uint, void, Counter>(&counter, &Counter::copyStrings), kJobs);
+		checkCounts(counter, kJobs);
+	}
+};
@@ -0,0 +1,129 @@
+#include <cxxtest/TestSuite.h>
+
+#include "graphics/surface.h"
+#include "graphics/yuv_to_rgb.h"
+
+class YUVToRGBTestSuite : public CxxTest::TestSuite
+{
+private:
+	enum {
+		kWidth = 256,
+		kHeight = 64,
+		kPlaneSize = (kWidth + 1) * (kHeight + 1)
+	};
+
+	enum Subsampling {
+		k444,
+		k420,
+		k410
+	};
+
+	/**
+	 * Planes where each row has every luminance value, and the chroma
+	 * covers all values in a few rows, plus some noise.
+	 */
+	struct Planes {
+		byte y[kPlaneSize];
+		byte u[kPlaneSize];
+		byte v[kPlaneSize];
+
+		Planes() {
+			uint32 seed = 1;
+			for (int i = 0; i < kPlaneSize; ++i) {
+				seed = seed * 1103515245 + 12345;
+				const int x = i % (kWidth + 1);
+				const int row = i / (kWidth + 1);
+				y[i] = (byte)(x + row * 3);
+				u[i] = (row & 1) ? (byte)(seed >> 16) : (byte)(x + row);
+				v[i] = (row & 2) ? (byte)(seed >> 24) : (byte)(255 - x + row * 7);
+			}
+		}
+	};
+
+	static void convert(Graphics::Surface &dst, const Planes &planes, Subsampling subsampling, Graphics::YUVToRGBManager::LuminanceScale scale, int width, int height) {
+		// Leave a border in the destination, to catch writes past the width
+		memset(dst.getPixels(), 0x55, dst.h * dst.pitch);
+
+		switch (subsampling) {
+		case k444:
+			YUVToRGBMan.convert444(&dst, scale, planes.y, planes.u, planes.v, width, height, kWidth + 1, kWidth + 1);
+			break;
+		case k420:
+			YUVToRGBMan.convert420(&dst, scale, planes.y, planes.u, planes.v, width, height, kWidth + 1, kWidth + 1);
+			break;
+		case k410:
+			YUVToRGBMan.convert410(&dst, scale, planes.y, planes.u, planes.v, width, height, kWidth + 1, kWidth + 1);
+			break;
+		}
+	}
+
+	static void checkKernel(Graphics::YUVToRGBManager::Kernel kernel, const Graphics::PixelFormat &format) {
+		static const int widths[] = { 4, 20, 36, kWidth };
+		// 4:4:4 has no chroma pairs, so any width works and the kernels
+		// have to finish odd ones with their scalar tail
+		static const int widths444[] = { 1, 7, 21, 35, kWidth - 1 };
+		static const Graphics::YUVToRGBManager::LuminanceScale scales[] = {
+			Graphics::YUVToRGBManager::kScaleFull, Graphics::YUVToRGBManager::kScaleITU
+		};
+
+		Planes *planes = new Planes();
+		Graphics::Surface expected, actual;
+		expected.create(kWidth + 8, kHeight, format);
+		actual.create(kWidth + 8, kHeight, format);
+
+		for (int subsampling = k444; subsampling <= k410; ++subsampling) {
+			for (int scale = 0; scale < 2; ++scale) {
+				const int count = ARRAYSIZE(widths) + (subsampling == k444 ? ARRAYSIZE(widths444) : 0);
+				for (int i = 0; i < count; ++i) {
+					const int width = (i < ARRAYSIZE(widths)) ? widths[i] : widths444[i - ARRAYSIZE(widths)];
+					TS_ASSERT(YUVToRGBMan.setKernel(Graphics::YUVToRGBManager::kKernelScalar));
+					convert(expected, *planes, (Subsampling)subsampling, scales[scale], width, kHeight);
+					TS_ASSERT(YUVToRGBMan.setKernel(kernel));
+					convert(actual, *planes, (Subsampling)subsampling, scales[scale], width, kHeight);
+
+					int mismatch = 0;
+					for (int y = 0; y < kHeight; ++y) {
+						if (memcmp(expected.getBasePtr(0, y), actual.getBasePtr(0, y), expected.pitch) != 0)
+							++mismatch;
+					}
+					TS_ASSERT_EQUALS(mismatch, 0);
+				}
+			}
+		}
+
+		expected.free();
+		actual.free();
+		delete planes;
+	}
+
+	static void checkKernel(Graphics::YUVToRGBManager::Kernel kernel) {
+		if (!Graphics::YUVToRGBManager::isKernelSupported(kernel))
+			return;
+
+		const Graphics::YUVToRGBManager::Kernel defaultKernel = YUVToRGBMan.getKernel();
+		checkKernel(kernel, Graphics::PixelFormat(2, 5, 6, 5, 0, 11, 5, 0, 0));
+		checkKernel(kernel, Graphics::PixelFormat(2, 5, 5, 5, 1, 10, 5, 0, 15));
+		checkKernel(kernel, Graphics::PixelFormat(2, 4, 4, 4, 4, 12, 8, 4, 0));
+		checkKernel(kernel, Graphics::PixelFormat(4, 8, 8, 8, 8, 16, 8, 0, 24));
+		checkKernel(kernel, Graphics::PixelFormat(4, 8, 8, 8, 8, 24, 16, 8, 0));
+		checkKernel(kernel, Graphics::PixelFormat(4, 8, 8, 8, 0, 0, 8, 16, 0));
+		YUVToRGBMan.setKernel(defaultKernel);
+	}
+
+public:
+	void test_scalar_always_supported() {
+		TS_ASSERT(Graphics::YUVToRGBManager::isKernelSupported(Graphics::YUVToRGBManager::kKernelScalar));
+	}
+
+	void test_sse2_matches_scalar() {
+		checkKernel(Graphics::YUVToRGBManager::kKernelSSE2);
+	}
+
+	void test_avx2_matches_scalar() {
+		checkKernel(Graphics::YUVToRGBManager::kKernelAVX2);
+	}
+
+	void test_neon_matches_scalar() {
+		checkKernel(Graphics::YUVToRGBManager::kKernelNEON);
+	}
+};
@@ -0,0 +1,83 @@
+#include <cxxtest/TestSuite.h>
+
+#include "common/array.h"
+#include "common/memstream.h"
+#include "graphics/surface.h"
+#include "image/codecs/cinepak.h"
+
+#include "cinepak_stream.h"
+
+class CinepakTestSuite : public CxxTest::TestSuite
+{
+private:
+	enum {
+		kWidth = 64,
+		kHeight = 48,
+		kStrips = 3,
+		kFrames = 6,
+		kKeyFrameInterval = 3
+	};
+
+	/**
+	 * Decodes the generated frames into the given format, and counts the
+	 * pixels which differ from the reference picture after each frame.
+	 */
+	static void checkFormat(const Graphics::PixelFormat &format) {
+		CinepakStreamWriter writer(kWidth, kHeight, kStrips);
+		Image::CinepakDecoder decoder;
+		TS_ASSERT(decoder.setOutputPixelFormat(format));
+
+		for (int frame = 0; frame < kFrames; frame++) {
+			const Common::Array<byte> data = writer.writeFrame(frame % kKeyFrameInterval == 0);
+			Common::MemoryReadStream stream(data.begin(), data.size());
+			const Graphics::Surface *surface = decoder.decodeFrame(stream);
+
+			TS_ASSERT(surface);
+			if (!surface)
+				break;
+
+			TS_ASSERT(surface->format == format);
+
+			int mismatch = 0;
+			for (int y = 0; y < kHeight; y++) {
+				for (int x = 0; x < kWidth; x++) {
+					const uint32 color = (format.bytesPerPixel == 2) ? *(const uint16 *)surface->getBasePtr(x, y) : *(const uint32 *)surface->getBasePtr(x, y);
+					if (color != writer.getColor(format, x, y))
+						mismatch++;
+				}
+			}
+			TS_ASSERT_EQUALS(mismatch, 0);
+		}
+	}
+
+public:
+	void test_decode_rgb565() {
+		checkFormat(Graphics::PixelFormat(2, 5, 6, 5, 0, 11, 5, 0, 0));
+	}
+
+	void test_decode_argb1555() {
+		checkFormat(Graphics::PixelFormat(2, 5, 5, 5, 1, 10, 5, 0, 15));
+	}
+
+	void test_decode_rgba8888() {
+		checkFormat(Graphics::PixelFormat(4, 8, 8, 8, 8, 24, 16, 8, 0));
+	}
+
+	void test_decode_argb8888() {
+		checkFormat(Graphics::PixelFormat(4, 8, 8, 8, 8, 16, 8, 0, 24));
+	}
+
+	void test_refuses_format_after_decoding() {
+		CinepakStreamWriter writer(kWidth, kHeight, kStrips);
+		Image::CinepakDecoder decoder;
+		TS_ASSERT(decoder.setOutputPixelFormat(Graphics::PixelFormat(2, 5, 6, 5, 0, 11, 5, 0, 0)));
+
+		const Common::Array<byte> data = writer.writeFrame(true);
+		Common::MemoryReadStream stream(data.begin(), data.size());
+		decoder.decodeFrame(stream);
+
+		TS_ASSERT(!decoder.canOutputPixelFormat(Graphics::PixelFormat(4, 8, 8, 8, 8, 24, 16, 8, 0)));
+		TS_ASSERT(!decoder.setOutputPixelFormat(Graphics::PixelFormat(4, 8, 8, 8, 8, 24, 16, 8, 0)));
+		TS_ASSERT(decoder.setOutputPixelFormat(Graphics::PixelFormat(2, 5, 6, 5, 0, 11, 5, 0, 0)));
+	}
+};
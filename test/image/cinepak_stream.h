@@ -0,0 +1,267 @@
+#ifndef TEST_IMAGE_CINEPAK_STREAM_H
+#define TEST_IMAGE_CINEPAK_STREAM_H
+
+#include "common/array.h"
+#include "common/util.h"
+#include "graphics/pixelformat.h"
+
+/**
+ * Writes Cinepak frames with random codebooks and vectors, and draws the
+ * same frames the straightforward way, one pixel at a time. Shared by the
+ * regression test and the benchmark, so both decode the same kind of
+ * stream.
+ */
+class CinepakStreamWriter {
+public:
+	/**
+	 * @param smoothColors	Draw codebook entries from a narrow range, like
+	 *                      in real videos, instead of clipping the colors
+	 *                      on both ends.
+	 */
+	CinepakStreamWriter(int width, int height, int strips, bool smoothColors = false) :
+		_width(width), _height(height), _strips(strips), _stripHeight(height / strips), _smoothColors(smoothColors), _seed(1),
+		_v1(strips * 256, Codebook()), _v4(strips * 256, Codebook()), _pixels(width * height, Pixel()) {
+	}
+
+	Common::Array<byte> writeFrame(bool keyFrame) {
+		Common::Array<byte> strips;
+
+		for (int i = 0; i < _strips; i++) {
+			// Without frame flag 1, each strip starts with the codebooks
+			// of the one above it
+			if (i > 0) {
+				for (int j = 0; j < 256; j++) {
+					_v1[i * 256 + j] = _v1[(i - 1) * 256 + j];
+					_v4[i * 256 + j] = _v4[(i - 1) * 256 + j];
+				}
+			}
+
+			Common::Array<byte> chunks;
+			writeCodebook(chunks, 0x20, &_v4[i * 256], keyFrame);
+			writeCodebook(chunks, 0x22, &_v1[i * 256], keyFrame);
+			writeVectors(chunks, i, keyFrame);
+
+			writeUint16BE(strips, keyFrame ? 0x1000 : 0x1100);
+			writeUint16BE(strips, chunks.size() + 12);
+			writeUint16BE(strips, 0);
+			writeUint16BE(strips, 0);
+			writeUint16BE(strips, _stripHeight);
+			writeUint16BE(strips, _width);
+			append(strips, chunks);
+		}
+
+		Common::Array<byte> frame;
+		frame.push_back(0);
+		writeUint24BE(frame, strips.size() + 10);
+		writeUint16BE(frame, _width);
+		writeUint16BE(frame, _height);
+		writeUint16BE(frame, _strips);
+		append(frame, strips);
+		return frame;
+	}
+
+	/** Returns the color the decoder should have written at a pixel. */
+	uint32 getColor(const Graphics::PixelFormat &format, int x, int y) const {
+		const Pixel &pixel = _pixels[y * _width + x];
+		return format.RGBToColor(clip(pixel.y + (pixel.v << 1)), clip(pixel.y - (pixel.u >> 1) - pixel.v), clip(pixel.y + (pixel.u << 1)));
+	}
+
+private:
+	struct Codebook {
+		byte y[4];
+		int8 u, v;
+
+		Codebook() : u(0), v(0) {
+			memset(y, 0, sizeof(y));
+		}
+	};
+
+	/** A pixel of the reference picture, before color conversion. */
+	struct Pixel {
+		byte y;
+		int8 u, v;
+
+		Pixel() : y(0), u(0), v(0) {}
+
+		void set(const Codebook &codebook, int index) {
+			y = codebook.y[index];
+			u = codebook.u;
+			v = codebook.v;
+		}
+	};
+
+	/**
+	 * Builds a chunk in the order the decoder reads it. The flag bits are
+	 * gathered into 32-bit words, each one written just before the data of
+	 * the first vector or codebook entry it describes.
+	 */
+	class ChunkBuilder {
+	public:
+		void addFlag(bool flag) {
+			_flags.push_back(flag);
+			_order.push_back(-1);
+		}
+
+		void addByte(byte value) {
+			_order.push_back(value);
+		}
+
+		void write(Common::Array<byte> &out, byte chunkID) const {
+			Common::Array<byte> data;
+			uint flagsLeft = 0, nextFlag = 0;
+
+			for (uint i = 0; i < _order.size(); i++) {
+				if (_order[i] >= 0) {
+					data.push_back(_order[i]);
+					continue;
+				}
+
+				if (!flagsLeft) {
+					uint32 word = 0;
+					for (uint j = 0; j < 32; j++)
+						if (nextFlag + j < _flags.size() && _flags[nextFlag + j])
+							word |= 0x80000000 >> j;
+
+					writeUint16BE(data, word >> 16);
+					writeUint16BE(data, word & 0xFFFF);
+					flagsLeft = 32;
+				}
+
+				flagsLeft--;
+				nextFlag++;
+			}
+
+			out.push_back(chunkID);
+			writeUint24BE(out, data.size() + 4);
+			append(out, data);
+		}
+
+	private:
+		Common::Array<bool> _flags;
+		Common::Array<int> _order;
+	};
+
+	uint nextRandom(uint limit) {
+		_seed = _seed * 1103515245 + 12345;
+		return (_seed >> 16) % limit;
+	}
+
+	static byte clip(int value) {
+		return CLIP(value, 0, 255);
+	}
+
+	static void writeUint16BE(Common::Array<byte> &out, uint16 value) {
+		out.push_back(value >> 8);
+		out.push_back(value & 0xFF);
+	}
+
+	static void writeUint24BE(Common::Array<byte> &out, uint32 value) {
+		out.push_back((value >> 16) & 0xFF);
+		writeUint16BE(out, value & 0xFFFF);
+	}
+
+	static void append(Common::Array<byte> &out, const Common::Array<byte> &data) {
+		for (uint i = 0; i < data.size(); i++)
+			out.push_back(data[i]);
+	}
+
+	void addCodebookEntry(ChunkBuilder &chunk, Codebook &entry) {
+		if (_smoothColors) {
+			const byte y = nextRandom(224);
+			for (int i = 0; i < 4; i++)
+				entry.y[i] = y + nextRandom(32);
+			entry.u = nextRandom(64) - 32;
+			entry.v = nextRandom(64) - 32;
+		} else {
+			for (int i = 0; i < 4; i++)
+				entry.y[i] = nextRandom(256);
+			entry.u = nextRandom(256) - 128;
+			entry.v = nextRandom(256) - 128;
+		}
+
+		for (int i = 0; i < 4; i++)
+			chunk.addByte(entry.y[i]);
+		chunk.addByte(entry.u);
+		chunk.addByte(entry.v);
+	}
+
+	void writeCodebook(Common::Array<byte> &out, byte chunkID, Codebook *codebook, bool keyFrame) {
+		ChunkBuilder chunk;
+
+		for (int i = 0; i < 256; i++) {
+			if (keyFrame) {
+				addCodebookEntry(chunk, codebook[i]);
+			} else {
+				// Update a quarter of the entries
+				const bool update = nextRandom(4) == 0;
+				chunk.addFlag(update);
+				if (update)
+					addCodebookEntry(chunk, codebook[i]);
+			}
+		}
+
+		// 0x20/0x22 replace the whole codebook, 0x21/0x23 update some entries
+		chunk.write(out, chunkID | (keyFrame ? 0 : 1));
+	}
+
+	void writeVectors(Common::Array<byte> &out, int strip, bool keyFrame) {
+		const Codebook *v1 = &_v1[strip * 256];
+		const Codebook *v4 = &_v4[strip * 256];
+		ChunkBuilder chunk;
+
+		for (int by = strip * _stripHeight; by < (strip + 1) * _stripHeight; by += 4) {
+			for (int bx = 0; bx < _width; bx += 4) {
+				// Update half of the blocks between key frames
+				if (!keyFrame) {
+					const bool update = nextRandom(2) == 0;
+					chunk.addFlag(update);
+					if (!update)
+						continue;
+				}
+
+				// Use a detailed vector for one block out of three
+				const bool detailed = nextRandom(3) == 0;
+				chunk.addFlag(detailed);
+
+				if (detailed) {
+					// Each V4 entry covers one quarter of the block
+					for (int quarter = 0; quarter < 4; quarter++) {
+						const byte index = nextRandom(256);
+						chunk.addByte(index);
+
+						for (int i = 0; i < 4; i++)
+							pixel(bx + (quarter & 1) * 2 + (i & 1), by + (quarter >> 1) * 2 + (i >> 1)).set(v4[index], i);
+					}
+				} else {
+					// Each luma of the V1 entry covers one quarter
+					const byte index = nextRandom(256);
+					chunk.addByte(index);
+
+					for (int y = 0; y < 4; y++) {
+						for (int x = 0; x < 4; x++)
+							pixel(bx + x, by + y).set(v1[index], (y >> 1) * 2 + (x >> 1));
+					}
+				}
+			}
+		}
+
+		chunk.write(out, keyFrame ? 0x30 : 0x31);
+	}
+
+	Pixel &pixel(int x, int y) {
+		return _pixels[y * _width + x];
+	}
+
+	const int _width;
+	const int _height;
+	const int _strips;
+	const int _stripHeight;
+	const bool _smoothColors;
+
+	uint32 _seed;
+	Common::Array<Codebook> _v1;
+	Common::Array<Codebook> _v4;
+	Common::Array<Pixel> _pixels;
+};
+
+#endif
@@ -5,8 +5,12 @@
 #
 ######################################################################
 
-TESTS        := $(srcdir)/test/common/*.h $(srcdir)/test/audio/*.h
-TEST_LIBS    := audio/libaudio.a common/libcommon.a
+TESTS        := $(srcdir)/test/common/*.h $(srcdir)/test/audio/*.h $(srcdir)/test/graphics/*.h $(srcdir)/test/image/*.h
+TEST_LIBS    := audio/libaudio.a image/libimage.a graphics/libgraphics.a common/libcommon.a
+
+ifdef USE_MT32EMU
+	TEST_LIBS += audio/softsynth/mt32/libmt32.a
+endif
 
 ifeq ($(ENABLE_WINTERMUTE), STATIC_PLUGIN)
 	TESTS += $(srcdir)/test/engines/wintermute/*.h
@@ -42,8 +46,24 @@ test/runner.cpp: $(TESTS)
 	@mkdir -p test
 	$(srcdir)/test/cxxtest/cxxtestgen.py $(TEST_FLAGS) -o $@ $+
 
+#
+# Micro-benchmarks, built against the same libraries as the tests.
+# Use the 'bench' target to run them.
+#
+BENCHMARKS   := test/bench/cinepak$(EXEEXT) \
+                test/bench/mixer$(EXEEXT) \
+                test/bench/opl$(EXEEXT) \
+                test/bench/resampler$(EXEEXT) \
+                test/bench/yuv_to_rgb$(EXEEXT)
+
+bench: $(BENCHMARKS)
+	@for bench in $(BENCHMARKS); do ./$$bench || exit 1; done
+test/bench/%$(EXEEXT): $(srcdir)/test/bench/%.cpp $(TEST_LIBS)
+	@mkdir -p test/bench
+	$(QUIET_CXX)$(CXX) $(TEST_CXXFLAGS) $(CPPFLAGS) -O2 -o $@ $+ $(TEST_LDFLAGS)
+
 clean: clean-test
 clean-test:
-	-$(RM) test/runner.cpp test/runner
+	-$(RM) test/runner.cpp test/runner $(BENCHMARKS)
 
-.PHONY: test clean-test
+.PHONY: test bench clean-test
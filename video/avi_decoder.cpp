@@ -902,6 +902,7 @@ AVIDecoder::AVIVideoTrack::AVIVideoTrack(int frameCount, const AVIStreamHeader &
 	_lastFrame = 0;
 	_curFrame = -1;
 	_reversed = false;
+	_outputSurface = 0;
 
 	useInitialPalette();
 }
@@ -983,6 +984,14 @@ bool AVIDecoder::AVIVideoTrack::rewind() {
 	delete _videoCodec;
 	_videoCodec = createCodec();
 	_lastFrame = 0;
+
+	if (_videoCodec) {
+		if (_outputFormat.bytesPerPixel)
+			_videoCodec->setOutputPixelFormat(_outputFormat);
+		if (_outputSurface)
+			_videoCodec->setOutputSurface(_outputSurface);
+	}
+
 	return true;
 }
 
@@ -1035,6 +1044,26 @@ void AVIDecoder::AVIVideoTrack::setDither(const byte *palette) {
 	_videoCodec->setDither(Image::Codec::kDitherTypeVFW, palette);
 }
 
+bool AVIDecoder::AVIVideoTrack::setOutputPixelFormat(const Graphics::PixelFormat &format) {
+	if (!_videoCodec || !_videoCodec->setOutputPixelFormat(format))
+		return false;
+
+	_outputFormat = format;
+	return true;
+}
+
+bool AVIDecoder::AVIVideoTrack::canOutputPixelFormat(const Graphics::PixelFormat &format) const {
+	return _videoCodec && _videoCodec->canOutputPixelFormat(format);
+}
+
+bool AVIDecoder::AVIVideoTrack::setOutputSurface(Graphics::Surface *surface) {
+	if (!_videoCodec || !_videoCodec->setOutputSurface(surface))
+		return false;
+
+	_outputSurface = surface;
+	return true;
+}
+
 AVIDecoder::AVIAudioTrack::AVIAudioTrack(const AVIStreamHeader &streamHeader, const PCMWaveFormat &waveFormat, Audio::Mixer::SoundType soundType) :
 		AudioTrack(soundType),
 		_audsHeader(streamHeader),
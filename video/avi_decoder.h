@@ -101,6 +101,7 @@ protected:
 	void readNextPacket();
 	bool seekIntern(const Audio::Timestamp &time);
 	bool supportsAudioTrackSwitching() const { return true; }
+	bool supportsDecodeAhead() const { return !_transparencyTrack.track; }
 	AudioTrack *getAudioTrack(int index);
 
 	/**
@@ -223,6 +224,9 @@ protected:
 		void useInitialPalette();
 		bool canDither() const;
 		void setDither(const byte *palette);
+		bool setOutputPixelFormat(const Graphics::PixelFormat &format);
+		bool canOutputPixelFormat(const Graphics::PixelFormat &format) const;
+		bool setOutputSurface(Graphics::Surface *surface);
 
 		bool isTruemotion1() const;
 		void forceDimensions(uint16 width, uint16 height);
@@ -274,6 +278,10 @@ protected:
 		Image::Codec *_videoCodec;
 		const Graphics::Surface *_lastFrame;
 		Image::Codec *createCodec();
+
+		// Output settings, applied again when the codec is recreated
+		Graphics::PixelFormat _outputFormat;
+		Graphics::Surface *_outputSurface;
 	};
 
 	class AVIAudioTrack : public AudioTrack {
@@ -39,6 +39,7 @@
 #include "common/rdft.h"
 #include "common/dct.h"
 #include "common/system.h"
+#include "common/workerpool.h"
 
 #include "graphics/yuv_to_rgb.h"
 #include "graphics/surface.h"
@@ -63,6 +64,7 @@ namespace Video {
 
 BinkDecoder::BinkDecoder() {
 	_bink = 0;
+	_threadCount = 0;
 }
 
 BinkDecoder::~BinkDecoder() {
@@ -103,7 +105,7 @@ bool BinkDecoder::loadStream(Common::SeekableReadStream *stream) {
 
 	// BIKh and BIKi swap the chroma planes
 	addTrack(new BinkVideoTrack(width, height, getDefaultHighColorFormat(), frameCount,
-			Common::Rational(frameRateNum, frameRateDen), (id == kBIKhID || id == kBIKiID), videoFlags & kVideoFlagAlpha, id));
+			Common::Rational(frameRateNum, frameRateDen), (id == kBIKhID || id == kBIKiID), videoFlags & kVideoFlagAlpha, id, _threadCount));
 
 	uint32 audioTrackCount = _bink->readUint32LE();
 
@@ -242,7 +244,7 @@ BinkDecoder::AudioInfo::~AudioInfo() {
 	delete dct;
 }
 
-BinkDecoder::BinkVideoTrack::BinkVideoTrack(uint32 width, uint32 height, const Graphics::PixelFormat &format, uint32 frameCount, const Common::Rational &frameRate, bool swapPlanes, bool hasAlpha, uint32 id) :
+BinkDecoder::BinkVideoTrack::BinkVideoTrack(uint32 width, uint32 height, const Graphics::PixelFormat &format, uint32 frameCount, const Common::Rational &frameRate, bool swapPlanes, bool hasAlpha, uint32 id, uint threadCount) :
 		_frameCount(frameCount), _frameRate(frameRate), _swapPlanes(swapPlanes), _hasAlpha(hasAlpha), _id(id) {
 	_curFrame = -1;
 
@@ -312,11 +314,25 @@ BinkDecoder::BinkVideoTrack::BinkVideoTrack(uint32 width, uint32 height, const G
 	memset(_oldPlanes[2],   0, _uvBlockWidth * 8 * _uvBlockHeight * 8);
 	memset(_oldPlanes[3], 255, _yBlockWidth  * 8 * _yBlockHeight  * 8);
 
+	// Every 8x8 block of every plane has at most one DCT per frame
+	_dctBlocks = new DCTBlock[2 * _yBlockWidth * _yBlockHeight + 2 * _uvBlockWidth * _uvBlockHeight];
+	_dctBlockCount = 0;
+	_dctPending = 0;
+	_dctJobStart = 0;
+	_dctJobEnd = 0;
+
+	_workers = new Common::WorkerPool(threadCount);
+	_transformJob = new Common::Functor1Mem<uint, void, BinkVideoTrack>(this, &BinkVideoTrack::transformBlocks);
+
 	initBundles();
 	initHuffman();
 }
 
 BinkDecoder::BinkVideoTrack::~BinkVideoTrack() {
+	delete _workers;
+	delete _transformJob;
+	delete[] _dctBlocks;
+
 	for (int i = 0; i < 4; i++) {
 		delete[] _curPlanes[i]; _curPlanes[i] = 0;
 		delete[] _oldPlanes[i]; _oldPlanes[i] = 0;
@@ -335,6 +351,13 @@ BinkDecoder::BinkVideoTrack::~BinkVideoTrack() {
 void BinkDecoder::BinkVideoTrack::decodePacket(VideoFrame &frame) {
 	assert(frame.bits);
 
+	// The bitstream has to be parsed in order, but the transforms of the DCT
+	// blocks are independent. They are queued while parsing a plane, and the
+	// worker threads transform the luma and alpha planes while the chroma
+	// planes are parsed here.
+	_dctBlockCount = 0;
+	_dctPending = 0;
+
 	if (_hasAlpha) {
 		if (_id == kBIKiID)
 			frame.bits->skip(32);
@@ -350,17 +373,30 @@ void BinkDecoder::BinkVideoTrack::decodePacket(VideoFrame &frame) {
 
 		decodePlane(frame, planeIdx, i != 0);
 
+		if (i == 0)
+			startTransforms();
+
 		if (frame.bits->pos() >= frame.bits->size())
 			break;
 	}
 
+	// Transform whatever is left, which also waits for the luma plane
+	_workers->finish();
+	startTransforms();
+	_workers->finish();
+
 	// Convert the YUV data we have to our format
 	// We're ignoring alpha for now
 	// The width used here is the surface-width, and not the video-width
 	// to allow for odd-sized videos.
+	// The first two rows are converted here, which also sets up the lookup
+	// table before the worker threads use it.
 	assert(_curPlanes[0] && _curPlanes[1] && _curPlanes[2]);
 	YUVToRGBMan.convert420(&_surface, Graphics::YUVToRGBManager::kScaleITU, _curPlanes[0], _curPlanes[1], _curPlanes[2],
-			_surfaceWidth, _surfaceHeight, _yBlockWidth * 8, _uvBlockWidth * 8);
+			_surfaceWidth, 2, _yBlockWidth * 8, _uvBlockWidth * 8);
+
+	_workers->run(Common::Functor1Mem<uint, void, BinkVideoTrack>(this, &BinkVideoTrack::convertRows),
+			(_surfaceHeight - 2 + kRowsPerConvertJob - 1) / kRowsPerConvertJob);
 
 	// And swap the planes with the reference planes
 	for (int i = 0; i < 4; i++)
@@ -369,6 +405,68 @@ void BinkDecoder::BinkVideoTrack::decodePacket(VideoFrame &frame) {
 	_curFrame++;
 }
 
+int16 *BinkDecoder::BinkVideoTrack::queueDCTBlock(DecodeContext &ctx, DCTMode mode) {
+	DCTBlock &block = _dctBlocks[_dctBlockCount++];
+
+	block.dest  = ctx.dest;
+	block.pitch = ctx.pitch;
+	block.mode  = mode;
+
+	memset(block.coeffs, 0, 64 * sizeof(int16));
+	return block.coeffs;
+}
+
+void BinkDecoder::BinkVideoTrack::startTransforms() {
+	_dctJobStart = _dctPending;
+	_dctJobEnd   = _dctBlockCount;
+	_dctPending  = _dctBlockCount;
+
+	_workers->start(*_transformJob, (_dctJobEnd - _dctJobStart + kDCTBlocksPerJob - 1) / kDCTBlocksPerJob);
+}
+
+void BinkDecoder::BinkVideoTrack::flushTransforms() {
+	for (DCTBlock *block = _dctBlocks + _dctPending; block < _dctBlocks + _dctBlockCount; block++) {
+		if (block->mode == kDCTPut)
+			IDCTPut(block->dest, block->pitch, block->coeffs);
+		else
+			IDCTAdd(block->dest, block->pitch, block->coeffs);
+	}
+
+	_dctPending = _dctBlockCount;
+}
+
+void BinkDecoder::BinkVideoTrack::transformBlocks(uint job) {
+	const uint32 start = _dctJobStart + job * kDCTBlocksPerJob;
+	const uint32 end   = MIN<uint32>(start + kDCTBlocksPerJob, _dctJobEnd);
+
+	for (DCTBlock *block = _dctBlocks + start; block < _dctBlocks + end; block++) {
+		switch (block->mode) {
+		case kDCTPut:
+			IDCTPut(block->dest, block->pitch, block->coeffs);
+			break;
+		case kDCTAdd:
+			IDCTAdd(block->dest, block->pitch, block->coeffs);
+			break;
+		}
+	}
+}
+
+void BinkDecoder::BinkVideoTrack::convertRows(uint job) {
+	// The first two rows are already converted
+	const int start = 2 + job * kRowsPerConvertJob;
+	const int end   = MIN<int>(start + kRowsPerConvertJob, _surfaceHeight);
+
+	const uint32 yPitch  = _yBlockWidth  * 8;
+	const uint32 uvPitch = _uvBlockWidth * 8;
+
+	Graphics::Surface rows;
+	rows.init(_surfaceWidth, end - start, _surface.pitch, _surface.getBasePtr(0, start), _surface.format);
+
+	YUVToRGBMan.convert420(&rows, Graphics::YUVToRGBManager::kScaleITU, _curPlanes[0] + start * yPitch,
+			_curPlanes[1] + (start / 2) * uvPitch, _curPlanes[2] + (start / 2) * uvPitch,
+			_surfaceWidth, end - start, yPitch, uvPitch);
+}
+
 void BinkDecoder::BinkVideoTrack::decodePlane(VideoFrame &video, int planeIdx, bool isChroma) {
 	uint32 blockWidth  = isChroma ? _uvBlockWidth  : _yBlockWidth;
 	uint32 blockHeight = isChroma ? _uvBlockHeight : _yBlockHeight;
@@ -741,6 +839,11 @@ void BinkDecoder::BinkVideoTrack::blockScaledRaw(DecodeContext &ctx) {
 void BinkDecoder::BinkVideoTrack::blockScaled(DecodeContext &ctx) {
 	BlockType blockType = (BlockType) getBundleValue(kSourceSubBlockTypes);
 
+	// A 16x16 block in the last column spills into the start of the following
+	// rows, whose blocks have to be transformed first
+	if ((ctx.blockX + 2) * 8 > ctx.pitch)
+		flushTransforms();
+
 	switch (blockType) {
 	case kBlockRun:
 		blockScaledRun(ctx);
@@ -824,14 +927,11 @@ void BinkDecoder::BinkVideoTrack::blockResidue(DecodeContext &ctx) {
 }
 
 void BinkDecoder::BinkVideoTrack::blockIntra(DecodeContext &ctx) {
-	int16 block[64];
-	memset(block, 0, 64 * sizeof(int16));
+	int16 *block = queueDCTBlock(ctx, kDCTPut);
 
 	block[0] = getBundleValue(kSourceIntraDC);
 
 	readDCTCoeffs(*ctx.video, block, true);
-
-	IDCTPut(ctx, block);
 }
 
 void BinkDecoder::BinkVideoTrack::blockFill(DecodeContext &ctx) {
@@ -845,14 +945,12 @@ void BinkDecoder::BinkVideoTrack::blockFill(DecodeContext &ctx) {
 void BinkDecoder::BinkVideoTrack::blockInter(DecodeContext &ctx) {
 	blockMotion(ctx);
 
-	int16 block[64];
-	memset(block, 0, 64 * sizeof(int16));
+	// Nothing else writes this block, so the difference can be added later
+	int16 *block = queueDCTBlock(ctx, kDCTAdd);
 
 	block[0] = getBundleValue(kSourceInterDC);
 
 	readDCTCoeffs(*ctx.video, block, false);
-
-	IDCTAdd(ctx, block);
 }
 
 void BinkDecoder::BinkVideoTrack::blockPattern(DecodeContext &ctx) {
@@ -1334,23 +1432,22 @@ void BinkDecoder::BinkVideoTrack::IDCT(int16 *block) {
 	}
 }
 
-void BinkDecoder::BinkVideoTrack::IDCTAdd(DecodeContext &ctx, int16 *block) {
+void BinkDecoder::BinkVideoTrack::IDCTAdd(byte *dest, uint32 pitch, int16 *block) {
 	int i, j;
 
 	IDCT(block);
-	byte *dest = ctx.dest;
-	for (i = 0; i < 8; i++, dest += ctx.pitch, block += 8)
+	for (i = 0; i < 8; i++, dest += pitch, block += 8)
 		for (j = 0; j < 8; j++)
 			 dest[j] += block[j];
 }
 
-void BinkDecoder::BinkVideoTrack::IDCTPut(DecodeContext &ctx, int16 *block) {
+void BinkDecoder::BinkVideoTrack::IDCTPut(byte *dest, uint32 pitch, int16 *block) {
 	int i;
 	int16 temp[64];
 	for (i = 0; i < 8; i++)
 		IDCTCol(&temp[i], &block[i]);
 	for (i = 0; i < 8; i++) {
-		IDCT_ROW( (&ctx.dest[i*ctx.pitch]), (&temp[8*i]) );
+		IDCT_ROW( (&dest[i*pitch]), (&temp[8*i]) );
 	}
 }
 
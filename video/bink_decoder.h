@@ -33,6 +33,7 @@
 
 #include "common/array.h"
 #include "common/bitstream.h"
+#include "common/func.h"
 #include "common/rational.h"
 
 #include "video/video_decoder.h"
@@ -50,6 +51,7 @@ class Huffman;
 
 class RDFT;
 class DCT;
+class WorkerPool;
 }
 
 namespace Graphics {
@@ -72,9 +74,17 @@ public:
 	bool loadStream(Common::SeekableReadStream *stream);
 	void close();
 
+	/**
+	 * Set the number of threads used to decode the video frames of streams
+	 * loaded afterwards. 0, the default, uses one thread per CPU core and 1
+	 * decodes everything on the calling thread. The output is the same.
+	 */
+	void setThreadCount(uint threads) { _threadCount = threads; }
+
 protected:
 	void readNextPacket();
 	bool supportsAudioTrackSwitching() const { return true; }
+	bool supportsDecodeAhead() const { return true; }
 	AudioTrack *getAudioTrack(int index);
 
 private:
@@ -141,7 +151,7 @@ private:
 
 	class BinkVideoTrack : public FixedRateVideoTrack {
 	public:
-		BinkVideoTrack(uint32 width, uint32 height, const Graphics::PixelFormat &format, uint32 frameCount, const Common::Rational &frameRate, bool swapPlanes, bool hasAlpha, uint32 id);
+		BinkVideoTrack(uint32 width, uint32 height, const Graphics::PixelFormat &format, uint32 frameCount, const Common::Rational &frameRate, bool swapPlanes, bool hasAlpha, uint32 id, uint threadCount);
 		~BinkVideoTrack();
 
 		uint16 getWidth() const { return _surface.w; }
@@ -211,6 +221,31 @@ private:
 			kBlockRaw           ///< Uncoded 8x8 block.
 		};
 
+		/** How the result of an inverse DCT is written to the plane. */
+		enum DCTMode {
+			kDCTPut, ///< Replace the block.
+			kDCTAdd  ///< Add to the block.
+		};
+
+		/**
+		 * An 8x8 block whose inverse DCT is deferred until its plane is
+		 * parsed, so that the transforms can run on several threads. This
+		 * does not change the result, since no other block of the frame
+		 * writes to the same pixels, except for 16x16 blocks spilling over
+		 * the right edge of the plane, see flushTransforms().
+		 */
+		struct DCTBlock {
+			int16 coeffs[64];
+			byte *dest;
+			uint32 pitch;
+			DCTMode mode;
+		};
+
+		enum {
+			kDCTBlocksPerJob   = 64, ///< DCT blocks transformed by one worker job.
+			kRowsPerConvertJob = 32 ///< Rows converted to RGB by one worker job.
+		};
+
 		/** Data structure for decoding and tranlating Huffman'd data. */
 		struct Huffman {
 			int  index;       ///< Index of the Huffman codebook to use.
@@ -262,6 +297,15 @@ private:
 		byte *_curPlanes[4]; ///< The 4 color planes, YUVA, current frame.
 		byte *_oldPlanes[4]; ///< The 4 color planes, YUVA, last frame.
 
+		Common::WorkerPool *_workers; ///< Threads for the transforms and YUV conversion.
+		Common::Functor1<uint, void> *_transformJob; ///< Calls transformBlocks(), while the plane parsing goes on.
+
+		DCTBlock *_dctBlocks;   ///< The DCT blocks of the current frame.
+		uint32 _dctBlockCount;  ///< Number of DCT blocks queued for the current frame.
+		uint32 _dctPending;     ///< First DCT block not transformed or handed to the workers yet.
+		uint32 _dctJobStart;    ///< First DCT block the running transform jobs handle.
+		uint32 _dctJobEnd;      ///< End of the DCT blocks the running transform jobs handle.
+
 		/** Initialize the bundles. */
 		void initBundles();
 		/** Deinitialize the bundles. */
@@ -273,6 +317,17 @@ private:
 		/** Decode a plane. */
 		void decodePlane(VideoFrame &video, int planeIdx, bool isChroma);
 
+		/** Queue a DCT block at the current position, returning its cleared coefficients. */
+		int16 *queueDCTBlock(DecodeContext &ctx, DCTMode mode);
+		/** Start transforming the pending DCT blocks on the worker threads. */
+		void startTransforms();
+		/** Transform the pending DCT blocks right away. */
+		void flushTransforms();
+		/** Transform one job's worth of queued DCT blocks. */
+		void transformBlocks(uint job);
+		/** Convert one job's worth of rows to RGB. */
+		void convertRows(uint job);
+
 		/** Read/Initialize a bundle for decoding a plane. */
 		void readBundle(VideoFrame &video, Source source);
 
@@ -318,9 +373,9 @@ private:
 		void readResidue     (VideoFrame &video, int16 *block, int masksCount);
 
 		// Bink video IDCT
-		void IDCT(int16 *block);
-		void IDCTPut(DecodeContext &ctx, int16 *block);
-		void IDCTAdd(DecodeContext &ctx, int16 *block);
+		static void IDCT(int16 *block);
+		static void IDCTPut(byte *dest, uint32 pitch, int16 *block);
+		static void IDCTAdd(byte *dest, uint32 pitch, int16 *block);
 	};
 
 	class BinkAudioTrack : public AudioTrack {
@@ -353,6 +408,7 @@ private:
 	};
 
 	Common::SeekableReadStream *_bink;
+	uint _threadCount;
 
 	Common::Array<AudioInfo> _audioTracks; ///< All audio tracks.
 	Common::Array<VideoFrame> _frames;      ///< All video frames.
@@ -86,10 +86,6 @@ void QuickTimeDecoder::close() {
 const Graphics::Surface *QuickTimeDecoder::decodeNextFrame() {
 	const Graphics::Surface *frame = VideoDecoder::decodeNextFrame();
 
-	// Update audio buffers too
-	// (needs to be done after we find the next track)
-	updateAudioBuffer();
-
 	// We have to initialize the scaled surface
 	if (frame && (_scaleFactorX != 1 || _scaleFactorY != 1)) {
 		if (!_scaledSurface) {
@@ -235,6 +231,16 @@ void QuickTimeDecoder::init() {
 	}
 }
 
+const Graphics::Surface *QuickTimeDecoder::decodeFrameIntern(const byte *&palette) {
+	const Graphics::Surface *frame = VideoDecoder::decodeFrameIntern(palette);
+
+	// Update audio buffers too
+	// (needs to be done after we find the next track)
+	updateAudioBuffer();
+
+	return frame;
+}
+
 void QuickTimeDecoder::updateAudioBuffer() {
 	// Updates the audio buffers for all audio tracks
 	for (TrackListIterator it = getTrackListBegin(); it != getTrackListEnd(); it++)
@@ -808,6 +814,54 @@ void QuickTimeDecoder::VideoTrackHandler::setDither(const byte *palette) {
 	}
 }
 
+bool QuickTimeDecoder::VideoTrackHandler::setOutputPixelFormat(const Graphics::PixelFormat &format) {
+	if (_forcedDitherPalette)
+		return format == getPixelFormat();
+
+	// Check every sample description first, so a failure doesn't leave
+	// their codecs in different formats
+	if (!canOutputPixelFormat(format))
+		return false;
+
+	bool result = true;
+	for (uint i = 0; i < _parent->sampleDescs.size(); i++) {
+		VideoSampleDesc *desc = (VideoSampleDesc *)_parent->sampleDescs[i];
+
+		if (!desc->_videoCodec->setOutputPixelFormat(format))
+			result = false;
+	}
+
+	return result;
+}
+
+bool QuickTimeDecoder::VideoTrackHandler::canOutputPixelFormat(const Graphics::PixelFormat &format) const {
+	if (_forcedDitherPalette)
+		return format == getPixelFormat();
+
+	for (uint i = 0; i < _parent->sampleDescs.size(); i++) {
+		const VideoSampleDesc *desc = (const VideoSampleDesc *)_parent->sampleDescs[i];
+
+		if (!desc || !desc->_videoCodec || !desc->_videoCodec->canOutputPixelFormat(format))
+			return false;
+	}
+
+	return true;
+}
+
+bool QuickTimeDecoder::VideoTrackHandler::setOutputSurface(Graphics::Surface *surface) {
+	// The frames have to go through a surface of our own when they're
+	// dithered or scaled, and the codecs of several sample descriptions
+	// can't take turns with one surface
+	if (_forcedDitherPalette || _parent->sampleDescs.size() != 1)
+		return false;
+
+	if (_parent->scaleFactorX != 1 || _parent->scaleFactorY != 1 || _decoder->_scaleFactorX != 1 || _decoder->_scaleFactorY != 1)
+		return false;
+
+	VideoSampleDesc *desc = (VideoSampleDesc *)_parent->sampleDescs[0];
+	return desc && desc->_videoCodec && desc->_videoCodec->setOutputSurface(surface);
+}
+
 namespace {
 
 // Return a pixel in RGB554
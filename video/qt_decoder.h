@@ -72,6 +72,8 @@ public:
 	Audio::Timestamp getDuration() const { return Audio::Timestamp(0, _duration, _timeScale); }
 
 protected:
+	const Graphics::Surface *decodeFrameIntern(const byte *&palette);
+	bool supportsDecodeAhead() const { return true; }
 	Common::QuickTimeParser::SampleDesc *readSampleDesc(Common::QuickTimeParser::Track *track, uint32 format, uint32 descSize);
 
 private:
@@ -142,6 +144,9 @@ private:
 		bool isReversed() const { return _reversed; }
 		bool canDither() const;
 		void setDither(const byte *palette);
+		bool setOutputPixelFormat(const Graphics::PixelFormat &format);
+		bool canOutputPixelFormat(const Graphics::PixelFormat &format) const;
+		bool setOutputSurface(Graphics::Surface *surface);
 
 		Common::Rational getScaledWidth() const;
 		Common::Rational getScaledHeight() const;
@@ -25,14 +25,35 @@
 #include "audio/audiostream.h"
 #include "audio/mixer.h" // for kMaxChannelVolume
 
+#include "common/atomic.h"
+#include "common/config-manager.h"
 #include "common/rational.h"
 #include "common/file.h"
+#include "common/rect.h"
 #include "common/system.h"
+#include "common/workerpool.h"
 
 #include "graphics/palette.h"
+#include "graphics/surface.h"
+#include "graphics/yuv_to_rgb.h"
 
 namespace Video {
 
+/**
+ * A frame decoded ahead, along with the state of its track right after
+ * decoding it, which is what the main thread reports until it takes the
+ * next frame.
+ */
+struct VideoDecoder::DecodedFrame {
+	Graphics::Surface surface;
+	bool hasSurface;
+	bool hasPalette;
+	byte palette[256 * 3];
+	int curFrame;
+	bool endOfTrack;
+	uint32 nextFrameStartTime;
+};
+
 VideoDecoder::VideoDecoder() {
 	_startTime = 0;
 	_dirtyPalette = false;
@@ -49,6 +70,15 @@ VideoDecoder::VideoDecoder() {
 	_nextVideoTrack = 0;
 	_mainAudioTrack = 0;
 	_canSetDither = true;
+	_hasOutputSurface = false;
+	_decodeAheadFrames = MAX(ConfMan.getInt("video_decode_ahead"), 0);
+	_aheadWorker = 0;
+	_aheadJob = 0;
+	_aheadQueue = 0;
+	_aheadTrack = 0;
+	_aheadHead = _aheadTail = 0;
+	_aheadStop = 0;
+	_shownFrame = 0;
 
 	// Find the best format for output
 	_defaultHighColorFormat = g_system->getScreenFormat();
@@ -57,7 +87,14 @@ VideoDecoder::VideoDecoder() {
 		_defaultHighColorFormat = Graphics::PixelFormat(4, 8, 8, 8, 8, 8, 16, 24, 0);
 }
 
+VideoDecoder::~VideoDecoder() {
+	freeDecodeAhead();
+}
+
 void VideoDecoder::close() {
+	// The worker may still be using the tracks
+	freeDecodeAhead();
+
 	if (isPlaying())
 		stop();
 
@@ -80,6 +117,7 @@ void VideoDecoder::close() {
 	_nextVideoTrack = 0;
 	_mainAudioTrack = 0;
 	_canSetDither = true;
+	_hasOutputSurface = false;
 }
 
 bool VideoDecoder::loadFile(const Common::String &filename) {
@@ -185,6 +223,26 @@ const Graphics::Surface *VideoDecoder::decodeNextFrame() {
 	_needsUpdate = false;
 	_canSetDither = false;
 
+	if (!_aheadWorker && _decodeAheadFrames)
+		startDecodingAhead();
+
+	if (_aheadWorker)
+		return nextDecodedFrame();
+
+	const byte *palette;
+	const Graphics::Surface *frame = decodeFrameIntern(palette);
+
+	if (palette) {
+		_palette = palette;
+		_dirtyPalette = true;
+	}
+
+	return frame;
+}
+
+const Graphics::Surface *VideoDecoder::decodeFrameIntern(const byte *&palette) {
+	palette = 0;
+
 	readNextPacket();
 
 	// If we have no next video track at this point, there shouldn't be
@@ -194,10 +252,8 @@ const Graphics::Surface *VideoDecoder::decodeNextFrame() {
 
 	const Graphics::Surface *frame = _nextVideoTrack->decodeNextFrame();
 
-	if (_nextVideoTrack->hasDirtyPalette()) {
-		_palette = _nextVideoTrack->getPalette();
-		_dirtyPalette = true;
-	}
+	if (_nextVideoTrack->hasDirtyPalette())
+		palette = _nextVideoTrack->getPalette();
 
 	// Look for the next video track here for the next decode.
 	findNextVideoTrack();
@@ -205,11 +261,24 @@ const Graphics::Surface *VideoDecoder::decodeNextFrame() {
 	return frame;
 }
 
+bool VideoDecoder::setDecodeAhead(uint frames) {
+	if (_aheadWorker)
+		return false;
+
+	_decodeAheadFrames = frames;
+	return true;
+}
+
 bool VideoDecoder::setReverse(bool reverse) {
 	// Can only reverse video-only videos
 	if (reverse && hasAudio())
 		return false;
 
+	// Frames are only decoded ahead going forward, and the tracks belong
+	// to the worker
+	if (_aheadWorker)
+		return !reverse;
+
 	// Attempt to make sure all the tracks are in the requested direction
 	for (TrackList::iterator it = _tracks.begin(); it != _tracks.end(); it++) {
 		if ((*it)->getTrackType() == Track::kTrackTypeVideo && ((VideoTrack *)*it)->isReversed() != reverse) {
@@ -234,7 +303,7 @@ int VideoDecoder::getCurFrame() const {
 
 	for (TrackList::const_iterator it = _tracks.begin(); it != _tracks.end(); it++)
 		if ((*it)->getTrackType() == Track::kTrackTypeVideo)
-			frame += ((VideoTrack *)*it)->getCurFrame() + 1;
+			frame += getTrackCurFrame((VideoTrack *)*it) + 1;
 
 	return frame;
 }
@@ -271,13 +340,27 @@ uint32 VideoDecoder::getTime() const {
 }
 
 uint32 VideoDecoder::getTimeToNextFrame() const {
-	if (endOfVideo() || _needsUpdate || !_nextVideoTrack)
+	if (endOfVideo() || _needsUpdate)
 		return 0;
 
 	uint32 currentTime = getTime();
-	uint32 nextFrameStartTime = _nextVideoTrack->getNextFrameStartTime();
+	uint32 nextFrameStartTime;
+	bool isReversed = false;
+
+	if (isDecodingAhead()) {
+		// _nextVideoTrack is already further ahead
+		if (_shownFrame->endOfTrack)
+			return 0;
 
-	if (_nextVideoTrack->isReversed()) {
+		nextFrameStartTime = _shownFrame->nextFrameStartTime;
+	} else if (_nextVideoTrack) {
+		nextFrameStartTime = _nextVideoTrack->getNextFrameStartTime();
+		isReversed = _nextVideoTrack->isReversed();
+	} else {
+		return 0;
+	}
+
+	if (isReversed) {
 		// For reversed videos, we need to handle the time difference the opposite way.
 		if (nextFrameStartTime >= currentTime)
 			return 0;
@@ -296,8 +379,8 @@ bool VideoDecoder::endOfVideo() const {
 	for (TrackList::const_iterator it = _tracks.begin(); it != _tracks.end(); it++) {
 		const Track *track = *it;
 
-		bool videoEndTimeReached = _endTimeSet && track->getTrackType() == Track::kTrackTypeVideo && ((const VideoTrack *)track)->getNextFrameStartTime() >= (uint)_endTime.msecs();
-		bool endReached = track->endOfTrack() || (isPlaying() && videoEndTimeReached);
+		bool videoEndTimeReached = _endTimeSet && track->getTrackType() == Track::kTrackTypeVideo && getTrackNextFrameStartTime((const VideoTrack *)track) >= (uint)_endTime.msecs();
+		bool endReached = isTrackEnded(track) || (isPlaying() && videoEndTimeReached);
 		if (!endReached)
 			return false;
 	}
@@ -320,6 +403,8 @@ bool VideoDecoder::rewind() {
 	if (!isRewindable())
 		return false;
 
+	stopDecodingAhead();
+
 	// Stop all tracks so they can be rewound
 	if (isPlaying())
 		stopAudio();
@@ -354,6 +439,8 @@ bool VideoDecoder::seek(const Audio::Timestamp &time) {
 	if (!isSeekable())
 		return false;
 
+	stopDecodingAhead();
+
 	// Stop all tracks so they can be seeked
 	if (isPlaying())
 		stopAudio();
@@ -511,6 +598,11 @@ bool VideoDecoder::setDitheringPalette(const byte *palette) {
 	if (!_canSetDither)
 		return false;
 
+	// Dithering switches the codecs to 8bpp surfaces of their own, which
+	// the output surface is not in
+	if (_hasOutputSurface)
+		return false;
+
 	bool result = false;
 
 	for (TrackList::iterator it = _tracks.begin(); it != _tracks.end(); it++) {
@@ -523,6 +615,55 @@ bool VideoDecoder::setDitheringPalette(const byte *palette) {
 	return result;
 }
 
+bool VideoDecoder::setOutputPixelFormat(const Graphics::PixelFormat &format) {
+	// If a frame was already decoded, we can't set it now.
+	if (!_canSetDither)
+		return false;
+
+	bool result = false;
+
+	// Check every track first, so a failure doesn't leave them in
+	// different formats
+	for (TrackList::const_iterator it = _tracks.begin(); it != _tracks.end(); it++) {
+		if ((*it)->getTrackType() == Track::kTrackTypeVideo) {
+			if (!((const VideoTrack *)*it)->canOutputPixelFormat(format))
+				return false;
+
+			result = true;
+		}
+	}
+
+	for (TrackList::iterator it = _tracks.begin(); it != _tracks.end(); it++) {
+		if ((*it)->getTrackType() == Track::kTrackTypeVideo && !((VideoTrack *)*it)->setOutputPixelFormat(format))
+			result = false;
+	}
+
+	return result;
+}
+
+bool VideoDecoder::setOutputSurface(Graphics::Surface *surface) {
+	// The frames decoded ahead are in their own surfaces
+	if (_aheadWorker)
+		return false;
+
+	VideoTrack *videoTrack = 0;
+
+	for (TrackList::iterator it = _tracks.begin(); it != _tracks.end(); it++) {
+		if ((*it)->getTrackType() == Track::kTrackTypeVideo) {
+			if (videoTrack)
+				return false;
+
+			videoTrack = (VideoTrack *)*it;
+		}
+	}
+
+	if (!videoTrack || !videoTrack->setOutputSurface(surface))
+		return false;
+
+	_hasOutputSurface = (surface != 0);
+	return true;
+}
+
 VideoDecoder::Track::Track() {
 	_paused = false;
 }
@@ -921,8 +1062,8 @@ bool VideoDecoder::hasFramesLeft() const {
 
 		const VideoTrack *track = (const VideoTrack *)*it;
 
-		bool videoEndTimeReached = _endTimeSet && track->getNextFrameStartTime() >= (uint)_endTime.msecs();
-		bool endReached = track->endOfTrack() || (isPlaying() && videoEndTimeReached);
+		bool videoEndTimeReached = _endTimeSet && getTrackNextFrameStartTime(track) >= (uint)_endTime.msecs();
+		bool endReached = isTrackEnded(track) || (isPlaying() && videoEndTimeReached);
 		if (!endReached)
 			return true;
 	}
@@ -938,6 +1079,164 @@ bool VideoDecoder::hasAudio() const {
 	return false;
 }
 
+void VideoDecoder::startDecodingAhead() {
+	if (!Common::WorkerPool::isThreaded() || !supportsDecodeAhead() || _hasOutputSurface)
+		return;
+
+	VideoTrack *videoTrack = 0;
+
+	for (TrackList::iterator it = _tracks.begin(); it != _tracks.end(); it++) {
+		if ((*it)->getTrackType() == Track::kTrackTypeVideo) {
+			// The queued frames follow a single video track
+			if (videoTrack)
+				return;
+
+			videoTrack = (VideoTrack *)*it;
+		}
+	}
+
+	if (!videoTrack || videoTrack->isReversed())
+		return;
+
+	// Singletons are not created thread safely, so make sure the
+	// converter many decoders use exists before the worker can need it
+	YUVToRGBMan.getKernel();
+
+	// Codecs like Cinepak pick their format from the screen on first use,
+	// which has to happen here rather than on the worker
+	videoTrack->getPixelFormat();
+
+	// One more slot than frames, for the one being shown
+	_aheadQueue = new DecodedFrame[_decodeAheadFrames + 1];
+	_aheadJob = new Common::Functor1Mem<uint, void, VideoDecoder>(this, &VideoDecoder::decodeAhead);
+	_aheadWorker = new Common::WorkerPool(1);
+	_aheadTrack = videoTrack;
+	_aheadHead = _aheadTail = 0;
+	_aheadStop = 0;
+	_shownFrame = 0;
+}
+
+void VideoDecoder::stopDecodingAhead() {
+	if (!_aheadWorker)
+		return;
+
+	Common::atomicStore(&_aheadStop, 1u);
+	_aheadWorker->finish();
+	_aheadStop = 0;
+	_aheadHead = _aheadTail = 0;
+	_shownFrame = 0;
+}
+
+void VideoDecoder::freeDecodeAhead() {
+	if (!_aheadWorker)
+		return;
+
+	stopDecodingAhead();
+
+	for (uint i = 0; i <= _decodeAheadFrames; i++)
+		_aheadQueue[i].surface.free();
+
+	delete _aheadWorker;
+	delete _aheadJob;
+	delete[] _aheadQueue;
+	_aheadWorker = 0;
+	_aheadJob = 0;
+	_aheadQueue = 0;
+	_aheadTrack = 0;
+}
+
+bool VideoDecoder::isDecodingAhead() const {
+	return _aheadWorker && (!_aheadWorker->isFinished() || Common::atomicLoad(&_aheadTail) != _aheadHead);
+}
+
+void VideoDecoder::decodeAhead(uint) {
+	while (!Common::atomicLoad(&_aheadStop) && !_aheadTrack->endOfTrack() && _aheadTail - Common::atomicLoad(&_aheadHead) < _decodeAheadFrames)
+		decodeAheadFrame();
+}
+
+void VideoDecoder::decodeAheadFrame() {
+	DecodedFrame &slot = _aheadQueue[_aheadTail % (_decodeAheadFrames + 1)];
+
+	const byte *palette;
+	const Graphics::Surface *frame = decodeFrameIntern(palette);
+
+	slot.hasSurface = frame != 0;
+	if (frame) {
+		// Keep the surface of the slot from the last time around, unless
+		// the frame size changed
+		if (slot.surface.w != frame->w || slot.surface.h != frame->h || slot.surface.format != frame->format) {
+			slot.surface.free();
+			slot.surface.create(frame->w, frame->h, frame->format);
+		}
+
+		slot.surface.copyRectToSurface(*frame, 0, 0, Common::Rect(frame->w, frame->h));
+	}
+
+	slot.hasPalette = palette != 0;
+	if (palette)
+		memcpy(slot.palette, palette, sizeof(slot.palette));
+
+	slot.curFrame = _aheadTrack->getCurFrame();
+	slot.endOfTrack = _aheadTrack->endOfTrack();
+	slot.nextFrameStartTime = _aheadTrack->getNextFrameStartTime();
+
+	Common::atomicStore(&_aheadTail, _aheadTail + 1);
+}
+
+const Graphics::Surface *VideoDecoder::nextDecodedFrame() {
+	// Wait for the worker if it is on the way to the next frame
+	while (Common::atomicLoad(&_aheadTail) == _aheadHead && !_aheadWorker->isFinished())
+		g_system->delayMillis(1);
+
+	if (Common::atomicLoad(&_aheadTail) == _aheadHead) {
+		// Nothing queued and the worker is idle, so decode right here
+		_aheadWorker->finish();
+		decodeAheadFrame();
+	}
+
+	const DecodedFrame &slot = _aheadQueue[_aheadHead % (_decodeAheadFrames + 1)];
+	Common::atomicStore(&_aheadHead, _aheadHead + 1);
+	_shownFrame = &slot;
+
+	if (slot.hasPalette) {
+		memcpy(_aheadPalette, slot.palette, sizeof(_aheadPalette));
+		_palette = _aheadPalette;
+		_dirtyPalette = true;
+	}
+
+	// Refill the queue behind the frame just taken. The slot of this frame
+	// is only reused once the next one is taken.
+	if (_aheadWorker->isFinished()) {
+		_aheadWorker->finish();
+
+		if (!_aheadTrack->endOfTrack())
+			_aheadWorker->startBackground(*_aheadJob, 1);
+	}
+
+	return slot.hasSurface ? &slot.surface : 0;
+}
+
+bool VideoDecoder::isTrackEnded(const Track *track) const {
+	if (track == _aheadTrack && isDecodingAhead())
+		return _shownFrame->endOfTrack;
+
+	return track->endOfTrack();
+}
+
+int VideoDecoder::getTrackCurFrame(const VideoTrack *track) const {
+	if (track == _aheadTrack && isDecodingAhead())
+		return _shownFrame->curFrame;
+
+	return track->getCurFrame();
+}
+
+uint32 VideoDecoder::getTrackNextFrameStartTime(const VideoTrack *track) const {
+	if (track == _aheadTrack && isDecodingAhead())
+		return _shownFrame->nextFrameStartTime;
+
+	return track->getNextFrameStartTime();
+}
+
 void VideoDecoder::eraseTrack(Track *track) {
 	for (uint idx = 0; idx < _externalTracks.size(); ++idx) {
 		if (_externalTracks[idx] == track)
@@ -26,6 +26,7 @@
 #include "audio/mixer.h"
 #include "audio/timestamp.h"	// TODO: Move this to common/ ?
 #include "common/array.h"
+#include "common/func.h"
 #include "common/rational.h"
 #include "common/str.h"
 #include "graphics/pixelformat.h"
@@ -38,6 +39,7 @@ class SeekableAudioStream;
 
 namespace Common {
 class SeekableReadStream;
+class WorkerPool;
 }
 
 namespace Graphics {
@@ -52,7 +54,7 @@ namespace Video {
 class VideoDecoder {
 public:
 	VideoDecoder();
-	virtual ~VideoDecoder() {}
+	virtual ~VideoDecoder();
 
 	/////////////////////////////////////////
 	// Opening/Closing a Video
@@ -386,7 +388,8 @@ public:
 	 * its surfaces in 8bpp with this palette.
 	 *
 	 * This should be called after loadStream(), but before a decodeNextFrame()
-	 * call. This is enforced.
+	 * call. This is enforced. It fails while an output surface is set with
+	 * setOutputSurface().
 	 *
 	 * The palette will be copied, so you do not need to worry about the pointer
 	 * going out-of-scope.
@@ -396,6 +399,61 @@ public:
 	 */
 	bool setDitheringPalette(const byte *palette);
 
+	/**
+	 * Have the video tracks decode straight into the given pixel format.
+	 *
+	 * For codecs that support it, this saves converting every frame after
+	 * it has been decoded. Otherwise the frames stay in the format returned
+	 * by getPixelFormat(), which then has to be converted by the caller.
+	 *
+	 * This should be called after loadStream(), but before a decodeNextFrame()
+	 * call. This is enforced.
+	 *
+	 * @param format The format the frames should be decoded to
+	 * @return true if all video tracks now decode to this format
+	 */
+	bool setOutputPixelFormat(const Graphics::PixelFormat &format);
+
+	/**
+	 * Have the video track decode straight into the given surface.
+	 *
+	 * For codecs that support it, this allows decoding directly into
+	 * e.g. a screen buffer, and decodeNextFrame() then returns this surface.
+	 * The surface must be in the format returned by getPixelFormat(), and at
+	 * least as large as the frame rounded up to the codec's block size. Its
+	 * contents must not be changed between frames, since codecs only update
+	 * the parts of the frame that changed.
+	 *
+	 * This only works for videos with a single video track, and disables
+	 * decoding ahead. Pass 0 to go back to the track's own surface; the
+	 * current frame is kept either way. The surface must stay valid until
+	 * then, or until close() is called.
+	 *
+	 * @param surface The surface to decode into, or 0
+	 * @return true on success, false otherwise
+	 */
+	bool setOutputSurface(Graphics::Surface *surface);
+
+	/**
+	 * Decode frames ahead of time on another thread.
+	 *
+	 * Up to the given number of frames are decoded in the background and
+	 * kept in a queue, so that decodeNextFrame() mostly just takes the next
+	 * frame from it. This evens out expensive frames and slow reads, at the
+	 * cost of the memory for the queued frames.
+	 *
+	 * This only takes effect for formats which support it, on ports with
+	 * threads, and for videos with a single video track played forward.
+	 * The default is taken from the "video_decode_ahead" setting.
+	 *
+	 * This can't be changed while frames are being decoded ahead, i.e.
+	 * between the first decodeNextFrame() call and close().
+	 *
+	 * @param frames The number of frames to decode ahead, 0 to disable
+	 * @return true on success, false otherwise
+	 */
+	bool setDecodeAhead(uint frames);
+
 	/////////////////////////////////////////
 	// Audio Control
 	/////////////////////////////////////////
@@ -645,6 +703,22 @@ protected:
 		 * Activate dithering mode with a palette
 		 */
 		virtual void setDither(const byte *palette) {}
+
+		/**
+		 * Decode frames straight into the given pixel format, if possible
+		 */
+		virtual bool setOutputPixelFormat(const Graphics::PixelFormat &format) { return canOutputPixelFormat(format); }
+
+		/**
+		 * Check whether setOutputPixelFormat() would succeed, without
+		 * changing anything
+		 */
+		virtual bool canOutputPixelFormat(const Graphics::PixelFormat &format) const { return format == getPixelFormat(); }
+
+		/**
+		 * Decode frames straight into the given surface, if possible
+		 */
+		virtual bool setOutputSurface(Graphics::Surface *surface) { return false; }
 	};
 
 	/**
@@ -826,6 +900,32 @@ protected:
 	 */
 	virtual void readNextPacket() {}
 
+	/**
+	 * Decode the next frame of the video.
+	 *
+	 * This calls readNextPacket(), then the next video track's
+	 * decodeNextFrame() function, and finds the video track for the frame
+	 * after it. A subclass may override this to do more work for each
+	 * frame, but must still call this function.
+	 *
+	 * When decoding ahead, this is called on another thread.
+	 *
+	 * @param palette Set to the palette of the track if it changed, or 0
+	 * @return a surface containing the decoded frame, or 0
+	 */
+	virtual const Graphics::Surface *decodeFrameIntern(const byte *&palette);
+
+	/**
+	 * Whether this format can decode frames ahead on another thread.
+	 *
+	 * Returning true means that readNextPacket() and decodeFrameIntern()
+	 * only use the tracks and the file, and nothing else touches them
+	 * between decodeNextFrame() calls.
+	 *
+	 * @see setDecodeAhead()
+	 */
+	virtual bool supportsDecodeAhead() const { return false; }
+
 	/**
 	 * Define a track to be used by this class.
 	 *
@@ -946,9 +1046,36 @@ private:
 	// Enforcement of not being able to set dither
 	bool _canSetDither;
 
+	// A video track is decoding into a caller supplied surface
+	bool _hasOutputSurface;
+
 	// Default PixelFormat settings
 	Graphics::PixelFormat _defaultHighColorFormat;
 
+	// Frames decoded ahead, in a ring which the worker fills from _aheadTail
+	// and decodeNextFrame() empties from _aheadHead
+	struct DecodedFrame;
+	uint _decodeAheadFrames;
+	Common::WorkerPool *_aheadWorker;
+	Common::Functor1Mem<uint, void, VideoDecoder> *_aheadJob;
+	DecodedFrame *_aheadQueue;
+	VideoTrack *_aheadTrack;
+	volatile uint32 _aheadHead, _aheadTail;
+	volatile uint32 _aheadStop;
+	const DecodedFrame *_shownFrame;
+	byte _aheadPalette[256 * 3];
+
+	void startDecodingAhead();
+	void stopDecodingAhead();
+	void freeDecodeAhead();
+	bool isDecodingAhead() const;
+	void decodeAhead(uint);
+	void decodeAheadFrame();
+	const Graphics::Surface *nextDecodedFrame();
+	bool isTrackEnded(const Track *track) const;
+	int getTrackCurFrame(const VideoTrack *track) const;
+	uint32 getTrackNextFrameStartTime(const VideoTrack *track) const;
+
 	// Internal helper functions
 	void stopAudio();
 	void startAudio();